@@ -0,0 +1,638 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <algorithm>
+#include <map>
+
+#include "engine/Simulation.h"
+#include "engine/WorkerPool.h"
+#include "engine/Kernels.h"
+#include "engine/StepKernels.h"
+#include "engine/Collision.h"
+#include "engine/Rasterizer.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Ticks between Morton reorders in the reorder benchmarks.
+const int BENCH_REORDER_INTERVAL = 60;
+
+struct BenchOptions {
+	int maxThreads = 0;
+	double minSeconds = 0.25;
+	bool quick = false;
+	const char* filter = nullptr;
+	const char* outPath = nullptr;
+	const char* baselinePath = nullptr;
+	double tolerance = 0.10;
+};
+
+struct BenchResult {
+	std::string name;
+	double itemsPerSecond;
+	double nanosecondsPerItem;
+	// Hardware cache misses per item, or negative when not measured.
+	double cacheMissesPerItem = -1.0;
+};
+
+static void PrintUsage(const char* program) {
+	std::cout << "Usage: " << program << " [options]\n"
+		<< "  --threads P     highest thread count for the scenarios (default: hardware concurrency)\n"
+		<< "  --min-time S    seconds each measurement runs for at least (default 0.25)\n"
+		<< "  --quick         smaller particle counts, for a fast check\n"
+		<< "  --filter TEXT   only run benchmarks whose name contains TEXT\n"
+		<< "  --out FILE      write the results as JSON\n"
+		<< "  --baseline FILE compare against an earlier --out file and fail on regressions\n"
+		<< "  --tolerance F   allowed throughput drop against the baseline (default 0.10)\n";
+}
+
+static bool ParseOptions(int argc, char* argv[], BenchOptions& options) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(arg, "--threads") == 0 && hasValue) {
+			options.maxThreads = atoi(argv[++i]);
+		} else if (strcmp(arg, "--min-time") == 0 && hasValue) {
+			options.minSeconds = atof(argv[++i]);
+		} else if (strcmp(arg, "--quick") == 0) {
+			options.quick = true;
+		} else if (strcmp(arg, "--filter") == 0 && hasValue) {
+			options.filter = argv[++i];
+		} else if (strcmp(arg, "--out") == 0 && hasValue) {
+			options.outPath = argv[++i];
+		} else if (strcmp(arg, "--baseline") == 0 && hasValue) {
+			options.baselinePath = argv[++i];
+		} else if (strcmp(arg, "--tolerance") == 0 && hasValue) {
+			options.tolerance = atof(argv[++i]);
+		} else {
+			return false;
+		}
+	}
+	return options.minSeconds > 0.0 && options.tolerance >= 0.0;
+}
+
+// Thread counts 1, 2, 4, ... up to and including maxThreads.
+static std::vector<size_t> ThreadSweep(size_t maxThreads) {
+	std::vector<size_t> counts;
+	for (size_t n = 1; n < maxThreads; n *= 2) {
+		counts.push_back(n);
+	}
+	counts.push_back(maxThreads);
+	return counts;
+}
+
+// Keeps results of the micro loops alive without a store per iteration.
+static volatile float sink;
+
+// Grows repeats until one body(repeats) call lasts minSeconds, then keeps
+// the best of three calls of that size. body returns the items it processed.
+// setup, when given, runs untimed before every call.
+static BenchResult Measure(const std::string& name, double minSeconds, const std::function<double(int)>& body,
+	const std::function<void()>& setup = std::function<void()>()) {
+	int repeats = 1;
+	double seconds = 0.0;
+	double items = 0.0;
+	for (;;) {
+		if (setup) {
+			setup();
+		}
+		auto start = std::chrono::steady_clock::now();
+		items = body(repeats);
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (seconds >= minSeconds || repeats >= (1 << 24)) {
+			break;
+		}
+		repeats *= seconds > 0.0 ? std::clamp((int)(minSeconds / seconds * 1.2) + 1, 2, 64) : 64;
+	}
+
+	double best = items / seconds;
+	for (int run = 0; run < 2; ++run) {
+		if (setup) {
+			setup();
+		}
+		auto start = std::chrono::steady_clock::now();
+		items = body(repeats);
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		best = std::max(best, items / seconds);
+	}
+	return { name, best, 1e9 / best };
+}
+
+static std::vector<Wall> RandomWalls(int count, std::mt19937& rng) {
+	std::uniform_real_distribution<float> x(0.0f, CANVAS_WIDTH), y(0.0f, CANVAS_HEIGHT);
+	std::vector<Wall> walls;
+	for (int i = 0; i < count; ++i) {
+		walls.emplace_back(x(rng), y(rng), x(rng), y(rng));
+	}
+	return walls;
+}
+
+// Corridors on an 80 px grid: every cell closes its right or bottom side,
+// which leaves long runs with openings between them.
+static std::vector<Wall> MazeWalls(std::mt19937& rng) {
+	const float CELL = 80.0f;
+	std::vector<Wall> walls;
+	for (float x = 0.0f; x + CELL <= CANVAS_WIDTH; x += CELL) {
+		for (float y = 0.0f; y + CELL <= CANVAS_HEIGHT; y += CELL) {
+			if (rng() & 1) {
+				walls.emplace_back(x + CELL, y, x + CELL, y + CELL);
+			} else {
+				walls.emplace_back(x, y + CELL, x + CELL, y + CELL);
+			}
+		}
+	}
+	return walls;
+}
+
+// Counts hardware cache misses of this thread and of threads it starts
+// after Start. Those threads' counts only arrive when they exit, so stop
+// their pool before calling Stop. Reports -1 where perf events are missing.
+class CacheMissCounter {
+public:
+	~CacheMissCounter() {
+#if defined(__linux__)
+		if (fd >= 0) {
+			close(fd);
+		}
+#endif
+	}
+
+	void Start() {
+#if defined(__linux__)
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	double Stop() {
+#if defined(__linux__)
+		uint64_t misses = 0;
+		if (fd >= 0 && read(fd, &misses, sizeof(misses)) == sizeof(misses)) {
+			return (double)misses;
+		}
+#endif
+		return -1.0;
+	}
+
+private:
+	int fd = -1;
+};
+
+struct Scenario {
+	const char* name;
+	std::vector<Wall> walls;
+	float startVelocity, endVelocity;
+	CollisionMode collisionMode;
+};
+
+static Simulation BuildScene(const Scenario& scenario, int particles, WorkerPool& pool) {
+	Simulation sim;
+	sim.seed = 1;
+	sim.collisionMode = scenario.collisionMode;
+	for (const auto& wall : scenario.walls) {
+		sim.AddWall(wall.startX, wall.startY, wall.endX, wall.endY);
+	}
+
+	BatchSpec spawn;
+	spawn.count = particles;
+	spawn.variation = BATCH_RANDOM_UNIFORM;
+	spawn.endX = CANVAS_WIDTH;
+	spawn.endY = CANVAS_HEIGHT;
+	spawn.endAngle = 360.0f;
+	spawn.startVelocity = scenario.startVelocity;
+	spawn.endVelocity = scenario.endVelocity;
+	sim.AddParticleBatch(spawn, pool);
+	return sim;
+}
+
+static void RunMicro(const BenchOptions& options, const std::vector<Wall>& walls, std::vector<BenchResult>& results,
+	const std::function<bool(const std::string&)>& selected) {
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> x(0.0f, CANVAS_WIDTH), y(0.0f, CANVAS_HEIGHT), angle(0.0f, 360.0f);
+	const int POINTS = 4096;
+	std::vector<float> px(POINTS), py(POINTS), angles(POINTS);
+	for (int i = 0; i < POINTS; ++i) {
+		px[i] = x(rng);
+		py[i] = y(rng);
+		angles[i] = angle(rng);
+	}
+
+	if (selected("micro/PointLineDistance")) {
+		results.push_back(Measure("micro/PointLineDistance", options.minSeconds, [&](int repeats) {
+			float sum = 0.0f;
+			for (int r = 0; r < repeats; ++r) {
+				const Wall& wall = walls[r % walls.size()];
+				for (int i = 0; i < POINTS; ++i) {
+					sum += PointLineDistance(px[i], py[i], wall.startX, wall.startY, wall.endX, wall.endY);
+				}
+			}
+			sink = sum;
+			return (double)repeats * POINTS;
+		}));
+	}
+
+	if (selected("micro/ReflectAngle")) {
+		results.push_back(Measure("micro/ReflectAngle", options.minSeconds, [&](int repeats) {
+			float sum = 0.0f;
+			for (int r = 0; r < repeats; ++r) {
+				const Wall& wall = walls[r % walls.size()];
+				for (int i = 0; i < POINTS; ++i) {
+					sum += ReflectAngle(wall, angles[i]);
+				}
+			}
+			sink = sum;
+			return (double)repeats * POINTS;
+		}));
+	}
+
+	// One swept move per point against every wall, wall by wall and through
+	// the cache; both count particle-wall pairs.
+	std::uniform_real_distribution<float> move(-50.0f, 50.0f);
+	std::vector<float> moveX(POINTS), moveY(POINTS);
+	for (int i = 0; i < POINTS; ++i) {
+		moveX[i] = move(rng);
+		moveY[i] = move(rng);
+	}
+	if (selected("micro/SweepWall")) {
+		results.push_back(Measure("micro/SweepWall", options.minSeconds, [&](int repeats) {
+			float sum = 0.0f;
+			for (int r = 0; r < repeats; ++r) {
+				for (int i = 0; i < POINTS; ++i) {
+					for (const Wall& wall : walls) {
+						float t, nx, ny;
+						if (SweepWall(wall, px[i], py[i], moveX[i], moveY[i], t, nx, ny)) {
+							sum += t;
+						}
+					}
+				}
+			}
+			sink = sum;
+			return (double)repeats * POINTS * walls.size();
+		}));
+	}
+
+	if (selected("micro/SweepWalls")) {
+		WallCache cache;
+		for (const Wall& wall : walls) {
+			cache.Add(wall);
+		}
+		results.push_back(Measure("micro/SweepWalls", options.minSeconds, [&](int repeats) {
+			float sum = 0.0f;
+			for (int r = 0; r < repeats; ++r) {
+				for (int i = 0; i < POINTS; ++i) {
+					float t;
+					if (SweepWalls(cache, { nullptr, cache.Size() }, px[i], py[i], moveX[i], moveY[i], 2.0f, t) >= 0) {
+						sum += t;
+					}
+				}
+			}
+			sink = sum;
+			return (double)repeats * POINTS * walls.size();
+		}));
+	}
+
+	if (selected("micro/UpdatePosition")) {
+		std::vector<Particle> particles;
+		for (int i = 0; i < POINTS; ++i) {
+			particles.emplace_back(px[i], py[i], angles[i], 100.0f + i % 200);
+		}
+		results.push_back(Measure("micro/UpdatePosition", options.minSeconds, [&](int repeats) {
+			for (int r = 0; r < repeats; ++r) {
+				for (auto& particle : particles) {
+					particle.UpdatePosition(1.0f / 60.0f, walls);
+				}
+			}
+			return (double)repeats * POINTS;
+		}));
+	}
+
+	if (selected("micro/SpawnRandomParticle")) {
+		Simulation sim;
+		sim.seed = 1;
+		results.push_back(Measure("micro/SpawnRandomParticle", options.minSeconds, [&](int repeats) {
+			sim.ResetParticles();
+			for (int r = 0; r < repeats; ++r) {
+				sim.SpawnRandomParticle();
+			}
+			return (double)repeats;
+		}));
+	}
+
+	// The draw path at the GUI's render pool size, per particle drawn.
+	WorkerPool renderPool(std::max(1u, std::thread::hardware_concurrency() / 4));
+	Rasterizer rasterizer((int)CANVAS_WIDTH, (int)CANVAS_HEIGHT);
+	int drawCount = options.quick ? 100000 : 1000000;
+	std::vector<float> drawX(drawCount), drawY(drawCount);
+	for (int i = 0; i < drawCount; ++i) {
+		drawX[i] = x(rng);
+		drawY[i] = y(rng);
+	}
+	const std::pair<const char*, RasterMode> modes[] = { { "micro/Render/points", RASTER_POINTS }, { "micro/Render/density", RASTER_DENSITY } };
+	for (const auto& mode : modes) {
+		if (!selected(mode.first)) {
+			continue;
+		}
+		rasterizer.mode = mode.second;
+		results.push_back(Measure(mode.first, options.minSeconds, [&](int repeats) {
+			for (int r = 0; r < repeats; ++r) {
+				rasterizer.Render(drawX.data(), drawY.data(), drawX.size(), walls, renderPool);
+			}
+			return (double)repeats * drawCount;
+		}));
+	}
+}
+
+static void RunScenarios(const BenchOptions& options, size_t maxThreads, std::vector<BenchResult>& results,
+	const std::function<bool(const std::string&)>& selected) {
+	std::mt19937 rng(11);
+	std::vector<Scenario> scenarios;
+	scenarios.push_back({ "empty", {}, 10.0f, 300.0f, COLLISION_SWEPT });
+	scenarios.push_back({ "walls", RandomWalls(200, rng), 10.0f, 300.0f, COLLISION_SWEPT });
+	scenarios.push_back({ "maze", MazeWalls(rng), 10.0f, 300.0f, COLLISION_SWEPT });
+	// Over 500 px/s every step uses the 10 px threshold of the original test.
+	scenarios.push_back({ "fast", RandomWalls(50, rng), 500.0f, 1000.0f, COLLISION_THRESHOLD });
+
+	std::vector<int> counts = options.quick ? std::vector<int>{ 10000, 100000 } : std::vector<int>{ 10000, 100000, 1000000 };
+	WorkerPool spawnPool(maxThreads);
+	for (const auto& scenario : scenarios) {
+		for (int count : counts) {
+			Simulation scene;
+			bool built = false;
+			for (size_t numThreads : ThreadSweep(maxThreads)) {
+				std::string name = std::string("macro/") + scenario.name + "/" + std::to_string(count) + "/t" + std::to_string(numThreads);
+				if (!selected(name)) {
+					continue;
+				}
+				if (!built) {
+					scene = BuildScene(scenario, count, spawnPool);
+					built = true;
+				}
+
+				// Each call steps a fresh copy, made outside the timing, so every
+				// measurement starts from the same state.
+				Simulation sim;
+				WorkerPool pool(numThreads, "worker", 0);
+				results.push_back(Measure(name, options.minSeconds, [&](int repeats) {
+					sim.Step(1.0f / 60.0f, pool, repeats);
+					return (double)repeats * count;
+				}, [&] {
+					sim = scene;
+				}));
+			}
+		}
+	}
+}
+
+// Steps the same large scene as stored by insertion (random positions) and
+// re-sorted into Morton order every BENCH_REORDER_INTERVAL ticks, with the
+// cost of the re-sorts included, plus the cache misses of a fixed run of each.
+static void RunReorder(const BenchOptions& options, size_t maxThreads, std::vector<BenchResult>& results,
+	const std::function<bool(const std::string&)>& selected) {
+	std::mt19937 rng(11);
+	std::vector<Scenario> scenarios;
+	scenarios.push_back({ "walls", RandomWalls(200, rng), 10.0f, 300.0f, COLLISION_SWEPT });
+	scenarios.push_back({ "maze", MazeWalls(rng), 10.0f, 300.0f, COLLISION_SWEPT });
+
+	int count = options.quick ? 100000 : 1000000;
+	const int MISS_TICKS = 2 * BENCH_REORDER_INTERVAL;
+	WorkerPool spawnPool(maxThreads);
+	for (const auto& scenario : scenarios) {
+		Simulation scene;
+		bool built = false;
+		for (int interval : { 0, BENCH_REORDER_INTERVAL }) {
+			std::string name = std::string("reorder/") + scenario.name + "/" + std::to_string(count) + "/"
+				+ (interval > 0 ? "every" + std::to_string(interval) : std::string("off"));
+			if (!selected(name)) {
+				continue;
+			}
+			if (!built) {
+				scene = BuildScene(scenario, count, spawnPool);
+				built = true;
+			}
+
+			Simulation sim = scene;
+			sim.reorderInterval = interval;
+			WorkerPool pool(maxThreads);
+			if (interval > 0) {
+				sim.ReorderParticles(pool);
+			}
+			results.push_back(Measure(name, options.minSeconds, [&](int repeats) {
+				sim.Step(1.0f / 60.0f, pool, repeats);
+				return (double)repeats * count;
+			}));
+
+			Simulation counted = scene;
+			counted.reorderInterval = interval;
+			CacheMissCounter counter;
+			counter.Start();
+			{
+				WorkerPool countedPool(maxThreads);
+				if (interval > 0) {
+					counted.ReorderParticles(countedPool);
+				}
+				counted.Step(1.0f / 60.0f, countedPool, MISS_TICKS);
+			}
+			double misses = counter.Stop();
+			results.back().cacheMissesPerItem = misses >= 0.0 ? misses / ((double)count * MISS_TICKS) : -1.0;
+		}
+	}
+}
+
+// One scene per step kernel instantiation: each border with no walls, and
+// with a few walls scanned linearly and through the grid, jitter on and off,
+// threshold and swept tests. Names carry the kernel the scene selected.
+static void RunKernels(const BenchOptions& options, size_t maxThreads, std::vector<BenchResult>& results,
+	const std::function<bool(const std::string&)>& selected) {
+	std::mt19937 rng(13);
+	std::vector<Wall> walls = RandomWalls(8, rng);
+	int count = 100000;
+	WorkerPool pool(maxThreads);
+
+	std::vector<Simulation> variants;
+	for (BorderMode border : { BORDER_REFLECT, BORDER_WRAP, BORDER_ABSORB }) {
+		Simulation bare;
+		bare.borderMode = border;
+		variants.push_back(bare);
+		for (size_t linearLimit : { LINEAR_WALL_MAX, (size_t)0 }) {
+			for (bool jitter : { true, false }) {
+				for (CollisionMode collision : { COLLISION_THRESHOLD, COLLISION_SWEPT }) {
+					Simulation walled;
+					walled.borderMode = border;
+					walled.linearWallLimit = linearLimit;
+					walled.wallJitter = jitter;
+					walled.collisionMode = collision;
+					for (const auto& wall : walls) {
+						walled.AddWall(wall.startX, wall.startY, wall.endX, wall.endY);
+					}
+					variants.push_back(walled);
+				}
+			}
+		}
+	}
+
+	for (auto& scene : variants) {
+		std::string name = std::string("kernels/") + scene.GetStepKernelName() + "/" + std::to_string(count);
+		if (!selected(name)) {
+			continue;
+		}
+		BatchSpec spawn;
+		spawn.count = count;
+		spawn.variation = BATCH_RANDOM_UNIFORM;
+		spawn.endX = CANVAS_WIDTH;
+		spawn.endY = CANVAS_HEIGHT;
+		spawn.endAngle = 360.0f;
+		spawn.startVelocity = 10.0f;
+		spawn.endVelocity = 300.0f;
+		scene.seed = 1;
+		scene.AddParticleBatch(spawn, pool);
+
+		// Absorbing borders drain the scene, so it restarts once half are gone.
+		Simulation sim = scene;
+		results.push_back(Measure(name, options.minSeconds, [&](int repeats) {
+			double items = 0.0;
+			for (int i = 0; i < repeats; ++i) {
+				if (sim.GetParticleCount() < (size_t)count / 2) {
+					sim = scene;
+				}
+				items += (double)sim.GetParticleCount();
+				sim.Step(1.0f / 60.0f, pool, 1);
+			}
+			return items;
+		}));
+	}
+}
+
+static void WriteJson(const char* path, const std::vector<BenchResult>& results) {
+	std::ofstream file(path, std::ios::trunc);
+	file << "{\n  \"kernel\": \"" << KernelPathName(GetKernelPath()) << "\",\n"
+		<< "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [\n";
+	file << std::setprecision(10);
+	for (size_t i = 0; i < results.size(); ++i) {
+		file << "    {\"name\": \"" << results[i].name << "\", \"itemsPerSecond\": " << results[i].itemsPerSecond
+			<< ", \"nsPerItem\": " << results[i].nanosecondsPerItem;
+		if (results[i].cacheMissesPerItem >= 0.0) {
+			file << ", \"cacheMissesPerItem\": " << results[i].cacheMissesPerItem;
+		}
+		file << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	file << "  ]\n}\n";
+}
+
+// Reads the result lines of a file written by WriteJson.
+static bool ReadBaseline(const char* path, std::map<std::string, double>& baseline) {
+	std::ifstream file(path);
+	if (!file) {
+		return false;
+	}
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t name = line.find("\"name\": \"");
+		size_t value = line.find("\"itemsPerSecond\": ");
+		if (name == std::string::npos || value == std::string::npos) {
+			continue;
+		}
+		name += 9;
+		baseline[line.substr(name, line.find('"', name) - name)] = atof(line.c_str() + value + 18);
+	}
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	BenchOptions options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	size_t maxThreads = options.maxThreads > 0 ? options.maxThreads : std::thread::hardware_concurrency();
+	if (maxThreads == 0) {
+		maxThreads = 1;
+	}
+
+	std::map<std::string, double> baseline;
+	if (options.baselinePath && !ReadBaseline(options.baselinePath, baseline)) {
+		std::cerr << "Could not read baseline " << options.baselinePath << std::endl;
+		return 1;
+	}
+
+	auto selected = [&options](const std::string& name) {
+		return !options.filter || name.find(options.filter) != std::string::npos;
+	};
+
+	std::cout << "Kernel: " << KernelPathName(GetKernelPath()) << "  Threads: " << maxThreads
+		<< "  Min time: " << options.minSeconds << " s" << std::endl;
+
+	std::mt19937 rng(3);
+	std::vector<Wall> microWalls = RandomWalls(20, rng);
+	std::vector<BenchResult> results;
+	RunMicro(options, microWalls, results, selected);
+	RunScenarios(options, maxThreads, results, selected);
+	RunReorder(options, maxThreads, results, selected);
+	RunKernels(options, maxThreads, results, selected);
+
+	// The name column fits the longest name, such as the kernels/ ones.
+	size_t nameWidth = 48;
+	for (const auto& result : results) {
+		nameWidth = std::max(nameWidth, result.name.size() + 2);
+	}
+	std::cout << std::left << std::setw(nameWidth) << "benchmark" << std::setw(18) << "items/sec" << std::setw(14) << "ns/item"
+		<< std::setw(14) << "misses/item" << (options.baselinePath ? "vs baseline" : "") << std::endl;
+
+	int regressions = 0;
+	for (const auto& result : results) {
+		std::cout << std::left << std::fixed << std::setw(nameWidth) << result.name << std::setprecision(0) << std::setw(18) << result.itemsPerSecond
+			<< std::setprecision(3) << std::setw(14) << result.nanosecondsPerItem;
+		if (result.cacheMissesPerItem >= 0.0) {
+			std::cout << std::setw(14) << result.cacheMissesPerItem;
+		} else {
+			std::cout << std::setw(14) << "-";
+		}
+		auto previous = baseline.find(result.name);
+		if (previous != baseline.end() && previous->second > 0.0) {
+			double ratio = result.itemsPerSecond / previous->second;
+			std::cout << std::setprecision(2) << ratio << "x";
+			if (ratio < 1.0 - options.tolerance) {
+				std::cout << "  REGRESSION";
+				++regressions;
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	if (options.outPath) {
+		WriteJson(options.outPath, results);
+		std::cout << "Wrote " << results.size() << " results to " << options.outPath << std::endl;
+	}
+	if (regressions > 0) {
+		std::cout << regressions << " benchmarks are more than " << std::setprecision(0) << options.tolerance * 100.0
+			<< "% slower than the baseline" << std::endl;
+		return 2;
+	}
+	return 0;
+}
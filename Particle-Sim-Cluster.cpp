@@ -0,0 +1,420 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "engine/Simulation.h"
+#include "engine/WorkerPool.h"
+#include "engine/Rasterizer.h"
+#include "engine/HaloExchange.h"
+
+// Walls within this distance of a tile, beyond the farthest a particle can
+// travel in one tick, are copied into the tile. Covers the collision
+// threshold, the bounce jitter and the wall grid margin.
+const float WALL_HALO_SLACK = 16.0f;
+
+struct ClusterOptions {
+	int particles = 100000;
+	int walls = 0;
+	int ticks = 600;
+	int columns = 2;
+	int rows = 2;
+	int threads = 1;
+	float timeStep = 1.0f / 60.0f;
+	CollisionMode collisionMode = COLLISION_SWEPT;
+	bool hasSeed = false;
+	uint64_t seed = 0;
+	HaloTransport transport = HALO_SHARED_MEMORY;
+	int linkKilobytes = 1024;
+	int snapshotEvery = 0;
+	bool verify = false;
+	const char* framePath = nullptr;
+};
+
+static void PrintUsage(const char* program) {
+	std::cout << "Usage: " << program << " [options]\n"
+		<< "  --particles N   particles to spawn (default 100000)\n"
+		<< "  --walls M       random walls to spawn (default 0)\n"
+		<< "  --ticks T       fixed steps to run (default 600)\n"
+		<< "  --tiles CxR     columns and rows of tiles, one process each (default 2x2)\n"
+		<< "  --threads P     worker threads per tile process (default 1)\n"
+		<< "  --dt S          seconds per step (default 1/60)\n"
+		<< "  --collision M   wall collision test: swept (default) or threshold\n"
+		<< "  --seed S        seed for spawning and collision jitter (default: random)\n"
+		<< "  --transport T   halo links: shm (default) or socket\n"
+		<< "  --link-kb K     capacity of each halo link in KiB (default 1024)\n"
+		<< "  --snapshot-every K  merge a snapshot every K ticks as well as at the end\n"
+		<< "  --frame FILE    write the final merged snapshot as a PPM image\n"
+		<< "  --verify        run the same scene in one process and compare the final states\n";
+}
+
+static bool ParseOptions(int argc, char* argv[], ClusterOptions& options) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(arg, "--particles") == 0 && hasValue) {
+			options.particles = atoi(argv[++i]);
+		} else if (strcmp(arg, "--walls") == 0 && hasValue) {
+			options.walls = atoi(argv[++i]);
+		} else if (strcmp(arg, "--ticks") == 0 && hasValue) {
+			options.ticks = atoi(argv[++i]);
+		} else if (strcmp(arg, "--tiles") == 0 && hasValue) {
+			if (sscanf(argv[++i], "%dx%d", &options.columns, &options.rows) != 2) {
+				return false;
+			}
+		} else if (strcmp(arg, "--threads") == 0 && hasValue) {
+			options.threads = atoi(argv[++i]);
+		} else if (strcmp(arg, "--dt") == 0 && hasValue) {
+			options.timeStep = (float)atof(argv[++i]);
+		} else if (strcmp(arg, "--collision") == 0 && hasValue) {
+			const char* mode = argv[++i];
+			if (strcmp(mode, "swept") == 0) {
+				options.collisionMode = COLLISION_SWEPT;
+			} else if (strcmp(mode, "threshold") == 0) {
+				options.collisionMode = COLLISION_THRESHOLD;
+			} else {
+				return false;
+			}
+		} else if (strcmp(arg, "--seed") == 0 && hasValue) {
+			options.seed = strtoull(argv[++i], nullptr, 10);
+			options.hasSeed = true;
+		} else if (strcmp(arg, "--transport") == 0 && hasValue) {
+			const char* transport = argv[++i];
+			if (strcmp(transport, "shm") == 0) {
+				options.transport = HALO_SHARED_MEMORY;
+			} else if (strcmp(transport, "socket") == 0) {
+				options.transport = HALO_SOCKET;
+			} else {
+				return false;
+			}
+		} else if (strcmp(arg, "--link-kb") == 0 && hasValue) {
+			options.linkKilobytes = atoi(argv[++i]);
+		} else if (strcmp(arg, "--snapshot-every") == 0 && hasValue) {
+			options.snapshotEvery = atoi(argv[++i]);
+		} else if (strcmp(arg, "--frame") == 0 && hasValue) {
+			options.framePath = argv[++i];
+		} else if (strcmp(arg, "--verify") == 0) {
+			options.verify = true;
+		} else {
+			return false;
+		}
+	}
+	return options.particles >= 0 && options.walls >= 0 && options.ticks > 0 && options.columns > 0 && options.rows > 0
+		&& options.threads > 0 && options.timeStep > 0.0f && options.linkKilobytes > 0 && options.snapshotEvery >= 0;
+}
+
+// Snapshots are merged every snapshotEvery ticks and after the last tick.
+static bool IsSnapshotTick(const ClusterOptions& options, int tick) {
+	return tick == options.ticks || (options.snapshotEvery > 0 && tick % options.snapshotEvery == 0);
+}
+
+// FNV-1a over the raw bits of every particle in id order, so a scene split
+// across processes hashes the same as one stepped in a single store.
+static uint64_t MergedHash(const std::vector<HaloParticle>& particles) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const auto& particle : particles) {
+		const unsigned char* p = (const unsigned char*)&particle;
+		for (size_t i = 0; i < sizeof(HaloParticle); ++i) {
+			hash = (hash ^ p[i]) * 0x100000001b3ull;
+		}
+	}
+	return hash;
+}
+
+// Copies the walls that reach within `margin` of the tile, in their
+// original order so candidate lists break ties the same way as the whole
+// scene does.
+static void CopyTileWalls(const Simulation& scene, Simulation& sim, float x0, float y0, float x1, float y1, float margin) {
+	sim.ClearWalls();
+	for (const auto& wall : scene.walls) {
+		float left = std::min(wall.startX, wall.endX) - margin;
+		float right = std::max(wall.startX, wall.endX) + margin;
+		float top = std::min(wall.startY, wall.endY) - margin;
+		float bottom = std::max(wall.startY, wall.endY) + margin;
+		if (right >= x0 && left <= x1 && bottom >= y0 && top <= y1) {
+			sim.AddWall(wall.startX, wall.startY, wall.endX, wall.endY);
+		}
+	}
+	// A scene without walls takes the border-clamping SIMD path, so a tile
+	// far from every wall still keeps one to step like the whole scene.
+	if (sim.walls.empty() && !scene.walls.empty()) {
+		const Wall& wall = scene.walls.front();
+		sim.AddWall(wall.startX, wall.startY, wall.endX, wall.endY);
+	}
+}
+
+// Body of one tile process: steps its share of the scene and trades
+// particles with its neighbours after every tick.
+static int RunTile(int tile, const Simulation& scene, const TileLayout& layout, HaloMesh& mesh,
+	SnapshotExchange& snapshots, const ClusterOptions& options, float wallMargin) {
+	float x0, y0, x1, y1;
+	layout.Bounds(tile, x0, y0, x1, y1);
+	Simulation sim = scene;
+	CopyTileWalls(scene, sim, x0, y0, x1, y1, wallMargin);
+	for (size_t i = sim.particles.Size(); i-- > 0;) {
+		if (layout.TileOf(sim.particles.x[i], sim.particles.y[i]) != tile) {
+			sim.particles.Remove(i);
+		}
+	}
+
+	TileReport& report = snapshots.Report(tile);
+	const std::vector<int>& neighbours = mesh.Neighbours(tile);
+	std::vector<std::vector<HaloParticle>> outgoing(neighbours.size());
+	std::vector<HaloParticle> incoming;
+	WorkerPool pool(options.threads, "tile " + std::to_string(tile) + " worker");
+	uint64_t snapshot = 0;
+
+	for (int done = 1; done <= options.ticks; ++done) {
+		auto start = std::chrono::steady_clock::now();
+		sim.Step(options.timeStep, pool, 1);
+		auto stepped = std::chrono::steady_clock::now();
+
+		for (auto& list : outgoing) {
+			list.clear();
+		}
+		ParticleStore& particles = sim.particles;
+		for (size_t i = particles.Size(); i-- > 0;) {
+			int owner = layout.TileOf(particles.x[i], particles.y[i]);
+			if (owner == tile) {
+				continue;
+			}
+			auto found = std::find(neighbours.begin(), neighbours.end(), owner);
+			if (found == neighbours.end()) {
+				std::cerr << "Tile " << tile << ": particle " << particles.id[i] << " skipped a tile" << std::endl;
+				return 1;
+			}
+			outgoing[found - neighbours.begin()].push_back({ particles.x[i], particles.y[i], particles.vx[i], particles.vy[i], particles.id[i] });
+			particles.Remove(i);
+			report.migratedOut++;
+		}
+
+		for (size_t k = 0; k < neighbours.size(); ++k) {
+			mesh.Send(tile, neighbours[k], sim.GetTick(), outgoing[k]);
+		}
+		incoming.clear();
+		for (size_t k = 0; k < neighbours.size(); ++k) {
+			mesh.Receive(tile, neighbours[k], sim.GetTick(), incoming);
+		}
+		for (const auto& particle : incoming) {
+			particles.AddWithId(particle.x, particle.y, particle.vx, particle.vy, particle.id);
+		}
+
+		auto exchanged = std::chrono::steady_clock::now();
+		report.stepSeconds += std::chrono::duration<double>(stepped - start).count();
+		report.exchangeSeconds += std::chrono::duration<double>(exchanged - stepped).count();
+		report.ticks = done;
+		report.bytesSent = mesh.GetBytesSent();
+		if (IsSnapshotTick(options, done)) {
+			snapshots.Publish(tile, ++snapshot, particles);
+		}
+	}
+	return 0;
+}
+
+static void StopTiles(const std::vector<pid_t>& tiles) {
+	for (pid_t pid : tiles) {
+		if (pid > 0) {
+			kill(pid, SIGKILL);
+			waitpid(pid, nullptr, 0);
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	ClusterOptions options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	// Same scene as the headless runner builds for the same options.
+	Simulation scene;
+	if (options.hasSeed) {
+		scene.seed = options.seed;
+	}
+	for (int i = 0; i < options.walls; ++i) {
+		scene.SpawnRandomWall();
+	}
+	{
+		BatchSpec spawn;
+		spawn.count = options.particles;
+		spawn.variation = BATCH_RANDOM_UNIFORM;
+		spawn.endX = CANVAS_WIDTH;
+		spawn.endY = CANVAS_HEIGHT;
+		spawn.endAngle = 360.0f;
+		spawn.startVelocity = 10.0f;
+		spawn.endVelocity = 300.0f;
+		// Destroyed before forking, so no worker threads are running then.
+		WorkerPool spawnPool;
+		scene.AddParticleBatch(spawn, spawnPool);
+	}
+	scene.collisionMode = options.collisionMode;
+
+	TileLayout layout;
+	layout.columns = options.columns;
+	layout.rows = options.rows;
+	layout.width = CANVAS_WIDTH;
+	layout.height = CANVAS_HEIGHT;
+
+	// Wall bounces keep the speed, so this bounds a particle's travel per tick
+	// for the whole run. Migrants must land in a neighbouring tile.
+	float maxSpeed = 0.0f;
+	for (size_t i = 0; i < scene.particles.Size(); ++i) {
+		maxSpeed = std::max(maxSpeed, scene.particles.GetSpeed(i));
+	}
+	float maxTravel = maxSpeed * options.timeStep;
+	if (maxTravel >= CANVAS_WIDTH / layout.columns || maxTravel >= CANVAS_HEIGHT / layout.rows) {
+		std::cerr << "Tiles must be wider than the " << maxTravel << " px a particle can travel in one tick" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Particles: " << options.particles << "  Walls: " << options.walls << "  Ticks: " << options.ticks
+		<< "  Tiles: " << layout.columns << "x" << layout.rows << "  Threads/tile: " << options.threads
+		<< "  Transport: " << (options.transport == HALO_SHARED_MEMORY ? "shm" : "socket")
+		<< "  Seed: " << scene.seed << std::endl;
+
+	HaloMesh mesh(layout, options.transport, (size_t)options.linkKilobytes * 1024);
+	SnapshotExchange snapshots(layout.Count(), scene.particles.Size());
+	float wallMargin = maxTravel + WALL_HALO_SLACK;
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<pid_t> tiles(layout.Count(), 0);
+	for (int tile = 0; tile < layout.Count(); ++tile) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			std::cerr << "Could not start tile process " << tile << std::endl;
+			StopTiles(tiles);
+			return 1;
+		}
+		if (pid == 0) {
+			int status = 1;
+			try {
+				status = RunTile(tile, scene, layout, mesh, snapshots, options, wallMargin);
+			} catch (const std::exception& error) {
+				std::cerr << "Tile " << tile << ": " << error.what() << std::endl;
+			}
+			std::cout.flush();
+			_exit(status);
+		}
+		tiles[tile] = pid;
+	}
+
+	// Merge snapshots as they complete, watching for tiles that died.
+	std::vector<HaloParticle> merged;
+	uint64_t snapshot = 0;
+	for (int tick = 1; tick <= options.ticks; ++tick) {
+		if (!IsSnapshotTick(options, tick)) {
+			continue;
+		}
+		++snapshot;
+		while (!snapshots.TryCollect(snapshot, merged)) {
+			int status;
+			pid_t exited = waitpid(-1, &status, WNOHANG);
+			if (exited > 0) {
+				std::replace(tiles.begin(), tiles.end(), exited, (pid_t)0);
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+					std::cerr << "A tile process failed; stopping the others" << std::endl;
+					StopTiles(tiles);
+					return 1;
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+		if (tick != options.ticks) {
+			std::cout << "Snapshot at tick " << tick << ": " << merged.size() << " particles, state "
+				<< std::hex << std::setw(16) << std::setfill('0') << MergedHash(merged) << std::dec << std::setfill(' ') << std::endl;
+		}
+	}
+	for (pid_t& pid : tiles) {
+		int status = 0;
+		if (pid > 0 && (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+			std::cerr << "A tile process failed" << std::endl;
+			return 1;
+		}
+		pid = 0;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << std::left << std::setw(6) << "tile" << std::setw(26) << "bounds" << std::setw(8) << "walls"
+		<< std::setw(12) << "particles" << std::setw(12) << "step s" << std::setw(14) << "exchange s"
+		<< std::setw(14) << "migrated out" << "KB sent" << std::endl;
+	uint64_t migrated = 0;
+	uint64_t bytes = 0;
+	for (int tile = 0; tile < layout.Count(); ++tile) {
+		const TileReport& report = snapshots.Report(tile);
+		float x0, y0, x1, y1;
+		layout.Bounds(tile, x0, y0, x1, y1);
+		Simulation walls;
+		CopyTileWalls(scene, walls, x0, y0, x1, y1, wallMargin);
+		std::string bounds = std::to_string((int)x0) + "," + std::to_string((int)y0) + "-" + std::to_string((int)x1) + "," + std::to_string((int)y1);
+		std::cout << std::fixed << std::setprecision(3) << std::setw(6) << tile << std::setw(26) << bounds
+			<< std::setw(8) << walls.walls.size() << std::setw(12) << report.particles
+			<< std::setw(12) << report.stepSeconds << std::setw(14) << report.exchangeSeconds
+			<< std::setw(14) << report.migratedOut << std::setprecision(1) << report.bytesSent / 1024.0 << std::endl;
+		migrated += report.migratedOut;
+		bytes += report.bytesSent;
+	}
+
+	uint64_t mergedHash = MergedHash(merged);
+	std::cout << std::setprecision(3) << "Wall time: " << elapsed.count() << " s, "
+		<< (double)options.particles * options.ticks / elapsed.count() << " particles/sec" << std::endl;
+	std::cout << std::setprecision(1) << "Migration: " << (double)migrated / options.ticks << " particles/tick, "
+		<< bytes / 1024.0 / options.ticks << " KB/tick over " << (options.transport == HALO_SHARED_MEMORY ? "shared memory" : "sockets") << std::endl;
+	std::cout << "Merged state: " << merged.size() << " particles, "
+		<< std::hex << std::setw(16) << std::setfill('0') << mergedHash << std::dec << std::setfill(' ') << std::endl;
+
+	int result = 0;
+	if (options.verify) {
+		Simulation sim = scene;
+		WorkerPool pool(options.threads);
+		auto singleStart = std::chrono::steady_clock::now();
+		sim.Step(options.timeStep, pool, options.ticks);
+		std::chrono::duration<double> singleTime = std::chrono::steady_clock::now() - singleStart;
+
+		std::vector<HaloParticle> reference;
+		for (size_t i = 0; i < sim.particles.Size(); ++i) {
+			reference.push_back({ sim.particles.x[i], sim.particles.y[i], sim.particles.vx[i], sim.particles.vy[i], sim.particles.id[i] });
+		}
+		std::sort(reference.begin(), reference.end(), [](const HaloParticle& a, const HaloParticle& b) {
+			return a.id < b.id;
+		});
+		uint64_t referenceHash = MergedHash(reference);
+		bool match = referenceHash == mergedHash;
+		std::cout << std::setprecision(3) << "Single process: " << singleTime.count() << " s, "
+			<< std::hex << std::setw(16) << std::setfill('0') << referenceHash << std::dec << std::setfill(' ')
+			<< (match ? "  match" : "  MISMATCH") << std::endl;
+		result = match ? 0 : 1;
+	}
+
+	if (options.framePath) {
+		std::vector<float> x(merged.size()), y(merged.size());
+		for (size_t i = 0; i < merged.size(); ++i) {
+			x[i] = merged[i].x;
+			y[i] = merged[i].y;
+		}
+		WorkerPool pool(options.threads);
+		Rasterizer rasterizer((int)CANVAS_WIDTH, (int)CANVAS_HEIGHT);
+		rasterizer.drawWalls = true;
+		rasterizer.Render(x.data(), y.data(), x.size(), scene.walls, pool);
+		if (!rasterizer.WritePPM(options.framePath)) {
+			std::cerr << "Could not write " << options.framePath << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote merged frame to " << options.framePath << std::endl;
+	}
+
+	return result;
+}
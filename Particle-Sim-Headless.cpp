@@ -0,0 +1,783 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include "engine/Simulation.h"
+#include "engine/WorkerPool.h"
+#include "engine/Kernels.h"
+#include "engine/Rasterizer.h"
+#include "engine/TrajectoryRecorder.h"
+#include "engine/SharedExport.h"
+#include "engine/Profiler.h"
+
+// Heap allocations made inside an AllocationScope, so --flow can show that a
+// scene in steady state steps without allocating. Every plain, array,
+// sized and aligned form of operator new and delete is replaced, so memory
+// always goes back to the allocator it came from; the library's nothrow
+// forms call these. They are kept out of line: once inlined into a caller, GCC
+// pairs the caller's new with the free() below and warns.
+static std::atomic<bool> countingAllocations{ false };
+static std::atomic<uint64_t> heapAllocations{ 0 };
+
+#if defined(_MSC_VER)
+#define HEAP_HOOK __declspec(noinline)
+#else
+#define HEAP_HOOK __attribute__((noinline))
+#endif
+
+// Counts the allocations made while it is alive; one at a time.
+class AllocationScope {
+public:
+	AllocationScope() {
+		heapAllocations.store(0);
+		countingAllocations.store(true);
+	}
+	~AllocationScope() { countingAllocations.store(false); }
+	uint64_t GetCount() const { return heapAllocations.load(); }
+};
+
+static void* countedAllocate(size_t bytes, size_t alignment) {
+	if (countingAllocations.load(std::memory_order_relaxed)) {
+		heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+	bytes = std::max<size_t>(bytes, 1);
+	void* memory;
+	if (alignment <= alignof(std::max_align_t)) {
+		memory = std::malloc(bytes);
+	} else {
+#if defined(_MSC_VER)
+		memory = _aligned_malloc(bytes, alignment);
+#else
+		memory = std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+#endif
+	}
+	if (!memory) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+static void countedFree(void* memory, size_t alignment) {
+#if defined(_MSC_VER)
+	if (alignment > alignof(std::max_align_t)) {
+		_aligned_free(memory);
+		return;
+	}
+#else
+	// aligned_alloc memory goes back through free like any other.
+	(void)alignment;
+#endif
+	std::free(memory);
+}
+
+HEAP_HOOK void* operator new(size_t bytes) { return countedAllocate(bytes, 0); }
+HEAP_HOOK void* operator new[](size_t bytes) { return countedAllocate(bytes, 0); }
+HEAP_HOOK void* operator new(size_t bytes, std::align_val_t alignment) { return countedAllocate(bytes, (size_t)alignment); }
+HEAP_HOOK void* operator new[](size_t bytes, std::align_val_t alignment) { return countedAllocate(bytes, (size_t)alignment); }
+HEAP_HOOK void operator delete(void* memory) noexcept { countedFree(memory, 0); }
+HEAP_HOOK void operator delete[](void* memory) noexcept { countedFree(memory, 0); }
+HEAP_HOOK void operator delete(void* memory, size_t) noexcept { countedFree(memory, 0); }
+HEAP_HOOK void operator delete[](void* memory, size_t) noexcept { countedFree(memory, 0); }
+HEAP_HOOK void operator delete(void* memory, std::align_val_t alignment) noexcept { countedFree(memory, (size_t)alignment); }
+HEAP_HOOK void operator delete[](void* memory, std::align_val_t alignment) noexcept { countedFree(memory, (size_t)alignment); }
+HEAP_HOOK void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept { countedFree(memory, (size_t)alignment); }
+HEAP_HOOK void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept { countedFree(memory, (size_t)alignment); }
+
+struct RunnerOptions {
+	int particles = 10000;
+	int walls = 0;
+	float worldWidth = CANVAS_WIDTH, worldHeight = CANVAS_HEIGHT;
+	int ticks = 600;
+	int maxThreads = 0;
+	int chunkSize = 1024;
+	int reorderInterval = 0;
+	float flowRate = 0.0f;
+	StorageMode storageMode = STORAGE_FULL;
+	float timeStep = 1.0f / 60.0f;
+	bool verify = false;
+	CollisionMode collisionMode = COLLISION_SWEPT;
+	BorderMode borderMode = BORDER_REFLECT;
+	bool wallJitter = true;
+	bool countTunneling = false;
+	float collideRadius = 0.0f;
+	bool hasSeed = false;
+	uint64_t seed = 0;
+	bool render = false;
+	RasterMode rasterMode = RASTER_AUTO;
+	const char* framePath = nullptr;
+	const char* loadPath = nullptr;
+	const char* savePath = nullptr;
+	const char* recordPath = nullptr;
+	int recordEvery = 1;
+	const char* exportName = nullptr;
+	const char* analyticsPrefix = nullptr;
+	const char* profilePath = nullptr;
+};
+
+static void PrintUsage(const char* program) {
+	std::cout << "Usage: " << program << " [options]\n"
+		<< "  --particles N   particles to spawn (default 10000)\n"
+		<< "  --walls M       random walls to spawn (default 0)\n"
+		<< "  --world WxH     world size in pixels (default 1280x720)\n"
+		<< "  --ticks T       fixed steps per run (default 600)\n"
+		<< "  --threads P     highest thread count to measure (default: hardware concurrency)\n"
+		<< "  --chunk C       particles per work-stealing chunk (default 1024)\n"
+		<< "  --storage S     particle storage: full (default) or compact 16-bit\n"
+		<< "  --reorder K     re-sort the particles into Morton order every K ticks (default: never)\n"
+		<< "  --flow R        emit R particles/sec from the left edge into a sink along the right edge\n"
+		<< "  --dt S          seconds per step (default 1/60)\n"
+		<< "  --collision M   wall collision test: swept (default), threshold or event\n"
+		<< "  --border B      world edges: reflect (default), wrap or absorb\n"
+		<< "  --no-jitter     bounce off walls without the random slide along them\n"
+		<< "  --count-tunneling  count particles that end a tick on the far side of a wall\n"
+		<< "  --collide R     elastic particle-particle collisions with radius R\n"
+		<< "  --seed S        seed for spawning and collision jitter (default: random)\n"
+		<< "  --render        also time the software rasterizer on each run's final state\n"
+		<< "  --heatmap       rasterize particle density instead of dots\n"
+		<< "  --frame FILE    write the last run's final frame as a PPM image (implies --render)\n"
+		<< "  --load FILE     start from a checkpoint instead of spawning a scene\n"
+		<< "  --save FILE     write the starting scene to a checkpoint\n"
+		<< "  --record FILE   replay the run on all threads, recording a trajectory\n"
+		<< "  --record-every K  ticks between recorded frames (default 1)\n"
+		<< "  --export NAME   replay the run on all threads, publishing every tick to shared memory NAME\n"
+		<< "  --analytics PREFIX  replay the run on all threads with analytics, print their cost and\n"
+		<< "                  write PREFIX-ticks.csv, -walls.csv, -density.csv and -speed.csv\n"
+		<< "  --profile FILE  time each phase, print the last run's percentiles and write a Chrome trace\n"
+		<< "  --verify        compare each kernel path against the original per-particle step,\n"
+		<< "                  or with --storage compact, compact storage against full (an empty box\n"
+		<< "                  fails past set error limits)\n";
+}
+
+static bool ParseOptions(int argc, char* argv[], RunnerOptions& options) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(arg, "--particles") == 0 && hasValue) {
+			options.particles = atoi(argv[++i]);
+		} else if (strcmp(arg, "--walls") == 0 && hasValue) {
+			options.walls = atoi(argv[++i]);
+		} else if (strcmp(arg, "--world") == 0 && hasValue) {
+			if (sscanf(argv[++i], "%fx%f", &options.worldWidth, &options.worldHeight) != 2) {
+				return false;
+			}
+		} else if (strcmp(arg, "--ticks") == 0 && hasValue) {
+			options.ticks = atoi(argv[++i]);
+		} else if (strcmp(arg, "--threads") == 0 && hasValue) {
+			options.maxThreads = atoi(argv[++i]);
+		} else if (strcmp(arg, "--chunk") == 0 && hasValue) {
+			options.chunkSize = atoi(argv[++i]);
+		} else if (strcmp(arg, "--storage") == 0 && hasValue) {
+			const char* storage = argv[++i];
+			if (strcmp(storage, "full") == 0) {
+				options.storageMode = STORAGE_FULL;
+			} else if (strcmp(storage, "compact") == 0) {
+				options.storageMode = STORAGE_COMPACT;
+			} else {
+				return false;
+			}
+		} else if (strcmp(arg, "--reorder") == 0 && hasValue) {
+			options.reorderInterval = atoi(argv[++i]);
+		} else if (strcmp(arg, "--flow") == 0 && hasValue) {
+			options.flowRate = (float)atof(argv[++i]);
+		} else if (strcmp(arg, "--dt") == 0 && hasValue) {
+			options.timeStep = (float)atof(argv[++i]);
+		} else if (strcmp(arg, "--collision") == 0 && hasValue) {
+			const char* mode = argv[++i];
+			if (strcmp(mode, "swept") == 0) {
+				options.collisionMode = COLLISION_SWEPT;
+			} else if (strcmp(mode, "threshold") == 0) {
+				options.collisionMode = COLLISION_THRESHOLD;
+			} else if (strcmp(mode, "event") == 0) {
+				options.collisionMode = COLLISION_EVENT;
+			} else {
+				return false;
+			}
+		} else if (strcmp(arg, "--border") == 0 && hasValue) {
+			const char* border = argv[++i];
+			if (strcmp(border, "reflect") == 0) {
+				options.borderMode = BORDER_REFLECT;
+			} else if (strcmp(border, "wrap") == 0) {
+				options.borderMode = BORDER_WRAP;
+			} else if (strcmp(border, "absorb") == 0) {
+				options.borderMode = BORDER_ABSORB;
+			} else {
+				return false;
+			}
+		} else if (strcmp(arg, "--no-jitter") == 0) {
+			options.wallJitter = false;
+		} else if (strcmp(arg, "--count-tunneling") == 0) {
+			options.countTunneling = true;
+		} else if (strcmp(arg, "--collide") == 0 && hasValue) {
+			options.collideRadius = (float)atof(argv[++i]);
+		} else if (strcmp(arg, "--seed") == 0 && hasValue) {
+			options.seed = strtoull(argv[++i], nullptr, 10);
+			options.hasSeed = true;
+		} else if (strcmp(arg, "--render") == 0) {
+			options.render = true;
+		} else if (strcmp(arg, "--heatmap") == 0) {
+			options.rasterMode = RASTER_DENSITY;
+		} else if (strcmp(arg, "--frame") == 0 && hasValue) {
+			options.framePath = argv[++i];
+			options.render = true;
+		} else if (strcmp(arg, "--load") == 0 && hasValue) {
+			options.loadPath = argv[++i];
+		} else if (strcmp(arg, "--save") == 0 && hasValue) {
+			options.savePath = argv[++i];
+		} else if (strcmp(arg, "--record") == 0 && hasValue) {
+			options.recordPath = argv[++i];
+		} else if (strcmp(arg, "--record-every") == 0 && hasValue) {
+			options.recordEvery = atoi(argv[++i]);
+		} else if (strcmp(arg, "--export") == 0 && hasValue) {
+			options.exportName = argv[++i];
+		} else if (strcmp(arg, "--analytics") == 0 && hasValue) {
+			options.analyticsPrefix = argv[++i];
+		} else if (strcmp(arg, "--profile") == 0 && hasValue) {
+			options.profilePath = argv[++i];
+		} else if (strcmp(arg, "--verify") == 0) {
+			options.verify = true;
+		} else {
+			return false;
+		}
+	}
+	return options.particles >= 0 && options.walls >= 0 && options.ticks > 0 && options.chunkSize > 0 && options.reorderInterval >= 0 && options.flowRate >= 0.0f && options.timeStep > 0.0f && options.recordEvery > 0;
+}
+
+static const char* COLLISION_MODE_NAMES[] = { "swept", "threshold", "event" };
+
+// Thread counts 1, 2, 4, ... up to and including maxThreads.
+static std::vector<size_t> ThreadSweep(size_t maxThreads) {
+	std::vector<size_t> counts;
+	for (size_t n = 1; n < maxThreads; n *= 2) {
+		counts.push_back(n);
+	}
+	counts.push_back(maxThreads);
+	return counts;
+}
+
+// FNV-1a over the raw bits of every particle, to show that runs with the
+// same seed end in the same state whatever the thread count. Particles are
+// taken in id order, so Morton reordering does not change the hash.
+static uint64_t StateHash(const Simulation& sim) {
+	ParticleStore expanded;
+	if (!sim.StoreIsCurrent()) {
+		sim.ExportParticles(expanded);
+	}
+	const ParticleStore& particles = sim.StoreIsCurrent() ? sim.particles : expanded;
+	size_t count = particles.Size();
+	std::vector<uint32_t> byId(count);
+	for (size_t i = 0; i < count; ++i) {
+		byId[i] = (uint32_t)i;
+	}
+	std::sort(byId.begin(), byId.end(), [&particles](uint32_t a, uint32_t b) {
+		return particles.id[a] < particles.id[b];
+	});
+
+	uint64_t hash = 0xcbf29ce484222325ull;
+	auto mix = [&hash, &byId](const AlignedArray<float>& values) {
+		for (uint32_t i : byId) {
+			const unsigned char* p = (const unsigned char*)&values[i];
+			for (size_t b = 0; b < sizeof(float); ++b) {
+				hash = (hash ^ p[b]) * 0x100000001b3ull;
+			}
+		}
+	};
+	mix(particles.x);
+	mix(particles.y);
+	mix(particles.vx);
+	mix(particles.vy);
+	return hash;
+}
+
+// Runs the original AoS Particle::UpdatePosition single-threaded and every
+// available kernel path on one thread, then reports speed and the largest
+// position difference against the reference. The reference draws its wall
+// jitter from the scene's seeded stream and is the threshold test, so with
+// walls the kernels run in threshold mode.
+static void VerifyKernels(const Simulation& scene, const RunnerOptions& options) {
+	std::vector<Particle> reference;
+	std::vector<ReferenceJitter> jitter(scene.particles.Size());
+	for (size_t i = 0; i < scene.particles.Size(); ++i) {
+		reference.emplace_back(scene.particles.x[i], scene.particles.y[i], scene.particles.GetAngle(i), scene.particles.GetSpeed(i));
+		jitter[i].enabled = scene.wallJitter;
+		jitter[i].seed = scene.seed;
+		jitter[i].id = scene.particles.id[i];
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (int tick = 0; tick < options.ticks; ++tick) {
+		for (size_t i = 0; i < reference.size(); ++i) {
+			jitter[i].tick = scene.GetTick() + tick;
+			reference[i].UpdatePosition(options.timeStep, scene.walls, &jitter[i]);
+		}
+	}
+	std::chrono::duration<double> referenceTime = std::chrono::steady_clock::now() - start;
+	double updates = (double)reference.size() * options.ticks;
+
+	if (!scene.walls.empty() && scene.collisionMode != COLLISION_THRESHOLD) {
+		std::cout << "Note: the reference is the threshold test, so the kernels run with --collision threshold." << std::endl;
+	}
+	if (scene.GetWidth() != CANVAS_WIDTH || scene.GetHeight() != CANVAS_HEIGHT || scene.borderMode != BORDER_REFLECT) {
+		std::cout << "Note: the reference reflects off the default canvas, so positions near the edges will differ." << std::endl;
+	}
+	std::cout << std::left << std::setw(12) << "path" << std::setw(18) << "particles/sec"
+		<< std::setw(12) << "vs AoS" << std::setw(18) << "max error (px)" << "diverged" << std::endl;
+	std::cout << std::fixed << std::setprecision(0) << std::setw(12) << "AoS"
+		<< std::setw(18) << updates / referenceTime.count() << std::setw(12) << "1.00x" << std::setw(18) << "-" << "-" << std::endl;
+
+	KernelPath detected = DetectKernelPath();
+	WorkerPool pool(1);
+	for (int path = KERNEL_SCALAR; path <= detected; ++path) {
+		SetKernelPath((KernelPath)path);
+		Simulation sim = scene;
+		if (!sim.walls.empty()) {
+			sim.collisionMode = COLLISION_THRESHOLD;
+		}
+
+		start = std::chrono::steady_clock::now();
+		sim.Step(options.timeStep, pool, options.ticks);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		// Rounding differences at a bounce are amplified by later ones, so a
+		// long run with walls has a few particles that no longer match at all.
+		ParticleStore result;
+		sim.ExportParticles(result);
+		double maxError = 0.0;
+		size_t diverged = 0;
+		for (size_t i = 0; i < reference.size(); ++i) {
+			double error = std::max(std::fabs(result.x[i] - reference[i].x), std::fabs(result.y[i] - reference[i].y));
+			maxError = std::max(maxError, error);
+			diverged += error > 1.0 ? 1 : 0;
+		}
+
+		std::cout << std::setw(12) << KernelPathName((KernelPath)path)
+			<< std::setprecision(0) << std::setw(18) << updates / elapsed.count()
+			<< std::setprecision(2) << std::setw(12) << referenceTime.count() / elapsed.count()
+			<< std::setprecision(5) << std::setw(18) << maxError << diverged << std::endl;
+	}
+	SetKernelPath(detected);
+}
+
+// Error limits for --storage compact --verify in an empty box, in position
+// steps (the world's longer side / COMPACT_POSITION_STEPS). Rounding adds a
+// fraction of a step each tick, and a particle rounded across a border a
+// tick early or late is clamped a tick's motion away; both grow with the
+// simulated time. At 1280x720 and 300 ticks of 1/60 s the limits are about
+// twice the measured 0.16 px mean and 2.2 px p99.
+// Mean error at the start, in steps.
+const double COMPACT_MEAN_ERROR_STEPS = 2.0;
+// Mean error added per simulated second, in steps.
+const double COMPACT_MEAN_ERROR_GROWTH = 3.0;
+// 99th-percentile error at the start, in steps.
+const double COMPACT_P99_ERROR_STEPS = 4.0;
+// 99th-percentile error added per simulated second, in steps.
+const double COMPACT_P99_ERROR_GROWTH = 50.0;
+
+// Steps the scene in full and in compact storage and reports the footprint,
+// speed and how far each compact particle ended up from its full-storage
+// self. Without walls the error is the quantization carried through the
+// run; with walls a particle that passes within rounding distance of a wall
+// end can bounce differently, so a few diverge completely. An empty box is
+// held to the COMPACT_*_ERROR limits; false when it exceeds them.
+static bool VerifyStorage(const Simulation& scene, const RunnerOptions& options, size_t threads) {
+	Simulation full = scene;
+	Simulation packed = scene;
+	packed.SetStorageMode(STORAGE_COMPACT);
+	WorkerPool pool(threads);
+
+	auto start = std::chrono::steady_clock::now();
+	full.Step(options.timeStep, pool, options.ticks);
+	std::chrono::duration<double> fullTime = std::chrono::steady_clock::now() - start;
+	start = std::chrono::steady_clock::now();
+	packed.Step(options.timeStep, pool, options.ticks);
+	std::chrono::duration<double> packedTime = std::chrono::steady_clock::now() - start;
+
+	ParticleStore result, expected;
+	packed.ExportParticles(result);
+	full.ExportParticles(expected);
+	std::vector<double> errors;
+	double maxSpeedError = 0.0;
+	for (size_t i = 0; i < result.Size(); ++i) {
+		size_t j = expected.Find(result.id[i]);
+		if (j == SIZE_MAX) {
+			continue;
+		}
+		double dx = result.x[i] - expected.x[j];
+		double dy = result.y[i] - expected.y[j];
+		errors.push_back(std::sqrt(dx * dx + dy * dy));
+		maxSpeedError = std::max(maxSpeedError, std::fabs((double)result.GetSpeed(i) - expected.GetSpeed(j)));
+	}
+	std::sort(errors.begin(), errors.end());
+	double mean = 0.0;
+	for (double error : errors) {
+		mean += error;
+	}
+	mean = errors.empty() ? 0.0 : mean / errors.size();
+	auto percentile = [&errors](double fraction) {
+		return errors.empty() ? 0.0 : errors[std::min(errors.size() - 1, (size_t)(fraction * errors.size()))];
+	};
+	size_t close = std::lower_bound(errors.begin(), errors.end(), 0.01) - errors.begin();
+
+	double fullUpdates = (double)full.GetParticleTicks();
+	double packedUpdates = (double)packed.GetParticleTicks();
+	std::cout << std::left << std::setw(10) << "storage" << std::setw(14) << "bytes/part" << std::setw(12) << "MB"
+		<< "particles/sec" << std::endl;
+	std::cout << std::fixed << std::setprecision(1) << std::setw(10) << "full"
+		<< std::setw(14) << (double)full.GetParticleBytes() / std::max<size_t>(1, full.GetParticleCount())
+		<< std::setw(12) << full.GetParticleBytes() / 1e6 << std::setprecision(0) << fullUpdates / fullTime.count() << std::endl;
+	std::cout << std::setprecision(1) << std::setw(10) << "compact"
+		<< std::setw(14) << (double)packed.GetParticleBytes() / std::max<size_t>(1, packed.GetParticleCount())
+		<< std::setw(12) << packed.GetParticleBytes() / 1e6 << std::setprecision(0) << packedUpdates / packedTime.count() << std::endl;
+	std::cout << std::setprecision(6) << "Position error after " << options.ticks << " ticks (px): mean " << mean
+		<< ", p50 " << percentile(0.5) << ", p99 " << percentile(0.99) << ", max " << percentile(1.0)
+		<< "; largest speed error " << maxSpeedError << " px/s; " << std::setprecision(2)
+		<< (errors.empty() ? 100.0 : close * 100.0 / errors.size()) << "% within 0.01 px" << std::endl;
+
+	if (!scene.walls.empty() || scene.particleCollisions || scene.GetFlow().Active() || scene.borderMode == BORDER_ABSORB) {
+		std::cout << "Error limits apply to an empty box without particle collisions, flow or absorbing borders; not checked." << std::endl;
+		return true;
+	}
+	double step = std::max(scene.GetWidth(), scene.GetHeight()) / COMPACT_POSITION_STEPS;
+	double seconds = (double)options.ticks * options.timeStep;
+	double meanLimit = step * (COMPACT_MEAN_ERROR_STEPS + COMPACT_MEAN_ERROR_GROWTH * seconds);
+	double p99Limit = step * (COMPACT_P99_ERROR_STEPS + COMPACT_P99_ERROR_GROWTH * seconds);
+	bool passed = mean <= meanLimit && percentile(0.99) <= p99Limit;
+	std::cout << "Limits: mean " << meanLimit << ", p99 " << p99Limit << " px: " << (passed ? "passed" : "FAILED") << std::endl;
+	return passed;
+}
+
+int main(int argc, char* argv[]) {
+	RunnerOptions options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	size_t maxThreads = options.maxThreads > 0 ? options.maxThreads : std::thread::hardware_concurrency();
+	if (maxThreads == 0) {
+		maxThreads = 1;
+	}
+
+	Simulation scene;
+	double spawnSeconds = 0.0;
+	auto spawnStart = std::chrono::steady_clock::now();
+
+	if (options.loadPath) {
+		// Particles, walls, seed and tick come from the checkpoint; the
+		// collision settings below still follow the command line.
+		if (!scene.LoadCheckpoint(options.loadPath)) {
+			std::cerr << "Could not load checkpoint " << options.loadPath << std::endl;
+			return 1;
+		}
+		options.particles = (int)scene.particles.Size();
+		options.walls = (int)scene.walls.size();
+	} else {
+		if (options.hasSeed) {
+			scene.seed = options.seed;
+		}
+		if (!scene.SetWorldSize(options.worldWidth, options.worldHeight)) {
+			std::cerr << "Invalid world size " << options.worldWidth << "x" << options.worldHeight << std::endl;
+			return 1;
+		}
+		for (int i = 0; i < options.walls; ++i) {
+			scene.SpawnRandomWall();
+		}
+
+		// Same distribution as SpawnRandomParticle, generated in parallel.
+		BatchSpec spawn;
+		spawn.count = options.particles;
+		spawn.variation = BATCH_RANDOM_UNIFORM;
+		spawn.endX = scene.GetWidth();
+		spawn.endY = scene.GetHeight();
+		spawn.endAngle = 360.0f;
+		spawn.startVelocity = 10.0f;
+		spawn.endVelocity = 300.0f;
+		WorkerPool spawnPool(maxThreads);
+		scene.AddParticleBatch(spawn, spawnPool);
+	}
+	spawnSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - spawnStart).count();
+
+	scene.chunkSize = options.chunkSize;
+	scene.reorderInterval = options.reorderInterval;
+	scene.collisionMode = options.collisionMode;
+	scene.borderMode = options.borderMode;
+	scene.wallJitter = options.wallJitter;
+	scene.countTunneling = options.countTunneling;
+	scene.particleCollisions = options.collideRadius > 0.0f;
+	if (scene.particleCollisions) {
+		scene.particleRadius = options.collideRadius;
+	}
+	if (options.flowRate > 0.0f) {
+		Emitter emitter;
+		emitter.y = scene.GetHeight() / 2;
+		emitter.rate = options.flowRate;
+		emitter.spread = 90.0f;
+		emitter.minSpeed = 100.0f;
+		emitter.maxSpeed = 300.0f;
+		scene.AddEmitter(emitter);
+		Sink sink;
+		sink.x0 = scene.GetWidth() - 20.0f;
+		sink.x1 = scene.GetWidth();
+		sink.y1 = scene.GetHeight();
+		scene.AddSink(sink);
+	}
+
+	if (options.savePath && !scene.SaveCheckpoint(options.savePath)) {
+		std::cerr << "Could not write checkpoint " << options.savePath << std::endl;
+		return 1;
+	}
+
+	std::cout << "Particles: " << options.particles << "  Walls: " << options.walls
+		<< "  World: " << scene.GetWidth() << "x" << scene.GetHeight()
+		<< "  Ticks: " << options.ticks << "  dt: " << options.timeStep << " s"
+		<< "  Kernel: " << KernelPathName(GetKernelPath())
+		<< "  Collision: " << COLLISION_MODE_NAMES[options.collisionMode]
+		<< "  Seed: " << scene.seed << (options.loadPath ? "  Load: " : "  Spawn: ") << spawnSeconds << " s" << std::endl;
+
+	if (options.verify) {
+		if (options.storageMode == STORAGE_COMPACT) {
+			return VerifyStorage(scene, options, maxThreads) ? 0 : 1;
+		} else {
+			VerifyKernels(scene, options);
+		}
+		return 0;
+	}
+
+	scene.SetStorageMode(options.storageMode);
+	std::cout << std::fixed << std::setprecision(1) << "Particle memory: " << scene.GetParticleBytes() / 1e6 << " MB ("
+		<< (double)scene.GetParticleBytes() / std::max<size_t>(1, scene.GetParticleCount()) << " bytes/particle, "
+		<< (options.storageMode == STORAGE_COMPACT ? "compact" : "full") << ")" << std::defaultfloat << std::endl;
+	std::cout << "Step kernel: " << scene.GetStepKernelName() << std::endl;
+
+	std::cout << std::left << std::setw(9) << "threads" << std::setw(12) << "seconds"
+		<< std::setw(18) << "particles/sec" << std::setw(20) << "ns/particle/tick"
+		<< std::setw(10) << "speedup" << std::setw(12) << "efficiency%" << std::setw(8) << "busy%"
+		<< std::setw(13) << "walls/query" << std::setw(12) << "pairs/tick" << std::setw(13) << "events/tick" << std::setw(10) << "tunneled" << std::setw(18) << "state"
+		<< (options.render ? "raster ms" : "") << std::endl;
+
+	// Frames are timed over several renders of the same state.
+	const int RENDER_REPEATS = 10;
+	Rasterizer rasterizer((int)CANVAS_WIDTH, (int)CANVAS_HEIGHT);
+	rasterizer.FitView(scene.GetWidth(), scene.GetHeight());
+	rasterizer.mode = options.rasterMode;
+	rasterizer.drawWalls = true;
+
+	SetProfiling(options.profilePath != nullptr);
+	SetProfileThreadName("main");
+	ProfileSummary profile;
+
+	double baselineSeconds = 0.0;
+	FlowStats flowStats;
+	size_t flowLive = 0;
+	uint64_t steadyAllocations = 0;
+	for (size_t numThreads : ThreadSweep(maxThreads)) {
+		// Every run starts from the same initial scene.
+		Simulation sim = scene;
+		WorkerPool pool(numThreads, "worker", 0);
+		ResetProfile();
+
+		auto start = std::chrono::steady_clock::now();
+		if (options.flowRate > 0.0f) {
+			// Allocations are counted over the second half, once the flow has filled the pool.
+			sim.Step(options.timeStep, pool, options.ticks - options.ticks / 2);
+			{
+				AllocationScope allocations;
+				sim.Step(options.timeStep, pool, options.ticks / 2);
+				steadyAllocations = allocations.GetCount();
+			}
+			flowStats = sim.GetFlow().GetStats();
+			flowLive = sim.GetParticleCount();
+		} else {
+			sim.Step(options.timeStep, pool, options.ticks);
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (options.profilePath) {
+			profile = SummarizeProfile(elapsed.count());
+		}
+
+		double seconds = elapsed.count();
+		double updates = (double)sim.GetParticleTicks();
+		if (numThreads == 1) {
+			baselineSeconds = seconds;
+		}
+		double speedup = baselineSeconds / seconds;
+
+		std::cout << std::left << std::fixed << std::setprecision(3)
+			<< std::setw(9) << numThreads
+			<< std::setw(12) << seconds
+			<< std::setw(18) << std::setprecision(0) << (updates > 0 ? updates / seconds : 0.0)
+			<< std::setw(20) << std::setprecision(2) << (updates > 0 ? seconds * 1e9 / updates : 0.0)
+			<< std::setw(10) << speedup
+			<< std::setw(12) << std::setprecision(1) << speedup * 100.0 / numThreads
+			<< std::setw(8) << pool.GetBusyRatio() * 100.0
+			<< std::setprecision(2) << std::setw(13) << sim.GetAverageWallCandidates()
+			<< std::setprecision(0) << std::setw(12) << sim.GetPairTestsPerTick()
+			<< std::setprecision(1) << std::setw(13) << sim.GetEventsPerTick();
+		if (options.countTunneling) {
+			std::cout << std::setw(10) << sim.GetTunnelingEvents();
+		} else {
+			std::cout << std::setw(10) << "-";
+		}
+		std::cout << std::hex << std::setw(16) << std::setfill('0') << StateHash(sim)
+			<< std::dec << std::setfill(' ') << "  ";
+
+		if (options.render) {
+			start = std::chrono::steady_clock::now();
+			for (int i = 0; i < RENDER_REPEATS; ++i) {
+				rasterizer.Render(sim, pool);
+			}
+			std::chrono::duration<double> renderTime = std::chrono::steady_clock::now() - start;
+			std::cout << renderTime.count() * 1000.0 / RENDER_REPEATS;
+		}
+		std::cout << std::endl;
+	}
+
+	if (options.flowRate > 0.0f) {
+		std::cout << "Flow: emitted " << flowStats.emitted << ", absorbed " << flowStats.absorbed
+			<< ", dropped " << flowStats.dropped << ", " << flowLive << " live at the end; "
+			<< steadyAllocations << " heap allocations over the last " << options.ticks / 2 << " ticks" << std::endl;
+	}
+
+	if (options.profilePath) {
+		std::cout << std::endl << std::left << std::setw(22) << "phase" << std::setw(10) << "samples"
+			<< std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << "max ms" << std::endl;
+		for (int phase = 0; phase < PROFILE_PHASE_COUNT; ++phase) {
+			const ProfilePhaseStats& stats = profile.phases[phase];
+			if (stats.samples > 0) {
+				std::cout << std::setw(22) << ProfilePhaseName((ProfilePhase)phase) << std::setw(10) << stats.samples
+					<< std::setprecision(4) << std::setw(10) << stats.p50Milliseconds << std::setw(10) << stats.p99Milliseconds
+					<< stats.maxMilliseconds << std::endl;
+			}
+		}
+		for (const auto& thread : profile.threads) {
+			std::cout << std::setw(22) << thread.name << std::setprecision(1) << thread.utilisation * 100.0 << "% busy" << std::endl;
+		}
+		if (!WriteChromeTrace(options.profilePath)) {
+			std::cerr << "Could not write " << options.profilePath << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote trace to " << options.profilePath << std::endl;
+		SetProfiling(false);
+	}
+
+	if (options.recordPath) {
+		// A separate run so the sweep above is timed without the recorder.
+		Simulation sim = scene;
+		WorkerPool pool(maxThreads);
+		TrajectoryRecorder recorder;
+		if (!recorder.Start(options.recordPath, (uint32_t)options.recordEvery)) {
+			std::cerr << "Could not write " << options.recordPath << std::endl;
+			return 1;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		recorder.Capture(sim);
+		for (int done = 0; done < options.ticks; done += options.recordEvery) {
+			sim.Step(options.timeStep, pool, std::min(options.recordEvery, options.ticks - done));
+			recorder.Capture(sim);
+		}
+		std::chrono::duration<double> stepTime = std::chrono::steady_clock::now() - start;
+		recorder.Stop();
+
+		std::cout << std::setprecision(3) << "Recorded " << recorder.GetFramesWritten() << " frames ("
+			<< recorder.GetFramesDropped() << " dropped) to " << options.recordPath << ": "
+			<< recorder.GetBytesWritten() / 1e6 << " MB, " << std::setprecision(1) << recorder.GetCompressionRatio() * 100.0
+			<< "% of raw, run " << std::setprecision(3) << stepTime.count() << " s, capture "
+			<< recorder.GetCaptureMilliseconds() << " ms, write " << recorder.GetWriteMilliseconds() << " ms per frame" << std::endl;
+	}
+
+	if (options.exportName) {
+		// Another separate run, stepping one tick at a time and publishing each.
+		Simulation sim = scene;
+		WorkerPool pool(maxThreads);
+		SharedExporter exporter;
+		if (!exporter.Open(options.exportName, std::max<size_t>(1, 2 * sim.GetParticleCount()), std::max<size_t>(1, 2 * sim.walls.size()))) {
+			std::cerr << "Could not create shared memory " << options.exportName << std::endl;
+			return 1;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		exporter.Publish(sim);
+		for (int tick = 0; tick < options.ticks; ++tick) {
+			sim.Step(options.timeStep, pool);
+			exporter.Publish(sim);
+		}
+		std::chrono::duration<double> runTime = std::chrono::steady_clock::now() - start;
+		std::cout << std::setprecision(3) << "Exported " << exporter.GetFramesPublished() << " frames to " << options.exportName
+			<< " (" << exporter.GetSegmentBytes() / 1e6 << " MB segment): run " << runTime.count() << " s, "
+			<< exporter.GetFramesPublished() / runTime.count() << " frames/s, publish " << exporter.GetPublishMilliseconds()
+			<< " ms per frame" << std::endl;
+		exporter.Close();
+	}
+
+	if (options.analyticsPrefix) {
+		// Timed against the same run without analytics.
+		double seconds[2] = {};
+		Simulation measured;
+		for (int pass = 0; pass < 2; ++pass) {
+			Simulation sim = scene;
+			sim.collectAnalytics = pass == 1;
+			WorkerPool pool(maxThreads);
+			auto start = std::chrono::steady_clock::now();
+			sim.Step(options.timeStep, pool, options.ticks);
+			seconds[pass] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (pass == 1) {
+				measured = sim;
+			}
+		}
+
+		const SceneAnalytics& analytics = measured.GetAnalytics();
+		std::vector<AnalyticsSample> samples;
+		analytics.CopyHistory(samples);
+		double hits = 0.0, speed = 0.0;
+		double pressure[SIDE_COUNT] = {};
+		for (const auto& sample : samples) {
+			hits += sample.wallHits;
+			speed += sample.meanSpeed;
+			for (int side = 0; side < SIDE_COUNT; ++side) {
+				pressure[side] += sample.borderPressure[side];
+			}
+		}
+		double count = (double)std::max<size_t>(1, samples.size());
+		const std::vector<uint64_t>& wallHits = analytics.GetWallHits();
+		size_t busiest = std::max_element(wallHits.begin(), wallHits.end()) - wallHits.begin();
+
+		std::cout << std::setprecision(3) << "Analytics: " << analytics.GetTickCount() << " ticks, run " << seconds[1]
+			<< " s against " << seconds[0] << " s without (" << std::setprecision(1)
+			<< (seconds[1] / seconds[0] - 1.0) * 100.0 << "% cost)" << std::endl;
+		std::cout << "  wall hits per tick " << hits / count;
+		if (!wallHits.empty()) {
+			std::cout << ", busiest wall " << busiest << " with " << wallHits[busiest] << " hits";
+		}
+		std::cout << std::endl << "  mean pressure left " << pressure[SIDE_LEFT] / count << ", right " << pressure[SIDE_RIGHT] / count
+			<< ", top " << pressure[SIDE_TOP] / count << ", bottom " << pressure[SIDE_BOTTOM] / count
+			<< "; mean speed " << speed / count << " px/s" << std::endl;
+		if (!analytics.WriteCsv(options.analyticsPrefix)) {
+			std::cerr << "Could not write " << options.analyticsPrefix << "-*.csv" << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote " << options.analyticsPrefix << "-ticks.csv, -walls.csv, -density.csv and -speed.csv" << std::endl;
+	}
+
+	if (options.framePath) {
+		if (!rasterizer.WritePPM(options.framePath)) {
+			std::cerr << "Could not write " << options.framePath << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote " << (rasterizer.UsedDensity() ? "heat map" : "frame") << " to " << options.framePath << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include "engine/SharedExport.h"
+
+// Reference reader for the shared-memory export: follows the newest frame,
+// checks every frame it reads and prints throughput once a second.
+
+static void PrintUsage(const char* program) {
+	std::cout << "Usage: " << program << " [NAME] [options]\n"
+		<< "  NAME            shared-memory segment (default particle-sim)\n"
+		<< "  --seconds S     stop after S seconds (default: when the writer closes)\n"
+		<< "  --wait S        keep retrying for S seconds until the segment appears (default 0)\n";
+}
+
+int main(int argc, char* argv[]) {
+	const char* name = "particle-sim";
+	double seconds = 0.0;
+	double waitSeconds = 0.0;
+	for (int i = 1; i < argc; ++i) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+			seconds = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--wait") == 0 && hasValue) {
+			waitSeconds = atof(argv[++i]);
+		} else if (argv[i][0] != '-') {
+			name = argv[i];
+		} else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	SharedExportReader reader;
+	while (!reader.Open(name)) {
+		if (std::chrono::duration<double>(Clock::now() - start).count() >= waitSeconds) {
+			std::cerr << "No particle export named " << name << std::endl;
+			return 1;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	const SharedExportHeader& header = *reader.GetHeader();
+	std::cout << "Segment " << name << ": " << header.segmentBytes / 1e6 << " MB, room for "
+		<< header.particleCapacity << " particles and " << header.wallCapacity << " walls" << std::endl;
+	std::cout << std::left << std::setw(10) << "tick" << std::setw(12) << "particles" << std::setw(10) << "frames/s"
+		<< std::setw(16) << "particles/s" << std::setw(10) << "MB/s" << std::setw(9) << "missed"
+		<< std::setw(7) << "torn" << std::setw(10) << "checksum" << "off-canvas" << std::endl;
+
+	uint64_t lastNumber = 0;
+	uint64_t lastTick = 0;
+	size_t lastCount = 0;
+	uint64_t frames = 0, particles = 0, missed = 0, torn = 0, badChecksums = 0, offCanvas = 0;
+	uint64_t totalFrames = 0, totalErrors = 0;
+	Clock::time_point reportStart = Clock::now();
+	start = reportStart;
+
+	for (;;) {
+		Clock::time_point now = Clock::now();
+		double elapsed = std::chrono::duration<double>(now - reportStart).count();
+		if (elapsed >= 1.0) {
+			std::cout << std::setw(10) << lastTick << std::setw(12) << lastCount << std::fixed << std::setprecision(1)
+				<< std::setw(10) << frames / elapsed << std::setprecision(0) << std::setw(16) << particles / elapsed
+				<< std::setprecision(1) << std::setw(10) << particles * 20.0 / elapsed / 1e6
+				<< std::setw(9) << missed << std::setw(7) << torn << std::setw(10) << badChecksums << offCanvas << std::endl;
+			totalFrames += frames;
+			totalErrors += badChecksums + offCanvas;
+			frames = particles = missed = torn = badChecksums = offCanvas = 0;
+			reportStart = now;
+		}
+		if (seconds > 0.0 && std::chrono::duration<double>(now - start).count() >= seconds) {
+			break;
+		}
+
+		uint64_t number = reader.GetPublished();
+		if (number == lastNumber) {
+			if (reader.WriterClosed()) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			continue;
+		}
+
+		SharedFrameView view;
+		if (!reader.Acquire(view)) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Everything below reads the frame in place; the seqlock check after
+		// it says whether it all came from the same tick.
+		uint64_t checksum = SharedFrameChecksum(view.x, view.y, view.id, view.particleCount);
+		uint64_t outside = 0;
+		for (size_t i = 0; i < view.particleCount; ++i) {
+			if (!(view.x[i] >= 0.0f && view.x[i] <= view.width && view.y[i] >= 0.0f && view.y[i] <= view.height)) {
+				++outside;
+			}
+		}
+		if (!reader.StillValid(view)) {
+			++torn;
+			continue;
+		}
+
+		if (lastNumber > 0 && view.number > lastNumber + 1) {
+			missed += view.number - lastNumber - 1;
+		}
+		badChecksums += checksum != view.checksum;
+		offCanvas += outside;
+		++frames;
+		particles += view.particleCount;
+		lastNumber = view.number;
+		lastTick = view.tick;
+		lastCount = view.particleCount;
+	}
+
+	totalFrames += frames;
+	totalErrors += badChecksums + offCanvas;
+	std::cout << "Read " << totalFrames << " frames, " << totalErrors << " inconsistent" << std::endl;
+	return totalErrors > 0 ? 2 : 0;
+}
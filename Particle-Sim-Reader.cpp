@@ -0,0 +1,93 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include "engine/TrajectoryRecorder.h"
+
+static void PrintUsage(const char* program) {
+	std::cout << "Usage: " << program << " FILE [options]\n"
+		<< "  --frame N       write frame N (0-based) as CSV instead of listing frames\n"
+		<< "  --out FILE      CSV destination for --frame (default: standard output)\n";
+}
+
+int main(int argc, char* argv[]) {
+	const char* path = nullptr;
+	long long dumpFrame = -1;
+	const char* outPath = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--frame") == 0 && hasValue) {
+			dumpFrame = atoll(argv[++i]);
+		} else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+			outPath = argv[++i];
+		} else if (!path && argv[i][0] != '-') {
+			path = argv[i];
+		} else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (!path) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	TrajectoryReader reader;
+	if (!reader.Open(path)) {
+		std::cerr << "Not a trajectory file: " << path << std::endl;
+		return 1;
+	}
+
+	if (dumpFrame < 0) {
+		std::cout << "Interval: " << reader.GetInterval() << " ticks" << std::endl;
+		std::cout << std::left << std::setw(8) << "frame" << std::setw(12) << "tick" << std::setw(12) << "particles"
+			<< std::setw(6) << "key" << std::setw(14) << "bytes" << std::setw(14) << "mean x" << "mean y" << std::endl;
+	}
+
+	// Frames only decode in order, since each one is a delta on the last.
+	long long frame = 0;
+	uint64_t totalBytes = 0;
+	for (; reader.NextFrame(); ++frame) {
+		totalBytes += reader.GetPayloadBytes();
+		if (dumpFrame >= 0) {
+			if (frame < dumpFrame) {
+				continue;
+			}
+			std::ofstream file;
+			if (outPath) {
+				file.open(outPath);
+				if (!file) {
+					std::cerr << "Could not write " << outPath << std::endl;
+					return 1;
+				}
+			}
+			std::ostream& out = outPath ? file : std::cout;
+			out << "id,x,y\n" << std::fixed << std::setprecision(4);
+			for (size_t i = 0; i < reader.Size(); ++i) {
+				out << reader.ids[i] << ',' << reader.x[i] << ',' << reader.y[i] << '\n';
+			}
+			return 0;
+		}
+
+		double sumX = 0.0, sumY = 0.0;
+		for (size_t i = 0; i < reader.Size(); ++i) {
+			sumX += reader.x[i];
+			sumY += reader.y[i];
+		}
+		double n = reader.Size() ? (double)reader.Size() : 1.0;
+		std::cout << std::left << std::fixed << std::setprecision(2)
+			<< std::setw(8) << frame << std::setw(12) << reader.GetTick() << std::setw(12) << reader.Size()
+			<< std::setw(6) << (reader.IsKeyFrame() ? "yes" : "") << std::setw(14) << reader.GetPayloadBytes()
+			<< std::setw(14) << sumX / n << sumY / n << std::endl;
+	}
+
+	if (dumpFrame >= 0) {
+		std::cerr << "Recording has only " << frame << " frames" << std::endl;
+		return 1;
+	}
+	std::cout << frame << " frames, " << totalBytes << " payload bytes" << std::endl;
+	return 0;
+}
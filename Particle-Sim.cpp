@@ -4,250 +4,322 @@
 #include <vector>
 #include <chrono>
 #include <string>
+#include <cstring>
+#include <cstdio>
 #include <ctime>
 #include <cmath>
 #include <random>
 #include <future>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
 
 #include <imgui.h>
 #include <imgui_impl_opengl3.h>
 #include <GLFW/glfw3.h>
 #include <imgui_impl_glfw.h>
 
+#include "engine/Simulation.h"
+#include "engine/SimulationThread.h"
+#include "engine/WorkerPool.h"
+#include "engine/Rasterizer.h"
+#include "engine/Profiler.h"
+
 using namespace std;
 
 static GLFWwindow* window = nullptr;
-float PI = 3.14159265359;
 ImVec4 wallColor = ImVec4(1.0f, 1.0f, 0.0f, 1.0f);
 ImVec4 particleColor = ImVec4(1.0f, 1.0f, 1.0f, 1.0f);
 
-class Wall {
-public:
-	float startX, startY, endX, endY;
-
-	Wall(float startX, float startY, float endX, float endY)
-		: startX(startX), startY(startY), endX(endX), endY(endY) {}
-
-	void DrawWall() {
-		ImDrawList* draw_list = ImGui::GetWindowDrawList();
-		ImVec2 start = ImVec2(startX, 720 - startY);
-		ImVec2 end = ImVec2(endX, 720 - endY);
-		draw_list->AddLine(start, end, ImColor(wallColor), 1.0f);
-	}
-
+// The scene lives on the simulation thread; the UI only reads its snapshots
+// and posts edits to it.
+SimulationThread simThread;
+// Rasterizes snapshots on the UI side, next to the simulation's own workers.
+WorkerPool renderPool(std::max(1u, std::thread::hardware_concurrency() / 4), "render worker");
+Rasterizer rasterizer((int)CANVAS_WIDTH, (int)CANVAS_HEIGHT);
+GLuint particleTexture = 0;
+// Positions of the particles in view this frame, blended between two ticks
+// when interpolating.
+std::vector<float> drawX, drawY;
+std::vector<ParticleRange> visibleRanges;
+std::vector<size_t> visibleOffsets;
+size_t visibleParticles = 0;
+// Set by the simulation thread when an "Add Particle" command was out of range.
+std::atomic<bool> particleRejected{ false };
+
+// Pan and zoom over the world: the world point at the middle of the black
+// panel, and panel pixels per world pixel.
+struct Camera {
+	float centerX = CANVAS_WIDTH / 2, centerY = CANVAS_HEIGHT / 2;
+	float zoom = 1.0f;
 };
-
-std::vector<Wall> walls;
-
-static float getDistance(float x1, float y1, float x2, float y2) {
-	return sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2));
+Camera camera;
+// Zoom change per notch of the mouse wheel, and the closest zoom.
+const float ZOOM_STEP = 1.25f;
+const float MAX_ZOOM = 64.0f;
+
+enum CheckpointStatus {
+	CHECKPOINT_IDLE = 0,
+	CHECKPOINT_SAVED,
+	CHECKPOINT_LOADED,
+	CHECKPOINT_FAILED
+};
+// Outcome of the last save/load command, set by the simulation thread.
+std::atomic<int> checkpointStatus{ CHECKPOINT_IDLE };
+
+static void PostCheckpoint(const std::string& path, bool save) {
+	simThread.Post([path, save](Simulation& sim) {
+		bool ok = save ? sim.SaveCheckpoint(path.c_str()) : sim.LoadCheckpoint(path.c_str());
+		checkpointStatus = ok ? (save ? CHECKPOINT_SAVED : CHECKPOINT_LOADED) : CHECKPOINT_FAILED;
+	});
 }
 
-static float pointLineDistance(float px, float py, float x1, float y1, float x2, float y2) {
-	float dx = x2 - x1;
-	float dy = y2 - y1;
-	float t = ((px - x1) * dx + (py - y1) * dy) / (dx * dx + dy * dy);
-	float closestX = x1 + t * dx;
-	float closestY = y1 + t * dy;
-
-	return sqrt((closestX - px) * (closestX - px) + (closestY - py) * (closestY - py));
+// The whole world, centred in the panel at one scale on both axes.
+static Camera FitCamera(float worldWidth, float worldHeight) {
+	Camera fitted;
+	fitted.centerX = worldWidth / 2;
+	fitted.centerY = worldHeight / 2;
+	fitted.zoom = std::min(CANVAS_WIDTH / worldWidth, CANVAS_HEIGHT / worldHeight);
+	return fitted;
 }
 
-static float reflectAngle(Wall wall, float angle) {
-	float wallAngle = atan2(wall.endY - wall.startY, wall.endX - wall.startX) * 180.0 / PI;
-	float reflectedAngle = 2 * wallAngle - angle;
-
-	reflectedAngle = fmod(reflectedAngle, 360.0f);
-
-	return reflectedAngle;
+static RasterView CameraView() {
+	float viewWidth = CANVAS_WIDTH / camera.zoom;
+	float viewHeight = CANVAS_HEIGHT / camera.zoom;
+	return { camera.centerX - viewWidth / 2, camera.centerY - viewHeight / 2, viewWidth, viewHeight };
 }
 
-class Particle {
-public:
-	float x, y;
-	float angle; 
-	float velocity;
-
-	Particle(float x, float y, float angle, float velocity)
-		: x(x), y(y), angle(angle), velocity(velocity) {}
-
-	void UpdatePosition(float deltaTime) {
-		float radians = angle * PI / 180.0;
-
-		float dx = cos(radians) * velocity * deltaTime;
-		float dy = sin(radians) * velocity * deltaTime;
-
-		float newX = x + dx;
-		float newY = y + dy;
-
-		// Threshold for collision detection
-		float threshold = velocity > 500 ? 10.0f : 3.0f;
-
-		bool collisionDetected = false;
-		Wall* collidedWall = nullptr;
+// World coordinates to the panel's, which has y pointing down.
+static ImVec2 ToPanel(const RasterView& view, float x, float y) {
+	return ImVec2((x - view.left) * camera.zoom, (view.bottom + view.height - y) * camera.zoom);
+}
 
-		for (auto& wall : walls) {
-			float lineDistance = pointLineDistance(newX, newY, wall.startX, wall.startY, wall.endX, wall.endY);
-			float wallStartDistance = getDistance(newX, newY, wall.startX, wall.startY);
-			float wallEndDistance = getDistance(newX, newY, wall.endX, wall.endY);
+// Drag with the left or right button to pan, scroll to zoom about the
+// cursor. Returns true when the camera moved.
+static bool UpdateCamera(const SimulationSnapshot& snapshot) {
+	ImGui::SetCursorPos(ImVec2(0, 0));
+	ImGui::InvisibleButton("Camera", ImVec2(CANVAS_WIDTH, CANVAS_HEIGHT), ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight);
+	ImGuiIO& io = ImGui::GetIO();
+	bool moved = false;
+	if (ImGui::IsItemActive() && (io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f)) {
+		camera.centerX -= io.MouseDelta.x / camera.zoom;
+		camera.centerY += io.MouseDelta.y / camera.zoom;
+		moved = true;
+	}
+	if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f) {
+		// The world point under the cursor stays under it.
+		float offsetX = io.MousePos.x - CANVAS_WIDTH / 2;
+		float offsetY = io.MousePos.y - CANVAS_HEIGHT / 2;
+		float worldX = camera.centerX + offsetX / camera.zoom;
+		float worldY = camera.centerY - offsetY / camera.zoom;
+		float minZoom = FitCamera(snapshot.worldWidth, snapshot.worldHeight).zoom / 2;
+		camera.zoom = std::min(std::max(camera.zoom * powf(ZOOM_STEP, io.MouseWheel), minZoom), MAX_ZOOM);
+		camera.centerX = worldX - offsetX / camera.zoom;
+		camera.centerY = worldY + offsetY / camera.zoom;
+		moved = true;
+	}
+	return moved;
+}
 
-			if (lineDistance < threshold || wallStartDistance < threshold || wallEndDistance < threshold) {
-				float dx = newX - wall.startX;
-				float dy = newY - wall.startY;
-				float wallLength = getDistance(wall.startX, wall.startY, wall.endX, wall.endY);
-				float t = (dx * (wall.endX - wall.startX) + dy * (wall.endY - wall.startY)) / (wallLength * wallLength);
+// Walls whose bounding box misses the view are not submitted.
+static void DrawWall(const Wall& wall, const RasterView& view) {
+	if (std::max(wall.startX, wall.endX) < view.left || std::min(wall.startX, wall.endX) > view.left + view.width ||
+		std::max(wall.startY, wall.endY) < view.bottom || std::min(wall.startY, wall.endY) > view.bottom + view.height) {
+		return;
+	}
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	draw_list->AddLine(ToPanel(view, wall.startX, wall.startY), ToPanel(view, wall.endX, wall.endY), ImColor(wallColor), 1.0f);
+}
 
-				if (t >= 0 && t <= 1) {
-					collisionDetected = true;
-					collidedWall = &wall;
-					break;
-				}
-			}
+// Sinks as red outlines, emitters as a green dot with a line along their direction.
+static void DrawFlow(const SimulationSnapshot& snapshot, const RasterView& view) {
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	ImColor sinkColor(1.0f, 0.3f, 0.3f);
+	ImColor emitterColor(0.3f, 1.0f, 0.3f);
+	for (const auto& sink : snapshot.sinks) {
+		ImVec2 start = ToPanel(view, sink.x0, sink.y0);
+		ImVec2 end = ToPanel(view, sink.x1, sink.y1);
+		if (sink.shape == SINK_REGION) {
+			draw_list->AddRect(ImVec2(std::min(start.x, end.x), std::min(start.y, end.y)),
+				ImVec2(std::max(start.x, end.x), std::max(start.y, end.y)), sinkColor);
+		} else {
+			draw_list->AddLine(start, end, sinkColor, 2.0f);
 		}
+	}
+	for (const auto& emitter : snapshot.emitters) {
+		float radians = emitter.direction * PI / 180.0f;
+		ImVec2 center = ToPanel(view, emitter.x, emitter.y);
+		draw_list->AddCircleFilled(center, 4.0f, emitterColor);
+		draw_list->AddLine(center, ImVec2(center.x + cos(radians) * 15.0f, center.y - sin(radians) * 15.0f), emitterColor);
+	}
+}
 
-		if (collisionDetected) {
-			std::random_device rd;
-			std::mt19937 gen(rd());
-			std::uniform_real_distribution<> disOffset(-0.3f, 0.3f);
-			float offsetX = disOffset(gen);
-			float offsetY = disOffset(gen);
-
-			x += offsetX;
-			y += offsetY;
-
-			if (getDistance(newX, newY, collidedWall->startX, collidedWall->startY) < threshold || 
-				getDistance(newX, newY, collidedWall->endX, collidedWall->endY) < threshold) {
-				//std::cout << "hIT THE TIP" << std::endl;
-				angle = fmod(angle + 180, 360.0f);
-			} else {
-				angle = reflectAngle(*collidedWall, angle);
-			}
-			
-			radians = angle * PI / 180.0;
-			dx = cos(radians) * velocity * deltaTime;
-			dy = sin(radians) * velocity * deltaTime;
-			newX = x + dx;
-			newY = y + dy;
-		}
+static void GLFWErrorCallback(int error, const char* description) {
+	std::cout << "GLFW Error " <<  description << " code: " << error << std::endl;
+}
 
-		x = newX;
-		y = newY;
+static void CreateParticleTexture() {
+	glGenTextures(1, &particleTexture);
+	glBindTexture(GL_TEXTURE_2D, particleTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rasterizer.GetWidth(), rasterizer.GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, rasterizer.GetPixels());
+}
 
-		if (x < 0) {
-			x = 0;
-			angle = 180 - angle;
+// Copies the particles of the buckets overlapping the view into drawX/drawY,
+// so drawing costs what is visible rather than the whole population. When
+// the snapshot has previous positions they are blended with the current
+// ones by how far the wall clock is into the next tick, so particles move
+// smoothly at any frame rate.
+static void GatherVisible(const SimulationSnapshot& snapshot, const RasterView& view) {
+	snapshot.buckets.FindVisible(view.left, view.bottom, view.left + view.width, view.bottom + view.height, visibleRanges);
+	visibleOffsets.resize(visibleRanges.size() + 1);
+	visibleOffsets[0] = 0;
+	for (size_t r = 0; r < visibleRanges.size(); ++r) {
+		visibleOffsets[r + 1] = visibleOffsets[r] + visibleRanges[r].end - visibleRanges[r].begin;
+	}
+	visibleParticles = visibleOffsets.back();
+	drawX.resize(visibleParticles);
+	drawY.resize(visibleParticles);
+
+	bool blend = snapshot.stepInterval > 0.0 && snapshot.previousX.size() == snapshot.x.size();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - snapshot.stepTime).count();
+	float alpha = blend ? (float)std::min(1.0, std::max(0.0, elapsed / snapshot.stepInterval)) : 1.0f;
+	renderPool.ParallelFor(visibleRanges.size(), 1, [&](size_t r, size_t, size_t) {
+		ParticleRange range = visibleRanges[r];
+		float* x = drawX.data() + visibleOffsets[r];
+		float* y = drawY.data() + visibleOffsets[r];
+		if (!blend) {
+			std::copy(snapshot.x.begin() + range.begin, snapshot.x.begin() + range.end, x);
+			std::copy(snapshot.y.begin() + range.begin, snapshot.y.begin() + range.end, y);
+			return;
 		}
-		else if (x > 1280) {
-			x = 1280;
-			angle = 180 - angle;
+		for (size_t i = range.begin; i < range.end; ++i) {
+			x[i - range.begin] = snapshot.previousX[i] + (snapshot.x[i] - snapshot.previousX[i]) * alpha;
+			y[i - range.begin] = snapshot.previousY[i] + (snapshot.y[i] - snapshot.previousY[i]) * alpha;
 		}
+	});
+}
 
-		if (y < 0) {
-			y = 0;
-			angle = -angle;
-		}
-		else if (y > 720) {
-			y = 720;
-			angle = -angle;
-		}
+// Particles in view are splatted into one frame on the render pool and
+// drawn as a single textured quad; walls in view stay ImGui lines. Without
+// `redraw` the last frame's texture is shown again.
+static void DrawElements(const SimulationSnapshot& snapshot, bool redraw) {
+	ProfileScope scope(PROFILE_DRAW);
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	RasterView view = CameraView();
+
+	if (redraw) {
+		GatherVisible(snapshot, view);
+		rasterizer.view = view;
+		rasterizer.particleColor = RasterColor(particleColor.x, particleColor.y, particleColor.z);
+		rasterizer.Render(drawX.data(), drawY.data(), visibleParticles, snapshot.walls, renderPool);
+		glBindTexture(GL_TEXTURE_2D, particleTexture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, rasterizer.GetWidth(), rasterizer.GetHeight(), GL_RGBA, GL_UNSIGNED_BYTE, rasterizer.GetPixels());
 	}
-};
-
-std::vector<Particle> particles;
-
-static void SpawnRandomParticle() {
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<> disX(0, 1280);
-	std::uniform_real_distribution<> disY(0, 720);
-	std::uniform_real_distribution<> disAngle(0, 360);
-	std::uniform_real_distribution<> disVelocity(10, 300);
+	draw_list->AddImage((ImTextureID)(intptr_t)particleTexture, ImVec2(0, 0), ImVec2(CANVAS_WIDTH, CANVAS_HEIGHT));
 
-	float x, y;
-	bool validPosition = false;
-
-	while (!validPosition) {
-		x = disX(gen);
-		y = disY(gen);
+	for (const auto& wall : snapshot.walls) {
+		DrawWall(wall, view);
+	}
+	DrawFlow(snapshot, view);
+}
 
-		validPosition = true;
-		for (const auto& wall : walls) {
-			if (x >= wall.startX && x <= wall.endX && y >= wall.startY && y <= wall.endY) {
-				validPosition = false;
-				break;
-			}
+// Rolling p50/p99 per phase and how much of the window each thread was busy.
+static void DrawProfiler(const ProfileSummary& summary, const char* tracePath) {
+	ImGui::SetNextWindowPos(ImVec2(20, 20), ImGuiCond_Once);
+	ImGui::SetNextWindowBgAlpha(0.8f);
+	ImGui::Begin("Profiler", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+	ImGui::Text("%-20s %8s %9s %9s %9s", "phase", "samples", "p50 ms", "p99 ms", "max ms");
+	for (int phase = 0; phase < PROFILE_PHASE_COUNT; ++phase) {
+		const ProfilePhaseStats& stats = summary.phases[phase];
+		if (stats.samples == 0) {
+			continue;
 		}
+		ImGui::Text("%-20s %8zu %9.3f %9.3f %9.3f", ProfilePhaseName((ProfilePhase)phase), stats.samples,
+			stats.p50Milliseconds, stats.p99Milliseconds, stats.maxMilliseconds);
 	}
 
-	float angle = disAngle(gen);
-	float velocity = disVelocity(gen);
+	ImGui::Separator();
+	for (const auto& thread : summary.threads) {
+		ImGui::ProgressBar((float)thread.utilisation, ImVec2(150.0f, 0.0f));
+		ImGui::SameLine();
+		ImGui::Text("%s", thread.name.c_str());
+	}
 
-	particles.emplace_back(x, y, angle, velocity);
+	if (ImGui::Button("Write Trace")) {
+		WriteChromeTrace(tracePath);
+	}
+	ImGui::SameLine();
+	ImGui::Text("%s", tracePath);
+	ImGui::End();
 }
 
-static void SpawnRandomWall() {
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<> disStartX(0, 1280);
-	std::uniform_real_distribution<> disStartY(0, 720);
-	std::uniform_real_distribution<> disEndX(0, 1280);
-	std::uniform_real_distribution<> disEndY(0, 720);
-	
-	float startX = disStartX(gen);
-	float startY = disStartY(gen);
-	float endX = disEndX(gen);
-	float endY = disEndY(gen);
-
-	for (auto& particle : particles) {
-		if (particle.x >= startX && particle.x <= endX && particle.y >= startY && particle.y <= endY) {
-			float offsetX = (particle.x < (startX + endX) / 2) ? -10.0f : 10.0f;
-			float offsetY = (particle.y < (startY + endY) / 2) ? -10.0f : 10.0f;
-
-			bool insideAnotherWall = false;
-			for (const auto& otherWall : walls) {
-				if (particle.x + offsetX >= otherWall.startX && particle.x + offsetX <= otherWall.endX &&
-					particle.y + offsetY >= otherWall.startY && particle.y + offsetY <= otherWall.endY) {
-					insideAnotherWall = true;
-					break;
-				}
-			}
+static void DrawAnalytics(const SimulationSnapshot& snapshot, const char* csvPrefix) {
+	ImGui::SetNextWindowPos(ImVec2(20, 380), ImGuiCond_Once);
+	ImGui::SetNextWindowBgAlpha(0.8f);
+	ImGui::Begin("Analytics", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+	const std::vector<AnalyticsSample>& history = snapshot.analyticsHistory;
+	const ImVec2 plotSize(300.0f, 40.0f);
+	if (!history.empty()) {
+		int count = (int)history.size();
+		int stride = (int)sizeof(AnalyticsSample);
+		const char* sides[] = { "Left pressure", "Right pressure", "Top pressure", "Bottom pressure" };
+		for (int side = 0; side < SIDE_COUNT; ++side) {
+			ImGui::PlotLines(sides[side], &history[0].borderPressure[side], count, 0, nullptr, 0.0f, FLT_MAX, plotSize, stride);
+		}
+		ImGui::PlotLines("Wall hits/tick", &history[0].wallHits, count, 0, nullptr, 0.0f, FLT_MAX, plotSize, stride);
+		ImGui::PlotLines("Mean speed", &history[0].meanSpeed, count, 0, nullptr, 0.0f, FLT_MAX, plotSize, stride);
+		ImGui::PlotLines("Density spread", &history[0].densitySpread, count, 0, nullptr, 0.0f, FLT_MAX, plotSize, stride);
+	}
+	if (!snapshot.speedHistogram.empty()) {
+		char label[64];
+		snprintf(label, sizeof(label), "0-%.0f px/s", SPEED_BINS * SPEED_BIN_WIDTH);
+		ImGui::PlotHistogram("Speeds", snapshot.speedHistogram.data(), SPEED_BINS, 0, label, 0.0f, FLT_MAX, plotSize);
+	}
 
-			if (!insideAnotherWall && particle.x + offsetX >= 0 && particle.x + offsetX <= 1280 &&
-				particle.y + offsetY >= 0 && particle.y + offsetY <= 720) {
-				particle.x += offsetX;
-				particle.y += offsetY;
+	// Density grid as a heat map, one 4 px square per cell.
+	if (snapshot.density.size() == DENSITY_CELLS) {
+		const float cell = 4.0f;
+		float peak = *std::max_element(snapshot.density.begin(), snapshot.density.end());
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		for (int row = 0; row < DENSITY_ROWS; ++row) {
+			for (int column = 0; column < DENSITY_COLUMNS; ++column) {
+				float level = peak > 0.0f ? snapshot.density[row * DENSITY_COLUMNS + column] / peak : 0.0f;
+				ImVec2 min(origin.x + column * cell, origin.y + row * cell);
+				drawList->AddRectFilled(min, ImVec2(min.x + cell, min.y + cell), ImGui::GetColorU32(ImVec4(level, level * 0.5f, 1.0f - level, 1.0f)));
 			}
 		}
+		ImGui::Dummy(ImVec2(DENSITY_COLUMNS * cell, DENSITY_ROWS * cell));
 	}
 
-	walls.emplace_back(startX, startY, endX, endY);	
-}
-
-static void GLFWErrorCallback(int error, const char* description) {
-	std::cout << "GLFW Error " <<  description << " code: " << error << std::endl;
-}
-
-static void DrawElements() {
-	ImDrawList* draw_list = ImGui::GetWindowDrawList();
-
-	for (const auto& particle : particles) {
-		ImVec2 pos = ImVec2(particle.x, 720 - particle.y);
-
-		draw_list->AddCircleFilled(pos, 1.5f, ImColor(particleColor));
+	// The five walls hit most since analytics were turned on.
+	std::vector<size_t> busiest(snapshot.wallHits.size());
+	for (size_t w = 0; w < busiest.size(); ++w) {
+		busiest[w] = w;
 	}
-
-	for (auto& wall : walls) {
-		wall.DrawWall();
+	size_t shown = std::min<size_t>(5, busiest.size());
+	std::partial_sort(busiest.begin(), busiest.begin() + shown, busiest.end(), [&snapshot](size_t a, size_t b) {
+		return snapshot.wallHits[a] > snapshot.wallHits[b];
+	});
+	for (size_t i = 0; i < shown; ++i) {
+		size_t w = busiest[i];
+		ImGui::Text("Wall %zu: %llu hits, impulse %.0f", w, (unsigned long long)snapshot.wallHits[w], snapshot.wallImpulse[w]);
 	}
-}
 
-void UpdateParticlesRange(std::vector<Particle>::iterator begin, std::vector<Particle>::iterator end, float deltaTime) {
-	for (auto it = begin; it != end; ++it) {
-		it->UpdatePosition(deltaTime);
+	if (ImGui::Button("Export CSV")) {
+		std::string prefix(csvPrefix);
+		simThread.Post([prefix](Simulation& sim) { sim.GetAnalytics().WriteCsv(prefix.c_str()); });
 	}
+	ImGui::SameLine();
+	ImGui::Text("%s-*.csv", csvPrefix);
+	ImGui::End();
 }
 
-int main(int argc, char *argv) {
+int main(int argc, char* argv[]) {
 	if (!glfwInit()) {
 		std::cout << "Failed to initialize GLFW" << std::endl;
 		std::cin.get();
@@ -268,6 +340,25 @@ int main(int argc, char *argv) {
 	ImGui::CreateContext();
 	ImGui_ImplGlfw_InitForOpenGL(window, true);
 	ImGui_ImplOpenGL3_Init();
+	CreateParticleTexture();
+	simThread.Start();
+	SetProfileThreadName("ui");
+
+	char checkpointPath[256] = "scene.ckpt";
+	char recordPath[256] = "scene.traj";
+	int recordInterval = 1;
+	bool recording = false;
+	char exportName[128] = "particle-sim";
+	bool exporting = false;
+	bool profiling = false;
+	ProfileSummary profileSummary;
+	bool analytics = false;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "--load") == 0) {
+			snprintf(checkpointPath, sizeof(checkpointPath), "%s", argv[i + 1]);
+			PostCheckpoint(checkpointPath, false);
+		}
+	}
 
 	ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
@@ -280,7 +371,7 @@ int main(int argc, char *argv) {
 
 	char numParticlesStr[16] = "";
 	int numParticles = 0;
-	int particleVariationType = 0; //  0: Varying X and Y,  1: Varying Angle,  2: Varying Velocity
+	int particleVariationType = 0; //  0: Varying X and Y,  1: Varying Angle,  2: Varying Velocity,  3/4: Random
 	float startX = 0.0f, endX = 0.0f;
 	float startY = 0.0f, endY = 0.0f;
 	float startAngle = 0.0f, endAngle = 0.0f;
@@ -289,41 +380,50 @@ int main(int argc, char *argv) {
 	float wallStartX = 0.0f, wallStartY = 0.0f;
 	float wallEndX = 0.0f, wallEndY = 0.0f;
 
-	double frameTime = 0.0; // Time since the last frame
-	double targetFrameTime = 1.0 / 60.0; // Target time per frame (60 FPS)
-	double updateInterval = 0.5; // Interval for updating particles (0.5 seconds)
-	double lastUpdateTime = 0.0; // Last time particles were updated
-	double lastFPSUpdateTime = 0.0; // Last time the framerate was updated
-
-	const double targetFPS = 60.0;
-	const std::chrono::duration<double> targetFrameDuration = std::chrono::duration<double>(1.0 / targetFPS);
-
-	std::chrono::steady_clock::time_point prevTime = std::chrono::steady_clock::now();
-
-	const double timeStep = 1.0 / targetFPS; // Time step for updates
-	double accumulator = 0.0; // Accumulates elapsed time
-
+	Emitter newEmitter;
+	newEmitter.rate = 1000.0f;
+	newEmitter.spread = 30.0f;
+	newEmitter.minSpeed = 100.0f;
+	newEmitter.maxSpeed = 300.0f;
+	int sinkShape = SINK_REGION;
+	float sinkStartX = 0.0f, sinkStartY = 0.0f;
+	float sinkEndX = 0.0f, sinkEndY = 0.0f;
+
+	// All UI timing is on the steady clock the simulation thread paces its ticks by.
+	typedef std::chrono::steady_clock Clock;
+	const double updateInterval = 0.5; // Seconds between framerate and profiler refreshes
+	Clock::time_point framerateStart = Clock::now();
+	Clock::time_point lastProfileTime = framerateStart;
+	int framesCounted = 0;
 	double currentFramerate = 0.0;
-	double lastUIUpdateTime = 0.0;
+	uint64_t frameNumber = 0;
+
+	bool paused = false;
+	float timeScale = 1.0f;
+	int tickBudget = 5;
+	bool maxThroughput = false;
+	int drawEvery = 10;
+	bool interpolate = true;
+	int workerThreads = (int)simThread.GetThreadCount();
+	int chunkSize = (int)Simulation().chunkSize;
+	int collisionMode = (int)Simulation().collisionMode;
+	int borderMode = (int)Simulation().borderMode;
+	bool wallJitter = Simulation().wallJitter;
+	int reorderInterval = Simulation().reorderInterval;
+	int storageMode = (int)STORAGE_FULL;
+	float worldWidth = CANVAS_WIDTH, worldHeight = CANVAS_HEIGHT;
+	// World size the camera was last fitted to.
+	float fittedWidth = CANVAS_WIDTH, fittedHeight = CANVAS_HEIGHT;
+	bool particleCollisions = false;
+	float particleRadius = Simulation().particleRadius;
 
 	while (!glfwWindowShouldClose(window)) {
-		double currentTime = glfwGetTime();
-		frameTime = currentTime - lastUpdateTime;
-
-		std::chrono::steady_clock::time_point currentTimeForDelta = std::chrono::steady_clock::now();
-		std::chrono::duration<double> elapsedTime = currentTimeForDelta - prevTime;
-		prevTime = currentTimeForDelta;
-
-		accumulator += frameTime;
-
-		if (elapsedTime > std::chrono::seconds(1)) {
-			elapsedTime = std::chrono::duration<double>(1.0 / targetFPS);
-		}
-
-		double deltaTime = elapsedTime.count();
+		Clock::time_point frameStart = Clock::now();
+		++frameNumber;
 
 		glfwPollEvents();
 
+		ProfileScope uiScope(PROFILE_UI);
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
@@ -332,11 +432,22 @@ int main(int argc, char *argv) {
 
 		ImGui::SetNextWindowSize(ImVec2(1280, 720), ImGuiCond_Always);
 		ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Always);
-		ImGui::Begin("Black Panel", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
+		ImGui::Begin("Black Panel", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove |
+			ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
 
 		ImDrawList* draw_list = ImGui::GetWindowDrawList();
 
-		DrawElements();
+		// Max throughput leaves the cores to the simulation and only redraws
+		// every Nth frame, or when the camera moved.
+		const SimulationSnapshot& snapshot = simThread.ReadSnapshot();
+		bool refit = snapshot.worldWidth != fittedWidth || snapshot.worldHeight != fittedHeight;
+		if (refit) {
+			camera = FitCamera(snapshot.worldWidth, snapshot.worldHeight);
+			fittedWidth = snapshot.worldWidth;
+			fittedHeight = snapshot.worldHeight;
+		}
+		bool cameraMoved = UpdateCamera(snapshot) || refit;
+		DrawElements(snapshot, !maxThroughput || frameNumber % drawEvery == 0 || cameraMoved);
 
 		ImGui::End();
 
@@ -353,21 +464,198 @@ int main(int argc, char *argv) {
 		ImGui::ColorEdit3("Wall Color", (float*)&wallColor);
 		ImGui::ColorEdit3("Particle Color", (float*)&particleColor);
 
+		const char* renderModes[] = { "Auto", "Points", "Heat Map" };
+		int renderMode = (int)rasterizer.mode;
+		ImGui::PushItemWidth(175.0f);
+		if (ImGui::Combo("Render Mode", &renderMode, renderModes, IM_ARRAYSIZE(renderModes))) {
+			rasterizer.mode = (RasterMode)renderMode;
+		}
+		ImGui::PopItemWidth();
+
 		ImGui::Dummy(ImVec2(0, 20));
 
 		if (ImGui::Button("Reset Particles")) {
-			particles.clear();
+			simThread.Post([](Simulation& sim) { sim.ResetParticles(); });
 		}
 
 		ImGui::SameLine();
 		if (ImGui::Button("Clear Walls")) {
-			walls.clear();
+			simThread.Post([](Simulation& sim) { sim.ClearWalls(); });
+		}
+
+		ImGui::PushItemWidth(175.0f);
+		ImGui::InputText("Checkpoint File", checkpointPath, sizeof(checkpointPath));
+		ImGui::PopItemWidth();
+		if (ImGui::Button("Save Scene")) {
+			PostCheckpoint(checkpointPath, true);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Load Scene")) {
+			PostCheckpoint(checkpointPath, false);
+		}
+		ImGui::SameLine();
+		const char* checkpointMessages[] = { "", "Saved", "Loaded", "Checkpoint failed" };
+		ImGui::Text("%s", checkpointMessages[checkpointStatus.load()]);
+
+		ImGui::PushItemWidth(175.0f);
+		ImGui::InputText("Recording File", recordPath, sizeof(recordPath));
+		if (ImGui::InputInt("Record Every N Ticks", &recordInterval)) {
+			recordInterval = std::max(1, recordInterval);
+		}
+		ImGui::PopItemWidth();
+		if (ImGui::Checkbox("Record Trajectory", &recording)) {
+			if (recording) {
+				simThread.StartRecording(recordPath, (uint32_t)recordInterval);
+			}
+			else {
+				simThread.StopRecording();
+			}
+		}
+
+		ImGui::PushItemWidth(175.0f);
+		ImGui::InputText("Export Name", exportName, sizeof(exportName));
+		ImGui::PopItemWidth();
+		if (ImGui::Checkbox("Shared Memory Export", &exporting)) {
+			if (exporting) {
+				simThread.StartExport(exportName);
+			}
+			else {
+				simThread.StopExport();
+			}
+		}
+		if (exporting && simThread.ExportFailed()) {
+			ImGui::SameLine();
+			ImGui::Text("Could not create the segment");
 		}
 
 		ImGui::Dummy(ImVec2(0, 20));
 		ImGui::Text("Current FPS: %.f", currentFramerate);
-		ImGui::Text("Number of Particles: %d", particles.size());
-		ImGui::Text("Number of Walls: %d", walls.size());
+		ImGui::Text("Ticks per second: %.f", snapshot.ticksPerSecond);
+		ImGui::Text("Simulated time: %.2f s (tick %llu)", snapshot.simulatedSeconds, (unsigned long long)snapshot.tick);
+		ImGui::Text("Ticks dropped: %llu  caught up: %llu", (unsigned long long)snapshot.droppedTicks,
+			(unsigned long long)snapshot.caughtUpTicks);
+		ImGui::Text("Number of Particles: %zu", snapshot.x.size());
+		ImGui::Text("Number of Walls: %zu", snapshot.walls.size());
+		ImGui::Text("World: %.0f x %.0f  zoom: %.2fx  particles in view: %zu", snapshot.worldWidth, snapshot.worldHeight,
+			camera.zoom, visibleParticles);
+		ImGui::Text("Particle memory: %.1f MB (%.1f bytes/particle)", snapshot.particleBytes / 1e6,
+			snapshot.x.empty() ? 0.0 : (double)snapshot.particleBytes / snapshot.x.size());
+		ImGui::Text("Workers busy: %.0f%%  idle: %.0f%%", snapshot.busyRatio * 100.0, (1.0 - snapshot.busyRatio) * 100.0);
+		ImGui::Text("Step kernel: %s", snapshot.stepKernel);
+		ImGui::Text("Wall candidates per query: %.2f", snapshot.wallCandidates);
+		ImGui::Text("Particle pair tests per tick: %.0f", snapshot.pairTestsPerTick);
+		ImGui::Text("Wall impacts per tick (event-driven): %.1f", snapshot.eventsPerTick);
+		ImGui::Text("Emitted: %llu  absorbed: %llu  dropped: %llu", (unsigned long long)snapshot.flow.emitted,
+			(unsigned long long)snapshot.flow.absorbed, (unsigned long long)snapshot.flow.dropped);
+		if (ImGui::Checkbox("Profiler", &profiling)) {
+			ResetProfile();
+			SetProfiling(profiling);
+		}
+		ImGui::SameLine();
+		if (ImGui::Checkbox("Analytics", &analytics)) {
+			bool enabled = analytics;
+			simThread.Post([enabled](Simulation& sim) {
+				sim.collectAnalytics = enabled;
+				sim.ResetAnalytics();
+			});
+		}
+		if (snapshot.recording) {
+			ImGui::Text("Recorded frames: %llu  dropped: %llu", (unsigned long long)snapshot.recordFramesWritten, (unsigned long long)snapshot.recordFramesDropped);
+			ImGui::Text("Recording: %.1f MB  %.0f%% of raw", snapshot.recordBytes / 1e6, snapshot.recordRatio * 100.0);
+			ImGui::Text("Capture: %.3f ms  write: %.3f ms", snapshot.recordCaptureMilliseconds, snapshot.recordWriteMilliseconds);
+		}
+		if (snapshot.exporting) {
+			ImGui::Text("Exported frames: %llu  publish: %.3f ms", (unsigned long long)snapshot.exportFrames, snapshot.exportMilliseconds);
+		}
+
+		ImGui::PushItemWidth(175.0f);
+		if (ImGui::InputInt("Worker Threads", &workerThreads)) {
+			workerThreads = std::max(1, workerThreads);
+			simThread.SetThreadCount(workerThreads);
+		}
+		if (ImGui::InputInt("Chunk Size", &chunkSize, 256)) {
+			chunkSize = std::max(1, chunkSize);
+			simThread.SetChunkSize(chunkSize);
+		}
+		const char* collisionModes[] = { "Swept", "Threshold", "Event-Driven" };
+		if (ImGui::Combo("Wall Collisions", &collisionMode, collisionModes, IM_ARRAYSIZE(collisionModes))) {
+			CollisionMode mode = (CollisionMode)collisionMode;
+			simThread.Post([mode](Simulation& sim) { sim.collisionMode = mode; });
+		}
+		const char* borderModes[] = { "Reflect", "Wrap", "Absorb" };
+		if (ImGui::Combo("Borders", &borderMode, borderModes, IM_ARRAYSIZE(borderModes))) {
+			BorderMode mode = (BorderMode)borderMode;
+			simThread.Post([mode](Simulation& sim) { sim.borderMode = mode; });
+		}
+		if (ImGui::Checkbox("Wall Jitter", &wallJitter)) {
+			bool enabled = wallJitter;
+			simThread.Post([enabled](Simulation& sim) { sim.wallJitter = enabled; });
+		}
+		const char* storageModes[] = { "Full (float)", "Compact (16-bit)" };
+		if (ImGui::Combo("Particle Storage", &storageMode, storageModes, IM_ARRAYSIZE(storageModes))) {
+			StorageMode mode = (StorageMode)storageMode;
+			simThread.Post([mode](Simulation& sim) { sim.SetStorageMode(mode); });
+		}
+		// Compact storage steps a subset of the scene; what it leaves out is
+		// greyed out below.
+		bool compactStorage = storageMode == STORAGE_COMPACT;
+		if (compactStorage) {
+			ImGui::TextDisabled("Compact storage runs event-driven collisions as swept and absorbing\n"
+				"borders as reflecting, and skips reordering, particle collisions and flow.");
+		}
+		ImGui::InputFloat("World Width", &worldWidth, 1280.0f);
+		ImGui::InputFloat("World Height", &worldHeight, 720.0f);
+		if (ImGui::Button("Resize World")) {
+			float width = std::max(1.0f, worldWidth), height = std::max(1.0f, worldHeight);
+			simThread.Post([width, height](Simulation& sim) { sim.SetWorldSize(width, height); });
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Reset View")) {
+			camera = FitCamera(snapshot.worldWidth, snapshot.worldHeight);
+		}
+		ImGui::BeginDisabled(compactStorage);
+		if (ImGui::InputInt("Reorder Every (ticks)", &reorderInterval, 60)) {
+			reorderInterval = std::max(0, reorderInterval);
+			int interval = reorderInterval;
+			simThread.Post([interval](Simulation& sim) { sim.reorderInterval = interval; });
+		}
+		if (ImGui::Checkbox("Particle Collisions", &particleCollisions)) {
+			bool enabled = particleCollisions;
+			simThread.Post([enabled](Simulation& sim) { sim.particleCollisions = enabled; });
+		}
+		if (ImGui::InputFloat("Particle Radius", &particleRadius, 0.5f)) {
+			particleRadius = std::max(0.5f, particleRadius);
+			float radius = particleRadius;
+			simThread.Post([radius](Simulation& sim) { sim.particleRadius = radius; });
+		}
+		ImGui::EndDisabled();
+
+		if (ImGui::Checkbox("Pause", &paused)) {
+			simThread.SetPaused(paused);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Step") && paused) {
+			simThread.StepPaused();
+		}
+		ImGui::SameLine();
+		if (ImGui::Checkbox("Interpolate", &interpolate)) {
+			simThread.SetInterpolation(interpolate);
+		}
+		if (ImGui::SliderFloat("Time Scale", &timeScale, 0.1f, 10.0f, "%.2fx", ImGuiSliderFlags_Logarithmic)) {
+			simThread.SetTimeScale(timeScale);
+		}
+		if (ImGui::InputInt("Tick Budget per Step", &tickBudget)) {
+			tickBudget = std::max(1, tickBudget);
+			simThread.SetTickBudget(tickBudget);
+		}
+		if (ImGui::Checkbox("Max Throughput", &maxThroughput)) {
+			simThread.SetMaxThroughput(maxThroughput);
+		}
+		ImGui::SameLine();
+		if (ImGui::InputInt("Draw Every N Frames", &drawEvery)) {
+			drawEvery = std::max(1, drawEvery);
+		}
+		ImGui::PopItemWidth();
 		
 		ImGui::PopStyleColor(4);
 
@@ -415,50 +703,28 @@ int main(int argc, char *argv) {
 		ImGui::Dummy(ImVec2(0, 10));
 
 		if (ImGui::Button("Add Particle")) {
-			
-
-			bool insideWall = false;
-			Wall* collidingWall = nullptr;
-
-			for (auto& wall : walls) {
-				if (newParticleX >= wall.startX && newParticleX <= wall.endX &&
-					newParticleY >= wall.startY && newParticleY <= wall.endY) {
-					insideWall = true;
-					collidingWall = &wall;
-					break;
-				}
-			}
-
-			if (insideWall) {
-				if (newParticleX < collidingWall->endX && !(collidingWall->endX >= 1280)) {
-					newParticleX = collidingWall->endX + 1.0f;
+			float x = newParticleX, y = newParticleY, angle = newParticleAngle, velocity = newParticleVelocity;
+			simThread.Post([x, y, angle, velocity](Simulation& sim) {
+				if (!sim.AddParticle(x, y, angle, velocity)) {
+					particleRejected = true;
 				}
-				else {
-					newParticleX = collidingWall->startX - 1.0f;
-				}
-			}
-
-			//std::cout << "New particle velocity: " << newParticleVelocity << std::endl; // Debug output
-
-			if (newParticleX >= 0 && newParticleX <= 1280 &&
-				newParticleY >= 0 && newParticleY <= 720 &&
-				newParticleAngle >= 0.0 && newParticleAngle <= 360.0) {
-				particles.emplace_back(newParticleX, newParticleY, newParticleAngle, newParticleVelocity);
-			}
-			else {
-				showErrorPopup = true;
-			}
+			});
 		}
 
 		ImGui::SameLine();
 		if (ImGui::Button("Spawn Random Particle")) {
-			SpawnRandomParticle();
+			simThread.Post([](Simulation& sim) { sim.SpawnRandomParticle(); });
+		}
+
+		if (particleRejected.exchange(false)) {
+			showErrorPopup = true;
 		}
 
 		if (showErrorPopup) {
 			ImGui::OpenPopup("Invalid Input");
 			if (ImGui::BeginPopupModal("Invalid Input", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
-				ImGui::Text("The input values for X and Y coordinates must be within the dimensions of the black panel (0-1280,   0-720).\nThe angle must be between   0 and   360 degrees.");
+				ImGui::Text("The input values for X and Y coordinates must be within the world (0-%.0f,   0-%.0f).\nThe angle must be between   0 and   360 degrees.",
+					snapshot.worldWidth, snapshot.worldHeight);
 				if (ImGui::Button("OK")) {
 					ImGui::CloseCurrentPopup();
 					showErrorPopup = false;
@@ -478,7 +744,7 @@ int main(int argc, char *argv) {
 		ImGui::InputText("Number of Particles", numParticlesStr, sizeof(numParticlesStr));
 		numParticles = atoi(numParticlesStr);
 
-		const char* particleVariationTypes[] = { "Varying X and Y", "Varying Angle", "Varying Velocity" };
+		const char* particleVariationTypes[] = { "Varying X and Y", "Varying Angle", "Varying Velocity", "Random (uniform)", "Random (normal)" };
 		ImGui::Combo("Particle Variation Type", &particleVariationType, particleVariationTypes, IM_ARRAYSIZE(particleVariationTypes));
 		ImGui::InputFloat("Start X", &startX);
 		ImGui::InputFloat("Start Y", &startY);
@@ -491,52 +757,30 @@ int main(int argc, char *argv) {
 
 		ImGui::Dummy(ImVec2(0, 10));
 
+		const BatchSpawner& spawner = simThread.GetBatchSpawner();
 		if (ImGui::Button("Add Batch Particles")) {
-			float dX = (endX - startX) / (numParticles - 1);
-			float dY = (endY - startY) / (numParticles - 1);
-			float dAngle = (endAngle - startAngle) / (numParticles - 1);
-			float dVelocity = (endVelocity - startVelocity) / (numParticles - 1);
-
-			for (int i = 0; i < numParticles; ++i) {
-				float x = startX + i * dX;
-				float y = startY + i * dY;
-				float angle = startAngle + i * dAngle;
-				float velocity = startVelocity + i * dVelocity;
-
-				bool insideWall = false;
-				Wall* collidingWall = nullptr;
-
-				for (auto& wall : walls) {
-					if (x >= wall.startX && x <= wall.endX &&
-						y >= wall.startY && y <= wall.endY) {
-						insideWall = true;
-						collidingWall = &wall;
-						break;
-					}
-				}
-
-				if (insideWall) {
-					if (x < collidingWall->endX && !(collidingWall->endX >= 1280)) {
-						x = collidingWall->endX + 1.0f;
-					}
-					else {
-						x = collidingWall->startX - 1.0f;
-					}
-				}
-
-				switch (particleVariationType) {
-					case 0: // Varying X and Y
-						particles.emplace_back(x, y, startAngle, startVelocity);
-						break;
-					case 1: // Varying Angle
-						angle = fmod(angle, 360.0f);
-						particles.emplace_back(startX, startY, angle, startVelocity);
-						break;
-					case 2: // Varying Velocity
-						particles.emplace_back(startX, startY, startAngle, velocity);
-						break;
-				}
-				//std::cout << "Particle position: (" << x << ", " << y << ")" << std::endl;
+			BatchSpec spec;
+			spec.count = numParticles;
+			spec.variation = particleVariationType;
+			spec.startX = startX;
+			spec.endX = endX;
+			spec.startY = startY;
+			spec.endY = endY;
+			spec.startAngle = startAngle;
+			spec.endAngle = endAngle;
+			spec.startVelocity = startVelocity;
+			spec.endVelocity = endVelocity;
+			simThread.AddBatch(spec);
+		}
+		if (spawner.Busy()) {
+			ImGui::SameLine();
+			ImGui::ProgressBar(spawner.GetProgress(), ImVec2(175.0f, 0.0f));
+			ImGui::SameLine();
+			if (spawner.GetQueued() > 0) {
+				ImGui::Text("Generating batch... (%zu queued)", spawner.GetQueued());
+			}
+			else {
+				ImGui::Text("Generating batch...");
 			}
 		}
 
@@ -557,49 +801,85 @@ int main(int argc, char *argv) {
 		ImGui::PopItemWidth();
 
 		if (ImGui::Button("Add Wall")) {
-			walls.emplace_back(wallStartX, wallStartY, wallEndX, wallEndY);
+			float x0 = wallStartX, y0 = wallStartY, x1 = wallEndX, y1 = wallEndY;
+			simThread.Post([x0, y0, x1, y1](Simulation& sim) { sim.AddWall(x0, y0, x1, y1); });
 		}
 
 		ImGui::SameLine();
 		if (ImGui::Button("Spawn Random Wall")) {
-			SpawnRandomWall();
+			simThread.Post([](Simulation& sim) { sim.SpawnRandomWall(); });
 		}
-		ImGui::PopStyleColor(4);
 
-		ImGui::End();
+		ImGui::Dummy(ImVec2(0, 20));
+		ImGui::Text("--------------------------------------------------------------------------------------------------------------------");
+		ImGui::Dummy(ImVec2(0, 20));
 
-		ImGui::PopStyleVar();
+		ImGui::Text("Add Emitters and Sinks");
+		ImGui::Dummy(ImVec2(0, 10));
 
-		while (accumulator >= timeStep) {
-			std::vector<std::future<void>> futures;
-			size_t numParticles = particles.size();
-			size_t numThreads = std::thread::hardware_concurrency();
-			size_t chunkSize = numParticles / numThreads;
+		ImGui::BeginDisabled(storageMode == STORAGE_COMPACT);
+		ImGui::PushItemWidth(175.0f);
+		ImGui::InputFloat("Emitter X", &newEmitter.x);
+		ImGui::InputFloat("Emitter Y", &newEmitter.y);
+		ImGui::InputFloat("Emitter Rate (per sec)", &newEmitter.rate);
+		ImGui::InputFloat("Emitter Direction", &newEmitter.direction);
+		ImGui::InputFloat("Emitter Spread", &newEmitter.spread);
+		ImGui::InputFloat("Emitter Min Speed", &newEmitter.minSpeed);
+		ImGui::InputFloat("Emitter Max Speed", &newEmitter.maxSpeed);
+		if (ImGui::Button("Add Emitter")) {
+			Emitter emitter = newEmitter;
+			simThread.Post([emitter](Simulation& sim) { sim.AddEmitter(emitter); });
+		}
 
-			for (size_t i = 0; i < numThreads; ++i) {
-				auto startIter = particles.begin() + i * chunkSize;
-				auto endIter = (i == numThreads - 1) ? particles.end() : startIter + chunkSize;
-				futures.push_back(std::async(std::launch::async, UpdateParticlesRange, startIter, endIter, timeStep));
-			}
+		const char* sinkShapes[] = { "Region", "Line" };
+		ImGui::Combo("Sink Shape", &sinkShape, sinkShapes, IM_ARRAYSIZE(sinkShapes));
+		ImGui::InputFloat("Sink Start X", &sinkStartX);
+		ImGui::InputFloat("Sink Start Y", &sinkStartY);
+		ImGui::InputFloat("Sink End X", &sinkEndX);
+		ImGui::InputFloat("Sink End Y", &sinkEndY);
+		ImGui::PopItemWidth();
+		if (ImGui::Button("Add Sink")) {
+			Sink sink;
+			sink.shape = (SinkShape)sinkShape;
+			sink.x0 = sinkStartX;
+			sink.y0 = sinkStartY;
+			sink.x1 = sinkEndX;
+			sink.y1 = sinkEndY;
+			simThread.Post([sink](Simulation& sim) { sim.AddSink(sink); });
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear Emitters and Sinks")) {
+			simThread.Post([](Simulation& sim) { sim.ClearFlow(); });
+		}
+		ImGui::EndDisabled();
+		ImGui::PopStyleColor(4);
 
-			futures.push_back(std::async(std::launch::async, DrawElements));
+		ImGui::End();
 
-			for (auto& future : futures) {
-				future.wait();
-			}
-			accumulator -= timeStep;
-		}
+		ImGui::PopStyleVar();
 
-		if (frameTime >= targetFrameTime) {
-			lastUpdateTime = currentTime;
+		++framesCounted;
+		double framerateElapsed = std::chrono::duration<double>(frameStart - framerateStart).count();
+		if (framerateElapsed >= updateInterval) {
+			currentFramerate = framesCounted / framerateElapsed;
+			std::cout << "Framerate: " << currentFramerate << " FPS" << std::endl;
+			framerateStart = frameStart;
+			framesCounted = 0;
 		}
 
-		if (currentTime - lastFPSUpdateTime >= updateInterval) {
-			currentFramerate = 1.0 / frameTime;
-			std::cout << "Framerate: " << currentFramerate << " FPS" << std::endl;
-			lastFPSUpdateTime = currentTime;
+		if (profiling) {
+			if (std::chrono::duration<double>(frameStart - lastProfileTime).count() >= updateInterval) {
+				profileSummary = SummarizeProfile(2.0);
+				lastProfileTime = frameStart;
+			}
+			DrawProfiler(profileSummary, "trace.json");
+		}
+		if (analytics && snapshot.analytics) {
+			DrawAnalytics(snapshot, "analytics");
 		}
+		uiScope.End();
 
+		ProfileScope presentScope(PROFILE_PRESENT);
 		ImGui::Render();
 		int display_w, display_h;
 		glfwGetFramebufferSize(window, &display_w, &display_h);
@@ -614,6 +894,8 @@ int main(int argc, char *argv) {
 		glfwSwapInterval(0); // Disable VSync
 	}
 
+	simThread.Stop();
+	glDeleteTextures(1, &particleTexture);
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
@@ -0,0 +1,234 @@
+#include "Analytics.h"
+#include "ParticleStore.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+
+// Bins merged per reduction chunk.
+const size_t REDUCE_CHUNK = 512;
+
+void AnalyticsAccumulator::Sample(const ParticleStore& store, size_t begin, size_t end) {
+	const float* x = store.x.Data();
+	const float* y = store.y.Data();
+	const float* vx = store.vx.Data();
+	const float* vy = store.vy.Data();
+	const float binScale = 1.0f / SPEED_BIN_WIDTH;
+	double sum = 0.0;
+
+	for (size_t i = begin; i < end; ++i) {
+		float speed = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+		sum += speed;
+		++speeds[std::min((int)(speed * binScale), SPEED_BINS - 1)];
+
+		// Absorbed particles end their last tick outside the world.
+		if (x[i] >= 0.0f && x[i] <= width && y[i] >= 0.0f && y[i] <= height) {
+			int column = std::min((int)(x[i] * columnScale), DENSITY_COLUMNS - 1);
+			int row = std::min((int)(y[i] * rowScale), DENSITY_ROWS - 1);
+			++density[row * DENSITY_COLUMNS + column];
+		}
+	}
+	speedSum += sum;
+	sampled += end - begin;
+}
+
+void SceneAnalytics::Prepare(size_t workers, size_t wallCount, float width, float height, uint64_t tick) {
+	if (accumulators.size() < workers) {
+		accumulators.resize(workers);
+	}
+	workerCount = workers;
+	if (wallHits.size() < wallCount) {
+		wallHits.resize(wallCount, 0);
+		wallImpulse.resize(wallCount, 0.0);
+	}
+	for (auto& accumulator : accumulators) {
+		accumulator.width = width;
+		accumulator.height = height;
+		accumulator.columnScale = DENSITY_COLUMNS / width;
+		accumulator.rowScale = DENSITY_ROWS / height;
+		if (accumulator.wallHits.size() < wallCount) {
+			accumulator.wallHits.resize(wallCount, 0);
+			accumulator.wallImpulse.resize(wallCount, 0.0f);
+		}
+	}
+	if (history.size() < ANALYTICS_HISTORY) {
+		history.reserve(ANALYTICS_HISTORY);
+	}
+	SetSampling(tick + 1);
+}
+
+void SceneAnalytics::SetSampling(uint64_t tick) {
+	bool sampling = SamplesTick(tick);
+	for (auto& accumulator : accumulators) {
+		accumulator.sampling = sampling;
+	}
+}
+
+// Bins [begin, end) of the concatenated walls, density cells and speed bins.
+void SceneAnalytics::ReduceRange(size_t begin, size_t end) {
+	size_t walls = wallHits.size();
+	for (size_t bin = begin; bin < end; ++bin) {
+		if (bin < walls) {
+			uint64_t hitSum = 0;
+			double impulseSum = 0.0;
+			for (size_t w = 0; w < workerCount; ++w) {
+				hitSum += accumulators[w].wallHits[bin];
+				impulseSum += accumulators[w].wallImpulse[bin];
+				accumulators[w].wallHits[bin] = 0;
+				accumulators[w].wallImpulse[bin] = 0.0f;
+			}
+			wallHits[bin] += hitSum;
+			wallImpulse[bin] += impulseSum;
+		} else if (bin < walls + DENSITY_CELLS) {
+			size_t cell = bin - walls;
+			uint32_t sum = 0;
+			for (size_t w = 0; w < workerCount; ++w) {
+				sum += accumulators[w].density[cell];
+				accumulators[w].density[cell] = 0;
+			}
+			density[cell] = sum;
+		} else {
+			size_t speed = bin - walls - DENSITY_CELLS;
+			uint32_t sum = 0;
+			for (size_t w = 0; w < workerCount; ++w) {
+				sum += accumulators[w].speeds[speed];
+				accumulators[w].speeds[speed] = 0;
+			}
+			speeds[speed] = sum;
+		}
+	}
+}
+
+void SceneAnalytics::Flush(WorkerPool& pool) {
+	// One capture fits std::function's inline storage, so this does not allocate.
+	pool.ParallelFor(wallHits.size(), REDUCE_CHUNK, [this](size_t begin, size_t end, size_t) {
+		ReduceRange(begin, end);
+	});
+}
+
+void SceneAnalytics::EndTick(uint64_t tick, size_t particles, float deltaTime, float width, float height) {
+	bool sampling = SamplesTick(tick);
+	if (sampling) {
+		ReduceRange(wallHits.size(), wallHits.size() + DENSITY_CELLS + SPEED_BINS);
+	}
+
+	AnalyticsSample sample;
+	sample.tick = tick;
+	double speedSum = 0.0;
+	uint64_t sampled = 0;
+	float borderImpulse[SIDE_COUNT] = {};
+	for (size_t w = 0; w < workerCount; ++w) {
+		AnalyticsAccumulator& accumulator = accumulators[w];
+		sample.wallHits += (float)accumulator.hits;
+		sample.wallImpulse += accumulator.impulse;
+		for (int side = 0; side < SIDE_COUNT; ++side) {
+			borderImpulse[side] += accumulator.borderImpulse[side];
+			accumulator.borderImpulse[side] = 0.0f;
+		}
+		speedSum += accumulator.speedSum;
+		sampled += accumulator.sampled;
+		accumulator.hits = 0;
+		accumulator.impulse = 0.0f;
+		accumulator.speedSum = 0.0;
+		accumulator.sampled = 0;
+	}
+	sample.particles = (float)particles;
+
+	if (sampling) {
+		borderPressure[SIDE_LEFT] = borderImpulse[SIDE_LEFT] / (deltaTime * height);
+		borderPressure[SIDE_RIGHT] = borderImpulse[SIDE_RIGHT] / (deltaTime * height);
+		borderPressure[SIDE_TOP] = borderImpulse[SIDE_TOP] / (deltaTime * width);
+		borderPressure[SIDE_BOTTOM] = borderImpulse[SIDE_BOTTOM] / (deltaTime * width);
+		meanSpeed = sampled > 0 ? (float)(speedSum / sampled) : 0.0f;
+		double mean = 0.0, squares = 0.0;
+		for (int cell = 0; cell < DENSITY_CELLS; ++cell) {
+			mean += density[cell];
+			squares += (double)density[cell] * density[cell];
+		}
+		mean /= DENSITY_CELLS;
+		double variance = std::max(0.0, squares / DENSITY_CELLS - mean * mean);
+		densitySpread = mean > 0.0 ? (float)(std::sqrt(variance) / mean) : 0.0f;
+	}
+	std::copy(borderPressure, borderPressure + SIDE_COUNT, sample.borderPressure);
+	sample.meanSpeed = meanSpeed;
+	sample.densitySpread = densitySpread;
+
+	if (history.size() < ANALYTICS_HISTORY) {
+		history.push_back(sample);
+	} else {
+		history[historyStart] = sample;
+		historyStart = (historyStart + 1) % ANALYTICS_HISTORY;
+	}
+	++ticks;
+	SetSampling(tick + 1);
+}
+
+void SceneAnalytics::ClearWalls() {
+	wallHits.clear();
+	wallImpulse.clear();
+	for (auto& accumulator : accumulators) {
+		accumulator.wallHits.clear();
+		accumulator.wallImpulse.clear();
+	}
+}
+
+void SceneAnalytics::Reset() {
+	std::fill(wallHits.begin(), wallHits.end(), 0);
+	std::fill(wallImpulse.begin(), wallImpulse.end(), 0.0);
+	std::fill(density, density + DENSITY_CELLS, 0);
+	std::fill(speeds, speeds + SPEED_BINS, 0);
+	std::fill(borderPressure, borderPressure + SIDE_COUNT, 0.0f);
+	meanSpeed = 0.0f;
+	densitySpread = 0.0f;
+	history.clear();
+	historyStart = 0;
+	ticks = 0;
+}
+
+void SceneAnalytics::CopyHistory(std::vector<AnalyticsSample>& out, size_t limit) const {
+	size_t count = std::min(limit, history.size());
+	out.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = history[(historyStart + history.size() - count + i) % history.size()];
+	}
+}
+
+bool SceneAnalytics::WriteCsv(const char* prefix) const {
+	std::string base(prefix);
+
+	std::ofstream series(base + "-ticks.csv", std::ios::trunc);
+	series << "tick,particles,wall_hits,wall_impulse,pressure_left,pressure_right,pressure_top,pressure_bottom,mean_speed,density_spread\n";
+	std::vector<AnalyticsSample> samples;
+	CopyHistory(samples);
+	for (const auto& sample : samples) {
+		series << sample.tick << ',' << sample.particles << ',' << sample.wallHits << ',' << sample.wallImpulse;
+		for (int side = 0; side < SIDE_COUNT; ++side) {
+			series << ',' << sample.borderPressure[side];
+		}
+		series << ',' << sample.meanSpeed << ',' << sample.densitySpread << '\n';
+	}
+
+	std::ofstream walls(base + "-walls.csv", std::ios::trunc);
+	walls << "wall,hits,impulse\n";
+	for (size_t w = 0; w < wallHits.size(); ++w) {
+		walls << w << ',' << wallHits[w] << ',' << wallImpulse[w] << '\n';
+	}
+
+	std::ofstream grid(base + "-density.csv", std::ios::trunc);
+	for (int row = 0; row < DENSITY_ROWS; ++row) {
+		for (int column = 0; column < DENSITY_COLUMNS; ++column) {
+			grid << (column > 0 ? "," : "") << density[row * DENSITY_COLUMNS + column];
+		}
+		grid << '\n';
+	}
+
+	std::ofstream histogram(base + "-speed.csv", std::ios::trunc);
+	histogram << "min_speed,count\n";
+	for (int bin = 0; bin < SPEED_BINS; ++bin) {
+		histogram << bin * SPEED_BIN_WIDTH << ',' << speeds[bin] << '\n';
+	}
+
+	return series.good() && walls.good() && grid.good() && histogram.good();
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ParticleStore;
+class WorkerPool;
+
+// Cells of the density grid, which spans the world; 20 px square on the
+// default canvas.
+const int DENSITY_COLUMNS = 64;
+const int DENSITY_ROWS = 36;
+const int DENSITY_CELLS = DENSITY_COLUMNS * DENSITY_ROWS;
+// Speed histogram bins, in px/s; the last bin also holds everything faster.
+const float SPEED_BIN_WIDTH = 20.0f;
+const int SPEED_BINS = 50;
+// Ticks of history kept for plots and CSV export, a minute at 60 ticks per second.
+const size_t ANALYTICS_HISTORY = 3600;
+// Ticks between samples of the density grid, speed histogram and edge
+// pressure, four seconds at 60 ticks per second. Sampling reads every
+// particle and scatters it into two sets of bins, several times the cost of
+// moving it, so it runs on one tick in this many.
+const uint64_t ANALYTICS_SAMPLE_INTERVAL = 240;
+
+enum CanvasSide {
+	SIDE_LEFT = 0,
+	SIDE_RIGHT = 1,
+	SIDE_TOP = 2,
+	SIDE_BOTTOM = 3,
+	SIDE_COUNT = 4
+};
+
+// What one worker measured during the current tick. The step kernels record
+// bounces into it, and on sampling ticks the move pass samples each chunk it
+// stepped; nothing is shared, so workers never contend. Particles have unit
+// mass, so an impulse is the change of velocity in px/s.
+struct alignas(64) AnalyticsAccumulator {
+	std::vector<uint32_t> wallHits;
+	std::vector<float> wallImpulse;
+	float borderImpulse[SIDE_COUNT] = {};
+	uint32_t hits = 0;
+	float impulse = 0.0f;
+	uint32_t density[DENSITY_CELLS] = {};
+	uint32_t speeds[SPEED_BINS] = {};
+	double speedSum = 0.0;
+	uint64_t sampled = 0;
+	// World size, and density cells per pixel across and down.
+	float width = 0.0f, height = 0.0f;
+	float columnScale = 0.0f, rowScale = 0.0f;
+	// Whether the current tick samples density, speed and edge pressure.
+	bool sampling = false;
+
+	void RecordWall(uint32_t wall, float change) {
+		++wallHits[wall];
+		wallImpulse[wall] += change;
+		++hits;
+		impulse += change;
+	}
+	void RecordBorder(CanvasSide side, float change) {
+		borderImpulse[side] += change;
+	}
+	// Adds particles [begin, end) to the density grid and speed histogram.
+	void Sample(const ParticleStore& store, size_t begin, size_t end);
+};
+
+// Totals of one tick.
+struct AnalyticsSample {
+	uint64_t tick = 0;
+	float particles = 0.0f;
+	float wallHits = 0.0f;
+	float wallImpulse = 0.0f;
+	// Of the latest sampling tick. Impulse per second per pixel of edge:
+	// force per unit length.
+	float borderPressure[SIDE_COUNT] = {};
+	float meanSpeed = 0.0f;
+	// Standard deviation of the density grid over its mean; 0 when uniform.
+	float densitySpread = 0.0f;
+};
+
+// Measurements taken inside the step (see Simulation::collectAnalytics):
+// per-wall hit counts and momentum transfer, pressure on each canvas edge,
+// a coarse density grid and a speed histogram. The per-tick totals are
+// merged at the barrier between ticks, so analytics do not break up a fused
+// run of ticks. The density grid, speed histogram and edge pressure are
+// sampled every ANALYTICS_SAMPLE_INTERVAL ticks, and the per-wall bins are
+// merged by a parallel reduction after each step. Counts are the same for
+// any number of threads; impulse sums are floats added per worker and per
+// SIMD lane, so they can differ in the last digits.
+class SceneAnalytics {
+public:
+	// Sizes the accumulators for a step from `tick` in a world of the given
+	// size; allocates only when the worker or wall count grew.
+	void Prepare(size_t workers, size_t wallCount, float width, float height, uint64_t tick);
+	AnalyticsAccumulator* GetAccumulator(size_t worker) { return &accumulators[worker]; }
+	// Merges and clears the tick's totals, and its samples on a sampling
+	// tick, and appends the tick's sample. Serial and cheap, for the barrier
+	// between ticks.
+	void EndTick(uint64_t tick, size_t particles, float deltaTime, float width, float height);
+	// Merges and clears the per-wall bins; after the last tick of a step.
+	void Flush(WorkerPool& pool);
+	// Walls were removed, so the per-wall totals no longer line up.
+	void ClearWalls();
+	void Reset();
+
+	// Since the last Reset, indexed like Simulation::walls.
+	const std::vector<uint64_t>& GetWallHits() const { return wallHits; }
+	const std::vector<double>& GetWallImpulse() const { return wallImpulse; }
+	// Of the latest sampling tick.
+	const uint32_t* GetDensity() const { return density; }
+	const uint32_t* GetSpeedHistogram() const { return speeds; }
+	// Ticks merged since the last Reset.
+	uint64_t GetTickCount() const { return ticks; }
+	// The latest `limit` samples, oldest first.
+	void CopyHistory(std::vector<AnalyticsSample>& out, size_t limit = ANALYTICS_HISTORY) const;
+
+	// Writes PREFIX-ticks.csv (the history), PREFIX-walls.csv,
+	// PREFIX-density.csv and PREFIX-speed.csv; false on I/O errors.
+	bool WriteCsv(const char* prefix) const;
+
+private:
+	// Whether the tick that ends at `tick` samples: one in
+	// ANALYTICS_SAMPLE_INTERVAL, and the first after a Reset.
+	bool SamplesTick(uint64_t tick) const { return ticks == 0 || tick % ANALYTICS_SAMPLE_INTERVAL == 0; }
+	void SetSampling(uint64_t tick);
+	void ReduceRange(size_t begin, size_t end);
+
+	std::vector<AnalyticsAccumulator> accumulators;
+	size_t workerCount = 0;
+
+	std::vector<uint64_t> wallHits;
+	std::vector<double> wallImpulse;
+	uint32_t density[DENSITY_CELLS] = {};
+	uint32_t speeds[SPEED_BINS] = {};
+
+	float borderPressure[SIDE_COUNT] = {};
+	float meanSpeed = 0.0f;
+	float densitySpread = 0.0f;
+
+	// Ring of the latest ANALYTICS_HISTORY samples.
+	std::vector<AnalyticsSample> history;
+	size_t historyStart = 0;
+	uint64_t ticks = 0;
+};
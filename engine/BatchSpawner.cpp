@@ -0,0 +1,213 @@
+#include "BatchSpawner.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Particles handed to a generator worker at a time.
+const size_t BATCH_CHUNK_SIZE = 4096;
+// Redraws of a random position before it is pushed out of the wall instead.
+const uint32_t MAX_SPAWN_ATTEMPTS = 16;
+
+// Uniform grid over the walls' bounding boxes, the shape spawns are tested
+// against. Built once per batch so each position only checks its own cell.
+class WallBoxIndex {
+public:
+	WallBoxIndex(const std::vector<Wall>& walls, float width, float height)
+		: walls(walls), cellSize(WallCellSize(width, height)) {
+		columns = std::max(1, (int)ceil(width / cellSize));
+		rows = std::max(1, (int)ceil(height / cellSize));
+		cells.resize((size_t)columns * rows);
+
+		for (size_t i = 0; i < walls.size(); ++i) {
+			const Wall& wall = walls[i];
+			// Boxes are start-to-end, as in the original spawn test, so a
+			// wall drawn right-to-left or top-to-bottom encloses nothing.
+			if (wall.startX > wall.endX || wall.startY > wall.endY) {
+				continue;
+			}
+			for (int cy = CellY(wall.startY); cy <= CellY(wall.endY); ++cy) {
+				for (int cx = CellX(wall.startX); cx <= CellX(wall.endX); ++cx) {
+					cells[(size_t)cy * columns + cx].push_back((uint32_t)i);
+				}
+			}
+		}
+	}
+
+	// First wall, in insertion order, whose box contains the point.
+	const Wall* Find(float x, float y) const {
+		for (uint32_t wallIndex : cells[(size_t)CellY(y) * columns + CellX(x)]) {
+			const Wall& wall = walls[wallIndex];
+			if (x >= wall.startX && x <= wall.endX &&
+				y >= wall.startY && y <= wall.endY) {
+				return &wall;
+			}
+		}
+		return nullptr;
+	}
+
+private:
+	int CellX(float x) const {
+		return std::min(std::max((int)floor(x / cellSize), 0), columns - 1);
+	}
+
+	int CellY(float y) const {
+		return std::min(std::max((int)floor(y / cellSize), 0), rows - 1);
+	}
+
+	const std::vector<Wall>& walls;
+	float cellSize;
+	int columns, rows;
+	std::vector<std::vector<uint32_t>> cells;
+};
+
+static void randomPosition(const BatchSpec& spec, const RandomBlock& random, float width, float height, float& x, float& y) {
+	if (spec.variation == BATCH_RANDOM_NORMAL) {
+		// Box-Muller around the middle of the range; the range spans six sigma.
+		float radius = sqrt(-2.0f * log(1.0f - RandomUnit(random.v[0])));
+		float theta = 2.0f * PI * RandomUnit(random.v[1]);
+		x = (spec.startX + spec.endX) * 0.5f + radius * cos(theta) * (spec.endX - spec.startX) / 6.0f;
+		y = (spec.startY + spec.endY) * 0.5f + radius * sin(theta) * (spec.endY - spec.startY) / 6.0f;
+	} else {
+		x = RandomRange(random.v[0], spec.startX, spec.endX);
+		y = RandomRange(random.v[1], spec.startY, spec.endY);
+	}
+	x = std::min(std::max(x, 0.0f), width);
+	y = std::min(std::max(y, 0.0f), height);
+}
+
+static void generateRange(const BatchSpec& spec, const WallBoxIndex& boxes, float width, float height, uint64_t seed,
+	uint32_t batchNumber, ParticleBatch& batch, size_t begin, size_t end) {
+	int steps = std::max(spec.count - 1, 1);
+	float dX = (spec.endX - spec.startX) / steps;
+	float dY = (spec.endY - spec.startY) / steps;
+	float dAngle = (spec.endAngle - spec.startAngle) / steps;
+	float dVelocity = (spec.endVelocity - spec.startVelocity) / steps;
+
+	for (size_t i = begin; i < end; ++i) {
+		float x = spec.startX;
+		float y = spec.startY;
+		float angle = spec.startAngle;
+		float velocity = spec.startVelocity;
+
+		switch (spec.variation) {
+			case BATCH_VARY_POSITION: {
+				x += i * dX;
+				y += i * dY;
+				const Wall* collidingWall = boxes.Find(x, y);
+				if (collidingWall) {
+					x = PushOutOfWall(*collidingWall, x, width);
+				}
+				break;
+			}
+			case BATCH_VARY_ANGLE:
+				angle = fmod(spec.startAngle + i * dAngle, 360.0f);
+				break;
+			case BATCH_VARY_VELOCITY:
+				velocity += i * dVelocity;
+				break;
+			case BATCH_RANDOM_UNIFORM:
+			case BATCH_RANDOM_NORMAL: {
+				RandomBlock random;
+				const Wall* collidingWall = nullptr;
+				uint32_t attempt = 0;
+				do {
+					random = RandomFor(seed, (uint32_t)i, batchNumber, RANDOM_SPAWN_BATCH, attempt++);
+					randomPosition(spec, random, width, height, x, y);
+					collidingWall = boxes.Find(x, y);
+				} while (collidingWall && attempt < MAX_SPAWN_ATTEMPTS);
+				if (collidingWall) {
+					x = PushOutOfWall(*collidingWall, x, width);
+				}
+				angle = RandomRange(random.v[2], spec.startAngle, spec.endAngle);
+				velocity = RandomRange(random.v[3], spec.startVelocity, spec.endVelocity);
+				break;
+			}
+		}
+
+		batch.x[i] = x;
+		batch.y[i] = y;
+		HeadingToVelocity(angle, velocity, batch.vx[i], batch.vy[i]);
+	}
+}
+
+void GenerateBatch(const BatchSpec& spec, const std::vector<Wall>& walls, float width, float height, uint64_t seed,
+	uint32_t batchNumber, WorkerPool& pool, ParticleBatch& batch, std::atomic<size_t>* progress) {
+	size_t count = (size_t)std::max(spec.count, 0);
+	batch.x.resize(count);
+	batch.y.resize(count);
+	batch.vx.resize(count);
+	batch.vy.resize(count);
+
+	WallBoxIndex boxes(walls, width, height);
+	pool.ParallelFor(count, BATCH_CHUNK_SIZE, [&](size_t begin, size_t end, size_t) {
+		generateRange(spec, boxes, width, height, seed, batchNumber, batch, begin, end);
+		if (progress) {
+			progress->fetch_add(end - begin, std::memory_order_relaxed);
+		}
+	});
+}
+
+BatchSpawner::BatchSpawner(size_t numThreads)
+	: pool(numThreads, "spawn worker") {}
+
+BatchSpawner::~BatchSpawner() {
+	if (worker.joinable()) {
+		worker.join();
+	}
+}
+
+void BatchSpawner::Start(const BatchSpec& batchSpec, Simulation& sim) {
+	if (busy) {
+		queued.push_back(batchSpec);
+		queuedCount.store(queued.size(), std::memory_order_relaxed);
+		return;
+	}
+	Generate(batchSpec, sim);
+}
+
+void BatchSpawner::Generate(const BatchSpec& batchSpec, Simulation& sim) {
+	if (worker.joinable()) {
+		worker.join();
+	}
+
+	spec = batchSpec;
+	seed = sim.seed;
+	batchNumber = sim.NextBatchNumber();
+	walls = sim.walls;
+	width = sim.GetWidth();
+	height = sim.GetHeight();
+	total.store((size_t)std::max(spec.count, 0), std::memory_order_relaxed);
+	generated.store(0, std::memory_order_relaxed);
+	ready.store(false, std::memory_order_relaxed);
+	busy.store(true, std::memory_order_release);
+
+	worker = std::thread([this] {
+		GenerateBatch(spec, walls, width, height, seed, batchNumber, pool, batch, &generated);
+		ready.store(true, std::memory_order_release);
+	});
+}
+
+float BatchSpawner::GetProgress() const {
+	size_t count = total.load(std::memory_order_relaxed);
+	return count > 0 ? (float)generated.load(std::memory_order_relaxed) / count : 1.0f;
+}
+
+bool BatchSpawner::Commit(Simulation& sim) {
+	if (!busy || !ready.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	worker.join();
+	sim.CommitBatch(batch);
+	batch = ParticleBatch();
+	if (queued.empty()) {
+		busy.store(false, std::memory_order_release);
+	} else {
+		BatchSpec next = queued.front();
+		queued.pop_front();
+		queuedCount.store(queued.size(), std::memory_order_relaxed);
+		Generate(next, sim);
+	}
+	return true;
+}
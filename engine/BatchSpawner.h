@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "Simulation.h"
+#include "WorkerPool.h"
+
+// Particles generated for a batch, waiting to be appended to a ParticleStore.
+struct ParticleBatch {
+	std::vector<float> x, y;
+	std::vector<float> vx, vy;
+
+	size_t Size() const { return x.size(); }
+};
+
+// Fills `batch` with spec.count particles, generated in parallel on `pool`,
+// inside a world of the given size. Positions that land inside a wall's
+// bounding box are moved out (the
+// interpolated modes) or redrawn (the random modes), testing each position
+// only against the walls indexed in its cell. Random draws are keyed by
+// (seed, batchNumber, particle index), so the result does not depend on the
+// pool size. `progress`, when given, counts generated particles as they finish.
+void GenerateBatch(const BatchSpec& spec, const std::vector<Wall>& walls, float width, float height, uint64_t seed,
+	uint32_t batchNumber, WorkerPool& pool, ParticleBatch& batch, std::atomic<size_t>* progress = nullptr);
+
+// Generates one batch at a time on a background thread and its own worker
+// pool, so a million-particle batch never stalls the frame. Batches started
+// while one is in flight wait in a queue. The walls and world size are
+// snapshotted when a batch starts generating; the finished particles are only
+// appended by Commit, which the owner calls between steps.
+class BatchSpawner {
+public:
+	explicit BatchSpawner(size_t numThreads = 0);
+	~BatchSpawner();
+
+	BatchSpawner(const BatchSpawner&) = delete;
+	BatchSpawner& operator=(const BatchSpawner&) = delete;
+
+	// Starts generating the batch, or queues it behind the one in flight.
+	void Start(const BatchSpec& spec, Simulation& sim);
+
+	// True from Start until the last queued batch is committed. Busy,
+	// GetQueued and GetProgress may be polled from another thread than the
+	// one that starts and commits.
+	bool Busy() const { return busy.load(std::memory_order_acquire); }
+	// Batches waiting behind the one in flight.
+	size_t GetQueued() const { return queuedCount.load(std::memory_order_relaxed); }
+	// Generated fraction of the batch in flight, 0 to 1.
+	float GetProgress() const;
+
+	// Appends a finished batch to `sim` and starts the next queued one.
+	// Returns false if none is ready.
+	bool Commit(Simulation& sim);
+
+private:
+	void Generate(const BatchSpec& spec, Simulation& sim);
+
+	WorkerPool pool;
+	std::thread worker;
+	std::atomic<bool> busy{ false };
+	std::atomic<bool> ready{ false };
+	std::atomic<size_t> generated{ 0 };
+	std::atomic<size_t> total{ 0 };
+	std::deque<BatchSpec> queued;
+	std::atomic<size_t> queuedCount{ 0 };
+
+	BatchSpec spec;
+	uint64_t seed = 0;
+	uint32_t batchNumber = 0;
+	std::vector<Wall> walls;
+	float width = 0.0f, height = 0.0f;
+	ParticleBatch batch;
+};
@@ -0,0 +1,209 @@
+#include "Checkpoint.h"
+#include "Simulation.h"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Copy-on-write mapping of a whole file: pages are read on first touch and a
+// write only changes the process's copy, never the file.
+class MappedFile {
+public:
+	~MappedFile() {
+#if defined(_WIN32)
+		if (data) {
+			UnmapViewOfFile(data);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+#else
+		if (data) {
+			munmap(data, size);
+		}
+#endif
+	}
+
+	bool Open(const char* path) {
+#if defined(_WIN32)
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER fileSize;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			return false;
+		}
+		size = (size_t)fileSize.QuadPart;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (!mapping) {
+			return false;
+		}
+		data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		return data != nullptr;
+#else
+		int descriptor = open(path, O_RDONLY);
+		if (descriptor < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+			close(descriptor);
+			return false;
+		}
+		size = (size_t)info.st_size;
+		void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+		close(descriptor);
+		if (address == MAP_FAILED) {
+			return false;
+		}
+		data = address;
+		return true;
+#endif
+	}
+
+	unsigned char* Data() const { return (unsigned char*)data; }
+	size_t Size() const { return size; }
+
+private:
+	void* data = nullptr;
+	size_t size = 0;
+#if defined(_WIN32)
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+};
+
+static uint64_t alignUp(uint64_t value) {
+	return (value + PARTICLE_ALIGNMENT - 1) / PARTICLE_ALIGNMENT * PARTICLE_ALIGNMENT;
+}
+
+static void writePadding(std::ofstream& file, uint64_t from, uint64_t to) {
+	static const char zeros[PARTICLE_ALIGNMENT] = {};
+	file.write(zeros, (std::streamsize)(to - from));
+}
+
+bool Simulation::SaveCheckpoint(const char* path) const {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+
+	// Compact particles are saved as floats, so a checkpoint loads in either
+	// storage, and event-mode positions as of now.
+	ParticleStore expanded;
+	bool current = StoreIsCurrent();
+	if (!current) {
+		ExportParticles(expanded);
+	}
+	const ParticleStore& saved = current ? particles : expanded;
+
+	size_t count = saved.Size();
+	uint64_t stride = (count + PARTICLE_PADDING - 1) / PARTICLE_PADDING * PARTICLE_PADDING;
+	uint64_t wallBytes = walls.size() * 4 * sizeof(float);
+
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.byteOrder = CHECKPOINT_BYTE_ORDER;
+	header.seed = seed;
+	header.tick = tick;
+	header.particleCount = count;
+	header.particleStride = stride;
+	header.particleOffset = alignUp(sizeof(header) + wallBytes);
+	header.wallCount = walls.size();
+	header.nextParticleId = particles.GetNextId();
+	header.particleSpawns = particleSpawns;
+	header.wallSpawns = wallSpawns;
+	header.batchSpawns = batchSpawns;
+	header.collisionMode = collisionMode;
+	header.flags = particleCollisions ? CHECKPOINT_PARTICLE_COLLISIONS : 0;
+	header.particleRadius = particleRadius;
+	header.worldWidth = width;
+	header.worldHeight = height;
+	file.write((const char*)&header, sizeof(header));
+
+	for (const auto& wall : walls) {
+		float coordinates[4] = { wall.startX, wall.startY, wall.endX, wall.endY };
+		file.write((const char*)coordinates, sizeof(coordinates));
+	}
+	writePadding(file, sizeof(header) + wallBytes, header.particleOffset);
+
+	// Arrays are written with their padding lanes so each one starts aligned.
+	std::vector<char> zeros((size_t)(stride - count) * sizeof(float));
+	const float* arrays[4] = { saved.x.Data(), saved.y.Data(), saved.vx.Data(), saved.vy.Data() };
+	for (const float* array : arrays) {
+		file.write((const char*)array, count * sizeof(float));
+		file.write(zeros.data(), zeros.size());
+	}
+	file.write((const char*)saved.id.Data(), count * sizeof(uint32_t));
+	file.write(zeros.data(), zeros.size());
+
+	return (bool)file;
+}
+
+bool Simulation::LoadCheckpoint(const char* path) {
+	std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>();
+	if (!mapped->Open(path) || mapped->Size() < sizeof(CheckpointHeader)) {
+		return false;
+	}
+
+	CheckpointHeader header;
+	memcpy(&header, mapped->Data(), sizeof(header));
+	if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != CHECKPOINT_VERSION || header.byteOrder != CHECKPOINT_BYTE_ORDER) {
+		return false;
+	}
+
+	uint64_t wallBytes = header.wallCount * 4 * sizeof(float);
+	uint64_t arrayBytes = header.particleStride * sizeof(float);
+	if (header.particleStride < header.particleCount || header.particleStride % PARTICLE_PADDING != 0 ||
+		header.particleOffset % PARTICLE_ALIGNMENT != 0 || header.particleOffset < sizeof(header) + wallBytes ||
+		header.particleOffset + 5 * arrayBytes > mapped->Size()) {
+		return false;
+	}
+
+	// A checkpoint's particles were saved inside its world, so unlike a
+	// resize nothing is clamped and the mapped arrays stay unread. The grid
+	// is sized before the walls go in.
+	ClearWalls();
+	SetBounds(header.worldWidth > 0.0f ? header.worldWidth : CANVAS_WIDTH,
+		header.worldHeight > 0.0f ? header.worldHeight : CANVAS_HEIGHT);
+	const float* wallTable = (const float*)(mapped->Data() + sizeof(header));
+	for (uint64_t i = 0; i < header.wallCount; ++i) {
+		AddWall(wallTable[i * 4], wallTable[i * 4 + 1], wallTable[i * 4 + 2], wallTable[i * 4 + 3]);
+	}
+
+	unsigned char* block = mapped->Data() + header.particleOffset;
+	float* x = (float*)block;
+	float* y = (float*)(block + arrayBytes);
+	float* vx = (float*)(block + 2 * arrayBytes);
+	float* vy = (float*)(block + 3 * arrayBytes);
+	uint32_t* ids = (uint32_t*)(block + 4 * arrayBytes);
+	particles.Adopt(mapped, x, y, vx, vy, ids, (size_t)header.particleCount, (size_t)header.particleStride, header.nextParticleId);
+	compact.Clear();
+
+	seed = header.seed;
+	tick = header.tick;
+	particleSpawns = header.particleSpawns;
+	wallSpawns = header.wallSpawns;
+	batchSpawns = header.batchSpawns;
+	collisionMode = header.collisionMode <= COLLISION_EVENT ? (CollisionMode)header.collisionMode : COLLISION_SWEPT;
+	particleCollisions = (header.flags & CHECKPOINT_PARTICLE_COLLISIONS) != 0;
+	particleRadius = header.particleRadius;
+	events.Invalidate(particles);
+	return true;
+}
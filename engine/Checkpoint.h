@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout of a scene checkpoint, little-endian throughout:
+//
+//   CheckpointHeader
+//   wall table     wallCount x { startX, startY, endX, endY } floats
+//   particle block at particleOffset (PARTICLE_ALIGNMENT aligned): the x, y,
+//                  vx, vy float arrays and the id array, each particleStride
+//                  elements long and each starting PARTICLE_ALIGNMENT aligned
+//
+// The particle block is exactly the ParticleStore layout, so loading maps
+// the file and adopts the arrays in place instead of parsing them.
+// Simulation::SaveCheckpoint and Simulation::LoadCheckpoint read and write it.
+
+const char CHECKPOINT_MAGIC[8] = { 'P', 'S', 'I', 'M', 'C', 'K', 'P', 'T' };
+const uint32_t CHECKPOINT_VERSION = 1;
+// Written as a native integer; reads back differently on a big-endian host.
+const uint32_t CHECKPOINT_BYTE_ORDER = 0x01020304u;
+
+const uint32_t CHECKPOINT_PARTICLE_COLLISIONS = 1u << 0;
+
+struct CheckpointHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t seed;
+	uint64_t tick;
+	uint64_t particleCount;
+	uint64_t particleStride;
+	uint64_t particleOffset;
+	uint64_t wallCount;
+	uint32_t nextParticleId;
+	uint32_t particleSpawns;
+	uint32_t wallSpawns;
+	uint32_t batchSpawns;
+	uint32_t collisionMode;
+	uint32_t flags;
+	float particleRadius;
+	// 0 in checkpoints written before the world size was configurable, which
+	// load as the default CANVAS_WIDTH x CANVAS_HEIGHT.
+	float worldWidth;
+	float worldHeight;
+	uint32_t reserved[7];
+};
+
+static_assert(sizeof(CheckpointHeader) == 128, "checkpoint header layout changed");
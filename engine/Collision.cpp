@@ -0,0 +1,51 @@
+#include "Collision.h"
+#include "Simulation.h"
+
+#include <cmath>
+
+bool SweepWall(const Wall& wall, float x, float y, float dx, float dy, float& t, float& nx, float& ny) {
+	float ex = wall.endX - wall.startX;
+	float ey = wall.endY - wall.startY;
+
+	float denominator = dx * ey - dy * ex;
+	if (denominator == 0.0f) {
+		return false;
+	}
+
+	float ax = wall.startX - x;
+	float ay = wall.startY - y;
+	float hitT = (ax * ey - ay * ex) / denominator;
+	float hitS = (ax * dy - ay * dx) / denominator;
+
+	if (hitT <= MIN_IMPACT_TIME || hitT > 1.0f || hitS < -ENDPOINT_SLACK || hitS > 1.0f + ENDPOINT_SLACK) {
+		return false;
+	}
+
+	float length = sqrt(ex * ex + ey * ey);
+	nx = -ey / length;
+	ny = ex / length;
+	if (nx * dx + ny * dy > 0) {
+		nx = -nx;
+		ny = -ny;
+	}
+	t = hitT;
+	return true;
+}
+
+bool CrossesWall(const Wall& wall, float x0, float y0, float x1, float y1) {
+	float dx = x1 - x0;
+	float dy = y1 - y0;
+	float ex = wall.endX - wall.startX;
+	float ey = wall.endY - wall.startY;
+
+	float denominator = dx * ey - dy * ex;
+	if (denominator == 0.0f) {
+		return false;
+	}
+
+	float ax = wall.startX - x0;
+	float ay = wall.startY - y0;
+	float t = (ax * ey - ay * ex) / denominator;
+	float s = (ax * dy - ay * dx) / denominator;
+	return t > 0.0f && t < 1.0f && s >= 0.0f && s <= 1.0f;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+class Wall;
+
+// Distance, in pixels, a bouncing particle stops short of the wall it hit so
+// the next sweep starts strictly on the near side. Moves are swept this far
+// past their end, and wall jitter keeps at least half of it from any wall.
+const float COLLISION_SKIN = 1e-3f;
+// Upper bound on wall/border bounces resolved inside a single step.
+const int MAX_BOUNCES_PER_STEP = 8;
+// Relative slack on the wall parameter so shared endpoints are covered.
+const float ENDPOINT_SLACK = 1e-5f;
+// Ignores re-hits at the very start of a move, which come from rounding.
+const float MIN_IMPACT_TIME = 1e-6f;
+
+// Swept test of the move (x, y) -> (x + dx, y + dy) against a wall segment.
+// On a hit, t is the fraction of the move at impact and (nx, ny) the unit
+// wall normal facing the side the particle came from. Hits within a hair of
+// either endpoint still count, so walls that share an endpoint leave no gap.
+bool SweepWall(const Wall& wall, float x, float y, float dx, float dy, float& t, float& nx, float& ny);
+
+// True when the straight move crosses the wall segment. Used to count
+// tunneling: a particle that ends a tick on the far side of a wall.
+bool CrossesWall(const Wall& wall, float x0, float y0, float x1, float y1);
@@ -0,0 +1,122 @@
+#include "CompactStore.h"
+#include "Kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static int16_t encodePosition(float value, float unit) {
+	long steps = std::min<long>(std::max<long>(lrintf(value / unit), 0), COMPACT_POSITION_STEPS);
+	return (int16_t)(steps - COMPACT_POSITION_OFFSET);
+}
+
+static float decodePosition(int16_t value, float unit) {
+	return (value + COMPACT_POSITION_OFFSET) * unit;
+}
+
+static int16_t encodeVelocity(float value, float inverseScale) {
+	long units = lrintf(value * inverseScale);
+	return (int16_t)std::min<long>(std::max<long>(units, -COMPACT_VELOCITY_MAX), COMPACT_VELOCITY_MAX);
+}
+
+size_t CompactStore::GetBytes() const {
+	return capacity * (4 * sizeof(int16_t) + sizeof(uint32_t));
+}
+
+void CompactStore::Reserve(size_t minCapacity) {
+	if (minCapacity <= capacity) {
+		return;
+	}
+
+	size_t newCapacity = (minCapacity + PARTICLE_PADDING - 1) / PARTICLE_PADDING * PARTICLE_PADDING;
+	x.Reallocate(newCapacity, count);
+	y.Reallocate(newCapacity, count);
+	vx.Reallocate(newCapacity, count);
+	vy.Reallocate(newCapacity, count);
+	id.Reallocate(newCapacity, count);
+	capacity = newCapacity;
+}
+
+void CompactStore::Rescale(float newScale) {
+	float ratio = velocityScale / newScale;
+	for (size_t i = 0; i < count; ++i) {
+		vx[i] = encodeVelocity(vx[i] * ratio, 1.0f);
+		vy[i] = encodeVelocity(vy[i] * ratio, 1.0f);
+	}
+	velocityScale = newScale;
+}
+
+void CompactStore::Append(const ParticleStore& from, float worldWidth, float worldHeight) {
+	size_t n = from.Size();
+	if (n == 0) {
+		return;
+	}
+	if (count == 0) {
+		unitX = worldWidth / COMPACT_POSITION_STEPS;
+		unitY = worldHeight / COMPACT_POSITION_STEPS;
+	}
+
+	float fastest = count > 0 ? velocityScale * COMPACT_VELOCITY_MAX : 0.0f;
+	float newFastest = fastest;
+	for (size_t i = 0; i < n; ++i) {
+		newFastest = std::max(newFastest, std::max(std::fabs(from.vx[i]), std::fabs(from.vy[i])));
+	}
+	if (newFastest > fastest) {
+		float newScale = newFastest > 0.0f ? newFastest / COMPACT_VELOCITY_MAX : 1.0f;
+		if (count > 0) {
+			Rescale(newScale);
+		}
+		velocityScale = newScale;
+	}
+
+	if (count + n > capacity) {
+		Reserve(std::max(count + n, capacity * 2));
+	}
+	float inverseScale = 1.0f / velocityScale;
+	for (size_t i = 0; i < n; ++i) {
+		x[count + i] = encodePosition(from.x[i], unitX);
+		y[count + i] = encodePosition(from.y[i], unitY);
+		vx[count + i] = encodeVelocity(from.vx[i], inverseScale);
+		vy[count + i] = encodeVelocity(from.vy[i], inverseScale);
+		id[count + i] = from.id[i];
+	}
+	count += n;
+}
+
+void CompactStore::ExpandInto(ParticleStore& to) const {
+	to.Reserve(to.Size() + count);
+	for (size_t i = 0; i < count; ++i) {
+		to.AddWithId(decodePosition(x[i], unitX), decodePosition(y[i], unitY), vx[i] * velocityScale, vy[i] * velocityScale, id[i]);
+	}
+}
+
+void CompactStore::CopyParticles(float* px, float* py, float* pvx, float* pvy, uint32_t* ids, size_t limit) const {
+	size_t n = std::min(count, limit);
+	for (size_t i = 0; i < n; ++i) {
+		px[i] = decodePosition(x[i], unitX);
+		py[i] = decodePosition(y[i], unitY);
+	}
+	if (pvx && pvy) {
+		for (size_t i = 0; i < n; ++i) {
+			pvx[i] = vx[i] * velocityScale;
+			pvy[i] = vy[i] * velocityScale;
+		}
+	}
+	if (ids) {
+		memcpy(ids, id.Data(), n * sizeof(uint32_t));
+	}
+}
+
+void CompactStore::Decode(size_t begin, size_t end, ParticleStore& scratch) const {
+	size_t n = end - begin;
+	scratch.Resize(n);
+	DecodeCompact(x.Data() + begin, y.Data() + begin, vx.Data() + begin, vy.Data() + begin,
+		scratch.x.Data(), scratch.y.Data(), scratch.vx.Data(), scratch.vy.Data(), n, unitX, unitY, velocityScale);
+	memcpy(scratch.id.Data(), id.Data() + begin, n * sizeof(uint32_t));
+}
+
+void CompactStore::Encode(size_t begin, size_t end, const ParticleStore& scratch, uint64_t tick) {
+	EncodeCompact(scratch.x.Data(), scratch.y.Data(), scratch.vx.Data(), scratch.vy.Data(), scratch.id.Data(),
+		x.Data() + begin, y.Data() + begin, vx.Data() + begin, vy.Data() + begin, end - begin,
+		unitX, unitY, velocityScale, tick);
+}
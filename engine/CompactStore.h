@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ParticleStore.h"
+
+// Largest magnitude of a compact velocity component.
+const int32_t COMPACT_VELOCITY_MAX = 32767;
+
+// Quantized particle storage for runs too large for the float arrays.
+// Positions are int16 steps of width / 65535 and height / 65535, about
+// 1/51 px across a 1280 px world, so worlds of any size fit. Encoding after
+// a tick rounds up or down at random (see EncodeCompact), so a particle
+// moving less than a step per tick still moves on average instead of
+// sticking. Velocities are int16 components times one scale shared by the
+// whole store, chosen so the fastest component just fits, which keeps each
+// component to within scale / 2 of its float value. That is 8 bytes of
+// state plus the 4 byte id per particle, against 20 bytes in a
+// ParticleStore.
+//
+// Kernels never see this layout: Simulation decodes a chunk into a small
+// float store, steps it and encodes it back, trading a little arithmetic
+// for a smaller stream through memory.
+class CompactStore {
+public:
+	AlignedArray<int16_t> x, y, vx, vy;
+	AlignedArray<uint32_t> id;
+
+	size_t Size() const { return count; }
+	bool Empty() const { return count == 0; }
+	void Clear() { count = 0; }
+	// Bytes allocated for particles.
+	size_t GetBytes() const;
+	// Pixels/sec per velocity unit.
+	float GetVelocityScale() const { return velocityScale; }
+
+	// Appends every particle in `from`, ids included, rounding positions to
+	// the nearest step. An empty store takes the world size given; otherwise
+	// it must match the one the store holds. A particle faster than the
+	// current scale allows rescales the velocities already stored.
+	void Append(const ParticleStore& from, float worldWidth, float worldHeight);
+	// Appends every particle to `to` as floats, keeping ids.
+	void ExpandInto(ParticleStore& to) const;
+	// Writes the first `limit` particles in storage order as floats; null
+	// outputs are skipped.
+	void CopyParticles(float* px, float* py, float* pvx, float* pvy, uint32_t* ids, size_t limit) const;
+
+	// Replaces `scratch` with particles [begin, end) as floats, and writes it
+	// back after stepping `tick`, which keys the rounding. Distinct ranges
+	// may be coded concurrently.
+	void Decode(size_t begin, size_t end, ParticleStore& scratch) const;
+	void Encode(size_t begin, size_t end, const ParticleStore& scratch, uint64_t tick);
+
+private:
+	void Reserve(size_t minCapacity);
+	void Rescale(float newScale);
+
+	size_t count = 0;
+	size_t capacity = 0;
+	float velocityScale = 1.0f;
+	// Pixels per position step.
+	float unitX = 1.0f;
+	float unitY = 1.0f;
+};
@@ -0,0 +1,280 @@
+#include "EventScheduler.h"
+#include "Simulation.h"
+#include "WorkerPool.h"
+#include "Collision.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+const int32_t IMPACT_NONE = -1;
+const int32_t IMPACT_BORDER_X = -2;
+const int32_t IMPACT_BORDER_Y = -3;
+const int32_t IMPACT_BORDER_XY = -4;
+
+// Particles handed to a worker at a time.
+const size_t EVENT_CHUNK = 4096;
+
+const double NEVER = std::numeric_limits<double>::infinity();
+// Least time between two impacts of one particle, so a particle wedged in a
+// narrow corner cannot stall a step with ever shorter bounces.
+const double MIN_IMPACT_GAP = 1e-6;
+
+static int64_t bucketOf(double time) {
+	return (int64_t)std::floor(time / EVENT_BUCKET_SECONDS);
+}
+
+// Time until a coordinate moving at v leaves [0, limit], or infinity.
+static float timeToBorder(float position, float velocity, float limit) {
+	if (velocity > 0.0f) {
+		return std::max(0.0f, (limit - position) / velocity);
+	}
+	if (velocity < 0.0f) {
+		return std::max(0.0f, -position / velocity);
+	}
+	return std::numeric_limits<float>::infinity();
+}
+
+void EventScheduler::Schedule(size_t i, float vx, float vy, const std::vector<Wall>& walls, const WallGrid& grid,
+	int32_t excludeWall, std::vector<uint32_t>& found) {
+	float x = originX[i];
+	float y = originY[i];
+	float borderX = timeToBorder(x, vx, width);
+	float borderY = timeToBorder(y, vy, height);
+	float borderT = std::min(borderX, borderY);
+	if (!std::isfinite(borderT)) {
+		impact[i] = IMPACT_NONE;
+		nextImpact[i] = NEVER;
+		return;
+	}
+	impact[i] = borderX == borderY ? IMPACT_BORDER_XY : (borderX < borderY ? IMPACT_BORDER_X : IMPACT_BORDER_Y);
+
+	// Walls are swept along the whole straight run up to the border.
+	float dx = vx * borderT;
+	float dy = vy * borderT;
+	float hitT = 1.0f;
+	if (!grid.Empty()) {
+		grid.Query(x, y, x + dx, y + dy, found);
+		for (uint32_t wallIndex : found) {
+			float wallT, nx, ny;
+			if ((int32_t)wallIndex != excludeWall && SweepWall(walls[wallIndex], x, y, dx, dy, wallT, nx, ny) && wallT < hitT) {
+				hitT = wallT;
+				impact[i] = (int32_t)wallIndex;
+			}
+		}
+	}
+	nextImpact[i] = originTime[i] + (double)hitT * borderT;
+}
+
+void EventScheduler::Bounce(size_t i, ParticleStore& particles, const std::vector<Wall>& walls, const WallGrid& grid,
+	std::vector<uint32_t>& found) {
+	double time = nextImpact[i];
+	float vx = particles.vx[i];
+	float vy = particles.vy[i];
+	float elapsed = (float)(time - originTime[i]);
+	float x = originX[i] + vx * elapsed;
+	float y = originY[i] + vy * elapsed;
+	int32_t target = impact[i];
+	int32_t bounced = IMPACT_NONE;
+
+	if (target >= 0) {
+		// Reflect off the wall and step COLLISION_SKIN back to the side the
+		// particle came from.
+		const Wall& wall = walls[target];
+		float wx = wall.endX - wall.startX;
+		float wy = wall.endY - wall.startY;
+		float length = std::sqrt(wx * wx + wy * wy);
+		float nx = length > 0.0f ? -wy / length : 0.0f;
+		float ny = length > 0.0f ? wx / length : 0.0f;
+		if (vx * nx + vy * ny > 0.0f) {
+			nx = -nx;
+			ny = -ny;
+		}
+		float along = vx * nx + vy * ny;
+		vx -= 2 * along * nx;
+		vy -= 2 * along * ny;
+		x += nx * COLLISION_SKIN;
+		y += ny * COLLISION_SKIN;
+		bounced = target;
+	} else {
+		if (target == IMPACT_BORDER_X || target == IMPACT_BORDER_XY) {
+			x = vx > 0.0f ? width : 0.0f;
+			vx = -vx;
+		}
+		if (target == IMPACT_BORDER_Y || target == IMPACT_BORDER_XY) {
+			y = vy > 0.0f ? height : 0.0f;
+			vy = -vy;
+		}
+	}
+
+	particles.vx[i] = vx;
+	particles.vy[i] = vy;
+	originX[i] = std::min(std::max(x, 0.0f), width);
+	originY[i] = std::min(std::max(y, 0.0f), height);
+	originTime[i] = time;
+
+	Schedule(i, vx, vy, walls, grid, bounced, found);
+	nextImpact[i] = std::max(nextImpact[i], time + MIN_IMPACT_GAP);
+}
+
+void EventScheduler::Enqueue(uint32_t i) {
+	if (nextImpact[i] == NEVER) {
+		return;
+	}
+	int64_t bucket = bucketOf(nextImpact[i]);
+	if (bucket < firstBucket + EVENT_BUCKETS) {
+		buckets[(size_t)(bucket % EVENT_BUCKETS)].push_back(i);
+	} else {
+		later.emplace_back(bucket, i);
+		std::push_heap(later.begin(), later.end(), std::greater<std::pair<int64_t, uint32_t>>());
+	}
+}
+
+void EventScheduler::Rebuild(ParticleStore& particles, const std::vector<Wall>& walls, const WallGrid& grid, WorkerPool& pool) {
+	Sync(particles);
+	size_t count = particles.Size();
+	originX.assign(particles.x.Data(), particles.x.Data() + count);
+	originY.assign(particles.y.Data(), particles.y.Data() + count);
+	originTime.assign(count, now);
+	nextImpact.assign(count, NEVER);
+	impact.assign(count, IMPACT_NONE);
+
+	pool.ParallelFor(count, EVENT_CHUNK, [&](size_t begin, size_t end, size_t) {
+		std::vector<uint32_t> found;
+		for (size_t i = begin; i < end; ++i) {
+			Schedule(i, particles.vx[i], particles.vy[i], walls, grid, IMPACT_NONE, found);
+		}
+	});
+
+	buckets.resize((size_t)EVENT_BUCKETS);
+	for (auto& bucket : buckets) {
+		bucket.clear();
+	}
+	later.clear();
+	firstBucket = bucketOf(now);
+	for (size_t i = 0; i < count; ++i) {
+		Enqueue((uint32_t)i);
+	}
+	valid = true;
+}
+
+void EventScheduler::Invalidate(ParticleStore& particles) {
+	Sync(particles);
+	valid = false;
+}
+
+void EventScheduler::Sync(ParticleStore& particles) {
+	if (lagging) {
+		CopyPositions(particles, particles.x.Data(), particles.y.Data(), std::min(originX.size(), particles.Size()));
+		lagging = false;
+	}
+}
+
+void EventScheduler::CopyPositions(const ParticleStore& particles, float* x, float* y, size_t count) const {
+	for (size_t i = 0; i < count; ++i) {
+		Position(particles, i, x[i], y[i]);
+	}
+}
+
+template <typename T>
+static void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+	std::vector<T> moved(order.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		moved[i] = values[order[i]];
+	}
+	values.swap(moved);
+}
+
+void EventScheduler::Reorder(const std::vector<uint32_t>& order) {
+	if (!valid || order.size() != originX.size()) {
+		valid = false;
+		return;
+	}
+	permute(originX, order);
+	permute(originY, order);
+	permute(originTime, order);
+	permute(nextImpact, order);
+	permute(impact, order);
+
+	std::vector<uint32_t> slotOf(order.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		slotOf[order[i]] = (uint32_t)i;
+	}
+	for (auto& bucket : buckets) {
+		for (uint32_t& i : bucket) {
+			i = slotOf[i];
+		}
+	}
+	for (auto& entry : later) {
+		entry.second = slotOf[entry.second];
+	}
+}
+
+void EventScheduler::Advance(ParticleStore& particles, const std::vector<Wall>& walls, const WallGrid& grid,
+	float sceneWidth, float sceneHeight, double seconds, WorkerPool& pool, std::vector<WorkerStats>& stats) {
+	if (!valid || originX.size() != particles.Size() || width != sceneWidth || height != sceneHeight) {
+		width = sceneWidth;
+		height = sceneHeight;
+		Rebuild(particles, walls, grid, pool);
+	}
+
+	now += seconds;
+	lagging = true;
+
+	// Every bucket before the one holding `now` is due in full; that one only
+	// up to `now`, and keeps the rest.
+	int64_t lastBucket = bucketOf(now);
+	auto earliest = std::greater<std::pair<int64_t, uint32_t>>();
+	due.clear();
+	for (int64_t bucket = firstBucket; bucket <= lastBucket; ++bucket) {
+		while (!later.empty() && later.front().first < bucket + EVENT_BUCKETS) {
+			std::pop_heap(later.begin(), later.end(), earliest);
+			uint32_t i = later.back().second;
+			later.pop_back();
+			buckets[(size_t)(bucketOf(nextImpact[i]) % EVENT_BUCKETS)].push_back(i);
+		}
+		std::vector<uint32_t>& slot = buckets[(size_t)(bucket % EVENT_BUCKETS)];
+		if (bucket < lastBucket) {
+			due.insert(due.end(), slot.begin(), slot.end());
+			slot.clear();
+		} else {
+			size_t kept = 0;
+			for (uint32_t i : slot) {
+				if (nextImpact[i] <= now) {
+					due.push_back(i);
+				} else {
+					slot[kept++] = i;
+				}
+			}
+			slot.resize(kept);
+		}
+	}
+	firstBucket = lastBucket;
+
+	if (bounced.size() < stats.size()) {
+		bounced.resize(stats.size());
+	}
+	pool.ParallelFor(due.size(), EVENT_CHUNK, [&](size_t begin, size_t end, size_t workerIndex) {
+		std::vector<uint32_t> found;
+		uint64_t impacts = 0;
+		for (size_t d = begin; d < end; ++d) {
+			uint32_t i = due[d];
+			while (nextImpact[i] <= now) {
+				Bounce(i, particles, walls, grid, found);
+				++impacts;
+			}
+			bounced[workerIndex].push_back(i);
+		}
+		stats[workerIndex].impacts += impacts;
+	});
+
+	// Which worker bounced a particle only changes its place within a bucket,
+	// which no result depends on.
+	for (auto& list : bounced) {
+		for (uint32_t i : list) {
+			Enqueue(i);
+		}
+		list.clear();
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ParticleStore.h"
+
+class Wall;
+class WallGrid;
+class WorkerPool;
+struct WorkerStats;
+
+// Width of a calendar queue bucket, one tick at 60 ticks per second.
+const double EVENT_BUCKET_SECONDS = 1.0 / 60.0;
+// Buckets in the ring, about 17 s ahead at the default width.
+const int64_t EVENT_BUCKETS = 1024;
+
+// Event-driven stepping for COLLISION_EVENT. Between impacts a particle moves
+// in a straight line, so instead of moving it every tick each particle keeps
+// the point and time it last bounced plus the time of its next wall or border
+// impact, found analytically along the whole straight run. A step only
+// touches the particles with an impact inside it, so it costs O(impacts)
+// however many ticks it covers and however many particles are in flight.
+//
+// Positions are not written back by a step. They are evaluated as
+// origin + v * (t - originTime) when someone reads them (Position,
+// CopyPositions), or written into the store by Sync before anything else
+// reads or changes it.
+//
+// Particles do not interact in this mode, so only each particle's own
+// impacts have to be handled in order. Pending impacts sit in a calendar
+// queue of EVENT_BUCKET_SECONDS buckets; a step drains the buckets it covers
+// on the workers and files the particles it bounced under their next impact.
+class EventScheduler {
+public:
+	// Writes the positions back into the store (see Sync) and forces a
+	// rebuild on the next Advance. Call before particles or walls change
+	// outside Advance.
+	void Invalidate(ParticleStore& particles);
+	// Writes the current position of every scheduled particle into the
+	// store. The schedule stays valid.
+	void Sync(ParticleStore& particles);
+	// True while the store's positions lag behind the schedule.
+	bool Lagging() const { return lagging; }
+	// Follows the particles to new slots: slot i gets the state of order[i].
+	void Reorder(const std::vector<uint32_t>& order);
+
+	// Advances by `seconds`, processing every impact on the way. Velocities
+	// in `particles` are updated at each bounce; positions lag until read or
+	// synced. Impacts are counted in stats[workerIndex].impacts.
+	void Advance(ParticleStore& particles, const std::vector<Wall>& walls, const WallGrid& grid,
+		float width, float height, double seconds, WorkerPool& pool, std::vector<WorkerStats>& stats);
+
+	// Position of slot i at the current time. Only meaningful while Lagging.
+	void Position(const ParticleStore& particles, size_t i, float& x, float& y) const {
+		float elapsed = (float)(now - originTime[i]);
+		x = clampTo(originX[i] + particles.vx[i] * elapsed, width);
+		y = clampTo(originY[i] + particles.vy[i] * elapsed, height);
+	}
+	// Positions of slots [0, count) at the current time.
+	void CopyPositions(const ParticleStore& particles, float* x, float* y, size_t count) const;
+
+private:
+	static float clampTo(float value, float limit) {
+		return value < 0.0f ? 0.0f : (value > limit ? limit : value);
+	}
+
+	void Rebuild(ParticleStore& particles, const std::vector<Wall>& walls, const WallGrid& grid, WorkerPool& pool);
+	// Files particle i under the bucket of its next impact.
+	void Enqueue(uint32_t i);
+	// Finds particle i's next impact from its origin, skipping excludeWall,
+	// which it has just bounced off, and stores it in nextImpact/impact.
+	void Schedule(size_t i, float vx, float vy, const std::vector<Wall>& walls, const WallGrid& grid,
+		int32_t excludeWall, std::vector<uint32_t>& candidates);
+	void Bounce(size_t i, ParticleStore& particles, const std::vector<Wall>& walls, const WallGrid& grid,
+		std::vector<uint32_t>& candidates);
+
+	bool valid = false;
+	bool lagging = false;
+	double now = 0.0;
+	float width = 0.0f, height = 0.0f;
+
+	std::vector<float> originX, originY;
+	std::vector<double> originTime;
+	// Absolute time of the next impact, infinite for a resting particle.
+	std::vector<double> nextImpact;
+	// Wall index of the next impact, or one of the IMPACT_ border values.
+	std::vector<int32_t> impact;
+
+	// Ring of EVENT_BUCKETS buckets from bucket number firstBucket on; slot
+	// b % EVENT_BUCKETS holds the particles whose next impact is in bucket b.
+	// Impacts past the ring wait in `later`, a min-heap on bucket number.
+	std::vector<std::vector<uint32_t>> buckets;
+	int64_t firstBucket = 0;
+	std::vector<std::pair<int64_t, uint32_t>> later;
+	// Particles due in the current step, and per worker the ones it bounced.
+	std::vector<uint32_t> due;
+	std::vector<std::vector<uint32_t>> bounced;
+};
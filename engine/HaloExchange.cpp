@@ -0,0 +1,335 @@
+#include "HaloExchange.h"
+
+#if !defined(_WIN32)
+
+#include "ParticleStore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Bytes read from a socket per recv call.
+const size_t SOCKET_READ_BYTES = 64 * 1024;
+// Consumed staging bytes kept before the buffer is compacted.
+const size_t STAGING_COMPACT_BYTES = 1 << 20;
+
+struct HaloFrameHeader {
+	uint64_t tick;
+	uint64_t count;
+};
+
+// Data follows the header; head and tail count bytes ever written and read.
+struct HaloMesh::Ring {
+	alignas(64) std::atomic<uint64_t> head{ 0 };
+	alignas(64) std::atomic<uint64_t> tail{ 0 };
+
+	char* Data() { return (char*)(this + 1); }
+};
+
+static void* mapShared(size_t bytes) {
+	void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		throw std::runtime_error("could not map shared memory");
+	}
+	return memory;
+}
+
+// Spins briefly, then yields the core, then sleeps: tiles often wait only a
+// few microseconds for a neighbour, but may wait a whole tick for a slow one.
+static void waitBriefly(int& spins) {
+	++spins;
+	if (spins < 64) {
+		return;
+	}
+	if (spins < 256) {
+		std::this_thread::yield();
+		return;
+	}
+	std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+int TileLayout::TileOf(float x, float y) const {
+	int column = std::min(std::max((int)(x * columns / width), 0), columns - 1);
+	int row = std::min(std::max((int)(y * rows / height), 0), rows - 1);
+	return row * columns + column;
+}
+
+void TileLayout::Bounds(int tile, float& x0, float& y0, float& x1, float& y1) const {
+	int column = tile % columns;
+	int row = tile / columns;
+	x0 = width * column / columns;
+	x1 = width * (column + 1) / columns;
+	y0 = height * row / rows;
+	y1 = height * (row + 1) / rows;
+}
+
+std::vector<int> TileLayout::Neighbours(int tile) const {
+	std::vector<int> result;
+	int column = tile % columns;
+	int row = tile / columns;
+	for (int dy = -1; dy <= 1; ++dy) {
+		for (int dx = -1; dx <= 1; ++dx) {
+			int c = column + dx;
+			int r = row + dy;
+			if ((dx != 0 || dy != 0) && c >= 0 && c < columns && r >= 0 && r < rows) {
+				result.push_back(r * columns + c);
+			}
+		}
+	}
+	return result;
+}
+
+HaloMesh::HaloMesh(const TileLayout& layout, HaloTransport transport, size_t linkBytes)
+	: linkBytes(linkBytes) {
+	for (int tile = 0; tile < layout.Count(); ++tile) {
+		neighbours.push_back(layout.Neighbours(tile));
+		for (int neighbour : neighbours.back()) {
+			Link link;
+			link.from = tile;
+			link.to = neighbour;
+			links.push_back(link);
+		}
+	}
+
+	if (transport == HALO_SHARED_MEMORY) {
+		size_t stride = sizeof(Ring) + (linkBytes + 63) / 64 * 64;
+		sharedBytes = std::max<size_t>(stride * links.size(), 1);
+		sharedMemory = mapShared(sharedBytes);
+		for (size_t i = 0; i < links.size(); ++i) {
+			links[i].ring = new ((char*)sharedMemory + i * stride) Ring();
+		}
+		return;
+	}
+
+	// One socket pair per pair of neighbours carries both directions.
+	int bufferBytes = (int)std::min<size_t>(linkBytes, 1 << 30);
+	for (Link& link : links) {
+		if (link.from > link.to) {
+			continue;
+		}
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+			throw std::runtime_error("could not create halo socket pair");
+		}
+		for (int fd : fds) {
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+			setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufferBytes, sizeof(bufferBytes));
+			sockets.push_back(fd);
+		}
+		Link* reverse = Find(link.to, link.from);
+		link.writeFd = fds[0];
+		reverse->readFd = fds[0];
+		reverse->writeFd = fds[1];
+		link.readFd = fds[1];
+	}
+}
+
+HaloMesh::~HaloMesh() {
+	if (sharedMemory) {
+		munmap(sharedMemory, sharedBytes);
+	}
+	for (int fd : sockets) {
+		close(fd);
+	}
+}
+
+HaloMesh::Link* HaloMesh::Find(int from, int to) {
+	for (Link& link : links) {
+		if (link.from == from && link.to == to) {
+			return &link;
+		}
+	}
+	throw std::logic_error("tiles are not neighbours");
+}
+
+size_t HaloMesh::WriteSome(Link& link, const char* data, size_t bytes) {
+	if (link.ring) {
+		Ring& ring = *link.ring;
+		uint64_t head = ring.head.load(std::memory_order_relaxed);
+		uint64_t tail = ring.tail.load(std::memory_order_acquire);
+		size_t n = std::min(bytes, (size_t)(linkBytes - (head - tail)));
+		size_t offset = head % linkBytes;
+		size_t first = std::min(n, linkBytes - offset);
+		memcpy(ring.Data() + offset, data, first);
+		memcpy(ring.Data(), data + first, n - first);
+		ring.head.store(head + n, std::memory_order_release);
+		return n;
+	}
+
+	ssize_t written = send(link.writeFd, data, bytes, MSG_NOSIGNAL);
+	if (written < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			return 0;
+		}
+		throw std::runtime_error("halo link closed");
+	}
+	return (size_t)written;
+}
+
+// Moves everything waiting on the tile's incoming links into their staging.
+void HaloMesh::Pump(int tile) {
+	for (Link& link : links) {
+		if (link.to != tile) {
+			continue;
+		}
+		if (link.consumed > STAGING_COMPACT_BYTES || link.consumed == link.staging.size()) {
+			link.staging.erase(link.staging.begin(), link.staging.begin() + link.consumed);
+			link.consumed = 0;
+		}
+
+		if (link.ring) {
+			Ring& ring = *link.ring;
+			uint64_t head = ring.head.load(std::memory_order_acquire);
+			uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+			size_t n = (size_t)(head - tail);
+			size_t offset = tail % linkBytes;
+			size_t first = std::min(n, linkBytes - offset);
+			link.staging.insert(link.staging.end(), ring.Data() + offset, ring.Data() + offset + first);
+			link.staging.insert(link.staging.end(), ring.Data(), ring.Data() + (n - first));
+			ring.tail.store(head, std::memory_order_release);
+			continue;
+		}
+
+		for (;;) {
+			size_t size = link.staging.size();
+			link.staging.resize(size + SOCKET_READ_BYTES);
+			ssize_t received = recv(link.readFd, link.staging.data() + size, SOCKET_READ_BYTES, 0);
+			link.staging.resize(size + std::max<ssize_t>(received, 0));
+			if (received > 0) {
+				continue;
+			}
+			if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+				break;
+			}
+			throw std::runtime_error("halo link closed");
+		}
+	}
+}
+
+void HaloMesh::Send(int from, int to, uint64_t tick, const std::vector<HaloParticle>& particles) {
+	Link& link = *Find(from, to);
+	HaloFrameHeader header = { tick, particles.size() };
+	const char* parts[2] = { (const char*)&header, (const char*)particles.data() };
+	size_t sizes[2] = { sizeof(header), particles.size() * sizeof(HaloParticle) };
+
+	for (int part = 0; part < 2; ++part) {
+		size_t done = 0;
+		int spins = 0;
+		while (done < sizes[part]) {
+			size_t n = WriteSome(link, parts[part] + done, sizes[part] - done);
+			done += n;
+			if (n == 0) {
+				Pump(from);
+				waitBriefly(spins);
+			}
+		}
+		bytesSent += sizes[part];
+	}
+}
+
+void HaloMesh::Receive(int to, int from, uint64_t tick, std::vector<HaloParticle>& out) {
+	Link& link = *Find(from, to);
+	int spins = 0;
+	for (;;) {
+		size_t available = link.staging.size() - link.consumed;
+		if (available >= sizeof(HaloFrameHeader)) {
+			HaloFrameHeader header;
+			memcpy(&header, link.staging.data() + link.consumed, sizeof(header));
+			if (header.tick != tick) {
+				throw std::runtime_error("halo frame out of order");
+			}
+			size_t bytes = sizeof(header) + header.count * sizeof(HaloParticle);
+			if (available >= bytes) {
+				size_t first = out.size();
+				out.resize(first + header.count);
+				memcpy(out.data() + first, link.staging.data() + link.consumed + sizeof(header), header.count * sizeof(HaloParticle));
+				link.consumed += bytes;
+				return;
+			}
+		}
+		Pump(to);
+		if (link.staging.size() - link.consumed == available) {
+			waitBriefly(spins);
+		}
+	}
+}
+
+struct SnapshotExchange::Control {
+	// Last snapshot the coordinator has finished reading.
+	alignas(64) std::atomic<uint64_t> consumed{ 0 };
+	// Particles reserved in each slot so far.
+	alignas(64) std::atomic<uint64_t> fill[2];
+};
+
+SnapshotExchange::SnapshotExchange(int tiles, size_t maxParticles)
+	: tiles(tiles), maxParticles(maxParticles) {
+	size_t controlBytes = (sizeof(Control) + 63) / 64 * 64;
+	size_t reportBytes = tiles * sizeof(TileReport);
+	size_t slotBytes = (std::max<size_t>(maxParticles, 1) * sizeof(HaloParticle) + 63) / 64 * 64;
+	sharedBytes = controlBytes + reportBytes + 2 * slotBytes;
+	sharedMemory = mapShared(sharedBytes);
+
+	char* memory = (char*)sharedMemory;
+	control = new (memory) Control();
+	control->fill[0].store(0);
+	control->fill[1].store(0);
+	reports = (TileReport*)(memory + controlBytes);
+	for (int i = 0; i < tiles; ++i) {
+		new (&reports[i]) TileReport();
+	}
+	slots[0] = (HaloParticle*)(memory + controlBytes + reportBytes);
+	slots[1] = (HaloParticle*)(memory + controlBytes + reportBytes + slotBytes);
+}
+
+SnapshotExchange::~SnapshotExchange() {
+	munmap(sharedMemory, sharedBytes);
+}
+
+void SnapshotExchange::Publish(int tile, uint64_t snapshot, const ParticleStore& particles) {
+	int spins = 0;
+	while (snapshot > 2 && control->consumed.load(std::memory_order_acquire) < snapshot - 2) {
+		waitBriefly(spins);
+	}
+
+	size_t count = particles.Size();
+	int slot = snapshot % 2;
+	uint64_t offset = control->fill[slot].fetch_add(count, std::memory_order_relaxed);
+	if (offset + count > maxParticles) {
+		throw std::runtime_error("snapshot slot overflow");
+	}
+	HaloParticle* out = slots[slot] + offset;
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = { particles.x[i], particles.y[i], particles.vx[i], particles.vy[i], particles.id[i] };
+	}
+	reports[tile].particles = count;
+	reports[tile].published.store(snapshot, std::memory_order_release);
+}
+
+bool SnapshotExchange::TryCollect(uint64_t snapshot, std::vector<HaloParticle>& out) {
+	for (int tile = 0; tile < tiles; ++tile) {
+		if (reports[tile].published.load(std::memory_order_acquire) < snapshot) {
+			return false;
+		}
+	}
+
+	int slot = snapshot % 2;
+	size_t count = (size_t)control->fill[slot].load(std::memory_order_relaxed);
+	out.assign(slots[slot], slots[slot] + count);
+	std::sort(out.begin(), out.end(), [](const HaloParticle& a, const HaloParticle& b) {
+		return a.id < b.id;
+	});
+	control->fill[slot].store(0, std::memory_order_relaxed);
+	control->consumed.store(snapshot, std::memory_order_release);
+	return true;
+}
+
+#endif
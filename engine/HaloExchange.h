@@ -0,0 +1,137 @@
+#pragma once
+
+// Process-level domain decomposition: the canvas is split into tiles, each
+// stepped by its own process, and particles that cross a tile edge are
+// handed to the neighbouring process at the end of every tick. POSIX only;
+// the links are created before fork so every tile process inherits them.
+#if !defined(_WIN32)
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ParticleStore;
+
+// The canvas split into columns x rows equal tiles, numbered row by row.
+struct TileLayout {
+	int columns = 1;
+	int rows = 1;
+	float width = 0.0f;
+	float height = 0.0f;
+
+	int Count() const { return columns * rows; }
+	// Tile owning a point; points on the canvas edge belong to the edge tiles.
+	int TileOf(float x, float y) const;
+	void Bounds(int tile, float& x0, float& y0, float& x1, float& y1) const;
+	// Tiles sharing an edge or a corner.
+	std::vector<int> Neighbours(int tile) const;
+};
+
+// A particle in transit between tiles, keeping its id so its random draws
+// continue unchanged in the new process.
+struct HaloParticle {
+	float x, y, vx, vy;
+	uint32_t id;
+};
+
+enum HaloTransport {
+	// Single-producer single-consumer byte rings in shared memory.
+	HALO_SHARED_MEMORY = 0,
+	// A Unix domain socket pair per pair of neighbours.
+	HALO_SOCKET = 1
+};
+
+// One link in each direction between every pair of neighbouring tiles.
+// Every tick each tile sends every neighbour one frame (tick, count,
+// particles), possibly empty, so receiving a neighbour's frame for a tick
+// doubles as the barrier between ticks.
+class HaloMesh {
+public:
+	// Must be built before forking the tile processes.
+	HaloMesh(const TileLayout& layout, HaloTransport transport, size_t linkBytes);
+	~HaloMesh();
+	HaloMesh(const HaloMesh&) = delete;
+	HaloMesh& operator=(const HaloMesh&) = delete;
+
+	const std::vector<int>& Neighbours(int tile) const { return neighbours[tile]; }
+
+	// Blocks until the frame is written. While the link is full the sender
+	// keeps draining its own incoming links, so two tiles filling each
+	// other's links at once cannot deadlock.
+	void Send(int from, int to, uint64_t tick, const std::vector<HaloParticle>& particles);
+	// Blocks until `from`'s frame for `tick` arrived and appends its particles.
+	void Receive(int to, int from, uint64_t tick, std::vector<HaloParticle>& out);
+
+	// Bytes this process has sent over all its links.
+	uint64_t GetBytesSent() const { return bytesSent; }
+
+private:
+	struct Ring;
+	struct Link {
+		int from, to;
+		Ring* ring = nullptr;
+		int writeFd = -1, readFd = -1;
+		// Bytes read but not yet consumed; receiver side only.
+		std::vector<char> staging;
+		size_t consumed = 0;
+	};
+
+	Link* Find(int from, int to);
+	size_t WriteSome(Link& link, const char* data, size_t bytes);
+	void Pump(int tile);
+
+	size_t linkBytes;
+	std::vector<std::vector<int>> neighbours;
+	std::vector<Link> links;
+	void* sharedMemory = nullptr;
+	size_t sharedBytes = 0;
+	std::vector<int> sockets;
+	uint64_t bytesSent = 0;
+};
+
+// Per-tile counters in shared memory, read by the coordinator.
+struct alignas(64) TileReport {
+	std::atomic<uint64_t> published{ 0 };
+	uint64_t ticks = 0;
+	uint64_t migratedOut = 0;
+	uint64_t bytesSent = 0;
+	uint64_t particles = 0;
+	double stepSeconds = 0.0;
+	double exchangeSeconds = 0.0;
+};
+
+// Two snapshot slots in shared memory, each large enough for every
+// particle. Tiles publish snapshot n into slot n % 2 and the coordinator
+// merges it; a tile waits for the coordinator to finish with snapshot n - 2
+// before reusing its slot, so the two sides can be a snapshot apart.
+class SnapshotExchange {
+public:
+	SnapshotExchange(int tiles, size_t maxParticles);
+	~SnapshotExchange();
+	SnapshotExchange(const SnapshotExchange&) = delete;
+	SnapshotExchange& operator=(const SnapshotExchange&) = delete;
+
+	TileReport& Report(int tile) { return reports[tile]; }
+
+	// Tile side. Snapshots are numbered from 1.
+	void Publish(int tile, uint64_t snapshot, const ParticleStore& particles);
+	// Coordinator side: once every tile has published the snapshot, replaces
+	// `out` with the merged particles sorted by id and frees the slot.
+	// Returns false without waiting while a tile is still behind, so the
+	// caller can watch for tile processes that died.
+	bool TryCollect(uint64_t snapshot, std::vector<HaloParticle>& out);
+
+private:
+	struct Control;
+
+	int tiles;
+	size_t maxParticles;
+	void* sharedMemory = nullptr;
+	size_t sharedBytes = 0;
+	Control* control = nullptr;
+	TileReport* reports = nullptr;
+	HaloParticle* slots[2] = {};
+};
+
+#endif
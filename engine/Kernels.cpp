@@ -0,0 +1,441 @@
+#include "Kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define KERNEL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(KERNEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define KERNEL_TARGET_AVX2
+#endif
+
+static std::atomic<int> selectedPath{ -1 };
+
+template <bool Measure>
+static void integrateScalar(float* x, float* y, float* vx, float* vy, size_t count,
+	float deltaTime, float width, float height, float* impulse) {
+	for (size_t i = 0; i < count; ++i) {
+		float newX = x[i] + vx[i] * deltaTime;
+		float newY = y[i] + vy[i] * deltaTime;
+
+		if constexpr (Measure) {
+			impulse[0] += newX < 0.0f ? 2.0f * std::fabs(vx[i]) : 0.0f;
+			impulse[1] += newX > width ? 2.0f * std::fabs(vx[i]) : 0.0f;
+			impulse[2] += newY < 0.0f ? 2.0f * std::fabs(vy[i]) : 0.0f;
+			impulse[3] += newY > height ? 2.0f * std::fabs(vy[i]) : 0.0f;
+		}
+
+		float flipX = (newX < 0.0f) | (newX > width) ? -1.0f : 1.0f;
+		float flipY = (newY < 0.0f) | (newY > height) ? -1.0f : 1.0f;
+
+		x[i] = std::min(std::max(newX, 0.0f), width);
+		y[i] = std::min(std::max(newY, 0.0f), height);
+		vx[i] *= flipX;
+		vy[i] *= flipY;
+	}
+}
+
+#if defined(KERNEL_X86)
+// Adds the lanes of each side's velocity sum, doubled, to `impulse`. A
+// particle can only leave through the left or top edge moving towards it, so
+// those sums are negative.
+static void addImpulseSse(float* impulse, const __m128* sides) {
+	for (int side = 0; side < 4; ++side) {
+		float lanes[4];
+		_mm_storeu_ps(lanes, sides[side]);
+		float sum = 2.0f * (lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+		impulse[side] += side == 0 || side == 2 ? -sum : sum;
+	}
+}
+
+template <bool Measure>
+static void integrateSse(float* x, float* y, float* vx, float* vy, size_t count,
+	float deltaTime, float width, float height, float* impulse) {
+	const __m128 dt = _mm_set1_ps(deltaTime);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 maxX = _mm_set1_ps(width);
+	const __m128 maxY = _mm_set1_ps(height);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	// Per-lane sums of the velocity leaving by the left, right, top and bottom edges.
+	__m128 sides[4] = { zero, zero, zero, zero };
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 px = _mm_loadu_ps(x + i);
+		__m128 py = _mm_loadu_ps(y + i);
+		__m128 pvx = _mm_loadu_ps(vx + i);
+		__m128 pvy = _mm_loadu_ps(vy + i);
+
+		__m128 newX = _mm_add_ps(px, _mm_mul_ps(pvx, dt));
+		__m128 newY = _mm_add_ps(py, _mm_mul_ps(pvy, dt));
+
+		__m128 left = _mm_cmplt_ps(newX, zero), right = _mm_cmpgt_ps(newX, maxX);
+		__m128 top = _mm_cmplt_ps(newY, zero), bottom = _mm_cmpgt_ps(newY, maxY);
+		__m128 outX = _mm_or_ps(left, right);
+		__m128 outY = _mm_or_ps(top, bottom);
+
+		// Few vectors hold a particle leaving the world, so the sums are
+		// skipped for the rest.
+		if (Measure && _mm_movemask_ps(_mm_or_ps(outX, outY))) {
+			sides[0] = _mm_add_ps(sides[0], _mm_and_ps(left, pvx));
+			sides[1] = _mm_add_ps(sides[1], _mm_and_ps(right, pvx));
+			sides[2] = _mm_add_ps(sides[2], _mm_and_ps(top, pvy));
+			sides[3] = _mm_add_ps(sides[3], _mm_and_ps(bottom, pvy));
+		}
+
+		_mm_storeu_ps(x + i, _mm_min_ps(_mm_max_ps(newX, zero), maxX));
+		_mm_storeu_ps(y + i, _mm_min_ps(_mm_max_ps(newY, zero), maxY));
+		_mm_storeu_ps(vx + i, _mm_xor_ps(pvx, _mm_and_ps(outX, sign)));
+		_mm_storeu_ps(vy + i, _mm_xor_ps(pvy, _mm_and_ps(outY, sign)));
+	}
+
+	if constexpr (Measure) {
+		addImpulseSse(impulse, sides);
+	}
+	integrateScalar<Measure>(x + i, y + i, vx + i, vy + i, count - i, deltaTime, width, height, impulse);
+}
+
+template <bool Measure>
+KERNEL_TARGET_AVX2
+static void integrateAvx2(float* x, float* y, float* vx, float* vy, size_t count,
+	float deltaTime, float width, float height, float* impulse) {
+	const __m256 dt = _mm256_set1_ps(deltaTime);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 maxX = _mm256_set1_ps(width);
+	const __m256 maxY = _mm256_set1_ps(height);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 sides[4] = { zero, zero, zero, zero };
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 px = _mm256_loadu_ps(x + i);
+		__m256 py = _mm256_loadu_ps(y + i);
+		__m256 pvx = _mm256_loadu_ps(vx + i);
+		__m256 pvy = _mm256_loadu_ps(vy + i);
+
+		__m256 newX = _mm256_add_ps(px, _mm256_mul_ps(pvx, dt));
+		__m256 newY = _mm256_add_ps(py, _mm256_mul_ps(pvy, dt));
+
+		__m256 left = _mm256_cmp_ps(newX, zero, _CMP_LT_OQ), right = _mm256_cmp_ps(newX, maxX, _CMP_GT_OQ);
+		__m256 top = _mm256_cmp_ps(newY, zero, _CMP_LT_OQ), bottom = _mm256_cmp_ps(newY, maxY, _CMP_GT_OQ);
+		__m256 outX = _mm256_or_ps(left, right);
+		__m256 outY = _mm256_or_ps(top, bottom);
+
+		if (Measure && _mm256_movemask_ps(_mm256_or_ps(outX, outY))) {
+			sides[0] = _mm256_add_ps(sides[0], _mm256_and_ps(left, pvx));
+			sides[1] = _mm256_add_ps(sides[1], _mm256_and_ps(right, pvx));
+			sides[2] = _mm256_add_ps(sides[2], _mm256_and_ps(top, pvy));
+			sides[3] = _mm256_add_ps(sides[3], _mm256_and_ps(bottom, pvy));
+		}
+
+		_mm256_storeu_ps(x + i, _mm256_min_ps(_mm256_max_ps(newX, zero), maxX));
+		_mm256_storeu_ps(y + i, _mm256_min_ps(_mm256_max_ps(newY, zero), maxY));
+		_mm256_storeu_ps(vx + i, _mm256_xor_ps(pvx, _mm256_and_ps(outX, sign)));
+		_mm256_storeu_ps(vy + i, _mm256_xor_ps(pvy, _mm256_and_ps(outY, sign)));
+	}
+
+	if constexpr (Measure) {
+		__m128 halves[4];
+		for (int side = 0; side < 4; ++side) {
+			halves[side] = _mm_add_ps(_mm256_castps256_ps128(sides[side]), _mm256_extractf128_ps(sides[side], 1));
+		}
+		addImpulseSse(impulse, halves);
+	}
+	integrateSse<Measure>(x + i, y + i, vx + i, vy + i, count - i, deltaTime, width, height, impulse);
+}
+#endif
+
+// Multiplier of the dither hash.
+const uint32_t DITHER_GOLDEN = 0x9E3779B1u;
+// Weight of one unit in the top 24 bits of the dither hash.
+const float DITHER_UNIT = 1.0f / 16777216.0f;
+
+// Rounding offsets for a compact encode: the top 24 bits of a
+// multiplicative hash of the particle id and the tick, in [0, 1). One
+// multiply keeps the encode cheap; the rounding only needs to be unbiased.
+static uint32_t ditherSalt(uint64_t tick) {
+	return (uint32_t)(tick ^ (tick >> 32)) * 0x85EBCA77u;
+}
+
+static float ditherScalar(uint32_t id, uint32_t salt) {
+	return ((id ^ salt) * DITHER_GOLDEN >> 8) * DITHER_UNIT;
+}
+
+static void decodeCompactScalar(const int16_t* qx, const int16_t* qy, const int16_t* qvx, const int16_t* qvy,
+	float* x, float* y, float* vx, float* vy, size_t count, float unitX, float unitY, float velocityUnit) {
+	for (size_t i = 0; i < count; ++i) {
+		x[i] = (qx[i] + COMPACT_POSITION_OFFSET) * unitX;
+		y[i] = (qy[i] + COMPACT_POSITION_OFFSET) * unitY;
+		vx[i] = qvx[i] * velocityUnit;
+		vy[i] = qvy[i] * velocityUnit;
+	}
+}
+
+static int16_t saturateInt16(long value) {
+	return (int16_t)std::min<long>(std::max<long>(value, INT16_MIN), INT16_MAX);
+}
+
+static int16_t encodePositionScalar(float steps) {
+	int32_t q = steps < 0.0f ? 0 : std::min((int32_t)steps, COMPACT_POSITION_STEPS);
+	return (int16_t)(q - COMPACT_POSITION_OFFSET);
+}
+
+static void encodeCompactScalar(const float* x, const float* y, const float* vx, const float* vy, const uint32_t* ids,
+	int16_t* qx, int16_t* qy, int16_t* qvx, int16_t* qvy, size_t count, float unitX, float unitY, float velocityUnit,
+	uint32_t salt) {
+	float scaleX = 1.0f / unitX;
+	float scaleY = 1.0f / unitY;
+	float velocityScale = 1.0f / velocityUnit;
+	for (size_t i = 0; i < count; ++i) {
+		float dither = ditherScalar(ids[i], salt);
+		qx[i] = encodePositionScalar(x[i] * scaleX + dither);
+		qy[i] = encodePositionScalar(y[i] * scaleY + dither);
+		qvx[i] = saturateInt16(lrintf(vx[i] * velocityScale));
+		qvy[i] = saturateInt16(lrintf(vy[i] * velocityScale));
+	}
+}
+
+#if defined(KERNEL_X86)
+// Low 32 bits of each lane's product; SSE2 only multiplies even lanes.
+static __m128i multiplyLow32(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Four particles per step; SSE2 only, so every x86-64 CPU takes this path.
+static void decodeCompactSse(const int16_t* qx, const int16_t* qy, const int16_t* qvx, const int16_t* qvy,
+	float* x, float* y, float* vx, float* vy, size_t count, float unitX, float unitY, float velocityUnit) {
+	const __m128 positionX = _mm_set1_ps(unitX);
+	const __m128 positionY = _mm_set1_ps(unitY);
+	const __m128 velocity = _mm_set1_ps(velocityUnit);
+	const __m128i offset = _mm_set1_epi32(COMPACT_POSITION_OFFSET);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		// Sign-extend four int16 lanes: duplicate into the high halves, shift down.
+		__m128i px = _mm_loadl_epi64((const __m128i*)(qx + i));
+		__m128i py = _mm_loadl_epi64((const __m128i*)(qy + i));
+		__m128i pvx = _mm_loadl_epi64((const __m128i*)(qvx + i));
+		__m128i pvy = _mm_loadl_epi64((const __m128i*)(qvy + i));
+		px = _mm_add_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(px, px), 16), offset);
+		py = _mm_add_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(py, py), 16), offset);
+		pvx = _mm_srai_epi32(_mm_unpacklo_epi16(pvx, pvx), 16);
+		pvy = _mm_srai_epi32(_mm_unpacklo_epi16(pvy, pvy), 16);
+
+		_mm_storeu_ps(x + i, _mm_mul_ps(_mm_cvtepi32_ps(px), positionX));
+		_mm_storeu_ps(y + i, _mm_mul_ps(_mm_cvtepi32_ps(py), positionY));
+		_mm_storeu_ps(vx + i, _mm_mul_ps(_mm_cvtepi32_ps(pvx), velocity));
+		_mm_storeu_ps(vy + i, _mm_mul_ps(_mm_cvtepi32_ps(pvy), velocity));
+	}
+
+	decodeCompactScalar(qx + i, qy + i, qvx + i, qvy + i, x + i, y + i, vx + i, vy + i, count - i, unitX, unitY, velocityUnit);
+}
+
+static void encodeCompactSse(const float* x, const float* y, const float* vx, const float* vy, const uint32_t* ids,
+	int16_t* qx, int16_t* qy, int16_t* qvx, int16_t* qvy, size_t count, float unitX, float unitY, float velocityUnit,
+	uint32_t salt) {
+	const __m128 scaleX = _mm_set1_ps(1.0f / unitX);
+	const __m128 scaleY = _mm_set1_ps(1.0f / unitY);
+	const __m128 velocity = _mm_set1_ps(1.0f / velocityUnit);
+	const __m128i offset = _mm_set1_epi32(COMPACT_POSITION_OFFSET);
+	const __m128i golden = _mm_set1_epi32((int)DITHER_GOLDEN);
+	const __m128i saltLanes = _mm_set1_epi32((int)salt);
+	const __m128 ditherUnit = _mm_set1_ps(DITHER_UNIT);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i hash = multiplyLow32(_mm_xor_si128(_mm_loadu_si128((const __m128i*)(ids + i)), saltLanes), golden);
+		__m128 dither = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(hash, 8)), ditherUnit);
+
+		// Truncation is floor for the positive lanes; negative ones and
+		// those past the far edge saturate in the pack.
+		__m128i px = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + i), scaleX), dither)), offset);
+		__m128i py = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(y + i), scaleY), dither)), offset);
+		__m128i pvx = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(vx + i), velocity));
+		__m128i pvy = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(vy + i), velocity));
+		_mm_storel_epi64((__m128i*)(qx + i), _mm_packs_epi32(px, px));
+		_mm_storel_epi64((__m128i*)(qy + i), _mm_packs_epi32(py, py));
+		_mm_storel_epi64((__m128i*)(qvx + i), _mm_packs_epi32(pvx, pvx));
+		_mm_storel_epi64((__m128i*)(qvy + i), _mm_packs_epi32(pvy, pvy));
+	}
+
+	encodeCompactScalar(x + i, y + i, vx + i, vy + i, ids + i, qx + i, qy + i, qvx + i, qvy + i, count - i,
+		unitX, unitY, velocityUnit, salt);
+}
+
+// Eight particles per step, with a native 32-bit multiply for the dither.
+KERNEL_TARGET_AVX2
+static void decodeCompactAvx2(const int16_t* qx, const int16_t* qy, const int16_t* qvx, const int16_t* qvy,
+	float* x, float* y, float* vx, float* vy, size_t count, float unitX, float unitY, float velocityUnit) {
+	const __m256 positionX = _mm256_set1_ps(unitX);
+	const __m256 positionY = _mm256_set1_ps(unitY);
+	const __m256 velocity = _mm256_set1_ps(velocityUnit);
+	const __m256i offset = _mm256_set1_epi32(COMPACT_POSITION_OFFSET);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i px = _mm256_add_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(qx + i))), offset);
+		__m256i py = _mm256_add_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(qy + i))), offset);
+		__m256i pvx = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(qvx + i)));
+		__m256i pvy = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(qvy + i)));
+
+		_mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_cvtepi32_ps(px), positionX));
+		_mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_cvtepi32_ps(py), positionY));
+		_mm256_storeu_ps(vx + i, _mm256_mul_ps(_mm256_cvtepi32_ps(pvx), velocity));
+		_mm256_storeu_ps(vy + i, _mm256_mul_ps(_mm256_cvtepi32_ps(pvy), velocity));
+	}
+
+	decodeCompactSse(qx + i, qy + i, qvx + i, qvy + i, x + i, y + i, vx + i, vy + i, count - i, unitX, unitY, velocityUnit);
+}
+
+// Packs eight int32 lanes to int16 with saturation, in order.
+KERNEL_TARGET_AVX2
+static void storeInt16Avx2(int16_t* out, __m256i value) {
+	_mm_storeu_si128((__m128i*)out, _mm_packs_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1)));
+}
+
+KERNEL_TARGET_AVX2
+static void encodeCompactAvx2(const float* x, const float* y, const float* vx, const float* vy, const uint32_t* ids,
+	int16_t* qx, int16_t* qy, int16_t* qvx, int16_t* qvy, size_t count, float unitX, float unitY, float velocityUnit,
+	uint32_t salt) {
+	const __m256 scaleX = _mm256_set1_ps(1.0f / unitX);
+	const __m256 scaleY = _mm256_set1_ps(1.0f / unitY);
+	const __m256 velocity = _mm256_set1_ps(1.0f / velocityUnit);
+	const __m256i offset = _mm256_set1_epi32(COMPACT_POSITION_OFFSET);
+	const __m256i golden = _mm256_set1_epi32((int)DITHER_GOLDEN);
+	const __m256i saltLanes = _mm256_set1_epi32((int)salt);
+	const __m256 ditherUnit = _mm256_set1_ps(DITHER_UNIT);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i hash = _mm256_mullo_epi32(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(ids + i)), saltLanes), golden);
+		__m256 dither = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(hash, 8)), ditherUnit);
+
+		__m256i px = _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(x + i), scaleX), dither)), offset);
+		__m256i py = _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(y + i), scaleY), dither)), offset);
+		storeInt16Avx2(qx + i, px);
+		storeInt16Avx2(qy + i, py);
+		storeInt16Avx2(qvx + i, _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(vx + i), velocity)));
+		storeInt16Avx2(qvy + i, _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(vy + i), velocity)));
+	}
+
+	encodeCompactSse(x + i, y + i, vx + i, vy + i, ids + i, qx + i, qy + i, qvx + i, qvy + i, count - i,
+		unitX, unitY, velocityUnit, salt);
+}
+#endif
+
+KernelPath DetectKernelPath() {
+#if defined(KERNEL_X86)
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	if (osSavesYmm && (info[1] & (1 << 5))) {
+		return KERNEL_AVX2;
+	}
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return KERNEL_AVX2;
+	}
+#endif
+	return KERNEL_SSE;
+#else
+	return KERNEL_SCALAR;
+#endif
+}
+
+KernelPath GetKernelPath() {
+	int path = selectedPath.load(std::memory_order_relaxed);
+	if (path < 0) {
+		path = DetectKernelPath();
+		selectedPath.store(path, std::memory_order_relaxed);
+	}
+	return (KernelPath)path;
+}
+
+void SetKernelPath(KernelPath path) {
+	selectedPath.store(std::min(path, DetectKernelPath()), std::memory_order_relaxed);
+}
+
+const char* KernelPathName(KernelPath path) {
+	switch (path) {
+		case KERNEL_AVX2: return "AVX2";
+		case KERNEL_SSE: return "SSE";
+		default: return "scalar";
+	}
+}
+
+template <bool Measure>
+static void integrate(float* x, float* y, float* vx, float* vy, size_t count,
+	float deltaTime, float width, float height, float* impulse) {
+	switch (GetKernelPath()) {
+#if defined(KERNEL_X86)
+		case KERNEL_AVX2:
+			integrateAvx2<Measure>(x, y, vx, vy, count, deltaTime, width, height, impulse);
+			break;
+		case KERNEL_SSE:
+			integrateSse<Measure>(x, y, vx, vy, count, deltaTime, width, height, impulse);
+			break;
+#endif
+		default:
+			integrateScalar<Measure>(x, y, vx, vy, count, deltaTime, width, height, impulse);
+			break;
+	}
+}
+
+void IntegrateParticles(float* x, float* y, float* vx, float* vy, size_t count,
+	float deltaTime, float width, float height, float* borderImpulse) {
+	if (borderImpulse) {
+		integrate<true>(x, y, vx, vy, count, deltaTime, width, height, borderImpulse);
+	} else {
+		integrate<false>(x, y, vx, vy, count, deltaTime, width, height, nullptr);
+	}
+}
+
+void DecodeCompact(const int16_t* qx, const int16_t* qy, const int16_t* qvx, const int16_t* qvy,
+	float* x, float* y, float* vx, float* vy, size_t count, float unitX, float unitY, float velocityUnit) {
+#if defined(KERNEL_X86)
+	switch (GetKernelPath()) {
+		case KERNEL_AVX2:
+			decodeCompactAvx2(qx, qy, qvx, qvy, x, y, vx, vy, count, unitX, unitY, velocityUnit);
+			return;
+		case KERNEL_SSE:
+			decodeCompactSse(qx, qy, qvx, qvy, x, y, vx, vy, count, unitX, unitY, velocityUnit);
+			return;
+		default:
+			break;
+	}
+#endif
+	decodeCompactScalar(qx, qy, qvx, qvy, x, y, vx, vy, count, unitX, unitY, velocityUnit);
+}
+
+void EncodeCompact(const float* x, const float* y, const float* vx, const float* vy, const uint32_t* ids,
+	int16_t* qx, int16_t* qy, int16_t* qvx, int16_t* qvy, size_t count, float unitX, float unitY, float velocityUnit,
+	uint64_t tick) {
+	uint32_t salt = ditherSalt(tick);
+#if defined(KERNEL_X86)
+	switch (GetKernelPath()) {
+		case KERNEL_AVX2:
+			encodeCompactAvx2(x, y, vx, vy, ids, qx, qy, qvx, qvy, count, unitX, unitY, velocityUnit, salt);
+			return;
+		case KERNEL_SSE:
+			encodeCompactSse(x, y, vx, vy, ids, qx, qy, qvx, qvy, count, unitX, unitY, velocityUnit, salt);
+			return;
+		default:
+			break;
+	}
+#endif
+	encodeCompactScalar(x, y, vx, vy, ids, qx, qy, qvx, qvy, count, unitX, unitY, velocityUnit, salt);
+}
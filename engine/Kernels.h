@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum KernelPath {
+	KERNEL_SCALAR = 0,
+	KERNEL_SSE = 1,
+	KERNEL_AVX2 = 2
+};
+
+// Widest path the running CPU supports.
+KernelPath DetectKernelPath();
+// Path used by IntegrateParticles; defaults to DetectKernelPath().
+KernelPath GetKernelPath();
+// Requests a path for comparisons; anything wider than the CPU supports is clamped.
+void SetKernelPath(KernelPath path);
+const char* KernelPathName(KernelPath path);
+
+// Moves count particles one step in a straight line and reflects them off the
+// canvas edges. The edge reflection is a clamp plus a sign flip, so there are
+// no per-particle branches and the vector paths handle 4 or 8 lanes at once.
+// With `borderImpulse`, each bounce also adds twice the flipped velocity
+// component to its edge: left, right, top and bottom, as in CanvasSide.
+void IntegrateParticles(float* x, float* y, float* vx, float* vy, size_t count,
+	float deltaTime, float width, float height, float* borderImpulse = nullptr);
+
+// Compact particles (see CompactStore) to floats: a position is
+// (q + COMPACT_POSITION_OFFSET) * unitX or unitY, a velocity q * velocityUnit.
+void DecodeCompact(const int16_t* qx, const int16_t* qy, const int16_t* qvx, const int16_t* qvy,
+	float* x, float* y, float* vx, float* vy, size_t count, float unitX, float unitY, float velocityUnit);
+// And back. Positions round up or down at random, with a draw keyed by the
+// particle id and `tick`, so they move by the right amount on average even
+// when a tick's motion is less than a unit; positions saturate at the ends
+// of the range. Velocities round to nearest (ties to even) and saturate at
+// the int16 range.
+void EncodeCompact(const float* x, const float* y, const float* vx, const float* vy, const uint32_t* ids,
+	int16_t* qx, int16_t* qy, int16_t* qvx, int16_t* qvy, size_t count, float unitX, float unitY, float velocityUnit,
+	uint64_t tick);
+
+// Added to a stored position to get steps from the low edge of the world.
+const int32_t COMPACT_POSITION_OFFSET = 32768;
+// Steps across the world in a compact position.
+const int32_t COMPACT_POSITION_STEPS = 65535;
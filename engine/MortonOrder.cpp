@@ -0,0 +1,108 @@
+#include "MortonOrder.h"
+#include "ParticleStore.h"
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Grid cells per axis are 1 << MORTON_AXIS_BITS.
+const int MORTON_AXIS_BITS = 10;
+// Key bits sorted per radix pass; two passes cover the 20-bit key.
+const int RADIX_BITS = 10;
+const uint32_t RADIX_BUCKETS = 1u << RADIX_BITS;
+// Particles per sort chunk. Chunks are numbered by begin / SORT_CHUNK.
+const size_t SORT_CHUNK = 16384;
+
+// Moves the low 10 bits of v to the even bit positions.
+static uint32_t spreadBits(uint32_t v) {
+	v &= 0x3ff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+uint32_t MortonKey(float x, float y, float width, float height) {
+	const int cells = 1 << MORTON_AXIS_BITS;
+	int cx = std::min(std::max((int)(x / width * cells), 0), cells - 1);
+	int cy = std::min(std::max((int)(y / height * cells), 0), cells - 1);
+	return spreadBits(cx) | (spreadBits(cy) << 1);
+}
+
+template <typename T>
+static void gather(T* data, const std::vector<uint32_t>& order, std::vector<T>& scratch, size_t count, WorkerPool& pool) {
+	pool.ParallelFor(count, SORT_CHUNK, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			scratch[i] = data[order[i]];
+		}
+	});
+	pool.ParallelFor(count, SORT_CHUNK, [&](size_t begin, size_t end, size_t) {
+		memcpy(data + begin, scratch.data() + begin, (end - begin) * sizeof(T));
+	});
+}
+
+void MortonSorter::Sort(ParticleStore& particles, float width, float height, WorkerPool& pool) {
+	ProfileScope scope(PROFILE_REORDER);
+	size_t count = particles.Size();
+	if (count < 2) {
+		order.assign(count, 0);
+		return;
+	}
+	size_t chunks = (count + SORT_CHUNK - 1) / SORT_CHUNK;
+	keys.resize(count);
+	keysScratch.resize(count);
+	order.resize(count);
+	orderScratch.resize(count);
+	digitOffsets.resize(chunks * RADIX_BUCKETS);
+
+	pool.ParallelFor(count, SORT_CHUNK, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			keys[i] = MortonKey(particles.x[i], particles.y[i], width, height);
+			order[i] = (uint32_t)i;
+		}
+	});
+
+	for (int shift = 0; shift < 2 * MORTON_AXIS_BITS; shift += RADIX_BITS) {
+		pool.ParallelFor(count, SORT_CHUNK, [&](size_t begin, size_t end, size_t) {
+			uint32_t* counts = digitOffsets.data() + begin / SORT_CHUNK * RADIX_BUCKETS;
+			std::fill(counts, counts + RADIX_BUCKETS, 0u);
+			for (size_t i = begin; i < end; ++i) {
+				counts[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+			}
+		});
+
+		// Digit-major, chunk-minor prefix sum: a digit's particles from chunk
+		// c land before the same digit's from chunk c + 1.
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < RADIX_BUCKETS; ++digit) {
+			for (size_t chunk = 0; chunk < chunks; ++chunk) {
+				uint32_t& slot = digitOffsets[chunk * RADIX_BUCKETS + digit];
+				uint32_t digitCount = slot;
+				slot = offset;
+				offset += digitCount;
+			}
+		}
+
+		pool.ParallelFor(count, SORT_CHUNK, [&](size_t begin, size_t end, size_t) {
+			uint32_t* offsets = digitOffsets.data() + begin / SORT_CHUNK * RADIX_BUCKETS;
+			for (size_t i = begin; i < end; ++i) {
+				uint32_t position = offsets[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+				keysScratch[position] = keys[i];
+				orderScratch[position] = order[i];
+			}
+		});
+		keys.swap(keysScratch);
+		order.swap(orderScratch);
+	}
+
+	floatScratch.resize(count);
+	idScratch.resize(count);
+	gather(particles.x.Data(), order, floatScratch, count, pool);
+	gather(particles.y.Data(), order, floatScratch, count, pool);
+	gather(particles.vx.Data(), order, floatScratch, count, pool);
+	gather(particles.vy.Data(), order, floatScratch, count, pool);
+	gather(particles.id.Data(), order, idScratch, count, pool);
+	particles.IdsMoved();
+}
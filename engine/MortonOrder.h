@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ParticleStore;
+class WorkerPool;
+
+// Z-order key of a point, from its cell in a 1024 x 1024 grid over the canvas.
+uint32_t MortonKey(float x, float y, float width, float height);
+
+// Re-sorts a store by the Morton key of each particle's position, so that
+// particles close on the canvas are close in memory and each chunk a worker
+// takes covers one compact region. Ids move with their particles.
+//
+// The keys are sorted with a parallel LSD radix sort: each pass counts
+// digits per chunk, prefix-sums the counts digit by digit and chunk by chunk,
+// and scatters every chunk to its own range of the output, which keeps the
+// sort stable and the result independent of the thread count.
+class MortonSorter {
+public:
+	MortonSorter() {}
+	// Only scratch space lives here, so copies start empty.
+	MortonSorter(const MortonSorter&) {}
+	MortonSorter& operator=(const MortonSorter&) { return *this; }
+
+	void Sort(ParticleStore& particles, float width, float height, WorkerPool& pool);
+	// After a Sort, slot i holds the particle that was at GetOrder()[i].
+	const std::vector<uint32_t>& GetOrder() const { return order; }
+
+private:
+	std::vector<uint32_t> keys, keysScratch;
+	std::vector<uint32_t> order, orderScratch;
+	std::vector<uint32_t> digitOffsets;
+	std::vector<float> floatScratch;
+	std::vector<uint32_t> idScratch;
+};
@@ -0,0 +1,83 @@
+#include "ParticleBuckets.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+// Particles counted and scattered by one worker at a time.
+const size_t BUCKET_CHUNK = 65536;
+const int BUCKET_CELLS = PARTICLE_BUCKET_COLUMNS * PARTICLE_BUCKET_ROWS;
+
+static int bucketColumn(float x, float columnScale) {
+	return std::min(std::max((int)(x * columnScale), 0), PARTICLE_BUCKET_COLUMNS - 1);
+}
+
+static int bucketRow(float y, float rowScale) {
+	return std::min(std::max((int)(y * rowScale), 0), PARTICLE_BUCKET_ROWS - 1);
+}
+
+void ParticleBuckets::FindVisible(float left, float bottom, float right, float top, std::vector<ParticleRange>& ranges) const {
+	ranges.clear();
+	if (start.size() != (size_t)BUCKET_CELLS + 1 || right < 0.0f || top < 0.0f || left > width || bottom > height) {
+		return;
+	}
+	float columnScale = PARTICLE_BUCKET_COLUMNS / width;
+	float rowScale = PARTICLE_BUCKET_ROWS / height;
+	int firstColumn = bucketColumn(left, columnScale);
+	int lastColumn = bucketColumn(right, columnScale);
+	for (int row = bucketRow(bottom, rowScale); row <= bucketRow(top, rowScale); ++row) {
+		size_t begin = start[row * PARTICLE_BUCKET_COLUMNS + firstColumn];
+		size_t end = start[row * PARTICLE_BUCKET_COLUMNS + lastColumn + 1];
+		if (end > begin) {
+			ranges.push_back({ begin, end });
+		}
+	}
+}
+
+void BucketSorter::Sort(const float* x, const float* y, size_t count, float width, float height, ParticleBuckets& buckets,
+	WorkerPool& pool) {
+	size_t chunks = (count + BUCKET_CHUNK - 1) / BUCKET_CHUNK;
+	chunkCounts.assign(chunks * BUCKET_CELLS, 0);
+	slots.resize(count);
+	float columnScale = PARTICLE_BUCKET_COLUMNS / width;
+	float rowScale = PARTICLE_BUCKET_ROWS / height;
+
+	pool.ParallelFor(count, BUCKET_CHUNK, [&](size_t begin, size_t end, size_t) {
+		uint32_t* counts = &chunkCounts[begin / BUCKET_CHUNK * BUCKET_CELLS];
+		for (size_t i = begin; i < end; ++i) {
+			uint32_t cell = (uint32_t)(bucketRow(y[i], rowScale) * PARTICLE_BUCKET_COLUMNS + bucketColumn(x[i], columnScale));
+			slots[i] = cell;
+			counts[cell]++;
+		}
+	});
+
+	// Cell-major prefix sum: each chunk gets its own slice of every cell's
+	// range, so the scatter needs no atomics and keeps slot order.
+	buckets.width = width;
+	buckets.height = height;
+	buckets.start.resize(BUCKET_CELLS + 1);
+	uint32_t offset = 0;
+	for (int cell = 0; cell < BUCKET_CELLS; ++cell) {
+		buckets.start[cell] = offset;
+		for (size_t chunk = 0; chunk < chunks; ++chunk) {
+			uint32_t counted = chunkCounts[chunk * BUCKET_CELLS + cell];
+			chunkCounts[chunk * BUCKET_CELLS + cell] = offset;
+			offset += counted;
+		}
+	}
+	buckets.start[BUCKET_CELLS] = offset;
+
+	pool.ParallelFor(count, BUCKET_CHUNK, [&](size_t begin, size_t end, size_t) {
+		uint32_t* cursors = &chunkCounts[begin / BUCKET_CHUNK * BUCKET_CELLS];
+		for (size_t i = begin; i < end; ++i) {
+			slots[i] = cursors[slots[i]]++;
+		}
+	});
+}
+
+void BucketSorter::Scatter(const float* from, float* to, WorkerPool& pool) const {
+	pool.ParallelFor(slots.size(), BUCKET_CHUNK, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			to[slots[i]] = from[i];
+		}
+	});
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Coarse cells across and down the world. In a world 100 times the size of
+// the screen, a screen-sized view still only overlaps a few of them.
+const int PARTICLE_BUCKET_COLUMNS = 64;
+const int PARTICLE_BUCKET_ROWS = 64;
+
+// Particle slots [begin, end).
+struct ParticleRange {
+	size_t begin, end;
+};
+
+// Where each coarse cell's particles are, once their positions have been
+// grouped by cell (see BucketSorter). Cells are row-major from (0, 0) and
+// particles outside the world count in the nearest edge cell, so the cells
+// of one row that a rectangle overlaps hold one contiguous range.
+struct ParticleBuckets {
+	float width = 0.0f, height = 0.0f;
+	// Particles of cell c are [start[c], start[c + 1]); empty before the
+	// first sort.
+	std::vector<uint32_t> start;
+
+	// Replaces `ranges` with the particles of every cell overlapping
+	// [left, right] x [bottom, top], one range per row of cells.
+	void FindVisible(float left, float bottom, float right, float top, std::vector<ParticleRange>& ranges) const;
+};
+
+// Groups positions by coarse cell with a parallel counting sort. Slot order
+// is kept within a cell, and any other per-particle array can be permuted
+// the same way with Scatter.
+class BucketSorter {
+public:
+	// Groups `count` positions in a world of the given size and describes
+	// the result in `buckets`.
+	void Sort(const float* x, const float* y, size_t count, float width, float height, ParticleBuckets& buckets,
+		WorkerPool& pool);
+	// Writes from[i] to its grouped slot in `to`, for every particle of the last Sort.
+	void Scatter(const float* from, float* to, WorkerPool& pool) const;
+
+private:
+	// Per chunk and cell: particles counted, then where the chunk's slice starts.
+	std::vector<uint32_t> chunkCounts;
+	// Cell of each particle, then its grouped slot.
+	std::vector<uint32_t> slots;
+};
@@ -0,0 +1,188 @@
+#include "ParticleCollider.h"
+#include "Simulation.h"
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Particles handed to a worker at a time while bucketing.
+const size_t COLLIDE_CHUNK = 4096;
+// Cells per block of the parallel prefix sum.
+const size_t SCAN_BLOCK = 4096;
+// Cells handed to a worker at a time in a colour pass.
+const size_t COLOR_CHUNK = 64;
+// Cells never get smaller than this, whatever the radius.
+const float MIN_COLLISION_CELL = 2.0f;
+// Most cells of the grid; cells grow in worlds large enough to need more.
+const float MAX_COLLISION_CELLS = (float)(1 << 22);
+
+// Neighbours that share pairs with a cell besides itself. The other four are
+// covered by the neighbours' own passes, so each pair is tested once.
+static const int OWNED_NEIGHBORS[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+
+// Equal masses: the two velocities swap their components along the line of
+// centres. Pairs already moving apart are left alone so they cannot stick.
+static bool collidePair(ParticleStore& particles, uint32_t i, uint32_t j, float diameterSquared) {
+	float dx = particles.x[j] - particles.x[i];
+	float dy = particles.y[j] - particles.y[i];
+	float distanceSquared = dx * dx + dy * dy;
+	if (distanceSquared >= diameterSquared || distanceSquared == 0.0f) {
+		return false;
+	}
+
+	float approach = (particles.vx[j] - particles.vx[i]) * dx + (particles.vy[j] - particles.vy[i]) * dy;
+	if (approach >= 0.0f) {
+		return false;
+	}
+
+	float impulse = approach / distanceSquared;
+	particles.vx[i] += impulse * dx;
+	particles.vy[i] += impulse * dy;
+	particles.vx[j] -= impulse * dx;
+	particles.vy[j] -= impulse * dy;
+	return true;
+}
+
+void ParticleCollider::Resize(float radius, float width, float height) {
+	// Cells at least one diameter wide, and large enough in a big world to
+	// keep the grid within MAX_COLLISION_CELLS.
+	float size = std::max({ 2.0f * radius, MIN_COLLISION_CELL, std::sqrt(width * height / MAX_COLLISION_CELLS) });
+	diameterSquared = 4.0f * radius * radius;
+	if (size == cellSize && width == gridWidth && height == gridHeight && cellFill) {
+		return;
+	}
+
+	cellSize = size;
+	gridWidth = width;
+	gridHeight = height;
+	columns = std::max(1, (int)ceil(width / cellSize));
+	rows = std::max(1, (int)ceil(height / cellSize));
+	size_t cells = (size_t)columns * rows;
+	cellStart.resize(cells + 1);
+	blockSums.resize((cells + SCAN_BLOCK - 1) / SCAN_BLOCK);
+	cellFill.reset(new std::atomic<uint32_t>[cells]);
+}
+
+void ParticleCollider::BuildCells(const ParticleStore& particles, WorkerPool& pool) {
+	size_t count = particles.Size();
+	size_t cells = (size_t)columns * rows;
+	cellOf.resize(count);
+	sorted.resize(count);
+
+	pool.ParallelFor(cells, SCAN_BLOCK, [&](size_t begin, size_t end, size_t) {
+		for (size_t c = begin; c < end; ++c) {
+			cellFill[c].store(0, std::memory_order_relaxed);
+		}
+	});
+
+	pool.ParallelFor(count, COLLIDE_CHUNK, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			int cx = std::min(std::max((int)(particles.x[i] / cellSize), 0), columns - 1);
+			int cy = std::min(std::max((int)(particles.y[i] / cellSize), 0), rows - 1);
+			uint32_t cell = (uint32_t)cy * columns + cx;
+			cellOf[i] = cell;
+			cellFill[cell].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+
+	// Exclusive prefix sum of the cell counts: block totals in parallel, a
+	// short serial scan over the blocks, then each block offsets its cells.
+	pool.ParallelFor(cells, SCAN_BLOCK, [&](size_t begin, size_t end, size_t) {
+		uint32_t sum = 0;
+		for (size_t c = begin; c < end; ++c) {
+			sum += cellFill[c].load(std::memory_order_relaxed);
+		}
+		blockSums[begin / SCAN_BLOCK] = sum;
+	});
+
+	uint32_t offset = 0;
+	for (auto& sum : blockSums) {
+		uint32_t blockTotal = sum;
+		sum = offset;
+		offset += blockTotal;
+	}
+
+	pool.ParallelFor(cells, SCAN_BLOCK, [&](size_t begin, size_t end, size_t) {
+		uint32_t start = blockSums[begin / SCAN_BLOCK];
+		for (size_t c = begin; c < end; ++c) {
+			cellStart[c] = start;
+			start += cellFill[c].load(std::memory_order_relaxed);
+			cellFill[c].store(cellStart[c], std::memory_order_relaxed);
+		}
+	});
+	cellStart[cells] = (uint32_t)count;
+
+	pool.ParallelFor(count, COLLIDE_CHUNK, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			sorted[cellFill[cellOf[i]].fetch_add(1, std::memory_order_relaxed)] = (uint32_t)i;
+		}
+	});
+
+	// The scatter order depends on thread timing; cells are short, so
+	// sorting them restores index order cheaply.
+	pool.ParallelFor(cells, SCAN_BLOCK, [&](size_t begin, size_t end, size_t) {
+		for (size_t c = begin; c < end; ++c) {
+			if (cellStart[c + 1] - cellStart[c] > 1) {
+				std::sort(sorted.begin() + cellStart[c], sorted.begin() + cellStart[c + 1]);
+			}
+		}
+	});
+}
+
+void ParticleCollider::CollideCell(ParticleStore& particles, int cx, int cy, WorkerStats& stats) const {
+	size_t cell = (size_t)cy * columns + cx;
+	for (uint32_t a = cellStart[cell]; a < cellStart[cell + 1]; ++a) {
+		uint32_t i = sorted[a];
+
+		for (uint32_t b = a + 1; b < cellStart[cell + 1]; ++b) {
+			stats.pairTests++;
+			stats.particleCollisions += collidePair(particles, i, sorted[b], diameterSquared);
+		}
+
+		for (const auto& offset : OWNED_NEIGHBORS) {
+			int nx = cx + offset[0];
+			int ny = cy + offset[1];
+			if (nx < 0 || nx >= columns || ny >= rows) {
+				continue;
+			}
+			size_t neighbor = (size_t)ny * columns + nx;
+			for (uint32_t b = cellStart[neighbor]; b < cellStart[neighbor + 1]; ++b) {
+				stats.pairTests++;
+				stats.particleCollisions += collidePair(particles, i, sorted[b], diameterSquared);
+			}
+		}
+	}
+}
+
+void ParticleCollider::Resolve(ParticleStore& particles, float radius, float width, float height,
+	WorkerPool& pool, std::vector<WorkerStats>& stats) {
+	if (particles.Size() < 2 || radius <= 0.0f) {
+		return;
+	}
+
+	ProfileScope scope(PROFILE_PARTICLE_COLLISIONS);
+	Resize(radius, width, height);
+	BuildCells(particles, pool);
+
+	// A cell writes to itself and the owned neighbours, all within one cell
+	// of it, so cells three apart in both directions never share a particle.
+	for (int color = 0; color < 9; ++color) {
+		int offsetX = color % 3;
+		int offsetY = color / 3;
+		int colorColumns = (columns - offsetX + 2) / 3;
+		int colorRows = (rows - offsetY + 2) / 3;
+		if (colorColumns <= 0 || colorRows <= 0) {
+			continue;
+		}
+
+		pool.ParallelFor((size_t)colorColumns * colorRows, COLOR_CHUNK, [&](size_t begin, size_t end, size_t workerIndex) {
+			ProfileScope chunkScope(PROFILE_COLLIDE_CHUNK);
+			for (size_t k = begin; k < end; ++k) {
+				int cx = offsetX + 3 * (int)(k % colorColumns);
+				int cy = offsetY + 3 * (int)(k / colorColumns);
+				CollideCell(particles, cx, cy, stats[workerIndex]);
+			}
+		});
+	}
+}
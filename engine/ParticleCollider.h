@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ParticleStore;
+class WorkerPool;
+struct WorkerStats;
+
+// Elastic collisions between equal-mass particles of a common radius.
+//
+// Every tick the particles are bucketed into a cell list (cells one diameter
+// wide) with a parallel counting sort. Each pair is then tested only by the
+// cell that owns it, and cells are processed in nine colour passes of cells
+// three apart, so no two workers ever touch the same particle and the
+// narrowphase needs no locks. Particles within a cell are kept in index order,
+// which keeps results independent of the thread count.
+class ParticleCollider {
+public:
+	ParticleCollider() {}
+	// Everything here is rebuilt each tick, so copies start empty.
+	ParticleCollider(const ParticleCollider&) {}
+	ParticleCollider& operator=(const ParticleCollider&) { return *this; }
+
+	void Resolve(ParticleStore& particles, float radius, float width, float height,
+		WorkerPool& pool, std::vector<WorkerStats>& stats);
+
+private:
+	void Resize(float radius, float width, float height);
+	void BuildCells(const ParticleStore& particles, WorkerPool& pool);
+	void CollideCell(ParticleStore& particles, int cx, int cy, WorkerStats& stats) const;
+
+	float cellSize = 0.0f;
+	float gridWidth = 0.0f, gridHeight = 0.0f;
+	float diameterSquared = 0.0f;
+	int columns = 0, rows = 0;
+
+	std::vector<uint32_t> cellOf;
+	std::vector<uint32_t> sorted;
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> blockSums;
+	std::unique_ptr<std::atomic<uint32_t>[]> cellFill;
+};
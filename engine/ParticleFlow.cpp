@@ -0,0 +1,127 @@
+#include "ParticleFlow.h"
+#include "ParticleStore.h"
+#include "Simulation.h"
+#include "Collision.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <cmath>
+
+static bool insideRegion(const Sink& sink, float x, float y) {
+	return x >= std::min(sink.x0, sink.x1) && x <= std::max(sink.x0, sink.x1) &&
+		y >= std::min(sink.y0, sink.y1) && y <= std::max(sink.y0, sink.y1);
+}
+
+void ParticleFlow::Prepare(ParticleStore& store, size_t maxParticles, size_t workers) {
+	if (capacity != maxParticles || store.Capacity() < maxParticles) {
+		capacity = maxParticles;
+		store.ReservePool(capacity);
+		absorbed.reserve(capacity);
+	}
+	if (caught.size() < workers) {
+		caught.resize(workers);
+	}
+	owed.resize(emitters.size(), 0.0);
+
+	hasLines = false;
+	for (const Sink& sink : sinks) {
+		hasLines = hasLines || sink.shape == SINK_LINE;
+	}
+	if (hasLines && startX.size() < store.Capacity()) {
+		startX.resize(store.Capacity());
+		startY.resize(store.Capacity());
+	}
+}
+
+void ParticleFlow::SetAbsorbBorders(bool absorb, float borderWidth, float borderHeight) {
+	absorbBorders = absorb;
+	width = borderWidth;
+	height = borderHeight;
+}
+
+void ParticleFlow::BeginRange(const ParticleStore& store, size_t begin, size_t end) {
+	if (!hasLines) {
+		return;
+	}
+	std::copy(store.x.Data() + begin, store.x.Data() + end, startX.begin() + begin);
+	std::copy(store.y.Data() + begin, store.y.Data() + end, startY.begin() + begin);
+}
+
+void ParticleFlow::EndRange(const ParticleStore& store, size_t begin, size_t end, size_t worker) {
+	std::vector<uint32_t>& out = caught[worker];
+	for (size_t i = begin; i < end; ++i) {
+		float x = store.x[i];
+		float y = store.y[i];
+		if (absorbBorders && (x < 0.0f || x > width || y < 0.0f || y > height)) {
+			out.push_back((uint32_t)i);
+			continue;
+		}
+		for (const Sink& sink : sinks) {
+			bool hit = sink.shape == SINK_REGION ? insideRegion(sink, x, y) :
+				CrossesWall(Wall(sink.x0, sink.y0, sink.x1, sink.y1), startX[i], startY[i], x, y);
+			if (hit) {
+				out.push_back((uint32_t)i);
+				break;
+			}
+		}
+	}
+}
+
+void ParticleFlow::Apply(ParticleStore& store, const std::vector<Wall>& walls, const WallGrid& grid,
+	uint64_t seed, uint64_t tick, float deltaTime, float width, float height) {
+	// FreeAll queues the ids in id order, so neither how chunks were dealt
+	// out nor a Morton reorder changes which ids the emitters reuse.
+	absorbed.clear();
+	for (std::vector<uint32_t>& list : caught) {
+		absorbed.insert(absorbed.end(), list.begin(), list.end());
+		list.clear();
+	}
+	store.FreeAll(absorbed);
+	stats.absorbed += absorbed.size();
+
+	for (size_t e = 0; e < emitters.size(); ++e) {
+		const Emitter& emitter = emitters[e];
+		owed[e] += (double)emitter.rate * deltaTime;
+		uint32_t due = (uint32_t)owed[e];
+		owed[e] -= due;
+
+		for (uint32_t k = 0; k < due; ++k) {
+			if (store.Size() >= capacity) {
+				stats.dropped += due - k;
+				break;
+			}
+			RandomBlock random = RandomFor(seed, (uint32_t)e, tick, RANDOM_EMIT, k);
+			float angle = emitter.direction + RandomRange(random.v[0], -0.5f, 0.5f) * emitter.spread;
+			float speed = RandomRange(random.v[1], emitter.minSpeed, emitter.maxSpeed);
+			float vx, vy;
+			HeadingToVelocity(angle, speed, vx, vy);
+
+			// Spread each tick's batch along the first tick of its path so a
+			// stream leaves the emitter evenly rather than in pulses.
+			float lead = RandomUnit(random.v[2]) * deltaTime;
+			float x = std::min(std::max(emitter.x + vx * lead, 0.0f), width);
+			float y = std::min(std::max(emitter.y + vy * lead, 0.0f), height);
+			if (!grid.Empty()) {
+				grid.Query(emitter.x, emitter.y, x, y, found);
+				for (uint32_t wallIndex : found) {
+					if (CrossesWall(walls[wallIndex], emitter.x, emitter.y, x, y)) {
+						x = emitter.x;
+						y = emitter.y;
+						break;
+					}
+				}
+			}
+			store.Add(x, y, vx, vy);
+			++stats.emitted;
+		}
+	}
+}
+
+void ParticleFlow::Clear() {
+	emitters.clear();
+	sinks.clear();
+	owed.clear();
+	for (std::vector<uint32_t>& list : caught) {
+		list.clear();
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ParticleStore;
+class Wall;
+class WallGrid;
+
+// A continuous source of particles, in canvas coordinates.
+struct Emitter {
+	float x = 0.0f, y = 0.0f;
+	// Particles per second of simulated time.
+	float rate = 0.0f;
+	// Particles leave within spread / 2 degrees either side of direction.
+	float direction = 0.0f;
+	float spread = 0.0f;
+	float minSpeed = 0.0f, maxSpeed = 0.0f;
+};
+
+enum SinkShape {
+	// Absorbs particles that end a tick inside the rectangle (x0, y0)-(x1, y1).
+	SINK_REGION = 0,
+	// Absorbs particles whose move during a tick crosses the segment. It does
+	// not deflect anything, so a sink line on top of a wall sees nothing.
+	SINK_LINE = 1
+};
+
+struct Sink {
+	SinkShape shape = SINK_REGION;
+	float x0 = 0.0f, y0 = 0.0f;
+	float x1 = 0.0f, y1 = 0.0f;
+};
+
+// Totals since the flow was last reset.
+struct FlowStats {
+	uint64_t emitted = 0;
+	uint64_t absorbed = 0;
+	// Emissions skipped because the store was at capacity.
+	uint64_t dropped = 0;
+};
+
+// Emitters and sinks for steady-state flow scenes. Workers only note which
+// particles a sink caught while they step; the particles are freed and the
+// new ones emitted between ticks, where nothing holds an index into the
+// store. Freed ids are recycled through the store's free list and every
+// buffer here keeps its capacity, so once a scene reaches steady state a
+// tick allocates nothing.
+class ParticleFlow {
+public:
+	std::vector<Emitter> emitters;
+	std::vector<Sink> sinks;
+
+	bool Active() const { return !emitters.empty() || !sinks.empty() || absorbBorders; }
+	// Also absorbs particles that end a tick outside [0, width] x [0, height].
+	void SetAbsorbBorders(bool absorb, float width, float height);
+
+	// Before a tick: sizes the per-worker buffers and reserves the store for
+	// `capacity` particles, the most the emitters will fill it to.
+	void Prepare(ParticleStore& store, size_t capacity, size_t workers);
+	// On the workers: call before moving particles [begin, end) ...
+	void BeginRange(const ParticleStore& store, size_t begin, size_t end);
+	// ... and after, to queue those a sink caught.
+	void EndRange(const ParticleStore& store, size_t begin, size_t end, size_t worker);
+	// At the tick boundary: frees the caught particles, then emits this tick's
+	// share of every emitter's rate. Emissions are keyed by (seed, emitter,
+	// tick), so the result does not depend on the thread count.
+	void Apply(ParticleStore& store, const std::vector<Wall>& walls, const WallGrid& grid,
+		uint64_t seed, uint64_t tick, float deltaTime, float width, float height);
+
+	void Clear();
+	const FlowStats& GetStats() const { return stats; }
+	void ResetStats() { stats = FlowStats(); }
+
+private:
+	size_t capacity = 0;
+	bool hasLines = false;
+	bool absorbBorders = false;
+	float width = 0.0f, height = 0.0f;
+	// Positions at the start of the tick, for the sink line test.
+	std::vector<float> startX, startY;
+	std::vector<std::vector<uint32_t>> caught;
+	std::vector<uint32_t> absorbed;
+	// Fraction of a particle each emitter has owed since its last emission.
+	std::vector<double> owed;
+	std::vector<uint32_t> found;
+	FlowStats stats;
+};
@@ -0,0 +1,225 @@
+#include "ParticleStore.h"
+
+#include <algorithm>
+#include <cmath>
+
+void ParticleStore::Reserve(size_t minCapacity) {
+	if (minCapacity <= capacity) {
+		return;
+	}
+
+	size_t newCapacity = (minCapacity + PARTICLE_PADDING - 1) / PARTICLE_PADDING * PARTICLE_PADDING;
+	x.Reallocate(newCapacity, count);
+	y.Reallocate(newCapacity, count);
+	vx.Reallocate(newCapacity, count);
+	vy.Reallocate(newCapacity, count);
+	id.Reallocate(newCapacity, count);
+	capacity = newCapacity;
+	backing.reset();
+}
+
+void ParticleStore::ReservePool(size_t maxParticles) {
+	Reserve(maxParticles);
+	freeIds.reserve(maxParticles);
+	generations.reserve(maxParticles);
+	indexOfId.reserve(maxParticles);
+}
+
+void ParticleStore::Clear() {
+	count = 0;
+	nextId = 0;
+	freeIds.clear();
+	generations.clear();
+	LayoutChanged();
+}
+
+void ParticleStore::Adopt(std::shared_ptr<void> memory, float* px, float* py, float* pvx, float* pvy, uint32_t* ids,
+	size_t n, size_t stride, uint32_t firstFreeId) {
+	x.Adopt(px, stride);
+	y.Adopt(py, stride);
+	vx.Adopt(pvx, stride);
+	vy.Adopt(pvy, stride);
+	id.Adopt(ids, stride);
+	backing = std::move(memory);
+	count = n;
+	capacity = stride;
+	nextId = firstFreeId;
+	freeIds.clear();
+	generations.clear();
+	LayoutChanged();
+}
+
+uint32_t ParticleStore::TakeId() {
+	if (freeIds.empty()) {
+		return nextId++;
+	}
+	uint32_t reused = freeIds.back();
+	freeIds.pop_back();
+	return reused;
+}
+
+void ParticleStore::Push(float px, float py, float pvx, float pvy, uint32_t pid) {
+	if (count == capacity) {
+		Reserve(capacity < 1024 ? 1024 : capacity * 2);
+	}
+
+	size_t i = count++;
+	x[i] = px;
+	y[i] = py;
+	vx[i] = pvx;
+	vy[i] = pvy;
+	id[i] = pid;
+	++layoutVersion;
+	IndexMoved(pid, i);
+}
+
+size_t ParticleStore::Add(float px, float py, float pvx, float pvy) {
+	Push(px, py, pvx, pvy, TakeId());
+	return count - 1;
+}
+
+void ParticleStore::Resize(size_t n) {
+	Reserve(n);
+	count = n;
+	LayoutChanged();
+}
+
+void ParticleStore::Release() {
+	uint32_t keepNextId = nextId;
+	std::vector<uint32_t> keepFreeIds = std::move(freeIds);
+	std::vector<uint32_t> keepGenerations = std::move(generations);
+	uint64_t keepLayoutVersion = layoutVersion;
+	*this = ParticleStore();
+	nextId = keepNextId;
+	layoutVersion = keepLayoutVersion;
+	freeIds = std::move(keepFreeIds);
+	generations = std::move(keepGenerations);
+}
+
+size_t ParticleStore::AddWithId(float px, float py, float pvx, float pvy, uint32_t pid) {
+	Push(px, py, pvx, pvy, pid);
+	nextId = std::max(nextId, pid + 1);
+	return count - 1;
+}
+
+void ParticleStore::Remove(size_t i) {
+	size_t last = --count;
+	uint32_t removed = id[i];
+	x[i] = x[last];
+	y[i] = y[last];
+	vx[i] = vx[last];
+	vy[i] = vy[last];
+	id[i] = id[last];
+	++layoutVersion;
+	IndexMoved(id[i], i);
+	IndexMoved(removed, SIZE_MAX);
+}
+
+void ParticleStore::IndexMoved(uint32_t pid, size_t i) {
+	if (!indexValid) {
+		return;
+	}
+	if (pid >= indexOfId.size()) {
+		indexOfId.resize(pid + 1, UINT32_MAX);
+	}
+	indexOfId[pid] = i == SIZE_MAX ? UINT32_MAX : (uint32_t)i;
+}
+
+void ParticleStore::RetireId(uint32_t particleId) {
+	if (particleId >= generations.size()) {
+		generations.resize(nextId, 0);
+	}
+	++generations[particleId];
+	freeIds.push_back(particleId);
+}
+
+void ParticleStore::Free(size_t i) {
+	RetireId(id[i]);
+	Remove(i);
+}
+
+void ParticleStore::FreeAll(std::vector<uint32_t>& indices) {
+	// Highest id first, so the lowest is the next one reused.
+	std::sort(indices.begin(), indices.end(), [this](uint32_t a, uint32_t b) { return id[a] > id[b]; });
+	for (uint32_t i : indices) {
+		RetireId(id[i]);
+	}
+	// Removing from the highest index down only ever moves survivors.
+	std::sort(indices.begin(), indices.end());
+	for (size_t k = indices.size(); k-- > 0;) {
+		Remove(indices[k]);
+	}
+}
+
+uint32_t ParticleStore::GenerationOf(uint32_t particleId) const {
+	return particleId < generations.size() ? generations[particleId] : 0;
+}
+
+ParticleHandle ParticleStore::GetHandle(size_t i) const {
+	ParticleHandle handle;
+	handle.id = id[i];
+	handle.generation = GenerationOf(id[i]);
+	return handle;
+}
+
+size_t ParticleStore::Resolve(ParticleHandle handle) {
+	if (handle.id >= nextId || GenerationOf(handle.id) != handle.generation) {
+		return SIZE_MAX;
+	}
+	return Find(handle.id);
+}
+
+void ParticleStore::Append(const float* px, const float* py, const float* pvx, const float* pvy, size_t n) {
+	if (count + n > capacity) {
+		Reserve(std::max(count + n, capacity * 2));
+	}
+
+	memcpy(x.Data() + count, px, n * sizeof(float));
+	memcpy(y.Data() + count, py, n * sizeof(float));
+	memcpy(vx.Data() + count, pvx, n * sizeof(float));
+	memcpy(vy.Data() + count, pvy, n * sizeof(float));
+	for (size_t i = 0; i < n; ++i) {
+		id[count + i] = TakeId();
+	}
+	count += n;
+	LayoutChanged();
+}
+
+size_t ParticleStore::Find(uint32_t particleId) {
+	if (!indexValid) {
+		indexOfId.assign(nextId, UINT32_MAX);
+		for (size_t i = 0; i < count; ++i) {
+			indexOfId[id[i]] = (uint32_t)i;
+		}
+		indexValid = true;
+	}
+	if (particleId >= indexOfId.size() || indexOfId[particleId] == UINT32_MAX) {
+		return SIZE_MAX;
+	}
+	return indexOfId[particleId];
+}
+
+size_t ParticleStore::AddHeading(float px, float py, float angle, float velocity) {
+	float pvx, pvy;
+	HeadingToVelocity(angle, velocity, pvx, pvy);
+	return Add(px, py, pvx, pvy);
+}
+
+float ParticleStore::GetAngle(size_t i) const {
+	return VelocityToAngle(vx[i], vy[i]);
+}
+
+float ParticleStore::GetSpeed(size_t i) const {
+	return sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+}
+
+void HeadingToVelocity(float angle, float velocity, float& vx, float& vy) {
+	float radians = angle * PI / 180.0f;
+	vx = cos(radians) * velocity;
+	vy = sin(radians) * velocity;
+}
+
+float VelocityToAngle(float vx, float vy) {
+	float angle = atan2(vy, vx) * 180.0f / PI;
+	return angle < 0 ? angle + 360.0f : angle;
+}
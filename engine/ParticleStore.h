@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+const float PI = 3.14159265359f;
+
+// Cache-line alignment for every particle array.
+const size_t PARTICLE_ALIGNMENT = 64;
+// Capacities are rounded up to this many floats so SIMD loads never run past the end.
+const size_t PARTICLE_PADDING = 16;
+
+inline void* AlignedAllocate(size_t bytes) {
+	bytes = (bytes + PARTICLE_ALIGNMENT - 1) / PARTICLE_ALIGNMENT * PARTICLE_ALIGNMENT;
+#if defined(_MSC_VER)
+	void* memory = _aligned_malloc(bytes, PARTICLE_ALIGNMENT);
+#else
+	void* memory = std::aligned_alloc(PARTICLE_ALIGNMENT, bytes);
+#endif
+	if (!memory) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+inline void AlignedFree(void* memory) {
+#if defined(_MSC_VER)
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+// Minimal aligned array of trivially copyable values. Growth keeps the first
+// `keep` elements; new elements are zeroed so padding lanes stay harmless.
+// An array can also borrow memory it does not own (see Adopt); it switches
+// to its own allocation the next time it is reallocated or copied.
+template <typename T>
+class AlignedArray {
+public:
+	AlignedArray() {}
+	~AlignedArray() {
+		if (owned) {
+			AlignedFree(data);
+		}
+	}
+
+	AlignedArray(const AlignedArray& other) {
+		Reallocate(other.capacity, 0);
+		if (capacity > 0) {
+			memcpy(data, other.data, capacity * sizeof(T));
+		}
+	}
+
+	AlignedArray(AlignedArray&& other) noexcept {
+		std::swap(data, other.data);
+		std::swap(capacity, other.capacity);
+		std::swap(owned, other.owned);
+	}
+
+	AlignedArray& operator=(AlignedArray other) noexcept {
+		std::swap(data, other.data);
+		std::swap(capacity, other.capacity);
+		std::swap(owned, other.owned);
+		return *this;
+	}
+
+	T* Data() { return data; }
+	const T* Data() const { return data; }
+	size_t Capacity() const { return capacity; }
+
+	T& operator[](size_t i) { return data[i]; }
+	const T& operator[](size_t i) const { return data[i]; }
+
+	void Reallocate(size_t newCapacity, size_t keep) {
+		T* newData = newCapacity > 0 ? (T*)AlignedAllocate(newCapacity * sizeof(T)) : nullptr;
+		if (newCapacity > 0) {
+			memset(newData, 0, newCapacity * sizeof(T));
+		}
+		if (keep > 0) {
+			memcpy(newData, data, keep * sizeof(T));
+		}
+		if (owned) {
+			AlignedFree(data);
+		}
+		data = newData;
+		capacity = newCapacity;
+		owned = true;
+	}
+
+	// Points the array at `externalCapacity` elements of PARTICLE_ALIGNMENT
+	// aligned memory owned by someone else, e.g. a mapped checkpoint file.
+	void Adopt(T* external, size_t externalCapacity) {
+		if (owned) {
+			AlignedFree(data);
+		}
+		data = external;
+		capacity = externalCapacity;
+		owned = false;
+	}
+
+private:
+	T* data = nullptr;
+	size_t capacity = 0;
+	bool owned = true;
+};
+
+// Names one particle for as long as it lives. Ids of freed particles are
+// handed out again, and each reuse bumps the id's generation, so a handle to
+// a freed particle stops resolving instead of finding its successor.
+struct ParticleHandle {
+	uint32_t id = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+// Structure-of-arrays particle storage. The heading is kept as a velocity
+// vector (pixels/sec) so integration needs no trigonometry; angle and speed
+// are only derived when a particle is read back or reflected off a wall.
+// Each particle also gets a stable id, handed out in spawn order, which keys
+// its random draws so they do not depend on where the particle is stored.
+class ParticleStore {
+public:
+	AlignedArray<float> x, y;
+	AlignedArray<float> vx, vy;
+	AlignedArray<uint32_t> id;
+
+	size_t Size() const { return count; }
+	size_t Capacity() const { return capacity; }
+	bool Empty() const { return count == 0; }
+
+	void Reserve(size_t minCapacity);
+	// Reserve plus room for `maxParticles` ids in the free list and lookup
+	// tables, so adding and freeing below that never allocates.
+	void ReservePool(size_t maxParticles);
+	// Also forgets freed ids; handles do not survive a Clear.
+	void Clear();
+	// Sets the size without initialising new particles, for scratch stores.
+	void Resize(size_t n);
+	// Empties the store and frees its arrays, but keeps handing out ids from
+	// where it left off.
+	void Release();
+
+	size_t Add(float px, float py, float pvx, float pvy);
+	size_t AddHeading(float px, float py, float angle, float velocity);
+	// Bulk Add of n particles with a single reservation.
+	void Append(const float* px, const float* py, const float* pvx, const float* pvy, size_t n);
+	// Adds a particle that already has an id, e.g. one handed over by another
+	// store. Later ids are handed out past it.
+	size_t AddWithId(float px, float py, float pvx, float pvy, uint32_t pid);
+	// Removes particle i by moving the last particle into its slot.
+	void Remove(size_t i);
+	// Remove, and puts the particle's id on the free list for the next Add.
+	void Free(size_t i);
+	// Frees the particles at `indices` (which it reorders). Their ids go on the
+	// free list in id order, so which id the next Add reuses does not depend
+	// on where the particles were stored.
+	void FreeAll(std::vector<uint32_t>& indices);
+
+	ParticleHandle GetHandle(size_t i) const;
+	// Index of the handle's particle, or SIZE_MAX once it has been freed.
+	size_t Resolve(ParticleHandle handle);
+	size_t GetFreeIdCount() const { return freeIds.size(); }
+
+	float GetAngle(size_t i) const;
+	float GetSpeed(size_t i) const;
+
+	// Takes over `n` particles laid out in arrays of `stride` elements in
+	// memory kept alive by `backing`, without copying them. The store moves to
+	// its own memory the first time it has to grow.
+	void Adopt(std::shared_ptr<void> backing, float* px, float* py, float* pvx, float* pvy, uint32_t* ids,
+		size_t n, size_t stride, uint32_t firstFreeId);
+	uint32_t GetNextId() const { return nextId; }
+
+	// Index of the particle with the given id, or SIZE_MAX if there is none.
+	// The id table behind it is built by the first lookup, then kept up to
+	// date by single adds and removes; bulk appends, resizes and reorders
+	// make the next lookup rebuild it.
+	size_t Find(uint32_t particleId);
+	// Tells the store its ids were moved by writing the arrays directly.
+	void IdsMoved() { LayoutChanged(); }
+	// Bumped whenever particles are added, removed or moved between slots, so
+	// anything kept per slot is still valid while the version is unchanged.
+	uint64_t GetLayoutVersion() const { return layoutVersion; }
+
+private:
+	void LayoutChanged() {
+		indexValid = false;
+		++layoutVersion;
+	}
+	// Records in the id table, if it is built, that `pid` now lives at slot i.
+	void IndexMoved(uint32_t pid, size_t i);
+	void Push(float px, float py, float pvx, float pvy, uint32_t pid);
+	// The most recently freed id, or a new one.
+	uint32_t TakeId();
+	// Bumps the id's generation and puts it on the free list.
+	void RetireId(uint32_t particleId);
+	uint32_t GenerationOf(uint32_t particleId) const;
+
+	size_t count = 0;
+	size_t capacity = 0;
+	uint32_t nextId = 0;
+	std::vector<uint32_t> freeIds;
+	// Times each id has been freed; ids past the end have never been.
+	std::vector<uint32_t> generations;
+	std::shared_ptr<void> backing;
+	std::vector<uint32_t> indexOfId;
+	bool indexValid = false;
+	uint64_t layoutVersion = 0;
+};
+
+// Degrees/speed to a velocity vector, the representation used by ParticleStore.
+void HeadingToVelocity(float angle, float velocity, float& vx, float& vy);
+// Velocity vector back to degrees in [0, 360).
+float VelocityToAngle(float vx, float vy);
@@ -0,0 +1,260 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+// Samples kept per thread; older ones are overwritten.
+const uint64_t PROFILE_BUFFER_SAMPLES = 1 << 16;
+
+std::atomic<bool> profilingEnabled{ false };
+
+static const char* PHASE_NAMES[PROFILE_PHASE_COUNT] = {
+	"ui", "draw", "present", "step", "move chunk", "particle collisions", "collide chunk", "reorder", "flow", "raster tile"
+};
+
+const char* ProfilePhaseName(ProfilePhase phase) {
+	return phase < PROFILE_PHASE_COUNT ? PHASE_NAMES[phase] : "?";
+}
+
+// Written by its own thread only. A sample is published by the release store
+// of head, and a reader drops any sample the writer may have lapped while it
+// was being copied.
+struct ProfileSample {
+	std::atomic<uint64_t> start{ 0 };
+	// duration in ns << 8 | phase
+	std::atomic<uint64_t> packed{ 0 };
+};
+
+struct ProfileBuffer {
+	// Allocated by the first sample, so threads that never record stay small.
+	std::unique_ptr<ProfileSample[]> samples;
+	std::atomic<uint64_t> head{ 0 };
+	// Samples before this index were discarded by ResetProfile.
+	std::atomic<uint64_t> firstKept{ 0 };
+	std::atomic<bool> inUse{ true };
+	// Registry state, guarded by registryMutex.
+	uint32_t threadId = 0;
+	std::string name;
+};
+
+struct DecodedSample {
+	uint64_t start;
+	uint64_t duration;
+	int depth;
+	ProfilePhase phase;
+};
+
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ProfileBuffer>> registry;
+static uint32_t nextThreadId = 1;
+
+// Hands the buffer back for reuse when its thread exits.
+struct ThreadBuffer {
+	ProfileBuffer* buffer = nullptr;
+	~ThreadBuffer() {
+		if (buffer) {
+			buffer->inUse.store(false, std::memory_order_release);
+		}
+	}
+};
+
+static thread_local ThreadBuffer threadBuffer;
+
+static ProfileBuffer& currentBuffer() {
+	if (threadBuffer.buffer) {
+		return *threadBuffer.buffer;
+	}
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	ProfileBuffer* buffer = nullptr;
+	for (auto& candidate : registry) {
+		if (!candidate->inUse.load(std::memory_order_acquire)) {
+			buffer = candidate.get();
+			buffer->firstKept.store(buffer->head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			buffer->inUse.store(true, std::memory_order_relaxed);
+			break;
+		}
+	}
+	if (!buffer) {
+		registry.emplace_back(new ProfileBuffer());
+		buffer = registry.back().get();
+	}
+	buffer->threadId = nextThreadId++;
+	buffer->name = "thread " + std::to_string(buffer->threadId);
+	threadBuffer.buffer = buffer;
+	return *buffer;
+}
+
+// Copies the samples still in the buffer. Caller holds registryMutex.
+static void readSamples(const ProfileBuffer& buffer, std::vector<DecodedSample>& out) {
+	out.clear();
+	uint64_t head = buffer.head.load(std::memory_order_acquire);
+	uint64_t first = std::max(buffer.firstKept.load(std::memory_order_relaxed),
+		head > PROFILE_BUFFER_SAMPLES ? head - PROFILE_BUFFER_SAMPLES : 0);
+	for (uint64_t i = first; i < head; ++i) {
+		const ProfileSample& sample = buffer.samples[i % PROFILE_BUFFER_SAMPLES];
+		uint64_t packed = sample.packed.load(std::memory_order_relaxed);
+		out.push_back({ sample.start.load(std::memory_order_relaxed), packed >> 8, 0, (ProfilePhase)(packed & 0xff) });
+	}
+
+	uint64_t lapped = buffer.head.load(std::memory_order_acquire);
+	if (lapped >= first + PROFILE_BUFFER_SAMPLES) {
+		size_t overwritten = (size_t)std::min<uint64_t>(lapped - PROFILE_BUFFER_SAMPLES + 1 - first, out.size());
+		out.erase(out.begin(), out.begin() + overwritten);
+	}
+}
+
+void SetProfiling(bool enabled) {
+	profilingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void SetProfileThreadName(const std::string& name) {
+	ProfileBuffer& buffer = currentBuffer();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	buffer.name = name;
+}
+
+uint64_t ProfileNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ProfileRecord(ProfilePhase phase, uint64_t start) {
+	uint64_t end = ProfileNow();
+	ProfileBuffer& buffer = currentBuffer();
+	if (!buffer.samples) {
+		buffer.samples.reset(new ProfileSample[PROFILE_BUFFER_SAMPLES]);
+	}
+	uint64_t head = buffer.head.load(std::memory_order_relaxed);
+	ProfileSample& sample = buffer.samples[head % PROFILE_BUFFER_SAMPLES];
+	sample.start.store(start, std::memory_order_relaxed);
+	sample.packed.store(((end - start) << 8) | phase, std::memory_order_relaxed);
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+// Scopes on one thread nest strictly, so the depth of a sample is how many
+// of its samples enclose it.
+static void assignDepths(std::vector<DecodedSample>& samples) {
+	std::sort(samples.begin(), samples.end(), [](const DecodedSample& a, const DecodedSample& b) {
+		return a.start != b.start ? a.start < b.start : a.duration > b.duration;
+	});
+	std::vector<uint64_t> openEnds;
+	for (auto& sample : samples) {
+		while (!openEnds.empty() && openEnds.back() <= sample.start) {
+			openEnds.pop_back();
+		}
+		sample.depth = (int)openEnds.size();
+		openEnds.push_back(sample.start + sample.duration);
+	}
+}
+
+static double percentile(std::vector<uint64_t>& values, double fraction) {
+	size_t index = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+	std::nth_element(values.begin(), values.begin() + index, values.end());
+	return values[index] / 1e6;
+}
+
+ProfileSummary SummarizeProfile(double seconds) {
+	ProfileSummary summary;
+	uint64_t now = ProfileNow();
+	uint64_t window = (uint64_t)(seconds * 1e9);
+	uint64_t cutoff = now > window ? now - window : 0;
+
+	std::vector<uint64_t> durations[PROFILE_PHASE_COUNT];
+	std::vector<DecodedSample> samples;
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (const auto& buffer : registry) {
+		readSamples(*buffer, samples);
+		assignDepths(samples);
+
+		uint64_t busy = 0;
+		bool any = false;
+		for (const auto& sample : samples) {
+			uint64_t end = sample.start + sample.duration;
+			if (end < cutoff) {
+				continue;
+			}
+			any = true;
+			durations[sample.phase].push_back(sample.duration);
+			if (sample.depth == 0) {
+				busy += end - std::max(sample.start, cutoff);
+			}
+		}
+		if (any) {
+			summary.threads.push_back({ buffer->name, window ? std::min(1.0, (double)busy / window) : 0.0 });
+		}
+	}
+
+	for (int phase = 0; phase < PROFILE_PHASE_COUNT; ++phase) {
+		std::vector<uint64_t>& values = durations[phase];
+		ProfilePhaseStats& stats = summary.phases[phase];
+		stats.samples = values.size();
+		if (values.empty()) {
+			continue;
+		}
+		stats.maxMilliseconds = *std::max_element(values.begin(), values.end()) / 1e6;
+		stats.p99Milliseconds = percentile(values, 0.99);
+		stats.p50Milliseconds = percentile(values, 0.5);
+	}
+	return summary;
+}
+
+static void writeJsonString(std::ofstream& file, const std::string& text) {
+	file << '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			file << '\\';
+		}
+		file << c;
+	}
+	file << '"';
+}
+
+bool WriteChromeTrace(const char* path) {
+	std::ofstream file(path, std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::vector<std::vector<DecodedSample>> perThread(registry.size());
+	uint64_t origin = UINT64_MAX;
+	for (size_t i = 0; i < registry.size(); ++i) {
+		readSamples(*registry[i], perThread[i]);
+		for (const auto& sample : perThread[i]) {
+			origin = std::min(origin, sample.start);
+		}
+	}
+
+	// Trace timestamps are microseconds from the oldest sample.
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	file.setf(std::ios::fixed);
+	file.precision(3);
+	for (size_t i = 0; i < registry.size(); ++i) {
+		if (perThread[i].empty()) {
+			continue;
+		}
+		uint32_t tid = registry[i]->threadId;
+		file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":";
+		writeJsonString(file, registry[i]->name);
+		file << "}}";
+		first = false;
+		for (const auto& sample : perThread[i]) {
+			file << ",\n{\"name\":\"" << ProfilePhaseName(sample.phase) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+				<< ",\"ts\":" << (sample.start - origin) / 1e3 << ",\"dur\":" << sample.duration / 1e3 << "}";
+		}
+	}
+	file << "\n]}\n";
+	return (bool)file;
+}
+
+void ResetProfile() {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (auto& buffer : registry) {
+		buffer->firstKept.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+	}
+}
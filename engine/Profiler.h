@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Phases the built-in profiler times. Worker-side phases are recorded once
+// per chunk, so stragglers show up as long chunks on one thread.
+enum ProfilePhase {
+	PROFILE_UI = 0,              // building the ImGui windows
+	PROFILE_DRAW,                // DrawElements: rasterize and upload the frame
+	PROFILE_PRESENT,             // ImGui render and buffer swap
+	PROFILE_STEP,                // one Simulation::Step call
+	PROFILE_MOVE_CHUNK,          // move a chunk of particles, wall collisions included
+	PROFILE_PARTICLE_COLLISIONS, // one ParticleCollider::Resolve
+	PROFILE_COLLIDE_CHUNK,       // narrowphase over a chunk of cells
+	PROFILE_REORDER,             // one Morton re-sort of the particle arrays
+	PROFILE_FLOW,                // free absorbed and emit new particles between ticks
+	PROFILE_RASTER_TILE,         // splat one band of rows
+	PROFILE_PHASE_COUNT
+};
+
+const char* ProfilePhaseName(ProfilePhase phase);
+
+// Off by default; a disabled scope costs one relaxed load.
+extern std::atomic<bool> profilingEnabled;
+
+void SetProfiling(bool enabled);
+inline bool IsProfiling() { return profilingEnabled.load(std::memory_order_relaxed); }
+
+// Label for the calling thread in summaries and traces.
+void SetProfileThreadName(const std::string& name);
+
+uint64_t ProfileNow();
+void ProfileRecord(ProfilePhase phase, uint64_t start);
+
+// Times the enclosing block into the calling thread's sample buffer. Each
+// thread writes only its own buffer, so recording takes no lock.
+class ProfileScope {
+public:
+	explicit ProfileScope(ProfilePhase phase)
+		: phase(phase), start(IsProfiling() ? ProfileNow() : 0) {}
+	~ProfileScope() { End(); }
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+	// Ends the scope early; later calls do nothing.
+	void End() {
+		if (start) {
+			ProfileRecord(phase, start);
+			start = 0;
+		}
+	}
+
+private:
+	ProfilePhase phase;
+	uint64_t start;
+};
+
+struct ProfilePhaseStats {
+	size_t samples = 0;
+	double p50Milliseconds = 0.0;
+	double p99Milliseconds = 0.0;
+	double maxMilliseconds = 0.0;
+};
+
+struct ProfileThreadStats {
+	std::string name;
+	// Share of the window covered by the thread's outermost scopes.
+	double utilisation = 0.0;
+};
+
+struct ProfileSummary {
+	ProfilePhaseStats phases[PROFILE_PHASE_COUNT];
+	std::vector<ProfileThreadStats> threads;
+};
+
+// Percentiles and utilisation over samples that ended in the last `seconds`.
+ProfileSummary SummarizeProfile(double seconds);
+// Writes every buffered sample as Chrome trace-event JSON (chrome://tracing,
+// Perfetto).
+bool WriteChromeTrace(const char* path);
+// Forgets every buffered sample.
+void ResetProfile();
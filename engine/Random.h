@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al., "Parallel Random
+// Numbers: As Easy as 1, 2, 3"). Each call maps a 128-bit counter and a 64-bit
+// key straight to four random words, so a draw keyed by (seed, particle id,
+// tick, stream) is the same no matter which thread makes it or in what order,
+// and there is no generator state to construct or share.
+
+enum RandomStream {
+	RANDOM_WALL_JITTER = 1,
+	RANDOM_SPAWN_PARTICLE = 2,
+	RANDOM_SPAWN_WALL = 3,
+	RANDOM_SPAWN_BATCH = 4,
+	RANDOM_EMIT = 5
+};
+
+struct RandomBlock {
+	uint32_t v[4];
+};
+
+inline uint32_t PhiloxMulHi(uint32_t a, uint32_t b, uint32_t& lo) {
+	uint64_t product = (uint64_t)a * b;
+	lo = (uint32_t)product;
+	return (uint32_t)(product >> 32);
+}
+
+inline RandomBlock Philox4x32(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint64_t key) {
+	uint32_t k0 = (uint32_t)key;
+	uint32_t k1 = (uint32_t)(key >> 32);
+
+	for (int round = 0; round < 10; ++round) {
+		uint32_t lo0, lo1;
+		uint32_t hi0 = PhiloxMulHi(0xD2511F53u, c0, lo0);
+		uint32_t hi1 = PhiloxMulHi(0xCD9E8D57u, c2, lo1);
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+		k0 += 0x9E3779B9u;
+		k1 += 0xBB67AE85u;
+	}
+
+	RandomBlock block = { { c0, c1, c2, c3 } };
+	return block;
+}
+
+// Draw `index` of `stream` for one subject (particle id or spawn number) at one tick.
+inline RandomBlock RandomFor(uint64_t seed, uint32_t subject, uint64_t tick, RandomStream stream, uint32_t index) {
+	return Philox4x32(subject, (uint32_t)tick, (uint32_t)(tick >> 32), ((uint32_t)stream << 24) | (index & 0xFFFFFFu), seed);
+}
+
+// Uniform float in [0, 1) from the top 24 bits.
+inline float RandomUnit(uint32_t bits) {
+	return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+inline float RandomRange(uint32_t bits, float low, float high) {
+	return low + (high - low) * RandomUnit(bits);
+}
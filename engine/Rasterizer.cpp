@@ -0,0 +1,262 @@
+#include "Rasterizer.h"
+#include "Simulation.h"
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+// Particles binned by one worker at a time.
+const size_t RASTER_CHUNK = 16384;
+// Rows per tile; a tile is drawn by exactly one worker.
+const int TILE_ROWS = 16;
+// Densities up to this are coloured from a table built once per frame.
+const uint32_t HEAT_TABLE_SIZE = 4096;
+
+Rasterizer::Rasterizer(int width, int height)
+	: view{ 0.0f, 0.0f, CANVAS_WIDTH, CANVAS_HEIGHT }, width(width), height(height) {
+	tileCount = (height + TILE_ROWS - 1) / TILE_ROWS;
+	pixels.assign((size_t)width * height, backgroundColor);
+	density.assign((size_t)width * height, 0);
+	tileStart.resize(tileCount + 1);
+	tileMaximum.resize(tileCount);
+}
+
+void Rasterizer::FitView(float worldWidth, float worldHeight) {
+	float scale = std::max(worldWidth / width, worldHeight / height);
+	view.width = width * scale;
+	view.height = height * scale;
+	view.left = (worldWidth - view.width) * 0.5f;
+	view.bottom = (worldHeight - view.height) * 0.5f;
+}
+
+// Dark blue -> magenta -> orange -> pale yellow as t goes from 0 to 1.
+static uint32_t heatColor(float t) {
+	static const float stops[4][3] = {
+		{ 0.05f, 0.0f, 0.35f },
+		{ 0.75f, 0.05f, 0.55f },
+		{ 1.0f, 0.55f, 0.05f },
+		{ 1.0f, 1.0f, 0.75f }
+	};
+	float scaled = std::min(std::max(t, 0.0f), 1.0f) * 3.0f;
+	int k = std::min((int)scaled, 2);
+	float f = scaled - k;
+	return RasterColor(stops[k][0] + (stops[k + 1][0] - stops[k][0]) * f,
+		stops[k][1] + (stops[k + 1][1] - stops[k][1]) * f,
+		stops[k][2] + (stops[k + 1][2] - stops[k][2]) * f);
+}
+
+void Rasterizer::Render(const Simulation& sim, WorkerPool& pool) {
+	if (sim.StoreIsCurrent()) {
+		Render(sim.particles.x.Data(), sim.particles.y.Data(), sim.particles.Size(), sim.walls, pool);
+		return;
+	}
+	decodedX.resize(sim.GetParticleCount());
+	decodedY.resize(sim.GetParticleCount());
+	sim.CopyPositions(decodedX.data(), decodedY.data());
+	Render(decodedX.data(), decodedY.data(), decodedX.size(), sim.walls, pool);
+}
+
+void Rasterizer::Render(const float* x, const float* y, size_t count, const std::vector<Wall>& walls, WorkerPool& pool) {
+	usedDensity = mode == RASTER_DENSITY || (mode == RASTER_AUTO && count > (size_t)width * height);
+
+	// A dot reaches one row above and below its centre, so it may be binned
+	// into two tiles; density only counts the centre pixel.
+	int spread = usedDensity ? 0 : 1;
+	float scaleX = width / view.width;
+	float scaleY = height / view.height;
+	float top = view.bottom + view.height;
+
+	// False for particles outside the view; those within a pixel of its
+	// edge, such as particles on the world border, land on the edge pixel.
+	auto toPixel = [&](size_t i, int& column, int& row) {
+		float px = (x[i] - view.left) * scaleX;
+		float py = (top - y[i]) * scaleY;
+		if (!(px > -1.0f && px < width + 1.0f && py > -1.0f && py < height + 1.0f)) {
+			return false;
+		}
+		column = std::min(std::max((int)px, 0), width - 1);
+		row = std::min(std::max((int)py, 0), height - 1);
+		return true;
+	};
+
+	size_t chunks = (count + RASTER_CHUNK - 1) / RASTER_CHUNK;
+	binCounts.assign(chunks * tileCount, 0);
+
+	pool.ParallelFor(count, RASTER_CHUNK, [&](size_t begin, size_t end, size_t) {
+		uint32_t* counts = &binCounts[begin / RASTER_CHUNK * tileCount];
+		for (size_t i = begin; i < end; ++i) {
+			int column, row;
+			if (!toPixel(i, column, row)) {
+				continue;
+			}
+			int firstTile = std::max(row - spread, 0) / TILE_ROWS;
+			int lastTile = std::min(row + spread, height - 1) / TILE_ROWS;
+			for (int tile = firstTile; tile <= lastTile; ++tile) {
+				counts[tile]++;
+			}
+		}
+	});
+
+	// Tile-major prefix sum: each chunk gets its own slice of every tile's
+	// range, so the scatter needs no atomics and keeps particle order.
+	uint32_t offset = 0;
+	for (int tile = 0; tile < tileCount; ++tile) {
+		tileStart[tile] = offset;
+		for (size_t chunk = 0; chunk < chunks; ++chunk) {
+			uint32_t binned = binCounts[chunk * tileCount + tile];
+			binCounts[chunk * tileCount + tile] = offset;
+			offset += binned;
+		}
+	}
+	tileStart[tileCount] = offset;
+	binEntries.resize(offset);
+
+	pool.ParallelFor(count, RASTER_CHUNK, [&](size_t begin, size_t end, size_t) {
+		uint32_t* cursors = &binCounts[begin / RASTER_CHUNK * tileCount];
+		for (size_t i = begin; i < end; ++i) {
+			int column, row;
+			if (!toPixel(i, column, row)) {
+				continue;
+			}
+			int firstTile = std::max(row - spread, 0) / TILE_ROWS;
+			int lastTile = std::min(row + spread, height - 1) / TILE_ROWS;
+			for (int tile = firstTile; tile <= lastTile; ++tile) {
+				binEntries[cursors[tile]++] = (uint32_t)row * width + column;
+			}
+		}
+	});
+
+	pool.ParallelFor(tileCount, 1, [&](size_t tile, size_t, size_t) {
+		ProfileScope scope(PROFILE_RASTER_TILE);
+		int rowBegin = (int)tile * TILE_ROWS;
+		int rowEnd = std::min(rowBegin + TILE_ROWS, height);
+		size_t pixelBegin = (size_t)rowBegin * width;
+		size_t pixelEnd = (size_t)rowEnd * width;
+
+		if (usedDensity) {
+			std::fill(density.begin() + pixelBegin, density.begin() + pixelEnd, 0);
+			uint32_t maximum = 0;
+			for (uint32_t k = tileStart[tile]; k < tileStart[tile + 1]; ++k) {
+				maximum = std::max(maximum, ++density[binEntries[k]]);
+			}
+			tileMaximum[tile] = maximum;
+			return;
+		}
+
+		std::fill(pixels.begin() + pixelBegin, pixels.begin() + pixelEnd, backgroundColor);
+		for (uint32_t k = tileStart[tile]; k < tileStart[tile + 1]; ++k) {
+			int row = binEntries[k] / width;
+			int column = binEntries[k] % width;
+			int top = std::max(row - 1, rowBegin);
+			int bottom = std::min(row + 1, rowEnd - 1);
+			int left = std::max(column - 1, 0);
+			int right = std::min(column + 1, width - 1);
+			for (int r = top; r <= bottom; ++r) {
+				std::fill(pixels.begin() + (size_t)r * width + left, pixels.begin() + (size_t)r * width + right + 1, particleColor);
+			}
+		}
+	});
+
+	if (usedDensity) {
+		uint32_t maximum = *std::max_element(tileMaximum.begin(), tileMaximum.end());
+		float scale = maximum > 0 ? 1.0f / log(1.0f + maximum) : 0.0f;
+
+		heatTable.resize(std::min(maximum, HEAT_TABLE_SIZE) + 1);
+		heatTable[0] = backgroundColor;
+		for (uint32_t d = 1; d < heatTable.size(); ++d) {
+			heatTable[d] = heatColor(log(1.0f + d) * scale);
+		}
+
+		pool.ParallelFor(tileCount, 1, [&](size_t tile, size_t, size_t) {
+			size_t pixelBegin = tile * TILE_ROWS * width;
+			size_t pixelEnd = std::min<size_t>((tile + 1) * TILE_ROWS, height) * width;
+			for (size_t p = pixelBegin; p < pixelEnd; ++p) {
+				uint32_t d = density[p];
+				pixels[p] = d < heatTable.size() ? heatTable[d] : heatColor(log(1.0f + d) * scale);
+			}
+		});
+	}
+
+	if (drawWalls) {
+		DrawWalls(walls);
+	}
+}
+
+// Trims the segment to the parametric range inside [0, width] x [0, height];
+// false when none of it is.
+static bool clipSegment(float& x0, float& y0, float& x1, float& y1, float width, float height) {
+	float t0 = 0.0f, t1 = 1.0f;
+	float dx = x1 - x0, dy = y1 - y0;
+	const float p[4] = { -dx, dx, -dy, dy };
+	const float q[4] = { x0, width - x0, y0, height - y0 };
+	for (int edge = 0; edge < 4; ++edge) {
+		if (p[edge] == 0.0f) {
+			if (q[edge] < 0.0f) {
+				return false;
+			}
+			continue;
+		}
+		float t = q[edge] / p[edge];
+		if (p[edge] < 0.0f) {
+			t0 = std::max(t0, t);
+		} else {
+			t1 = std::min(t1, t);
+		}
+	}
+	if (t0 > t1) {
+		return false;
+	}
+	x1 = x0 + dx * t1;
+	y1 = y0 + dy * t1;
+	x0 += dx * t0;
+	y0 += dy * t0;
+	return true;
+}
+
+void Rasterizer::DrawWalls(const std::vector<Wall>& walls) {
+	float scaleX = width / view.width;
+	float scaleY = height / view.height;
+	float top = view.bottom + view.height;
+
+	for (const auto& wall : walls) {
+		float x0 = (wall.startX - view.left) * scaleX;
+		float y0 = (top - wall.startY) * scaleY;
+		float x1 = (wall.endX - view.left) * scaleX;
+		float y1 = (top - wall.endY) * scaleY;
+		// Only the visible part is stepped, however far the wall reaches.
+		if (!clipSegment(x0, y0, x1, y1, (float)width, (float)height)) {
+			continue;
+		}
+
+		int steps = std::max(1, (int)ceil(std::max(std::fabs(x1 - x0), std::fabs(y1 - y0))));
+		for (int s = 0; s <= steps; ++s) {
+			int column = (int)(x0 + (x1 - x0) * s / steps);
+			int row = (int)(y0 + (y1 - y0) * s / steps);
+			if (column >= 0 && column < width && row >= 0 && row < height) {
+				pixels[(size_t)row * width + column] = wallColor;
+			}
+		}
+	}
+}
+
+bool Rasterizer::WritePPM(const char* path) const {
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	std::vector<unsigned char> row((size_t)width * 3);
+	for (int r = 0; r < height; ++r) {
+		for (int c = 0; c < width; ++c) {
+			uint32_t color = pixels[(size_t)r * width + c];
+			row[c * 3] = (unsigned char)color;
+			row[c * 3 + 1] = (unsigned char)(color >> 8);
+			row[c * 3 + 2] = (unsigned char)(color >> 16);
+		}
+		file.write((const char*)row.data(), row.size());
+	}
+	return (bool)file;
+}
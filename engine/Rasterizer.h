@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Wall;
+class Simulation;
+class WorkerPool;
+
+enum RasterMode {
+	// Density once there are more particles than pixels, points otherwise.
+	RASTER_AUTO = 0,
+	// Every particle as a 3x3 dot in the particle colour.
+	RASTER_POINTS = 1,
+	// Particles per pixel, log-scaled through a heat colour map.
+	RASTER_DENSITY = 2
+};
+
+// Packs a colour as RGBA bytes in memory, the layout of the frame buffer.
+inline uint32_t RasterColor(float r, float g, float b) {
+	return (uint32_t)(r * 255.0f + 0.5f) | ((uint32_t)(g * 255.0f + 0.5f) << 8) |
+		((uint32_t)(b * 255.0f + 0.5f) << 16) | 0xFF000000u;
+}
+
+// The part of the world a frame shows: the rectangle from (left, bottom)
+// that is width x height world pixels.
+struct RasterView {
+	float left, bottom, width, height;
+};
+
+// Software splatter for the particle store. Particles are binned by the band
+// of rows (tile) they cover, then each tile is drawn by one worker, so no two
+// workers ever write the same pixel. Row 0 is the top of the view, and
+// particles outside the view are skipped.
+class Rasterizer {
+public:
+	// The default canvas until changed.
+	RasterView view;
+	RasterMode mode = RASTER_AUTO;
+	uint32_t particleColor = 0xFFFFFFFFu;
+	uint32_t wallColor = 0xFF00FFFFu;
+	uint32_t backgroundColor = 0xFF000000u;
+	// Walls are drawn as one pixel lines after the particles.
+	bool drawWalls = false;
+
+	Rasterizer(int width, int height);
+
+	// Sets the view to the whole world, centred at one scale on both axes.
+	void FitView(float worldWidth, float worldHeight);
+
+	void Render(const Simulation& sim, WorkerPool& pool);
+	// Same, from a copy of the positions such as a SimulationSnapshot.
+	void Render(const float* x, const float* y, size_t count, const std::vector<Wall>& walls, WorkerPool& pool);
+
+	const uint32_t* GetPixels() const { return pixels.data(); }
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	// Whether the last Render produced a heat map.
+	bool UsedDensity() const { return usedDensity; }
+
+	// Binary PPM (P6) of the last frame.
+	bool WritePPM(const char* path) const;
+
+private:
+	void DrawWalls(const std::vector<Wall>& walls);
+
+	int width, height;
+	int tileCount;
+	bool usedDensity = false;
+	std::vector<uint32_t> pixels;
+	// Positions of a compact-storage scene, decoded for rendering.
+	std::vector<float> decodedX, decodedY;
+	std::vector<uint32_t> density;
+
+	// Per particle chunk and tile: entries binned, then where they start.
+	std::vector<uint32_t> binCounts;
+	// Pixel index of each binned particle, grouped by tile.
+	std::vector<uint32_t> binEntries;
+	std::vector<uint32_t> tileStart;
+	std::vector<uint32_t> tileMaximum;
+	std::vector<uint32_t> heatTable;
+};
@@ -0,0 +1,317 @@
+#include "SharedExport.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <string>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t alignUp(uint64_t value) {
+	return (value + PARTICLE_ALIGNMENT - 1) / PARTICLE_ALIGNMENT * PARTICLE_ALIGNMENT;
+}
+
+// A named shared-memory mapping, created read-write by the writer or opened
+// read-only by a reader.
+class SharedSegment {
+public:
+	~SharedSegment() {
+#if defined(_WIN32)
+		if (data) {
+			UnmapViewOfFile(data);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+#else
+		if (data) {
+			munmap(data, size);
+		}
+		if (owner) {
+			shm_unlink(name.c_str());
+		}
+#endif
+	}
+
+	bool Create(const char* segmentName, size_t bytes) {
+		SetName(segmentName);
+#if defined(_WIN32)
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			(DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, name.c_str());
+		// A segment a reader still holds open keeps its old size; refuse it.
+		if (!mapping || GetLastError() == ERROR_ALREADY_EXISTS) {
+			return false;
+		}
+		data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+#else
+		// Readers of a previous segment keep their mapping; new readers get this one.
+		shm_unlink(name.c_str());
+		int descriptor = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (descriptor < 0) {
+			return false;
+		}
+		owner = true;
+		if (ftruncate(descriptor, (off_t)bytes) != 0) {
+			close(descriptor);
+			return false;
+		}
+		void* address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+		close(descriptor);
+		data = address == MAP_FAILED ? nullptr : address;
+#endif
+		size = bytes;
+		return data != nullptr;
+	}
+
+	bool OpenReadOnly(const char* segmentName) {
+		SetName(segmentName);
+#if defined(_WIN32)
+		mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+		if (!mapping) {
+			return false;
+		}
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		MEMORY_BASIC_INFORMATION info;
+		if (data && VirtualQuery(data, &info, sizeof(info))) {
+			size = info.RegionSize;
+		}
+#else
+		int descriptor = shm_open(name.c_str(), O_RDONLY, 0);
+		if (descriptor < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(descriptor, &info) != 0) {
+			close(descriptor);
+			return false;
+		}
+		size = (size_t)info.st_size;
+		void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+		close(descriptor);
+		data = address == MAP_FAILED ? nullptr : address;
+#endif
+		return data != nullptr;
+	}
+
+	void* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	// POSIX names start with a slash; Windows names live in the session namespace.
+	void SetName(const char* segmentName) {
+#if defined(_WIN32)
+		name = std::string("Local\\") + segmentName;
+#else
+		name = segmentName[0] == '/' ? segmentName : std::string("/") + segmentName;
+#endif
+	}
+
+	std::string name;
+	void* data = nullptr;
+	size_t size = 0;
+#if defined(_WIN32)
+	HANDLE mapping = nullptr;
+#else
+	bool owner = false;
+#endif
+};
+
+uint64_t SharedFrameChecksum(const float* x, const float* y, const uint32_t* ids, size_t count) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t xBits, yBits;
+		memcpy(&xBits, &x[i], sizeof(xBits));
+		memcpy(&yBits, &y[i], sizeof(yBits));
+		sum += (((uint64_t)xBits << 32) | yBits) + ids[i];
+	}
+	return sum;
+}
+
+SharedExporter::SharedExporter() {}
+
+SharedExporter::~SharedExporter() {
+	Close();
+}
+
+bool SharedExporter::Open(const char* name, size_t particleCapacity, size_t wallCapacity) {
+	Close();
+
+	uint64_t arrayBytes = alignUp(particleCapacity * sizeof(float));
+	uint64_t frameBytes = 5 * arrayBytes + alignUp(wallCapacity * 4 * sizeof(float));
+	uint64_t headerBytes = alignUp(sizeof(SharedExportHeader));
+	uint64_t segmentBytes = headerBytes + 2 * frameBytes;
+
+	segment = new SharedSegment();
+	if (!segment->Create(name, (size_t)segmentBytes)) {
+		delete segment;
+		segment = nullptr;
+		return false;
+	}
+
+	header = new (segment->Data()) SharedExportHeader();
+	header->version = SHARED_EXPORT_VERSION;
+	header->headerBytes = (uint32_t)headerBytes;
+	header->segmentBytes = segmentBytes;
+	header->particleCapacity = particleCapacity;
+	header->wallCapacity = wallCapacity;
+	header->frameOffset[0] = headerBytes;
+	header->frameOffset[1] = headerBytes + frameBytes;
+	header->xOffset = 0;
+	header->yOffset = arrayBytes;
+	header->vxOffset = 2 * arrayBytes;
+	header->vyOffset = 3 * arrayBytes;
+	header->idOffset = 4 * arrayBytes;
+	header->wallOffset = 5 * arrayBytes;
+	// Readers check the magic last, so a half-built header never matches.
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(header->magic, SHARED_EXPORT_MAGIC, sizeof(header->magic));
+
+	framesPublished = 0;
+	publishSeconds = 0.0;
+	return true;
+}
+
+void SharedExporter::Close() {
+	if (header) {
+		header->closed.store(1, std::memory_order_release);
+		header = nullptr;
+	}
+	delete segment;
+	segment = nullptr;
+}
+
+void SharedExporter::Publish(const Simulation& sim) {
+	if (!header) {
+		return;
+	}
+	auto start = std::chrono::steady_clock::now();
+
+	uint64_t number = header->published.load(std::memory_order_relaxed);
+	SharedFrame& frame = header->frames[number % 2];
+	char* block = (char*)header + header->frameOffset[number % 2];
+	uint64_t sequence = frame.sequence.load(std::memory_order_relaxed);
+	frame.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	float* x = (float*)(block + header->xOffset);
+	float* y = (float*)(block + header->yOffset);
+	uint32_t* ids = (uint32_t*)(block + header->idOffset);
+	size_t count = std::min<size_t>(sim.GetParticleCount(), header->particleCapacity);
+	sim.CopyParticles(x, y, (float*)(block + header->vxOffset), (float*)(block + header->vyOffset), ids, count);
+
+	size_t wallCount = std::min<size_t>(sim.walls.size(), header->wallCapacity);
+	float* walls = (float*)(block + header->wallOffset);
+	for (size_t i = 0; i < wallCount; ++i) {
+		const Wall& wall = sim.walls[i];
+		walls[i * 4] = wall.startX;
+		walls[i * 4 + 1] = wall.startY;
+		walls[i * 4 + 2] = wall.endX;
+		walls[i * 4 + 3] = wall.endY;
+	}
+
+	frame.tick = sim.GetTick();
+	frame.width = sim.GetWidth();
+	frame.height = sim.GetHeight();
+	frame.particleCount = count;
+	frame.sceneParticles = sim.GetParticleCount();
+	frame.wallCount = wallCount;
+	frame.checksum = SharedFrameChecksum(x, y, ids, count);
+	frame.sequence.store(sequence + 2, std::memory_order_release);
+	header->published.store(number + 1, std::memory_order_release);
+
+	++framesPublished;
+	publishSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double SharedExporter::GetPublishMilliseconds() const {
+	return framesPublished > 0 ? publishSeconds * 1000.0 / framesPublished : 0.0;
+}
+
+size_t SharedExporter::GetSegmentBytes() const {
+	return segment ? segment->Size() : 0;
+}
+
+SharedExportReader::SharedExportReader() {}
+
+SharedExportReader::~SharedExportReader() {
+	Close();
+}
+
+bool SharedExportReader::Open(const char* name) {
+	Close();
+	segment = new SharedSegment();
+	if (!segment->OpenReadOnly(name) || segment->Size() < sizeof(SharedExportHeader)) {
+		Close();
+		return false;
+	}
+	const SharedExportHeader* mapped = (const SharedExportHeader*)segment->Data();
+	if (memcmp(mapped->magic, SHARED_EXPORT_MAGIC, sizeof(mapped->magic)) != 0 ||
+		mapped->version != SHARED_EXPORT_VERSION || mapped->segmentBytes > segment->Size()) {
+		Close();
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	header = mapped;
+	return true;
+}
+
+void SharedExportReader::Close() {
+	header = nullptr;
+	delete segment;
+	segment = nullptr;
+}
+
+uint64_t SharedExportReader::GetPublished() const {
+	return header ? header->published.load(std::memory_order_acquire) : 0;
+}
+
+bool SharedExportReader::WriterClosed() const {
+	return !header || header->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool SharedExportReader::Acquire(SharedFrameView& view) const {
+	uint64_t number = GetPublished();
+	if (number == 0) {
+		return false;
+	}
+	const SharedFrame& frame = header->frames[(number - 1) % 2];
+	uint64_t sequence = frame.sequence.load(std::memory_order_acquire);
+	if (sequence % 2 != 0) {
+		return false;
+	}
+
+	const char* block = (const char*)header + header->frameOffset[(number - 1) % 2];
+	view.frame = &frame;
+	view.sequence = sequence;
+	view.number = number;
+	view.tick = frame.tick;
+	view.width = frame.width;
+	view.height = frame.height;
+	view.particleCount = (size_t)std::min(frame.particleCount, header->particleCapacity);
+	view.sceneParticles = (size_t)frame.sceneParticles;
+	view.wallCount = (size_t)std::min(frame.wallCount, header->wallCapacity);
+	view.checksum = frame.checksum;
+	view.x = (const float*)(block + header->xOffset);
+	view.y = (const float*)(block + header->yOffset);
+	view.vx = (const float*)(block + header->vxOffset);
+	view.vy = (const float*)(block + header->vyOffset);
+	view.id = (const uint32_t*)(block + header->idOffset);
+	view.walls = (const float*)(block + header->wallOffset);
+	return true;
+}
+
+bool SharedExportReader::StillValid(const SharedFrameView& view) const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return view.frame && view.frame->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+// Live export of the scene into a named shared-memory segment (POSIX
+// shm_open, or a named file mapping on Windows), so tools on the same host
+// can read every tick without copies and without ever slowing the
+// simulation down.
+//
+// The segment starts with a SharedExportHeader, followed by two frames.
+// Each frame holds x, y, vx, vy (float) and id (uint32) arrays of
+// particleCapacity elements, then wallCapacity walls as four floats, at the
+// offsets given in the header, all 64-byte aligned. The writer fills the
+// older frame and then publishes it, so a reader has a whole tick to use the
+// newest one before it is overwritten. Each frame is guarded by a seqlock:
+// a reader takes the sequence, uses the frame in place, and the frame was
+// intact if the sequence is even and unchanged afterwards.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class Simulation;
+
+// "PSIMSHM" plus a terminating zero.
+const char SHARED_EXPORT_MAGIC[8] = { 'P', 'S', 'I', 'M', 'S', 'H', 'M', 0 };
+const uint32_t SHARED_EXPORT_VERSION = 1;
+
+struct alignas(64) SharedFrame {
+	// Odd while the writer is filling the frame.
+	std::atomic<uint64_t> sequence{ 0 };
+	uint64_t tick;
+	// World size at this tick.
+	float width, height;
+	// Particles in the frame, at most particleCapacity.
+	uint64_t particleCount;
+	// Particles in the scene; more than particleCount when the export is capped.
+	uint64_t sceneParticles;
+	uint64_t wallCount;
+	// Sum over the frame of ((x bits << 32) | y bits) + id, for readers to
+	// check what they read.
+	uint64_t checksum;
+};
+
+struct alignas(64) SharedExportHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerBytes;
+	uint64_t segmentBytes;
+	uint64_t particleCapacity;
+	uint64_t wallCapacity;
+	// Offsets from the start of the segment.
+	uint64_t frameOffset[2];
+	// Offsets from the start of a frame's block.
+	uint64_t xOffset, yOffset, vxOffset, vyOffset, idOffset, wallOffset;
+
+	// Frames published so far; the newest is frames[(published - 1) % 2].
+	alignas(64) std::atomic<uint64_t> published{ 0 };
+	// Set when the writer stops; the segment gets no more frames.
+	std::atomic<uint32_t> closed{ 0 };
+	SharedFrame frames[2];
+};
+
+// Checksum over one frame's arrays, as stored in SharedFrame::checksum.
+uint64_t SharedFrameChecksum(const float* x, const float* y, const uint32_t* ids, size_t count);
+
+class SharedSegment;
+
+// Writer side, owned by whoever steps the simulation.
+class SharedExporter {
+public:
+	SharedExporter();
+	~SharedExporter();
+	SharedExporter(const SharedExporter&) = delete;
+	SharedExporter& operator=(const SharedExporter&) = delete;
+
+	// Creates (or replaces) the segment. Scenes larger than particleCapacity
+	// export their first particleCapacity particles.
+	bool Open(const char* name, size_t particleCapacity, size_t wallCapacity);
+	// Marks the segment closed and removes its name.
+	void Close();
+	bool Exporting() const { return header != nullptr; }
+
+	// Copies the scene into the older frame and publishes it.
+	void Publish(const Simulation& sim);
+
+	uint64_t GetFramesPublished() const { return framesPublished; }
+	// Mean time per Publish since Open.
+	double GetPublishMilliseconds() const;
+	size_t GetSegmentBytes() const;
+
+private:
+	SharedSegment* segment = nullptr;
+	SharedExportHeader* header = nullptr;
+	uint64_t framesPublished = 0;
+	double publishSeconds = 0.0;
+};
+
+// Reader side: maps the segment read-only and hands out frames in place.
+struct SharedFrameView {
+	const SharedFrame* frame = nullptr;
+	uint64_t sequence = 0;
+	// Position in the stream of published frames, from 1.
+	uint64_t number = 0;
+	uint64_t tick = 0;
+	float width = 0.0f, height = 0.0f;
+	size_t particleCount = 0;
+	size_t sceneParticles = 0;
+	size_t wallCount = 0;
+	uint64_t checksum = 0;
+	const float* x = nullptr;
+	const float* y = nullptr;
+	const float* vx = nullptr;
+	const float* vy = nullptr;
+	const uint32_t* id = nullptr;
+	// wallCount walls as startX, startY, endX, endY.
+	const float* walls = nullptr;
+};
+
+class SharedExportReader {
+public:
+	SharedExportReader();
+	~SharedExportReader();
+	SharedExportReader(const SharedExportReader&) = delete;
+	SharedExportReader& operator=(const SharedExportReader&) = delete;
+
+	// False if there is no segment of that name or it is not a version 1 export.
+	bool Open(const char* name);
+	void Close();
+
+	const SharedExportHeader* GetHeader() const { return header; }
+	uint64_t GetPublished() const;
+	bool WriterClosed() const;
+
+	// Points `view` at the newest frame. False when nothing has been
+	// published yet or the writer is in the middle of that frame.
+	bool Acquire(SharedFrameView& view) const;
+	// True if the frame was not touched since Acquire, i.e. everything read
+	// through the view in between is one consistent tick.
+	bool StillValid(const SharedFrameView& view) const;
+
+private:
+	SharedSegment* segment = nullptr;
+	const SharedExportHeader* header = nullptr;
+};
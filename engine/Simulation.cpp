@@ -0,0 +1,575 @@
+#include "Simulation.h"
+#include "WorkerPool.h"
+#include "Random.h"
+#include "BatchSpawner.h"
+#include "Profiler.h"
+#include "StepKernels.h"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <algorithm>
+
+static float getDistance(float x1, float y1, float x2, float y2) {
+	return sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2));
+}
+
+float PointLineDistance(float px, float py, float x1, float y1, float x2, float y2) {
+	float dx = x2 - x1;
+	float dy = y2 - y1;
+	float t = ((px - x1) * dx + (py - y1) * dy) / (dx * dx + dy * dy);
+	float closestX = x1 + t * dx;
+	float closestY = y1 + t * dy;
+
+	return sqrt((closestX - px) * (closestX - px) + (closestY - py) * (closestY - py));
+}
+
+float ReflectAngle(const Wall& wall, float angle) {
+	float wallAngle = atan2(wall.endY - wall.startY, wall.endX - wall.startX) * 180.0 / PI;
+	float reflectedAngle = 2 * wallAngle - angle;
+
+	reflectedAngle = fmod(reflectedAngle, 360.0f);
+
+	return reflectedAngle;
+}
+
+void Particle::UpdatePosition(float deltaTime, const std::vector<Wall>& walls, const ReferenceJitter* jitter) {
+	float radians = angle * PI / 180.0;
+
+	float dx = cos(radians) * velocity * deltaTime;
+	float dy = sin(radians) * velocity * deltaTime;
+
+	float newX = x + dx;
+	float newY = y + dy;
+
+	// Threshold for collision detection
+	float threshold = velocity > 500 ? 10.0f : 3.0f;
+
+	bool collisionDetected = false;
+	const Wall* collidedWall = nullptr;
+
+	for (auto& wall : walls) {
+		float lineDistance = PointLineDistance(newX, newY, wall.startX, wall.startY, wall.endX, wall.endY);
+		float wallStartDistance = getDistance(newX, newY, wall.startX, wall.startY);
+		float wallEndDistance = getDistance(newX, newY, wall.endX, wall.endY);
+
+		if (lineDistance < threshold || wallStartDistance < threshold || wallEndDistance < threshold) {
+			float dx = newX - wall.startX;
+			float dy = newY - wall.startY;
+			float wallLength = getDistance(wall.startX, wall.startY, wall.endX, wall.endY);
+			float t = (dx * (wall.endX - wall.startX) + dy * (wall.endY - wall.startY)) / (wallLength * wallLength);
+
+			if (t >= 0 && t <= 1) {
+				collisionDetected = true;
+				collidedWall = &wall;
+				break;
+			}
+		}
+	}
+
+	if (collisionDetected) {
+		if (!jitter) {
+			std::random_device rd;
+			std::mt19937 gen(rd());
+			std::uniform_real_distribution<> disOffset(-0.3f, 0.3f);
+			float offsetX = disOffset(gen);
+			float offsetY = disOffset(gen);
+
+			x += offsetX;
+			y += offsetY;
+		} else if (jitter->enabled) {
+			RandomBlock random = RandomFor(jitter->seed, jitter->id, jitter->tick, RANDOM_WALL_JITTER, 0);
+			x += RandomRange(random.v[0], -0.3f, 0.3f);
+			y += RandomRange(random.v[1], -0.3f, 0.3f);
+		}
+
+		if (getDistance(newX, newY, collidedWall->startX, collidedWall->startY) < threshold ||
+			getDistance(newX, newY, collidedWall->endX, collidedWall->endY) < threshold) {
+			angle = fmod(angle + 180, 360.0f);
+		} else {
+			angle = ReflectAngle(*collidedWall, angle);
+		}
+
+		radians = angle * PI / 180.0;
+		dx = cos(radians) * velocity * deltaTime;
+		dy = sin(radians) * velocity * deltaTime;
+		newX = x + dx;
+		newY = y + dy;
+	}
+
+	x = newX;
+	y = newY;
+
+	if (x < 0) {
+		x = 0;
+		angle = 180 - angle;
+	}
+	else if (x > CANVAS_WIDTH) {
+		x = CANVAS_WIDTH;
+		angle = 180 - angle;
+	}
+
+	if (y < 0) {
+		y = 0;
+		angle = -angle;
+	}
+	else if (y > CANVAS_HEIGHT) {
+		y = CANVAS_HEIGHT;
+		angle = -angle;
+	}
+}
+
+Simulation::Simulation()
+	: wallGrid(CANVAS_WIDTH, CANVAS_HEIGHT, WallCellSize(CANVAS_WIDTH, CANVAS_HEIGHT), MAX_WALL_THRESHOLD) {
+	std::random_device rd;
+	seed = ((uint64_t)rd() << 32) | rd();
+}
+
+// Walls are tested by their bounding box, matching the original UI behaviour.
+static const Wall* findEnclosingWall(const std::vector<Wall>& walls, float x, float y) {
+	for (auto& wall : walls) {
+		if (x >= wall.startX && x <= wall.endX &&
+			y >= wall.startY && y <= wall.endY) {
+			return &wall;
+		}
+	}
+	return nullptr;
+}
+
+float WallCellSize(float width, float height) {
+	return std::max(WALL_CELL_SIZE, std::sqrt(width * height / MAX_WALL_GRID_CELLS));
+}
+
+float PushOutOfWall(const Wall& wall, float x, float width) {
+	if (x < wall.endX && !(wall.endX >= width)) {
+		return wall.endX + 1.0f;
+	}
+	return wall.startX - 1.0f;
+}
+
+bool Simulation::AddParticle(float x, float y, float angle, float velocity) {
+	const Wall* collidingWall = findEnclosingWall(walls, x, y);
+	if (collidingWall) {
+		x = PushOutOfWall(*collidingWall, x, width);
+	}
+
+	if (x >= 0 && x <= width &&
+		y >= 0 && y <= height &&
+		angle >= 0.0 && angle <= 360.0) {
+		events.Invalidate(particles);
+		particles.AddHeading(x, y, angle, velocity);
+		return true;
+	}
+	return false;
+}
+
+void Simulation::AddParticleBatch(const BatchSpec& spec, WorkerPool& pool) {
+	ParticleBatch batch;
+	GenerateBatch(spec, walls, width, height, seed, NextBatchNumber(), pool, batch);
+	CommitBatch(batch);
+}
+
+void Simulation::CommitBatch(const ParticleBatch& batch) {
+	events.Invalidate(particles);
+	particles.Append(batch.x.data(), batch.y.data(), batch.vx.data(), batch.vy.data(), batch.Size());
+}
+
+void Simulation::AddWall(float startX, float startY, float endX, float endY) {
+	walls.emplace_back(startX, startY, endX, endY);
+	wallGrid.Insert(walls.back(), (uint32_t)(walls.size() - 1));
+	wallCache.Add(walls.back());
+	events.Invalidate(particles);
+}
+
+void Simulation::SpawnRandomParticle() {
+	uint32_t spawn = particleSpawns++;
+
+	// Positions inside a wall are redrawn from the next counter.
+	RandomBlock random;
+	float x, y;
+	uint32_t attempt = 0;
+	do {
+		random = RandomFor(seed, spawn, 0, RANDOM_SPAWN_PARTICLE, attempt++);
+		x = RandomRange(random.v[0], 0, width);
+		y = RandomRange(random.v[1], 0, height);
+	} while (findEnclosingWall(walls, x, y));
+
+	float angle = RandomRange(random.v[2], 0, 360);
+	float velocity = RandomRange(random.v[3], 10, 300);
+
+	events.Invalidate(particles);
+	particles.AddHeading(x, y, angle, velocity);
+}
+
+void Simulation::SpawnRandomWall() {
+	// Particles inside the new wall are pushed out, which needs them as floats.
+	UnpackParticles();
+	events.Invalidate(particles);
+	RandomBlock random = RandomFor(seed, wallSpawns++, 0, RANDOM_SPAWN_WALL, 0);
+	float startX = RandomRange(random.v[0], 0, width);
+	float startY = RandomRange(random.v[1], 0, height);
+	float endX = RandomRange(random.v[2], 0, width);
+	float endY = RandomRange(random.v[3], 0, height);
+
+	for (size_t i = 0; i < particles.Size(); ++i) {
+		float& px = particles.x[i];
+		float& py = particles.y[i];
+		if (px >= startX && px <= endX && py >= startY && py <= endY) {
+			float offsetX = (px < (startX + endX) / 2) ? -10.0f : 10.0f;
+			float offsetY = (py < (startY + endY) / 2) ? -10.0f : 10.0f;
+
+			bool insideAnotherWall = findEnclosingWall(walls, px + offsetX, py + offsetY) != nullptr;
+
+			if (!insideAnotherWall && px + offsetX >= 0 && px + offsetX <= width &&
+				py + offsetY >= 0 && py + offsetY <= height) {
+				px += offsetX;
+				py += offsetY;
+			}
+		}
+	}
+
+	AddWall(startX, startY, endX, endY);
+}
+
+void Simulation::ResetParticles() {
+	events.Invalidate(particles);
+	particles.Clear();
+	compact.Clear();
+	flow.ResetStats();
+}
+
+bool Simulation::AddEmitter(const Emitter& emitter) {
+	if (emitter.x < 0 || emitter.x > width || emitter.y < 0 || emitter.y > height ||
+		emitter.rate < 0 || emitter.minSpeed > emitter.maxSpeed) {
+		return false;
+	}
+	flow.emitters.push_back(emitter);
+	return true;
+}
+
+void Simulation::AddSink(const Sink& sink) {
+	flow.sinks.push_back(sink);
+}
+
+void Simulation::ClearFlow() {
+	flow.Clear();
+}
+
+bool Simulation::SetWorldSize(float newWidth, float newHeight) {
+	if (!(newWidth > 0.0f && newHeight > 0.0f)) {
+		return false;
+	}
+	SetBounds(newWidth, newHeight);
+
+	// Compact particles are unpacked to be moved, and packed again by the next Step.
+	UnpackParticles();
+	events.Invalidate(particles);
+	for (size_t i = 0; i < particles.Size(); ++i) {
+		if (particles.x[i] < 0.0f || particles.x[i] > width) {
+			particles.x[i] = std::min(std::max(particles.x[i], 0.0f), width);
+		}
+		if (particles.y[i] < 0.0f || particles.y[i] > height) {
+			particles.y[i] = std::min(std::max(particles.y[i], 0.0f), height);
+		}
+	}
+	return true;
+}
+
+void Simulation::SetBounds(float newWidth, float newHeight) {
+	width = newWidth;
+	height = newHeight;
+	wallGrid = WallGrid(width, height, WallCellSize(width, height), MAX_WALL_THRESHOLD);
+	for (size_t w = 0; w < walls.size(); ++w) {
+		wallGrid.Insert(walls[w], (uint32_t)w);
+	}
+}
+
+void Simulation::ClearWalls() {
+	walls.clear();
+	wallGrid.Clear();
+	wallCache.Clear();
+	analytics.ClearWalls();
+	events.Invalidate(particles);
+}
+
+void Simulation::Step(float deltaTime, WorkerPool& pool, int ticks) {
+	if (reorderInterval <= 0) {
+		StepTicks(deltaTime, pool, ticks);
+		return;
+	}
+
+	// The run is cut at every multiple of reorderInterval to re-sort there.
+	while (ticks > 0) {
+		int run = std::min(ticks, reorderInterval - (int)(tick % reorderInterval));
+		StepTicks(deltaTime, pool, run);
+		ticks -= run;
+		if (tick % reorderInterval == 0) {
+			ReorderParticles(pool);
+		}
+	}
+}
+
+void Simulation::ReorderParticles(WorkerPool& pool) {
+	if (storageMode == STORAGE_COMPACT) {
+		return;
+	}
+	events.Sync(particles);
+	sorter.Sort(particles, width, height, pool);
+	events.Reorder(sorter.GetOrder());
+}
+
+bool Simulation::UsesEvents() const {
+	return collisionMode == COLLISION_EVENT && !particleCollisions && !flow.Active() && borderMode == BORDER_REFLECT &&
+		!collectAnalytics;
+}
+
+const char* Simulation::GetStepKernelName() const {
+	if (storageMode == STORAGE_FULL && UsesEvents()) {
+		return "event";
+	}
+	// Compact storage cannot free particles, so absorbing borders reflect there.
+	BorderMode border = storageMode == STORAGE_COMPACT && borderMode == BORDER_ABSORB ? BORDER_REFLECT : borderMode;
+	return SelectStepKernel(border, collisionMode, walls.size(), linearWallLimit, wallJitter).name;
+}
+
+void Simulation::StepTicks(float deltaTime, WorkerPool& pool, int ticks) {
+	// Whole SIMD blocks per chunk keep every chunk start aligned.
+	size_t alignedChunk = (chunkSize + PARTICLE_PADDING - 1) / PARTICLE_PADDING * PARTICLE_PADDING;
+
+	if (workerStats.size() < pool.GetThreadCount()) {
+		workerStats.resize(pool.GetThreadCount());
+	}
+
+	ProfileScope scope(PROFILE_STEP);
+	if (collectAnalytics) {
+		analytics.Prepare(pool.GetThreadCount(), walls.size(), width, height, tick);
+	}
+	if (storageMode == STORAGE_COMPACT) {
+		StepCompact(deltaTime, pool, ticks, alignedChunk);
+		return;
+	}
+	flow.SetAbsorbBorders(borderMode == BORDER_ABSORB, width, height);
+	bool flowing = flow.Active();
+	if (UsesEvents()) {
+		events.Advance(particles, walls, wallGrid, width, height, (double)deltaTime * ticks, pool, workerStats);
+		tick += ticks;
+		statsTicks += ticks;
+		statsParticleTicks += (uint64_t)particles.Size() * ticks;
+		return;
+	}
+	// Ticked steps move particles behind the scheduler's back.
+	events.Invalidate(particles);
+
+	// The tick advances at the barrier between ticks, while no worker is stepping.
+	StepContext context = { particles, walls, wallGrid, wallCache, countTunneling, deltaTime, width, height, seed, tick };
+	stepKernel = SelectStepKernel(borderMode, collisionMode, walls.size(), linearWallLimit, wallJitter).function;
+	// Two captures fit std::function's inline storage, so building it does not allocate.
+	WorkerPool::RangeFunction body = [this, &context](size_t begin, size_t end, size_t workerIndex) {
+		ProfileScope chunkScope(PROFILE_MOVE_CHUNK);
+		bool flowing = flow.Active();
+		if (flowing) {
+			flow.BeginRange(particles, begin, end);
+		}
+		AnalyticsAccumulator* accumulator = collectAnalytics ? analytics.GetAccumulator(workerIndex) : nullptr;
+		stepKernel(context, begin, end, workerStats[workerIndex], accumulator);
+		if (accumulator && accumulator->sampling) {
+			accumulator->Sample(particles, begin, end);
+		}
+		if (flowing) {
+			flow.EndRange(particles, begin, end, workerIndex);
+		}
+	};
+	// Analytics merge each tick's totals here, between ticks, so they do not
+	// break up a fused run.
+	WorkerPool::TickFunction tickDone = [this, &context](int) {
+		context.tick = ++tick;
+		if (collectAnalytics) {
+			analytics.EndTick(tick, particles.Size(), context.deltaTime, context.width, context.height);
+		}
+	};
+	statsTicks += ticks;
+
+	if (!particleCollisions && !flowing) {
+		statsParticleTicks += (uint64_t)particles.Size() * ticks;
+		pool.RunTicks(ticks, particles.Size(), alignedChunk, body, tickDone);
+		if (collectAnalytics) {
+			analytics.Flush(pool);
+		}
+		return;
+	}
+
+	// Collisions need their own parallel phases after each move, and the
+	// flow changes the particle count between ticks.
+	for (int i = 0; i < ticks; ++i) {
+		if (flowing) {
+			flow.Prepare(particles, flowCapacity, pool.GetThreadCount());
+		}
+		statsParticleTicks += particles.Size();
+		pool.RunTicks(1, particles.Size(), alignedChunk, body, tickDone);
+		if (particleCollisions) {
+			collider.Resolve(particles, particleRadius, width, height, pool, workerStats);
+		}
+		if (flowing) {
+			ProfileScope flowScope(PROFILE_FLOW);
+			flow.Apply(particles, walls, wallGrid, seed, tick, deltaTime, width, height);
+		}
+	}
+	if (collectAnalytics) {
+		analytics.Flush(pool);
+	}
+}
+
+// Each chunk is decoded into the worker's float scratch store, stepped by the
+// same kernels as full storage and encoded back in place.
+void Simulation::StepCompact(float deltaTime, WorkerPool& pool, int ticks, size_t alignedChunk) {
+	events.Invalidate(particles);
+	PackParticles();
+	if (compactScratch.size() < pool.GetThreadCount()) {
+		compactScratch.resize(pool.GetThreadCount());
+	}
+
+	BorderMode border = borderMode == BORDER_ABSORB ? BORDER_REFLECT : borderMode;
+	stepKernel = SelectStepKernel(border, collisionMode, walls.size(), linearWallLimit, wallJitter).function;
+	StepContext context = { particles, walls, wallGrid, wallCache, countTunneling, deltaTime, width, height, seed, tick };
+	WorkerPool::RangeFunction body = [&](size_t begin, size_t end, size_t workerIndex) {
+		ProfileScope chunkScope(PROFILE_MOVE_CHUNK);
+		ParticleStore& scratch = compactScratch[workerIndex];
+		compact.Decode(begin, end, scratch);
+		StepContext chunk = { scratch, walls, wallGrid, wallCache, countTunneling, deltaTime, width, height, seed, context.tick };
+		AnalyticsAccumulator* accumulator = collectAnalytics ? analytics.GetAccumulator(workerIndex) : nullptr;
+		stepKernel(chunk, 0, end - begin, workerStats[workerIndex], accumulator);
+		if (accumulator && accumulator->sampling) {
+			accumulator->Sample(scratch, 0, end - begin);
+		}
+		compact.Encode(begin, end, scratch, chunk.tick);
+	};
+	WorkerPool::TickFunction tickDone = [&](int) {
+		context.tick = ++tick;
+		if (collectAnalytics) {
+			analytics.EndTick(tick, compact.Size(), deltaTime, width, height);
+		}
+	};
+	statsTicks += ticks;
+	statsParticleTicks += (uint64_t)compact.Size() * ticks;
+	pool.RunTicks(ticks, compact.Size(), alignedChunk, body, tickDone);
+	if (collectAnalytics) {
+		analytics.Flush(pool);
+	}
+}
+
+void Simulation::PackParticles() {
+	if (!particles.Empty()) {
+		compact.Append(particles, width, height);
+		particles.Release();
+	}
+}
+
+void Simulation::UnpackParticles() {
+	if (!compact.Empty()) {
+		compact.ExpandInto(particles);
+		compact.Clear();
+	}
+}
+
+void Simulation::SetStorageMode(StorageMode mode) {
+	storageMode = mode;
+	events.Invalidate(particles);
+	if (storageMode == STORAGE_COMPACT) {
+		PackParticles();
+	} else {
+		UnpackParticles();
+	}
+}
+
+size_t Simulation::GetParticleCount() const {
+	return compact.Size() + particles.Size();
+}
+
+void Simulation::CopyPositions(float* x, float* y, uint32_t* ids) const {
+	CopyParticles(x, y, nullptr, nullptr, ids, SIZE_MAX);
+}
+
+void Simulation::CopyParticles(float* x, float* y, float* vx, float* vy, uint32_t* ids, size_t limit) const {
+	compact.CopyParticles(x, y, vx, vy, ids, limit);
+	size_t offset = std::min(compact.Size(), limit);
+	size_t count = std::min(particles.Size(), limit - offset);
+	if (events.Lagging()) {
+		events.CopyPositions(particles, x + offset, y + offset, count);
+	} else {
+		memcpy(x + offset, particles.x.Data(), count * sizeof(float));
+		memcpy(y + offset, particles.y.Data(), count * sizeof(float));
+	}
+	if (vx && vy) {
+		memcpy(vx + offset, particles.vx.Data(), count * sizeof(float));
+		memcpy(vy + offset, particles.vy.Data(), count * sizeof(float));
+	}
+	if (ids) {
+		memcpy(ids + offset, particles.id.Data(), count * sizeof(uint32_t));
+	}
+}
+
+void Simulation::ExportParticles(ParticleStore& out) const {
+	compact.ExpandInto(out);
+	out.Reserve(out.Size() + particles.Size());
+	for (size_t i = 0; i < particles.Size(); ++i) {
+		float x = particles.x[i], y = particles.y[i];
+		if (events.Lagging()) {
+			events.Position(particles, i, x, y);
+		}
+		out.AddWithId(x, y, particles.vx[i], particles.vy[i], particles.id[i]);
+	}
+}
+
+size_t Simulation::GetParticleBytes() const {
+	return particles.Capacity() * (4 * sizeof(float) + sizeof(uint32_t)) + compact.GetBytes();
+}
+
+double Simulation::GetAverageWallCandidates() const {
+	uint64_t queries = 0;
+	uint64_t candidates = 0;
+	for (const auto& stats : workerStats) {
+		queries += stats.wallQueries;
+		candidates += stats.wallCandidates;
+	}
+	return queries > 0 ? (double)candidates / queries : 0.0;
+}
+
+uint64_t Simulation::GetTunnelingEvents() const {
+	uint64_t events = 0;
+	for (const auto& stats : workerStats) {
+		events += stats.tunnelingEvents;
+	}
+	return events;
+}
+
+double Simulation::GetPairTestsPerTick() const {
+	uint64_t tests = 0;
+	for (const auto& stats : workerStats) {
+		tests += stats.pairTests;
+	}
+	return statsTicks > 0 ? (double)tests / statsTicks : 0.0;
+}
+
+double Simulation::GetEventsPerTick() const {
+	uint64_t impacts = 0;
+	for (const auto& stats : workerStats) {
+		impacts += stats.impacts;
+	}
+	return statsTicks > 0 ? (double)impacts / statsTicks : 0.0;
+}
+
+uint64_t Simulation::GetParticleCollisions() const {
+	uint64_t collisions = 0;
+	for (const auto& stats : workerStats) {
+		collisions += stats.particleCollisions;
+	}
+	return collisions;
+}
+
+void Simulation::ResetStats() {
+	for (auto& stats : workerStats) {
+		stats = WorkerStats();
+	}
+	statsTicks = 0;
+	statsParticleTicks = 0;
+}
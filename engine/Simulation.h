@@ -0,0 +1,314 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "ParticleStore.h"
+#include "WallGrid.h"
+#include "WallCache.h"
+#include "ParticleCollider.h"
+#include "EventScheduler.h"
+#include "MortonOrder.h"
+#include "CompactStore.h"
+#include "ParticleFlow.h"
+#include "Analytics.h"
+
+class WorkerPool;
+struct ParticleBatch;
+struct StepContext;
+
+// Size of the GUI's black panel in pixels, and the default world size.
+const float CANVAS_WIDTH = 1280.0f;
+const float CANVAS_HEIGHT = 720.0f;
+
+// Side of a wall grid cell in pixels.
+const float WALL_CELL_SIZE = 32.0f;
+// Most cells of a wall grid; larger worlds get larger cells.
+const float MAX_WALL_GRID_CELLS = (float)(1 << 20);
+
+class Wall {
+public:
+	float startX, startY, endX, endY;
+
+	Wall(float startX, float startY, float endX, float endY)
+		: startX(startX), startY(startY), endX(endX), endY(endY) {}
+};
+
+// Where the reference step's wall jitter comes from. A seeded draw is the
+// threshold kernel's own, keyed by the scene seed, particle id and tick, so
+// the reference can be compared against the kernels with walls too.
+struct ReferenceJitter {
+	bool enabled = true;
+	uint64_t seed = 0;
+	uint32_t id = 0;
+	uint64_t tick = 0;
+};
+
+// Angle/speed view of a particle, used by the spawn APIs. Its UpdatePosition
+// is the original per-particle step, kept as the reference the SoA kernels
+// are validated against.
+class Particle {
+public:
+	float x, y;
+	float angle;
+	float velocity;
+
+	Particle(float x, float y, float angle, float velocity)
+		: x(x), y(y), angle(angle), velocity(velocity) {}
+
+	// Without `jitter`, bounces jitter from std::random_device as they always did.
+	void UpdatePosition(float deltaTime, const std::vector<Wall>& walls, const ReferenceJitter* jitter = nullptr);
+};
+
+enum BatchVariation {
+	BATCH_VARY_POSITION = 0,
+	BATCH_VARY_ANGLE = 1,
+	BATCH_VARY_VELOCITY = 2,
+	// Position, angle and velocity drawn uniformly from their start-end ranges.
+	BATCH_RANDOM_UNIFORM = 3,
+	// Position normally distributed around the middle of its range (which
+	// spans six sigma); angle and velocity uniform.
+	BATCH_RANDOM_NORMAL = 4
+};
+
+struct BatchSpec {
+	int count = 0;
+	int variation = BATCH_VARY_POSITION;
+	float startX = 0.0f, endX = 0.0f;
+	float startY = 0.0f, endY = 0.0f;
+	float startAngle = 0.0f, endAngle = 0.0f;
+	float startVelocity = 0.0f, endVelocity = 0.0f;
+};
+
+enum CollisionMode {
+	// Exact swept segment test with time of impact; no tunneling at any step size.
+	COLLISION_SWEPT = 0,
+	// Original proximity test at the end of the step (3 or 10 px threshold).
+	COLLISION_THRESHOLD = 1,
+	// Swept impacts scheduled ahead in time (see EventScheduler). Without wall
+	// jitter; particle collisions fall back to COLLISION_SWEPT ticks.
+	COLLISION_EVENT = 2
+};
+
+enum BorderMode {
+	// Particles bounce off the edges of the world.
+	BORDER_REFLECT = 0,
+	// Particles leaving at one edge come back in at the opposite one.
+	BORDER_WRAP = 1,
+	// Particles leaving the world are removed at the end of the tick, like
+	// by a sink; full storage then steps tick by tick and event mode runs as
+	// swept ticks. Compact storage reflects instead.
+	BORDER_ABSORB = 2
+};
+
+enum StorageMode {
+	// Float arrays in `particles`.
+	STORAGE_FULL = 0,
+	// Quantized arrays (see CompactStore), stepped tick by tick: event mode
+	// runs as COLLISION_SWEPT, and particle collisions and reordering are off.
+	STORAGE_COMPACT = 1
+};
+
+// X coordinate just past the side of the wall's bounding box nearest to x,
+// in a world `width` wide.
+float PushOutOfWall(const Wall& wall, float x, float width);
+// Side of a wall grid cell for a world: WALL_CELL_SIZE, or larger to keep
+// the grid within MAX_WALL_GRID_CELLS.
+float WallCellSize(float width, float height);
+// Distance from (px, py) to the infinite line through the two points.
+float PointLineDistance(float px, float py, float x1, float y1, float x2, float y2);
+// Heading, in degrees, after bouncing off the wall at the given heading.
+float ReflectAngle(const Wall& wall, float angle);
+
+// Per-worker counters, padded so workers never share a cache line.
+struct alignas(64) WorkerStats {
+	uint64_t wallQueries = 0;
+	uint64_t wallCandidates = 0;
+	uint64_t tunnelingEvents = 0;
+	uint64_t pairTests = 0;
+	uint64_t particleCollisions = 0;
+	uint64_t impacts = 0;
+};
+
+// Owns the particles and walls of one scene and advances them in fixed steps.
+// Has no rendering dependencies so it can run headless.
+class Simulation {
+public:
+	ParticleStore particles;
+	// Add walls through AddWall/SpawnRandomWall so the wall grid and cache stay in sync.
+	std::vector<Wall> walls;
+	WallGrid wallGrid;
+	WallCache wallCache;
+
+	// Particles handed to a worker at a time; idle workers steal whole chunks.
+	size_t chunkSize = 1024;
+
+	CollisionMode collisionMode = COLLISION_SWEPT;
+	// Anything but BORDER_REFLECT makes event mode step as swept ticks.
+	BorderMode borderMode = BORDER_REFLECT;
+	// Random slide of up to 0.3 px along a wall after each bounce, which
+	// keeps particles from retracing the same path forever.
+	bool wallJitter = true;
+	// Scenes with at most this many walls test every wall instead of querying
+	// the wall grid (see SelectStepKernel); 0 always uses the grid and values
+	// past LINEAR_WALL_MAX act as that. The default is about where the grid
+	// overtakes the scan with random walls at 100k particles.
+	size_t linearWallLimit = 32;
+	// Checks each wall-path particle for a straight crossing of a wall per tick.
+	bool countTunneling = false;
+	// Counts wall hits every tick and samples density, speeds and edge pressure
+	// every ANALYTICS_SAMPLE_INTERVAL ticks (see SceneAnalytics), inside the
+	// fused RunTicks. Event mode runs as swept ticks while this is on.
+	bool collectAnalytics = false;
+
+	// Elastic collisions between particles, all of radius particleRadius.
+	bool particleCollisions = false;
+	float particleRadius = 1.5f;
+
+	// Ticks between Morton re-sorts of the particle arrays (see MortonSorter);
+	// 0 never re-sorts. Only where each particle is stored changes, not how it
+	// moves, except with particle collisions, which resolve pairs in index
+	// order.
+	int reorderInterval = 0;
+
+	// Most particles the emitters fill the scene to; the store is reserved
+	// for this many as soon as an emitter or sink is added.
+	size_t flowCapacity = 1 << 20;
+
+	// Key for every random draw (wall jitter, random spawns). Two scenes with
+	// the same seed and the same calls produce bit-identical particles,
+	// whatever the thread count or chunk size. Defaults to a random value.
+	uint64_t seed;
+
+	Simulation();
+
+	// Returns false when the position is outside the world or the angle outside 0-360.
+	bool AddParticle(float x, float y, float angle, float velocity);
+	// Generates the batch on the pool and appends it; see BatchSpawner for the
+	// background version.
+	void AddParticleBatch(const BatchSpec& spec, WorkerPool& pool);
+	// Appends pre-generated particles. Must not overlap a Step.
+	void CommitBatch(const ParticleBatch& batch);
+	uint32_t NextBatchNumber() { return batchSpawns++; }
+	void AddWall(float startX, float startY, float endX, float endY);
+
+	void SpawnRandomParticle();
+	void SpawnRandomWall();
+
+	void ResetParticles();
+	void ClearWalls();
+
+	// Continuous emitters and absorbing sinks (see ParticleFlow). While any
+	// exist, full storage steps one tick at a time and event mode runs as
+	// swept ticks; compact storage ignores them. AddEmitter returns false
+	// when the emitter is outside the world or its rate or speeds are invalid.
+	bool AddEmitter(const Emitter& emitter);
+	void AddSink(const Sink& sink);
+	void ClearFlow();
+	const ParticleFlow& GetFlow() const { return flow; }
+
+	// The world spans (0, 0) to (width, height), CANVAS_WIDTH x CANVAS_HEIGHT
+	// by default. Resizing rebuilds the wall grid and moves particles beyond
+	// the new edges onto them. False, changing nothing, for a non-positive
+	// size.
+	bool SetWorldSize(float width, float height);
+	float GetWidth() const { return width; }
+	float GetHeight() const { return height; }
+
+	const SceneAnalytics& GetAnalytics() const { return analytics; }
+	void ResetAnalytics() { analytics.Reset(); }
+
+	// Advances every particle by the given number of ticks on the pool's workers.
+	void Step(float deltaTime, WorkerPool& pool, int ticks = 1);
+	// The step kernel the next Step will run (see SelectStepKernel), or
+	// "event" for the event scheduler.
+	const char* GetStepKernelName() const;
+	// Sorts the particles into Morton order now. Look particles up by id
+	// (ParticleStore::Find) rather than by index across a reorder.
+	void ReorderParticles(WorkerPool& pool);
+
+	// Converts every particle to the given storage. In compact storage
+	// `particles` only holds particles added since the last Step, which
+	// packs them; read positions through the functions below, which cover
+	// both modes.
+	void SetStorageMode(StorageMode mode);
+	StorageMode GetStorageMode() const { return storageMode; }
+	size_t GetParticleCount() const;
+	// Changes whenever particles are added, removed or reordered (see
+	// ParticleStore::GetLayoutVersion); positions copied out under one version
+	// line up slot for slot.
+	uint64_t GetLayoutVersion() const { return particles.GetLayoutVersion(); }
+	// Writes GetParticleCount() positions, and ids when `ids` is not null.
+	void CopyPositions(float* x, float* y, uint32_t* ids = nullptr) const;
+	// The first `limit` particles of the same order with velocities; null
+	// outputs are skipped.
+	void CopyParticles(float* x, float* y, float* vx, float* vy, uint32_t* ids, size_t limit) const;
+	// Appends every particle to `out` as floats, keeping ids.
+	void ExportParticles(ParticleStore& out) const;
+	// True when `particles` holds every particle's current state. False in
+	// compact storage and after event-driven steps, whose positions are only
+	// evaluated when read through the functions above.
+	bool StoreIsCurrent() const { return compact.Empty() && !events.Lagging(); }
+	// Bytes allocated for particle state in both storages.
+	size_t GetParticleBytes() const;
+
+	// Mean number of walls tested per wall-grid query since the last ResetStats().
+	double GetAverageWallCandidates() const;
+	// Particles that ended a tick on the far side of a wall; needs countTunneling.
+	uint64_t GetTunnelingEvents() const;
+	// Particle pair distance tests per tick since the last ResetStats().
+	double GetPairTestsPerTick() const;
+	uint64_t GetParticleCollisions() const;
+	// Impacts processed per tick in COLLISION_EVENT mode since the last ResetStats().
+	double GetEventsPerTick() const;
+	// Live particles summed over the ticks stepped since the last
+	// ResetStats(): the particle updates done, even as a flow changes the
+	// count from tick to tick.
+	uint64_t GetParticleTicks() const { return statsParticleTicks; }
+	void ResetStats();
+
+	// Ticks stepped since construction.
+	uint64_t GetTick() const { return tick; }
+
+	// Binary scene checkpoint (see Checkpoint.h); false on I/O or format errors.
+	// Loading maps the file and uses its particle arrays in place, and restores
+	// the seed and counters so the scene continues exactly as saved.
+	bool SaveCheckpoint(const char* path) const;
+	bool LoadCheckpoint(const char* path);
+
+private:
+	// True when the next full-storage Step runs on the event scheduler.
+	bool UsesEvents() const;
+	void StepTicks(float deltaTime, WorkerPool& pool, int ticks);
+	void StepCompact(float deltaTime, WorkerPool& pool, int ticks, size_t alignedChunk);
+	// Moves `particles` into the compact store, and back.
+	void PackParticles();
+	void UnpackParticles();
+	// Sets the world size and rebuilds the wall grid for it, leaving the
+	// particles alone.
+	void SetBounds(float newWidth, float newHeight);
+
+	std::vector<WorkerStats> workerStats;
+	// Picked by SelectStepKernel at the start of each step.
+	void (*stepKernel)(const StepContext& context, size_t begin, size_t end, WorkerStats& stats,
+		AnalyticsAccumulator* analytics) = nullptr;
+	ParticleCollider collider;
+	EventScheduler events;
+	MortonSorter sorter;
+	ParticleFlow flow;
+	SceneAnalytics analytics;
+	float width = CANVAS_WIDTH;
+	float height = CANVAS_HEIGHT;
+	StorageMode storageMode = STORAGE_FULL;
+	CompactStore compact;
+	// Per-worker float copies of the chunk being stepped in compact storage.
+	std::vector<ParticleStore> compactScratch;
+	uint64_t tick = 0;
+	uint64_t statsTicks = 0;
+	uint64_t statsParticleTicks = 0;
+	// Numbers the random spawns so each draws from its own counter.
+	uint32_t particleSpawns = 0;
+	uint32_t wallSpawns = 0;
+	uint32_t batchSpawns = 0;
+};
@@ -0,0 +1,77 @@
+#include "SimulationClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Default ticks per Advance, enough to catch up on a short hiccup.
+const int DEFAULT_TICK_BUDGET = 5;
+// Slowest time scale; smaller ones are clamped.
+const double MIN_TIME_SCALE = 0.01;
+// Fastest time scale; larger ones are clamped.
+const double MAX_TIME_SCALE = 100.0;
+
+SimulationClock::SimulationClock(double tickRate)
+	: tickRate(tickRate), tickBudget(DEFAULT_TICK_BUDGET) {}
+
+void SimulationClock::SetTimeScale(double scale) {
+	timeScale = std::min(std::max(scale, MIN_TIME_SCALE), MAX_TIME_SCALE);
+}
+
+void SimulationClock::SetPaused(bool pause) {
+	paused = pause;
+	owed = 0.0;
+	requestedSteps = 0;
+}
+
+void SimulationClock::RequestSteps(int ticks) {
+	requestedSteps += std::max(0, ticks);
+}
+
+void SimulationClock::SetMaxThroughput(bool enabled) {
+	maxThroughput = enabled;
+	owed = 0.0;
+}
+
+void SimulationClock::SetTickBudget(int ticks) {
+	tickBudget = std::max(1, ticks);
+}
+
+int SimulationClock::Advance(Clock::time_point now) {
+	double elapsed = started ? std::chrono::duration<double>(now - last).count() : 0.0;
+	last = now;
+	started = true;
+
+	if (paused) {
+		int ticks = std::min(requestedSteps, tickBudget);
+		requestedSteps -= ticks;
+		return ticks;
+	}
+	if (maxThroughput) {
+		return tickBudget;
+	}
+
+	double tickSeconds = GetTickSeconds();
+	owed += elapsed * timeScale;
+	double due = std::floor(owed / tickSeconds);
+	int ticks = (int)std::min(due, (double)tickBudget);
+	owed -= ticks * tickSeconds;
+	if (due > tickBudget) {
+		droppedTicks += (uint64_t)(due - tickBudget);
+		owed = std::fmod(owed, tickSeconds);
+	}
+	if (ticks > 1) {
+		caughtUpTicks += ticks - 1;
+	}
+	return ticks;
+}
+
+SimulationClock::Clock::time_point SimulationClock::NextTickTime(Clock::time_point now) const {
+	if (maxThroughput || (paused && requestedSteps > 0)) {
+		return now;
+	}
+	if (paused) {
+		return Clock::time_point::max();
+	}
+	double wait = (GetTickSeconds() - owed) / timeScale;
+	return last + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(std::max(wait, 0.0)));
+}
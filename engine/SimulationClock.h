@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Decides how many fixed-size ticks to run against the wall clock. Wall time
+// is scaled by the time scale into simulated time; whole ticks of it are run,
+// at most tickBudget per Advance, and whatever is still owed past the budget
+// is dropped instead of piling up (so a slow machine runs slower instead of
+// spiralling). Paused, only requested single steps run; in max-throughput
+// mode every Advance runs the whole budget without waiting for the wall clock.
+class SimulationClock {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	explicit SimulationClock(double tickRate = 60.0);
+
+	// Simulated seconds per wall second; 1 is real time.
+	void SetTimeScale(double scale);
+	double GetTimeScale() const { return timeScale; }
+	void SetPaused(bool paused);
+	bool IsPaused() const { return paused; }
+	// Ticks to run on the next Advance while paused.
+	void RequestSteps(int ticks);
+	void SetMaxThroughput(bool enabled);
+	bool IsMaxThroughput() const { return maxThroughput; }
+	// Most ticks a single Advance may return; at least 1.
+	void SetTickBudget(int ticks);
+	int GetTickBudget() const { return tickBudget; }
+
+	double GetTickSeconds() const { return 1.0 / tickRate; }
+	// Wall seconds one tick takes at the current time scale.
+	double GetTickInterval() const { return 1.0 / (tickRate * timeScale); }
+
+	// Ticks to run now.
+	int Advance(Clock::time_point now);
+	// When the next tick falls due; `now` when it is due already.
+	Clock::time_point NextTickTime(Clock::time_point now) const;
+
+	// Ticks owed by the wall clock that were skipped because they exceeded the budget.
+	uint64_t GetDroppedTicks() const { return droppedTicks; }
+	// Ticks run on top of the first in an Advance, to catch up with the wall clock.
+	uint64_t GetCaughtUpTicks() const { return caughtUpTicks; }
+
+private:
+	double tickRate;
+	double timeScale = 1.0;
+	bool paused = false;
+	bool maxThroughput = false;
+	int tickBudget;
+	int requestedSteps = 0;
+
+	// Simulated seconds owed but not yet run.
+	double owed = 0.0;
+	Clock::time_point last;
+	bool started = false;
+
+	uint64_t droppedTicks = 0;
+	uint64_t caughtUpTicks = 0;
+};
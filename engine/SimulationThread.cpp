@@ -0,0 +1,271 @@
+#include "SimulationThread.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Longest the simulation thread sleeps, so commands still land promptly
+// while paused or at a slow time scale.
+const double MAX_IDLE_SECONDS = 0.01;
+// Seconds between refreshes of the snapshot's stats.
+const double STATS_INTERVAL = 0.5;
+// Seconds between snapshots of steps taken at maximum throughput. A
+// snapshot copies every particle, so publishing after each Step would cost
+// about as much as the ticks it shows; the GUI redraws no faster anyway.
+const double UNPACED_PUBLISH_INTERVAL = 1.0 / 60.0;
+// Smallest particle capacity of a shared-memory export.
+const size_t EXPORT_MIN_PARTICLES = 1 << 20;
+// Smallest wall capacity of a shared-memory export.
+const size_t EXPORT_MIN_WALLS = 4096;
+// Analytics samples the snapshot carries for the plots, ten seconds at 60
+// ticks per second.
+const size_t ANALYTICS_PLOT_HISTORY = 600;
+
+SimulationThread::SimulationThread(double tickRate)
+	: pool(0, "sim worker", 0), clock(tickRate) {
+	threadCount.store(pool.GetThreadCount(), std::memory_order_relaxed);
+}
+
+SimulationThread::~SimulationThread() {
+	Stop();
+}
+
+void SimulationThread::Start() {
+	if (running.exchange(true)) {
+		return;
+	}
+	thread = std::thread(&SimulationThread::Run, this);
+}
+
+void SimulationThread::Stop() {
+	running.store(false, std::memory_order_release);
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void SimulationThread::Post(Command command) {
+	std::lock_guard<std::mutex> lock(commandMutex);
+	pendingCommands.push_back(std::move(command));
+}
+
+void SimulationThread::SetThreadCount(size_t numThreads) {
+	threadCount.store(numThreads, std::memory_order_relaxed);
+	Post([this, numThreads](Simulation&) {
+		pool.Resize(numThreads);
+	});
+}
+
+void SimulationThread::SetChunkSize(size_t chunkSize) {
+	Post([chunkSize](Simulation& sim) {
+		sim.chunkSize = chunkSize;
+	});
+}
+
+void SimulationThread::AddBatch(const BatchSpec& spec) {
+	Post([this, spec](Simulation& sim) {
+		spawner.Start(spec, sim);
+	});
+}
+
+void SimulationThread::StartRecording(const std::string& path, uint32_t interval) {
+	Post([this, path, interval](Simulation&) {
+		recorder.Start(path.c_str(), interval);
+	});
+}
+
+void SimulationThread::StopRecording() {
+	Post([this](Simulation&) {
+		recorder.Stop();
+	});
+}
+
+void SimulationThread::StartExport(const std::string& name) {
+	Post([this, name](Simulation& sim) {
+		size_t particles = std::max(EXPORT_MIN_PARTICLES, 2 * sim.GetParticleCount());
+		size_t walls = std::max(EXPORT_MIN_WALLS, 2 * sim.walls.size());
+		bool opened = exporter.Open(name.c_str(), particles, walls);
+		exportFailed.store(!opened, std::memory_order_relaxed);
+		if (opened) {
+			exporter.Publish(sim);
+		}
+	});
+}
+
+void SimulationThread::StopExport() {
+	Post([this](Simulation&) {
+		exporter.Close();
+	});
+}
+
+void SimulationThread::SetTimeScale(double scale) {
+	Post([this, scale](Simulation&) {
+		clock.SetTimeScale(scale);
+	});
+}
+
+void SimulationThread::SetPaused(bool paused) {
+	Post([this, paused](Simulation&) {
+		clock.SetPaused(paused);
+	});
+}
+
+void SimulationThread::StepPaused(int ticks) {
+	Post([this, ticks](Simulation&) {
+		clock.RequestSteps(ticks);
+	});
+}
+
+void SimulationThread::SetMaxThroughput(bool enabled) {
+	Post([this, enabled](Simulation&) {
+		clock.SetMaxThroughput(enabled);
+	});
+}
+
+void SimulationThread::SetTickBudget(int ticks) {
+	Post([this, ticks](Simulation&) {
+		clock.SetTickBudget(ticks);
+	});
+}
+
+void SimulationThread::SetInterpolation(bool enabled) {
+	Post([this, enabled](Simulation&) {
+		interpolating = enabled;
+		if (!enabled) {
+			previousX = std::vector<float>();
+			previousY = std::vector<float>();
+		}
+	});
+}
+
+bool SimulationThread::ApplyCommands() {
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		std::swap(pendingCommands, runningCommands);
+	}
+	for (auto& command : runningCommands) {
+		command(sim);
+	}
+	bool applied = !runningCommands.empty();
+	runningCommands.clear();
+	return applied;
+}
+
+void SimulationThread::PublishSnapshot() {
+	SimulationSnapshot& snapshot = snapshots.WriteBuffer();
+	size_t count = sim.GetParticleCount();
+	currentX.resize(count);
+	currentY.resize(count);
+	sim.CopyPositions(currentX.data(), currentY.data());
+	bucketSorter.Sort(currentX.data(), currentY.data(), count, sim.GetWidth(), sim.GetHeight(), snapshot.buckets, pool);
+	snapshot.x.resize(count);
+	snapshot.y.resize(count);
+	bucketSorter.Scatter(currentX.data(), snapshot.x.data(), pool);
+	bucketSorter.Scatter(currentY.data(), snapshot.y.data(), pool);
+	snapshot.worldWidth = sim.GetWidth();
+	snapshot.worldHeight = sim.GetHeight();
+	// Interpolating makes no sense across particles moving between slots.
+	snapshot.stepInterval = clock.IsMaxThroughput() || clock.IsPaused() ? 0.0 : clock.GetTickInterval();
+	if (interpolating && snapshot.stepInterval > 0.0 && previousX.size() == count && previousLayout == sim.GetLayoutVersion()) {
+		snapshot.previousX.resize(count);
+		snapshot.previousY.resize(count);
+		bucketSorter.Scatter(previousX.data(), snapshot.previousX.data(), pool);
+		bucketSorter.Scatter(previousY.data(), snapshot.previousY.data(), pool);
+	} else {
+		snapshot.previousX.clear();
+		snapshot.previousY.clear();
+	}
+	snapshot.stepTime = stepTime;
+	snapshot.particleBytes = sim.GetParticleBytes();
+	snapshot.stepKernel = sim.GetStepKernelName();
+	snapshot.walls = sim.walls;
+	snapshot.emitters = sim.GetFlow().emitters;
+	snapshot.sinks = sim.GetFlow().sinks;
+	snapshot.flow = sim.GetFlow().GetStats();
+	snapshot.tick = sim.GetTick();
+	snapshot.simulatedSeconds = sim.GetTick() * clock.GetTickSeconds();
+	snapshot.droppedTicks = clock.GetDroppedTicks();
+	snapshot.caughtUpTicks = clock.GetCaughtUpTicks();
+	snapshot.ticksPerSecond = ticksPerSecond;
+	snapshot.busyRatio = busyRatio;
+	snapshot.wallCandidates = wallCandidates;
+	snapshot.pairTestsPerTick = pairTestsPerTick;
+	snapshot.eventsPerTick = eventsPerTick;
+	snapshot.recording = recorder.Recording();
+	snapshot.recordFramesWritten = recorder.GetFramesWritten();
+	snapshot.recordFramesDropped = recorder.GetFramesDropped();
+	snapshot.recordBytes = recorder.GetBytesWritten();
+	snapshot.recordRatio = recorder.GetCompressionRatio();
+	snapshot.recordCaptureMilliseconds = recorder.GetCaptureMilliseconds();
+	snapshot.recordWriteMilliseconds = recorder.GetWriteMilliseconds();
+	snapshot.exporting = exporter.Exporting();
+	snapshot.exportFrames = exporter.GetFramesPublished();
+	snapshot.exportMilliseconds = exporter.GetPublishMilliseconds();
+	snapshot.analytics = sim.collectAnalytics;
+	if (sim.collectAnalytics) {
+		const SceneAnalytics& analytics = sim.GetAnalytics();
+		analytics.CopyHistory(snapshot.analyticsHistory, ANALYTICS_PLOT_HISTORY);
+		snapshot.density.assign(analytics.GetDensity(), analytics.GetDensity() + DENSITY_CELLS);
+		snapshot.speedHistogram.assign(analytics.GetSpeedHistogram(), analytics.GetSpeedHistogram() + SPEED_BINS);
+		snapshot.wallHits = analytics.GetWallHits();
+		snapshot.wallImpulse = analytics.GetWallImpulse();
+	}
+	snapshots.Publish();
+}
+
+void SimulationThread::Run() {
+	typedef std::chrono::steady_clock Clock;
+	Clock::duration maxIdle = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(MAX_IDLE_SECONDS));
+	Clock::duration unpacedPublish = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(UNPACED_PUBLISH_INTERVAL));
+	Clock::time_point publishTime = Clock::now();
+	SetProfileThreadName("simulation");
+	Clock::time_point statsStart = Clock::now();
+	uint64_t statsTick = sim.GetTick();
+	stepTime = statsStart;
+
+	while (running.load(std::memory_order_acquire)) {
+		// Scene edits and finished batches land between ticks.
+		bool changed = ApplyCommands();
+		changed |= spawner.Commit(sim);
+
+		Clock::time_point now = Clock::now();
+		int ticks = clock.Advance(now);
+		if (ticks > 0) {
+			// Unpaced ticks are never drawn in between.
+			if (interpolating && !clock.IsMaxThroughput() && !clock.IsPaused()) {
+				previousX.resize(sim.GetParticleCount());
+				previousY.resize(sim.GetParticleCount());
+				sim.CopyPositions(previousX.data(), previousY.data());
+				previousLayout = sim.GetLayoutVersion();
+			}
+			sim.Step((float)clock.GetTickSeconds(), pool, ticks);
+			stepTime = Clock::now();
+			recorder.Capture(sim);
+			exporter.Publish(sim);
+			changed |= !clock.IsMaxThroughput() || stepTime - publishTime >= unpacedPublish;
+		}
+
+		std::chrono::duration<double> statsElapsed = now - statsStart;
+		if (statsElapsed.count() >= STATS_INTERVAL) {
+			ticksPerSecond = (sim.GetTick() - statsTick) / statsElapsed.count();
+			busyRatio = pool.GetBusyRatio();
+			wallCandidates = sim.GetAverageWallCandidates();
+			pairTestsPerTick = sim.GetPairTestsPerTick();
+			eventsPerTick = sim.GetEventsPerTick();
+			pool.ResetStats();
+			sim.ResetStats();
+			statsStart = now;
+			statsTick = sim.GetTick();
+			changed = true;
+		}
+
+		if (changed) {
+			PublishSnapshot();
+			publishTime = Clock::now();
+		}
+		now = Clock::now();
+		std::this_thread::sleep_until(std::min(clock.NextTickTime(now), now + maxIdle));
+	}
+	recorder.Stop();
+	exporter.Close();
+}
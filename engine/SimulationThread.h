@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Simulation.h"
+#include "WorkerPool.h"
+#include "BatchSpawner.h"
+#include "TripleBuffer.h"
+#include "TrajectoryRecorder.h"
+#include "SharedExport.h"
+#include "SimulationClock.h"
+#include "ParticleBuckets.h"
+
+// What the UI draws: an immutable copy of the scene after some tick.
+struct SimulationSnapshot {
+	// Positions grouped by the coarse cell they are in, so a view of part
+	// of the world reads only the cells it overlaps.
+	std::vector<float> x, y;
+	ParticleBuckets buckets;
+	float worldWidth = CANVAS_WIDTH, worldHeight = CANVAS_HEIGHT;
+	// Positions before the step that produced x and y, slot for slot, when
+	// interpolation is on and no particle was added, removed or reordered
+	// since; empty otherwise.
+	std::vector<float> previousX, previousY;
+	// When that step finished, and the wall seconds until the next one is
+	// due; 0 when ticks are not paced by the wall clock.
+	std::chrono::steady_clock::time_point stepTime;
+	double stepInterval = 0.0;
+	std::vector<Wall> walls;
+	std::vector<Emitter> emitters;
+	std::vector<Sink> sinks;
+	FlowStats flow;
+	uint64_t tick = 0;
+	double simulatedSeconds = 0.0;
+	// Ticks the clock dropped over its budget, and ticks run to catch up.
+	uint64_t droppedTicks = 0;
+	uint64_t caughtUpTicks = 0;
+	// Bytes allocated for particle state by the simulation.
+	size_t particleBytes = 0;
+	// Step kernel the scene currently selects; a static string.
+	const char* stepKernel = "";
+
+	// Refreshed about twice a second.
+	double ticksPerSecond = 0.0;
+	double busyRatio = 0.0;
+	double wallCandidates = 0.0;
+	double pairTestsPerTick = 0.0;
+	double eventsPerTick = 0.0;
+
+	bool recording = false;
+	uint64_t recordFramesWritten = 0;
+	uint64_t recordFramesDropped = 0;
+	uint64_t recordBytes = 0;
+	double recordRatio = 0.0;
+	double recordCaptureMilliseconds = 0.0;
+	double recordWriteMilliseconds = 0.0;
+
+	bool exporting = false;
+	uint64_t exportFrames = 0;
+	double exportMilliseconds = 0.0;
+
+	// Filled while Simulation::collectAnalytics is on: the latest samples,
+	// oldest first, the latest tick's density grid and speed histogram, and
+	// the per-wall totals.
+	bool analytics = false;
+	std::vector<AnalyticsSample> analyticsHistory;
+	std::vector<float> density;
+	std::vector<float> speedHistogram;
+	std::vector<uint64_t> wallHits;
+	std::vector<double> wallImpulse;
+};
+
+// Runs a Simulation on its own thread, paced by a SimulationClock. After each
+// step the positions are published through a triple buffer, so the UI reads
+// the latest snapshot without blocking the simulation and a slow frame never
+// slows the ticks down. Every change to the scene or the clock is posted as a
+// command and applied between ticks on the simulation thread.
+class SimulationThread {
+public:
+	typedef std::function<void(Simulation&)> Command;
+
+	explicit SimulationThread(double tickRate = 60.0);
+	~SimulationThread();
+
+	SimulationThread(const SimulationThread&) = delete;
+	SimulationThread& operator=(const SimulationThread&) = delete;
+
+	void Start();
+	void Stop();
+
+	// Queues a command for the next tick boundary. Safe from any thread.
+	void Post(Command command);
+
+	void SetThreadCount(size_t numThreads);
+	void SetChunkSize(size_t chunkSize);
+	// Generates the batch in the background and adds it between ticks;
+	// batches requested while one is generating are queued.
+	void AddBatch(const BatchSpec& spec);
+	// Records positions every `interval` ticks to `path` until StopRecording.
+	void StartRecording(const std::string& path, uint32_t interval);
+	void StopRecording();
+	// Publishes every step to the shared-memory segment `name` (see
+	// SharedExport.h) until StopExport. The segment has room for twice the
+	// current scene, or at least EXPORT_MIN_PARTICLES particles.
+	void StartExport(const std::string& name);
+	void StopExport();
+	// False when the last StartExport could not create its segment.
+	bool ExportFailed() const { return exportFailed.load(std::memory_order_relaxed); }
+
+	// Clock controls; see SimulationClock.
+	void SetTimeScale(double scale);
+	void SetPaused(bool paused);
+	// Runs `ticks` more ticks while paused.
+	void StepPaused(int ticks = 1);
+	void SetMaxThroughput(bool enabled);
+	void SetTickBudget(int ticks);
+	// Keeps the positions from before each step in the snapshot, so the UI
+	// can draw between ticks. Costs one more copy of the positions per step.
+	void SetInterpolation(bool enabled);
+
+	// Newest published snapshot. Reader thread only; valid until the next call.
+	const SimulationSnapshot& ReadSnapshot() { return snapshots.Read(); }
+
+	size_t GetThreadCount() const { return threadCount.load(std::memory_order_relaxed); }
+	const BatchSpawner& GetBatchSpawner() const { return spawner; }
+
+private:
+	void Run();
+	// False when there were no commands.
+	bool ApplyCommands();
+	void PublishSnapshot();
+
+	Simulation sim;
+	WorkerPool pool;
+	BatchSpawner spawner;
+	TrajectoryRecorder recorder;
+	SharedExporter exporter;
+	std::atomic<bool> exportFailed{ false };
+	SimulationClock clock;
+
+	// Positions before the last step, for interpolation, and after it; both
+	// in simulation order, grouped by bucketSorter as they are published.
+	bool interpolating = true;
+	std::vector<float> previousX, previousY;
+	std::vector<float> currentX, currentY;
+	BucketSorter bucketSorter;
+	uint64_t previousLayout = 0;
+	std::chrono::steady_clock::time_point stepTime;
+
+	std::thread thread;
+	std::atomic<bool> running{ false };
+	std::atomic<size_t> threadCount{ 0 };
+
+	std::mutex commandMutex;
+	std::vector<Command> pendingCommands;
+	std::vector<Command> runningCommands;
+
+	TripleBuffer<SimulationSnapshot> snapshots;
+
+	// Stats window, owned by the simulation thread.
+	double ticksPerSecond = 0.0;
+	double busyRatio = 0.0;
+	double wallCandidates = 0.0;
+	double pairTestsPerTick = 0.0;
+	double eventsPerTick = 0.0;
+};
@@ -0,0 +1,475 @@
+#include "StepKernels.h"
+#include "Kernels.h"
+#include "Collision.h"
+#include "Random.h"
+#include "WallCache.h"
+#include "Analytics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// Position jitter applied after a wall bounce, in pixels either way.
+const float WALL_JITTER = 0.3f;
+
+static float wrapCoordinate(float value, float limit) {
+	return value - limit * std::floor(value / limit);
+}
+
+// Straight legs a particle actually travelled during one tick, recorded only
+// when tunneling is being counted.
+struct PathTrace {
+	float x[2 * MAX_BOUNCES_PER_STEP + 4];
+	float y[2 * MAX_BOUNCES_PER_STEP + 4];
+	// Set for points reached by wrapping to the opposite edge, which ends a leg without travelling.
+	bool wrapped[2 * MAX_BOUNCES_PER_STEP + 4];
+	int count = 0;
+
+	void Add(float px, float py, bool wrappedTo = false) {
+		if (count < 2 * MAX_BOUNCES_PER_STEP + 4) {
+			x[count] = px;
+			y[count] = py;
+			wrapped[count] = wrappedTo;
+			++count;
+		}
+	}
+};
+
+// Border policies: what a particle does at the edges of the world.
+struct ReflectBorders {
+	static constexpr const char* NAME = "reflect";
+	static constexpr bool WRAPS = false;
+	// Bounces off the edges push on them (see SceneAnalytics).
+	static constexpr bool PUSHES = true;
+
+	// A whole range of straight moves without walls; bounces add to
+	// `borderImpulse` when it is given.
+	static void Integrate(float* x, float* y, float* vx, float* vy, size_t count, float deltaTime, float width, float height,
+		float* borderImpulse) {
+		IntegrateParticles(x, y, vx, vy, count, deltaTime, width, height, borderImpulse);
+	}
+	// The end of a threshold-mode move.
+	static void Resolve(float& x, float& y, float& vx, float& vy, float width, float height) {
+		if (x < 0 || x > width) {
+			x = x < 0 ? 0 : width;
+			vx = -vx;
+		}
+		if (y < 0 || y > height) {
+			y = y < 0 ? 0 : height;
+			vy = -vy;
+		}
+	}
+	// A swept move reached the edge on the flagged axes; false ends the move there.
+	static bool Cross(bool crossX, bool crossY, float&, float&, float& vx, float& vy, float, float) {
+		if (crossX) {
+			vx = -vx;
+		}
+		if (crossY) {
+			vy = -vy;
+		}
+		return true;
+	}
+	// The stored coordinate at the end of a swept move.
+	static float Settle(float value, float limit) {
+		return std::min(std::max(value, 0.0f), limit);
+	}
+};
+
+struct WrapBorders {
+	static constexpr const char* NAME = "wrap";
+	static constexpr bool WRAPS = true;
+	static constexpr bool PUSHES = false;
+
+	static void Integrate(float* x, float* y, float* vx, float* vy, size_t count, float deltaTime, float width, float height,
+		float*) {
+		for (size_t i = 0; i < count; ++i) {
+			x[i] = wrapCoordinate(x[i] + vx[i] * deltaTime, width);
+			y[i] = wrapCoordinate(y[i] + vy[i] * deltaTime, height);
+		}
+	}
+	static void Resolve(float& x, float& y, float&, float&, float width, float height) {
+		x = wrapCoordinate(x, width);
+		y = wrapCoordinate(y, height);
+	}
+	static bool Cross(bool crossX, bool crossY, float& x, float& y, float& vx, float& vy, float width, float height) {
+		if (crossX) {
+			x = vx > 0 ? 0.0f : width;
+		}
+		if (crossY) {
+			y = vy > 0 ? 0.0f : height;
+		}
+		return true;
+	}
+	static float Settle(float value, float limit) {
+		return std::min(std::max(value, 0.0f), limit);
+	}
+};
+
+// Particles are left outside the world, where ParticleFlow frees them at
+// the end of the tick.
+struct AbsorbBorders {
+	static constexpr const char* NAME = "absorb";
+	static constexpr bool WRAPS = false;
+	static constexpr bool PUSHES = false;
+
+	static void Integrate(float* x, float* y, float* vx, float* vy, size_t count, float deltaTime, float, float, float*) {
+		for (size_t i = 0; i < count; ++i) {
+			x[i] += vx[i] * deltaTime;
+			y[i] += vy[i] * deltaTime;
+		}
+	}
+	static void Resolve(float&, float&, float&, float&, float, float) {}
+	static bool Cross(bool, bool, float&, float&, float&, float&, float, float) {
+		return false;
+	}
+	static float Settle(float value, float) {
+		return value;
+	}
+};
+
+// Wall policies: which walls of context.cache a move from (x0, y0) to
+// (x1, y1) is tested against.
+struct GridWalls {
+	static constexpr const char* NAME = "grid";
+
+	static WallSpan Query(const StepContext& context, float x0, float y0, float x1, float y1,
+		std::vector<uint32_t>& found) {
+		context.grid.Query(x0, y0, x1, y1, found);
+		return { found.data(), found.size() };
+	}
+};
+
+// Every wall, read straight from the cache a block at a time; no cells to
+// walk and no sort.
+struct LinearWalls {
+	static constexpr const char* NAME = "linear";
+
+	static WallSpan Query(const StepContext& context, float, float, float, float, std::vector<uint32_t>&) {
+		return { nullptr, context.cache.Size() };
+	}
+};
+
+static uint32_t spanWall(WallSpan span, size_t k) {
+	return span.indices ? span.indices[k] : (uint32_t)k;
+}
+
+// Edge bounces of a move ending at (x, y), as the reflecting border resolves them.
+static void recordBorderHits(const StepContext& context, float x, float y, float vx, float vy, AnalyticsAccumulator& analytics) {
+	if (x < 0 || x > context.width) {
+		analytics.RecordBorder(x < 0 ? SIDE_LEFT : SIDE_RIGHT, 2.0f * std::fabs(vx));
+	}
+	if (y < 0 || y > context.height) {
+		analytics.RecordBorder(y < 0 ? SIDE_TOP : SIDE_BOTTOM, 2.0f * std::fabs(vy));
+	}
+}
+
+// Same rules as Particle::UpdatePosition, on the SoA store, with the wall
+// geometry from the cache: a bounce off the middle of a wall mirrors the
+// velocity instead of going through angles. The collision threshold depends
+// on each particle's speed, so it stays a per-particle select.
+template <typename Border, typename Walls, bool Jitter>
+static void updateParticleThreshold(const StepContext& context, size_t i, std::vector<uint32_t>& found,
+	WorkerStats& stats, AnalyticsAccumulator* analytics, PathTrace* trace) {
+	ParticleStore& store = context.store;
+	const WallCache& cache = context.cache;
+	float deltaTime = context.deltaTime;
+
+	float x = store.x[i];
+	float y = store.y[i];
+	float vx = store.vx[i];
+	float vy = store.vy[i];
+
+	float newX = x + vx * deltaTime;
+	float newY = y + vy * deltaTime;
+
+	// Threshold for collision detection
+	float threshold = vx * vx + vy * vy > 500.0f * 500.0f ? 10.0f : 3.0f;
+
+	WallSpan candidates = Walls::Query(context, x, y, newX, newY, found);
+	stats.wallQueries++;
+	stats.wallCandidates += candidates.count;
+
+	int32_t w = FindNearWall(cache, candidates, newX, newY, threshold);
+	if (w >= 0) {
+		if constexpr (Jitter) {
+			RandomBlock random = RandomFor(context.seed, store.id[i], context.tick, RANDOM_WALL_JITTER, 0);
+			x += RandomRange(random.v[0], -WALL_JITTER, WALL_JITTER);
+			y += RandomRange(random.v[1], -WALL_JITTER, WALL_JITTER);
+		}
+		if (trace) {
+			trace->Add(x, y);
+		}
+
+		float startX = newX - cache.startX[w], startY = newY - cache.startY[w];
+		float endX = startX - cache.edgeX[w], endY = startY - cache.edgeY[w];
+		float thresholdSquared = threshold * threshold;
+		float oldVx = vx, oldVy = vy;
+		if (startX * startX + startY * startY < thresholdSquared || endX * endX + endY * endY < thresholdSquared) {
+			vx = -vx;
+			vy = -vy;
+		} else {
+			float reflectedX = cache.reflectXX[w] * vx + cache.reflectXY[w] * vy;
+			vy = cache.reflectXY[w] * vx - cache.reflectXX[w] * vy;
+			vx = reflectedX;
+		}
+		if (analytics) {
+			analytics->RecordWall((uint32_t)w, std::sqrt((vx - oldVx) * (vx - oldVx) + (vy - oldVy) * (vy - oldVy)));
+		}
+
+		newX = x + vx * deltaTime;
+		newY = y + vy * deltaTime;
+	}
+
+	if (trace) {
+		trace->Add(newX, newY);
+	}
+
+	if constexpr (Border::PUSHES) {
+		if (analytics) {
+			recordBorderHits(context, newX, newY, vx, vy, *analytics);
+		}
+	}
+	Border::Resolve(newX, newY, vx, vy, context.width, context.height);
+
+	store.x[i] = newX;
+	store.y[i] = newY;
+	store.vx[i] = vx;
+	store.vy[i] = vy;
+}
+
+// Continuous collision: the move is swept against the edges of the world and the
+// walls along it, the particle is stopped at the earliest impact, reflected,
+// and the rest of the step continues from there, up to MAX_BOUNCES_PER_STEP.
+template <typename Border, typename Walls, bool Jitter>
+static void updateParticleSwept(const StepContext& context, size_t i, std::vector<uint32_t>& found,
+	WorkerStats& stats, AnalyticsAccumulator* analytics, PathTrace* trace) {
+	ParticleStore& store = context.store;
+	float x = store.x[i];
+	float y = store.y[i];
+	float vx = store.vx[i];
+	float vy = store.vy[i];
+	float remaining = context.deltaTime;
+	float width = context.width;
+	float height = context.height;
+
+	for (int bounce = 0; bounce <= MAX_BOUNCES_PER_STEP && remaining > 0; ++bounce) {
+		float dx = vx * remaining;
+		float dy = vy * remaining;
+
+		float hitT = 2.0f;
+		bool hitBorderX = false, hitBorderY = false;
+		float nx = 0, ny = 0;
+
+		if (x + dx < 0 || x + dx > width) {
+			hitT = ((x + dx < 0 ? 0 : width) - x) / dx;
+			hitBorderX = true;
+		}
+		if (y + dy < 0 || y + dy > height) {
+			float borderT = ((y + dy < 0 ? 0 : height) - y) / dy;
+			if (borderT < hitT) {
+				hitT = borderT;
+				hitBorderX = false;
+			}
+			hitBorderY = borderT <= hitT;
+		}
+
+		WallSpan candidates = Walls::Query(context, x, y, x + dx, y + dy, found);
+		stats.wallQueries++;
+		stats.wallCandidates += candidates.count;
+
+		// Walls are swept COLLISION_SKIN past the end of the move, so a move
+		// that would end a rounding error beyond a wall stops short of it.
+		float length = std::sqrt(dx * dx + dy * dy);
+		float reach = length > 0.0f ? 1.0f + COLLISION_SKIN / length : 1.0f;
+		float wallT;
+		int32_t hitWall = SweepWalls(context.cache, candidates, x, y, dx * reach, dy * reach, hitT / reach, wallT);
+		if (hitWall >= 0) {
+			hitT = wallT * reach;
+			// The normal facing the side the particle came from.
+			nx = context.cache.normalX[hitWall];
+			ny = context.cache.normalY[hitWall];
+			if (nx * dx + ny * dy > 0) {
+				nx = -nx;
+				ny = -ny;
+			}
+		}
+
+		if (hitT > 1.0f && hitWall < 0) {
+			x += dx;
+			y += dy;
+			break;
+		}
+
+		hitT = std::max(hitT, 0.0f);
+		remaining *= std::max(1.0f - hitT, 0.0f);
+
+		bool wrapped = false;
+		if (hitWall >= 0) {
+			// Stop short of the impact on the part of the move already known
+			// to be clear, COLLISION_SKIN away from the wall even at grazing angles.
+			float backOff = std::min(hitT, COLLISION_SKIN / std::fabs(dx * nx + dy * ny));
+			x += dx * (hitT - backOff);
+			y += dy * (hitT - backOff);
+
+			float along = vx * nx + vy * ny;
+			vx -= 2 * along * nx;
+			vy -= 2 * along * ny;
+			if (analytics) {
+				analytics->RecordWall((uint32_t)hitWall, 2.0f * std::fabs(along));
+			}
+			if (trace) {
+				trace->Add(x, y);
+			}
+
+			if constexpr (Jitter) {
+				// Jitter slides along the wall, and is dropped if that slide
+				// would cross another wall or end closer to one than the skin,
+				// where the next sweep could start on its far side.
+				RandomBlock random = RandomFor(context.seed, store.id[i], context.tick, RANDOM_WALL_JITTER, bounce);
+				float offset = RandomRange(random.v[0], -WALL_JITTER, WALL_JITTER);
+				float jitterX = -ny * offset;
+				float jitterY = nx * offset;
+
+				float jitterT;
+				bool blocked = x + jitterX < 0 || x + jitterX > width || y + jitterY < 0 || y + jitterY > height ||
+					SweepWalls(context.cache, candidates, x, y, jitterX, jitterY, 2.0f, jitterT) >= 0 ||
+					FindNearWall(context.cache, candidates, x + jitterX, y + jitterY, 0.5f * COLLISION_SKIN) >= 0;
+				if (!blocked) {
+					x += jitterX;
+					y += jitterY;
+				}
+			}
+		} else {
+			x += dx * hitT;
+			y += dy * hitT;
+			if (trace && Border::WRAPS) {
+				trace->Add(x, y);
+			}
+			if constexpr (Border::PUSHES) {
+				if (analytics && hitBorderX) {
+					analytics->RecordBorder(vx > 0 ? SIDE_RIGHT : SIDE_LEFT, 2.0f * std::fabs(vx));
+				}
+				if (analytics && hitBorderY) {
+					analytics->RecordBorder(vy > 0 ? SIDE_BOTTOM : SIDE_TOP, 2.0f * std::fabs(vy));
+				}
+			}
+			if (!Border::Cross(hitBorderX, hitBorderY, x, y, vx, vy, width, height)) {
+				// Left the world: finish the move outside it.
+				x += dx * (1.0f - hitT);
+				y += dy * (1.0f - hitT);
+				break;
+			}
+			wrapped = Border::WRAPS;
+		}
+
+		if (trace) {
+			trace->Add(x, y, wrapped);
+		}
+	}
+
+	if (trace) {
+		trace->Add(x, y);
+	}
+
+	store.x[i] = Border::Settle(x, width);
+	store.y[i] = Border::Settle(y, height);
+	store.vx[i] = vx;
+	store.vy[i] = vy;
+}
+
+template <typename Walls>
+static bool pathCrossesWall(const StepContext& context, const PathTrace& trace, std::vector<uint32_t>& found) {
+	for (int leg = 1; leg < trace.count; ++leg) {
+		if (trace.wrapped[leg]) {
+			continue;
+		}
+		float x0 = trace.x[leg - 1], y0 = trace.y[leg - 1];
+		float x1 = trace.x[leg], y1 = trace.y[leg];
+
+		WallSpan candidates = Walls::Query(context, x0, y0, x1, y1, found);
+		for (size_t k = 0; k < candidates.count; ++k) {
+			if (CrossesWall(context.walls[spanWall(candidates, k)], x0, y0, x1, y1)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+template <typename Border>
+static void integrateRange(const StepContext& context, size_t begin, size_t end, WorkerStats&,
+	AnalyticsAccumulator* analytics) {
+	ParticleStore& store = context.store;
+	float* borderImpulse = Border::PUSHES && analytics && analytics->sampling ? analytics->borderImpulse : nullptr;
+	Border::Integrate(store.x.Data() + begin, store.y.Data() + begin, store.vx.Data() + begin, store.vy.Data() + begin,
+		end - begin, context.deltaTime, context.width, context.height, borderImpulse);
+}
+
+template <typename Border, typename Walls, bool Jitter, bool Swept>
+static void stepRange(const StepContext& context, size_t begin, size_t end, WorkerStats& stats,
+	AnalyticsAccumulator* analytics) {
+	ParticleStore& store = context.store;
+	// Reused across calls so a tick does not allocate once the buffer has grown.
+	static thread_local std::vector<uint32_t> found;
+	PathTrace trace;
+	PathTrace* tracePointer = context.countTunneling ? &trace : nullptr;
+
+	for (size_t i = begin; i < end; ++i) {
+		trace.count = 0;
+		trace.Add(store.x[i], store.y[i]);
+
+		if constexpr (Swept) {
+			updateParticleSwept<Border, Walls, Jitter>(context, i, found, stats, analytics, tracePointer);
+		} else {
+			updateParticleThreshold<Border, Walls, Jitter>(context, i, found, stats, analytics, tracePointer);
+		}
+
+		if (tracePointer) {
+			// A threshold move ends with the wrap, if any.
+			trace.Add(store.x[i], store.y[i], Border::WRAPS && !Swept);
+			if (pathCrossesWall<Walls>(context, trace, found)) {
+				stats.tunnelingEvents++;
+			}
+		}
+	}
+}
+
+template <typename Border, typename Walls, bool Jitter, bool Swept>
+static StepKernelInfo kernelInfo() {
+	static const std::string name = std::string(Border::NAME) + "/" + Walls::NAME +
+		(Jitter ? "/jitter" : "/no-jitter") + (Swept ? "/swept" : "/threshold");
+	return { stepRange<Border, Walls, Jitter, Swept>, name.c_str() };
+}
+
+template <typename Border, typename Walls>
+static StepKernelInfo selectWallKernel(CollisionMode collision, bool jitter) {
+	bool swept = collision != COLLISION_THRESHOLD;
+	if (jitter) {
+		return swept ? kernelInfo<Border, Walls, true, true>() : kernelInfo<Border, Walls, true, false>();
+	}
+	return swept ? kernelInfo<Border, Walls, false, true>() : kernelInfo<Border, Walls, false, false>();
+}
+
+template <typename Border>
+static StepKernelInfo selectBorderKernel(CollisionMode collision, size_t wallCount, size_t linearWallLimit, bool jitter) {
+	if (wallCount == 0) {
+		static const std::string name = std::string(Border::NAME) + "/no-walls";
+		return { integrateRange<Border>, name.c_str() };
+	}
+	if (wallCount <= std::min(linearWallLimit, LINEAR_WALL_MAX)) {
+		return selectWallKernel<Border, LinearWalls>(collision, jitter);
+	}
+	return selectWallKernel<Border, GridWalls>(collision, jitter);
+}
+
+StepKernelInfo SelectStepKernel(BorderMode border, CollisionMode collision, size_t wallCount, size_t linearWallLimit,
+	bool jitter) {
+	switch (border) {
+	case BORDER_WRAP:
+		return selectBorderKernel<WrapBorders>(collision, wallCount, linearWallLimit, jitter);
+	case BORDER_ABSORB:
+		return selectBorderKernel<AbsorbBorders>(collision, wallCount, linearWallLimit, jitter);
+	default:
+		return selectBorderKernel<ReflectBorders>(collision, wallCount, linearWallLimit, jitter);
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// The per-tick particle step, specialized at compile time on what a scene
+// uses: how particles leave the world, how walls are looked up, whether
+// wall bounces jitter, and the wall test. Simulation picks one
+// instantiation per step, so an empty box runs a straight SIMD loop and a
+// scene with a few walls and no jitter never touches the grid or the RNG.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Simulation.h"
+
+struct StepContext {
+	ParticleStore& store;
+	const std::vector<Wall>& walls;
+	const WallGrid& grid;
+	const WallCache& cache;
+	bool countTunneling;
+	float deltaTime;
+	// World size; the borders are at 0 and at width and height.
+	float width, height;
+	uint64_t seed;
+	uint64_t tick;
+};
+
+// Steps particles [begin, end) of context.store by one tick, recording
+// bounces into `analytics` unless it is null.
+typedef void (*StepKernel)(const StepContext& context, size_t begin, size_t end, WorkerStats& stats,
+	AnalyticsAccumulator* analytics);
+
+struct StepKernelInfo {
+	StepKernel function;
+	// "border/walls/jitter/test", e.g. "reflect/grid/jitter/swept", or
+	// "border/no-walls".
+	const char* name;
+};
+
+// Largest collision threshold; walls are registered in the grid with this
+// margin, so a cell query returns every wall a threshold test can reach.
+const float MAX_WALL_THRESHOLD = 10.0f;
+
+// Most walls a scene may have to be tested all at once rather than through the grid.
+const size_t LINEAR_WALL_MAX = 64;
+
+// The instantiation for a scene. Scenes with up to linearWallLimit walls
+// (at most LINEAR_WALL_MAX) test every wall instead of querying the grid.
+// The grid keeps every wall a move can reach, in index order, so both give
+// identical results. COLLISION_EVENT picks the swept kernel it falls back to.
+StepKernelInfo SelectStepKernel(BorderMode border, CollisionMode collision, size_t wallCount, size_t linearWallLimit,
+	bool jitter);
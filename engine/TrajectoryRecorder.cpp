@@ -0,0 +1,286 @@
+#include "TrajectoryRecorder.h"
+#include "Simulation.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// Frames that can wait for the writer before captures start being dropped.
+const size_t TRAJECTORY_BUFFERS = 4;
+// Longest run of delta frames, so a reader can resync within a few seconds.
+const uint32_t KEYFRAME_INTERVAL = 64;
+
+static uint32_t zigzag(int32_t value) {
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static void putVarint(std::vector<unsigned char>& out, uint32_t value) {
+	while (value >= 0x80) {
+		out.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((unsigned char)value);
+}
+
+static bool getVarint(const unsigned char*& in, const unsigned char* end, uint32_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 35 && in < end; shift += 7) {
+		unsigned char byte = *in++;
+		value |= (uint32_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int32_t quantize(float value) {
+	return (int32_t)std::lround(value * TRAJECTORY_SCALE);
+}
+
+static uint64_t nanosecondsSince(std::chrono::steady_clock::time_point start) {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+	Stop();
+}
+
+bool TrajectoryRecorder::Start(const char* path, uint32_t recordInterval) {
+	Stop();
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+
+	interval = recordInterval > 0 ? recordInterval : 1;
+	TrajectoryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+	header.version = TRAJECTORY_VERSION;
+	header.interval = interval;
+	header.scale = TRAJECTORY_SCALE;
+	file.write((const char*)&header, sizeof(header));
+
+	frames.assign(TRAJECTORY_BUFFERS, Frame());
+	freeFrames.clear();
+	filledFrames.clear();
+	for (size_t i = 0; i < frames.size(); ++i) {
+		freeFrames.push_back(i);
+	}
+	previousX.clear();
+	previousY.clear();
+	previousIds.clear();
+	framesSinceKey = 0;
+	lastCaptureTick = UINT64_MAX;
+
+	framesWritten.store(0, std::memory_order_relaxed);
+	framesDropped.store(0, std::memory_order_relaxed);
+	bytesWritten.store(sizeof(header), std::memory_order_relaxed);
+	rawBytes.store(0, std::memory_order_relaxed);
+	captureNanoseconds.store(0, std::memory_order_relaxed);
+	framesCaptured.store(0, std::memory_order_relaxed);
+	writeNanoseconds.store(0, std::memory_order_relaxed);
+
+	stopping = false;
+	recording = true;
+	writer = std::thread(&TrajectoryRecorder::WriterLoop, this);
+	return true;
+}
+
+void TrajectoryRecorder::Stop() {
+	if (!recording) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+	file.close();
+	recording = false;
+}
+
+void TrajectoryRecorder::Capture(const Simulation& sim) {
+	uint64_t tick = sim.GetTick();
+	if (!recording || (lastCaptureTick != UINT64_MAX && tick / interval == lastCaptureTick / interval)) {
+		return;
+	}
+	lastCaptureTick = tick;
+
+	auto start = std::chrono::steady_clock::now();
+	size_t slot;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (freeFrames.empty()) {
+			framesDropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		slot = freeFrames.back();
+		freeFrames.pop_back();
+	}
+
+	// The slot is ours until it is queued, so the copy runs unlocked.
+	Frame& frame = frames[slot];
+	size_t count = sim.GetParticleCount();
+	frame.tick = tick;
+	frame.x.resize(count);
+	frame.y.resize(count);
+	frame.ids.resize(count);
+	sim.CopyPositions(frame.x.data(), frame.y.data(), frame.ids.data());
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		filledFrames.push_back(slot);
+	}
+	wake.notify_one();
+	captureNanoseconds.fetch_add(nanosecondsSince(start), std::memory_order_relaxed);
+	framesCaptured.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TrajectoryRecorder::WriterLoop() {
+	size_t next = 0;
+	for (;;) {
+		size_t slot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, next] { return stopping || next < filledFrames.size(); });
+			if (next >= filledFrames.size()) {
+				return;
+			}
+			slot = filledFrames[next];
+		}
+
+		WriteFrame(frames[slot]);
+
+		// Frames are queued in capture order; retire this one and hand its
+		// buffers back to Capture.
+		std::lock_guard<std::mutex> lock(mutex);
+		filledFrames.erase(filledFrames.begin());
+		freeFrames.push_back(slot);
+	}
+}
+
+void TrajectoryRecorder::WriteFrame(const Frame& frame) {
+	auto start = std::chrono::steady_clock::now();
+	size_t count = frame.x.size();
+
+	bool keyFrame = framesSinceKey == 0 || count != previousIds.size() ||
+		memcmp(frame.ids.data(), previousIds.data(), count * sizeof(uint32_t)) != 0;
+	framesSinceKey = keyFrame ? 1 : (framesSinceKey + 1) % KEYFRAME_INTERVAL;
+
+	payload.clear();
+	if (keyFrame) {
+		uint32_t last = 0;
+		for (uint32_t id : frame.ids) {
+			putVarint(payload, zigzag((int32_t)(id - last)));
+			last = id;
+		}
+		previousIds = frame.ids;
+		previousX.assign(count, 0);
+		previousY.assign(count, 0);
+	}
+	for (size_t i = 0; i < count; ++i) {
+		int32_t q = quantize(frame.x[i]);
+		putVarint(payload, zigzag(q - previousX[i]));
+		previousX[i] = q;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		int32_t q = quantize(frame.y[i]);
+		putVarint(payload, zigzag(q - previousY[i]));
+		previousY[i] = q;
+	}
+
+	TrajectoryFrameHeader header;
+	header.tick = frame.tick;
+	header.count = (uint32_t)count;
+	header.flags = keyFrame ? TRAJECTORY_KEYFRAME | TRAJECTORY_IDS : 0;
+	header.payloadBytes = payload.size();
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)payload.data(), (std::streamsize)payload.size());
+
+	bytesWritten.fetch_add(sizeof(header) + payload.size(), std::memory_order_relaxed);
+	rawBytes.fetch_add(sizeof(header) + count * 2 * sizeof(float), std::memory_order_relaxed);
+	framesWritten.fetch_add(1, std::memory_order_relaxed);
+	writeNanoseconds.fetch_add(nanosecondsSince(start), std::memory_order_relaxed);
+}
+
+double TrajectoryRecorder::GetCompressionRatio() const {
+	uint64_t raw = rawBytes.load(std::memory_order_relaxed);
+	uint64_t written = bytesWritten.load(std::memory_order_relaxed) - sizeof(TrajectoryHeader);
+	return raw ? (double)written / raw : 0.0;
+}
+
+double TrajectoryRecorder::GetCaptureMilliseconds() const {
+	uint64_t captured = framesCaptured.load(std::memory_order_relaxed);
+	return captured ? captureNanoseconds.load(std::memory_order_relaxed) / 1e6 / captured : 0.0;
+}
+
+double TrajectoryRecorder::GetWriteMilliseconds() const {
+	uint64_t written = framesWritten.load(std::memory_order_relaxed);
+	return written ? writeNanoseconds.load(std::memory_order_relaxed) / 1e6 / written : 0.0;
+}
+
+bool TrajectoryReader::Open(const char* path) {
+	file.open(path, std::ios::binary);
+	if (!file.read((char*)&header, sizeof(header))) {
+		return false;
+	}
+	return memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic)) == 0 &&
+		header.version == TRAJECTORY_VERSION && header.scale > 0.0f;
+}
+
+bool TrajectoryReader::NextFrame() {
+	if (!file.read((char*)&frameHeader, sizeof(frameHeader))) {
+		return false;
+	}
+	bool keyFrame = IsKeyFrame();
+	size_t count = frameHeader.count;
+	if (!keyFrame && count != ids.size()) {
+		return false;
+	}
+	payload.resize((size_t)frameHeader.payloadBytes);
+	if (!file.read((char*)payload.data(), (std::streamsize)payload.size())) {
+		return false;
+	}
+
+	const unsigned char* in = payload.data();
+	const unsigned char* end = in + payload.size();
+	uint32_t value;
+	if (frameHeader.flags & TRAJECTORY_IDS) {
+		ids.resize(count);
+		uint32_t last = 0;
+		for (size_t i = 0; i < count; ++i) {
+			if (!getVarint(in, end, value)) {
+				return false;
+			}
+			last += (uint32_t)unzigzag(value);
+			ids[i] = last;
+		}
+	}
+	if (keyFrame) {
+		quantizedX.assign(count, 0);
+		quantizedY.assign(count, 0);
+	}
+	for (std::vector<int32_t>* axis : { &quantizedX, &quantizedY }) {
+		for (size_t i = 0; i < count; ++i) {
+			if (!getVarint(in, end, value)) {
+				return false;
+			}
+			(*axis)[i] += unzigzag(value);
+		}
+	}
+
+	x.resize(count);
+	y.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		x[i] = quantizedX[i] / header.scale;
+		y[i] = quantizedY[i] / header.scale;
+	}
+	return true;
+}
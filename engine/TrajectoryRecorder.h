@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Simulation;
+
+// Trajectory file layout, little-endian:
+//
+//   TrajectoryHeader
+//   frames, each a TrajectoryFrameHeader followed by payloadBytes of
+//     ids      (TRAJECTORY_IDS frames only) varint deltas between neighbours
+//     x deltas zigzag varints, one per particle
+//     y deltas zigzag varints, one per particle
+//
+// Positions are quantized to 1/TRAJECTORY_SCALE px. A key frame stores them
+// against zero; other frames against the previous frame, particle by particle,
+// which is only valid while count and ids are unchanged, so any change of
+// either forces a key frame.
+
+const char TRAJECTORY_MAGIC[8] = { 'P', 'S', 'I', 'M', 'T', 'R', 'A', 'J' };
+const uint32_t TRAJECTORY_VERSION = 1;
+const float TRAJECTORY_SCALE = 64.0f;
+
+const uint32_t TRAJECTORY_KEYFRAME = 1u << 0;
+const uint32_t TRAJECTORY_IDS = 1u << 1;
+
+struct TrajectoryHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t interval;
+	float scale;
+	uint32_t reserved[3];
+};
+
+struct TrajectoryFrameHeader {
+	uint64_t tick;
+	uint32_t count;
+	uint32_t flags;
+	uint64_t payloadBytes;
+};
+
+// Records every particle's position every `interval` ticks. Capture copies
+// the positions into one of a few reusable buffers and returns; a writer
+// thread encodes and writes them. When the writer falls behind and every
+// buffer is in use, the frame is dropped rather than stalling the step.
+class TrajectoryRecorder {
+public:
+	TrajectoryRecorder() {}
+	~TrajectoryRecorder();
+
+	TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+	TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+	bool Start(const char* path, uint32_t interval);
+	// Writes out the buffered frames and closes the file.
+	void Stop();
+	bool Recording() const { return recording; }
+
+	// Call after each step; records when a multiple of the interval was passed.
+	void Capture(const Simulation& sim);
+
+	uint64_t GetFramesWritten() const { return framesWritten.load(std::memory_order_relaxed); }
+	uint64_t GetFramesDropped() const { return framesDropped.load(std::memory_order_relaxed); }
+	uint64_t GetBytesWritten() const { return bytesWritten.load(std::memory_order_relaxed); }
+	// Encoded size over raw float positions, for the frames written so far.
+	double GetCompressionRatio() const;
+	// Mean time the step thread spent per captured frame.
+	double GetCaptureMilliseconds() const;
+	// Mean time the writer spent encoding and writing a frame.
+	double GetWriteMilliseconds() const;
+
+private:
+	struct Frame {
+		uint64_t tick = 0;
+		std::vector<float> x, y;
+		std::vector<uint32_t> ids;
+	};
+
+	void WriterLoop();
+	void WriteFrame(const Frame& frame);
+
+	bool recording = false;
+	uint32_t interval = 1;
+	uint64_t lastCaptureTick = 0;
+
+	std::ofstream file;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+	std::vector<Frame> frames;
+	std::vector<size_t> freeFrames;
+	std::vector<size_t> filledFrames;
+
+	// Writer thread state: the previous frame's quantized positions and ids.
+	std::vector<int32_t> previousX, previousY;
+	std::vector<uint32_t> previousIds;
+	uint32_t framesSinceKey = 0;
+	std::vector<unsigned char> payload;
+
+	std::atomic<uint64_t> framesWritten{ 0 };
+	std::atomic<uint64_t> framesDropped{ 0 };
+	std::atomic<uint64_t> bytesWritten{ 0 };
+	std::atomic<uint64_t> rawBytes{ 0 };
+	std::atomic<uint64_t> captureNanoseconds{ 0 };
+	std::atomic<uint64_t> framesCaptured{ 0 };
+	std::atomic<uint64_t> writeNanoseconds{ 0 };
+};
+
+// Decodes a trajectory file one frame at a time.
+class TrajectoryReader {
+public:
+	bool Open(const char* path);
+	// False at the end of the file or on a damaged frame.
+	bool NextFrame();
+
+	uint32_t GetInterval() const { return header.interval; }
+	uint64_t GetTick() const { return frameHeader.tick; }
+	bool IsKeyFrame() const { return (frameHeader.flags & TRAJECTORY_KEYFRAME) != 0; }
+	uint64_t GetPayloadBytes() const { return frameHeader.payloadBytes; }
+
+	size_t Size() const { return x.size(); }
+	std::vector<float> x, y;
+	std::vector<uint32_t> ids;
+
+private:
+	std::ifstream file;
+	TrajectoryHeader header = {};
+	TrajectoryFrameHeader frameHeader = {};
+	std::vector<int32_t> quantizedX, quantizedY;
+	std::vector<unsigned char> payload;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer triple buffer. The writer fills
+// WriteBuffer() and publishes it; the reader always gets the newest published
+// buffer without waiting, and neither side ever touches the buffer the other
+// one holds. Buffers are reused, so their allocations survive between frames.
+template <typename T>
+class TripleBuffer {
+public:
+	// Writer side.
+	T& WriteBuffer() { return buffers[back]; }
+
+	void Publish() {
+		uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+		back = previous & INDEX_MASK;
+	}
+
+	// Reader side: the newest published buffer, or the last one read if
+	// nothing new has been published since.
+	const T& Read() {
+		if (middle.load(std::memory_order_relaxed) & FRESH) {
+			uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+			front = previous & INDEX_MASK;
+		}
+		return buffers[front];
+	}
+
+private:
+	static const uint8_t INDEX_MASK = 3;
+	static const uint8_t FRESH = 4;
+
+	T buffers[3];
+	alignas(64) uint8_t back = 0;
+	alignas(64) std::atomic<uint8_t> middle{ 1 };
+	alignas(64) uint8_t front = 2;
+};
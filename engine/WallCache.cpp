@@ -0,0 +1,323 @@
+#include "WallCache.h"
+#include "Simulation.h"
+#include "Collision.h"
+#include "Kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define WALL_CACHE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(WALL_CACHE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define KERNEL_TARGET_AVX2
+#endif
+
+void WallCache::Add(const Wall& wall) {
+	if (count == startX.Capacity()) {
+		size_t capacity = std::max(WALL_CACHE_LANES, 2 * count);
+		for (AlignedArray<float>* array : { &startX, &startY, &edgeX, &edgeY, &normalX, &normalY,
+			&inverseLengthSquared, &reflectXX, &reflectXY }) {
+			array->Reallocate(capacity, count);
+		}
+	}
+
+	float ex = wall.endX - wall.startX;
+	float ey = wall.endY - wall.startY;
+	float lengthSquared = ex * ex + ey * ey;
+	float length = sqrt(ex * ex + ey * ey);
+	float inverse = lengthSquared > 0.0f ? 1.0f / lengthSquared : 0.0f;
+
+	startX[count] = wall.startX;
+	startY[count] = wall.startY;
+	edgeX[count] = ex;
+	edgeY[count] = ey;
+	normalX[count] = length > 0.0f ? -ey / length : 0.0f;
+	normalY[count] = length > 0.0f ? ex / length : 0.0f;
+	inverseLengthSquared[count] = inverse;
+	reflectXX[count] = (ex * ex - ey * ey) * inverse;
+	reflectXY[count] = 2.0f * ex * ey * inverse;
+	++count;
+}
+
+void WallCache::Clear() {
+	count = 0;
+}
+
+static int32_t sweepWallsScalar(const WallCache& cache, WallSpan span, float x, float y, float dx, float dy,
+	float limit, float& t) {
+	int32_t hit = -1;
+	for (size_t k = 0; k < span.count; ++k) {
+		uint32_t w = span.indices ? span.indices[k] : (uint32_t)k;
+		float ex = cache.edgeX[w];
+		float ey = cache.edgeY[w];
+		float denominator = dx * ey - dy * ex;
+		float ax = cache.startX[w] - x;
+		float ay = cache.startY[w] - y;
+		float hitT = (ax * ey - ay * ex) / denominator;
+		float hitS = (ax * dy - ay * dx) / denominator;
+
+		if (denominator != 0.0f && hitT > MIN_IMPACT_TIME && hitT <= 1.0f && hitS >= -ENDPOINT_SLACK &&
+			hitS <= 1.0f + ENDPOINT_SLACK && hitT < limit) {
+			limit = hitT;
+			hit = (int32_t)w;
+		}
+	}
+	if (hit >= 0) {
+		t = limit;
+	}
+	return hit;
+}
+
+static int32_t findNearWallScalar(const WallCache& cache, WallSpan span, float px, float py, float threshold) {
+	float thresholdSquared = threshold * threshold;
+	for (size_t k = 0; k < span.count; ++k) {
+		uint32_t w = span.indices ? span.indices[k] : (uint32_t)k;
+		float ex = cache.edgeX[w];
+		float ey = cache.edgeY[w];
+		float inverse = cache.inverseLengthSquared[w];
+		float qx = px - cache.startX[w];
+		float qy = py - cache.startY[w];
+		float t = (qx * ex + qy * ey) * inverse;
+		float cross = qx * ey - qy * ex;
+
+		// On the segment, the line is never farther than either endpoint.
+		if (cross * cross * inverse < thresholdSquared && t >= 0.0f && t <= 1.0f && inverse > 0.0f) {
+			return (int32_t)w;
+		}
+	}
+	return -1;
+}
+
+#if defined(WALL_CACHE_X86)
+// Indices of the walls in the block starting at span position k; lanes past
+// the end of the span repeat wall 0 and are masked out by the caller.
+static void blockIndices(WallSpan span, size_t k, uint32_t* out, size_t lanes) {
+	size_t valid = std::min(lanes, span.count - k);
+	for (size_t lane = 0; lane < lanes; ++lane) {
+		out[lane] = lane < valid ? (span.indices ? span.indices[k + lane] : (uint32_t)(k + lane)) : 0;
+	}
+}
+
+static int32_t sweepWallsSse(const WallCache& cache, WallSpan span, float x, float y, float dx, float dy,
+	float limit, float& t) {
+	const __m128 px = _mm_set1_ps(x), py = _mm_set1_ps(y);
+	const __m128 pdx = _mm_set1_ps(dx), pdy = _mm_set1_ps(dy);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 minT = _mm_set1_ps(MIN_IMPACT_TIME);
+	const __m128 minS = _mm_set1_ps(-ENDPOINT_SLACK), maxS = _mm_set1_ps(1.0f + ENDPOINT_SLACK);
+	int32_t hit = -1;
+
+	for (size_t k = 0; k < span.count; k += 4) {
+		alignas(16) uint32_t index[4];
+		blockIndices(span, k, index, 4);
+		__m128 sx, sy, ex, ey;
+		if (span.indices) {
+			sx = _mm_setr_ps(cache.startX[index[0]], cache.startX[index[1]], cache.startX[index[2]], cache.startX[index[3]]);
+			sy = _mm_setr_ps(cache.startY[index[0]], cache.startY[index[1]], cache.startY[index[2]], cache.startY[index[3]]);
+			ex = _mm_setr_ps(cache.edgeX[index[0]], cache.edgeX[index[1]], cache.edgeX[index[2]], cache.edgeX[index[3]]);
+			ey = _mm_setr_ps(cache.edgeY[index[0]], cache.edgeY[index[1]], cache.edgeY[index[2]], cache.edgeY[index[3]]);
+		} else {
+			sx = _mm_load_ps(cache.startX.Data() + k);
+			sy = _mm_load_ps(cache.startY.Data() + k);
+			ex = _mm_load_ps(cache.edgeX.Data() + k);
+			ey = _mm_load_ps(cache.edgeY.Data() + k);
+		}
+
+		__m128 denominator = _mm_sub_ps(_mm_mul_ps(pdx, ey), _mm_mul_ps(pdy, ex));
+		__m128 ax = _mm_sub_ps(sx, px);
+		__m128 ay = _mm_sub_ps(sy, py);
+		__m128 hitT = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(ax, ey), _mm_mul_ps(ay, ex)), denominator);
+		__m128 hitS = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(ax, pdy), _mm_mul_ps(ay, pdx)), denominator);
+
+		__m128 valid = _mm_and_ps(_mm_cmpneq_ps(denominator, zero), _mm_cmpgt_ps(hitT, minT));
+		valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmple_ps(hitT, one), _mm_cmplt_ps(hitT, _mm_set1_ps(limit))));
+		valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(hitS, minS), _mm_cmple_ps(hitS, maxS)));
+		int mask = _mm_movemask_ps(valid) & ((1 << std::min<size_t>(4, span.count - k)) - 1);
+		if (mask) {
+			alignas(16) float times[4];
+			_mm_store_ps(times, hitT);
+			for (int lane = 0; lane < 4; ++lane) {
+				if ((mask & (1 << lane)) && times[lane] < limit) {
+					limit = times[lane];
+					hit = (int32_t)index[lane];
+				}
+			}
+		}
+	}
+	if (hit >= 0) {
+		t = limit;
+	}
+	return hit;
+}
+
+static int32_t findNearWallSse(const WallCache& cache, WallSpan span, float px, float py, float threshold) {
+	const __m128 x = _mm_set1_ps(px), y = _mm_set1_ps(py);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 thresholdSquared = _mm_set1_ps(threshold * threshold);
+
+	for (size_t k = 0; k < span.count; k += 4) {
+		alignas(16) uint32_t index[4];
+		blockIndices(span, k, index, 4);
+		__m128 sx, sy, ex, ey, inverse;
+		if (span.indices) {
+			sx = _mm_setr_ps(cache.startX[index[0]], cache.startX[index[1]], cache.startX[index[2]], cache.startX[index[3]]);
+			sy = _mm_setr_ps(cache.startY[index[0]], cache.startY[index[1]], cache.startY[index[2]], cache.startY[index[3]]);
+			ex = _mm_setr_ps(cache.edgeX[index[0]], cache.edgeX[index[1]], cache.edgeX[index[2]], cache.edgeX[index[3]]);
+			ey = _mm_setr_ps(cache.edgeY[index[0]], cache.edgeY[index[1]], cache.edgeY[index[2]], cache.edgeY[index[3]]);
+			inverse = _mm_setr_ps(cache.inverseLengthSquared[index[0]], cache.inverseLengthSquared[index[1]],
+				cache.inverseLengthSquared[index[2]], cache.inverseLengthSquared[index[3]]);
+		} else {
+			sx = _mm_load_ps(cache.startX.Data() + k);
+			sy = _mm_load_ps(cache.startY.Data() + k);
+			ex = _mm_load_ps(cache.edgeX.Data() + k);
+			ey = _mm_load_ps(cache.edgeY.Data() + k);
+			inverse = _mm_load_ps(cache.inverseLengthSquared.Data() + k);
+		}
+
+		__m128 qx = _mm_sub_ps(x, sx);
+		__m128 qy = _mm_sub_ps(y, sy);
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(qx, ex), _mm_mul_ps(qy, ey)), inverse);
+		__m128 cross = _mm_sub_ps(_mm_mul_ps(qx, ey), _mm_mul_ps(qy, ex));
+		__m128 lineSquared = _mm_mul_ps(_mm_mul_ps(cross, cross), inverse);
+
+		__m128 inRange = _mm_and_ps(_mm_cmplt_ps(lineSquared, thresholdSquared), _mm_cmpgt_ps(inverse, zero));
+		inRange = _mm_and_ps(inRange, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmple_ps(t, one)));
+		int mask = _mm_movemask_ps(inRange) & ((1 << std::min<size_t>(4, span.count - k)) - 1);
+		for (int lane = 0; lane < 4; ++lane) {
+			if (mask & (1 << lane)) {
+				return (int32_t)index[lane];
+			}
+		}
+	}
+	return -1;
+}
+
+KERNEL_TARGET_AVX2
+static int32_t sweepWallsAvx2(const WallCache& cache, WallSpan span, float x, float y, float dx, float dy,
+	float limit, float& t) {
+	const __m256 px = _mm256_set1_ps(x), py = _mm256_set1_ps(y);
+	const __m256 pdx = _mm256_set1_ps(dx), pdy = _mm256_set1_ps(dy);
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	const __m256 minT = _mm256_set1_ps(MIN_IMPACT_TIME);
+	const __m256 minS = _mm256_set1_ps(-ENDPOINT_SLACK), maxS = _mm256_set1_ps(1.0f + ENDPOINT_SLACK);
+	int32_t hit = -1;
+
+	for (size_t k = 0; k < span.count; k += 8) {
+		alignas(32) uint32_t index[8];
+		blockIndices(span, k, index, 8);
+		__m256 sx, sy, ex, ey;
+		if (span.indices) {
+			__m256i lanes = _mm256_load_si256((const __m256i*)index);
+			sx = _mm256_i32gather_ps(cache.startX.Data(), lanes, 4);
+			sy = _mm256_i32gather_ps(cache.startY.Data(), lanes, 4);
+			ex = _mm256_i32gather_ps(cache.edgeX.Data(), lanes, 4);
+			ey = _mm256_i32gather_ps(cache.edgeY.Data(), lanes, 4);
+		} else {
+			sx = _mm256_load_ps(cache.startX.Data() + k);
+			sy = _mm256_load_ps(cache.startY.Data() + k);
+			ex = _mm256_load_ps(cache.edgeX.Data() + k);
+			ey = _mm256_load_ps(cache.edgeY.Data() + k);
+		}
+
+		__m256 denominator = _mm256_sub_ps(_mm256_mul_ps(pdx, ey), _mm256_mul_ps(pdy, ex));
+		__m256 ax = _mm256_sub_ps(sx, px);
+		__m256 ay = _mm256_sub_ps(sy, py);
+		__m256 hitT = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(ax, ey), _mm256_mul_ps(ay, ex)), denominator);
+		__m256 hitS = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(ax, pdy), _mm256_mul_ps(ay, pdx)), denominator);
+
+		__m256 valid = _mm256_and_ps(_mm256_cmp_ps(denominator, zero, _CMP_NEQ_OQ), _mm256_cmp_ps(hitT, minT, _CMP_GT_OQ));
+		valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(hitT, one, _CMP_LE_OQ),
+			_mm256_cmp_ps(hitT, _mm256_set1_ps(limit), _CMP_LT_OQ)));
+		valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(hitS, minS, _CMP_GE_OQ), _mm256_cmp_ps(hitS, maxS, _CMP_LE_OQ)));
+		int mask = _mm256_movemask_ps(valid) & ((1 << std::min<size_t>(8, span.count - k)) - 1);
+		if (mask) {
+			alignas(32) float times[8];
+			_mm256_store_ps(times, hitT);
+			for (int lane = 0; lane < 8; ++lane) {
+				if ((mask & (1 << lane)) && times[lane] < limit) {
+					limit = times[lane];
+					hit = (int32_t)index[lane];
+				}
+			}
+		}
+	}
+	if (hit >= 0) {
+		t = limit;
+	}
+	return hit;
+}
+
+KERNEL_TARGET_AVX2
+static int32_t findNearWallAvx2(const WallCache& cache, WallSpan span, float px, float py, float threshold) {
+	const __m256 x = _mm256_set1_ps(px), y = _mm256_set1_ps(py);
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	const __m256 thresholdSquared = _mm256_set1_ps(threshold * threshold);
+
+	for (size_t k = 0; k < span.count; k += 8) {
+		alignas(32) uint32_t index[8];
+		blockIndices(span, k, index, 8);
+		__m256 sx, sy, ex, ey, inverse;
+		if (span.indices) {
+			__m256i lanes = _mm256_load_si256((const __m256i*)index);
+			sx = _mm256_i32gather_ps(cache.startX.Data(), lanes, 4);
+			sy = _mm256_i32gather_ps(cache.startY.Data(), lanes, 4);
+			ex = _mm256_i32gather_ps(cache.edgeX.Data(), lanes, 4);
+			ey = _mm256_i32gather_ps(cache.edgeY.Data(), lanes, 4);
+			inverse = _mm256_i32gather_ps(cache.inverseLengthSquared.Data(), lanes, 4);
+		} else {
+			sx = _mm256_load_ps(cache.startX.Data() + k);
+			sy = _mm256_load_ps(cache.startY.Data() + k);
+			ex = _mm256_load_ps(cache.edgeX.Data() + k);
+			ey = _mm256_load_ps(cache.edgeY.Data() + k);
+			inverse = _mm256_load_ps(cache.inverseLengthSquared.Data() + k);
+		}
+
+		__m256 qx = _mm256_sub_ps(x, sx);
+		__m256 qy = _mm256_sub_ps(y, sy);
+		__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(qx, ex), _mm256_mul_ps(qy, ey)), inverse);
+		__m256 cross = _mm256_sub_ps(_mm256_mul_ps(qx, ey), _mm256_mul_ps(qy, ex));
+		__m256 lineSquared = _mm256_mul_ps(_mm256_mul_ps(cross, cross), inverse);
+
+		__m256 inRange = _mm256_and_ps(_mm256_cmp_ps(lineSquared, thresholdSquared, _CMP_LT_OQ), _mm256_cmp_ps(inverse, zero, _CMP_GT_OQ));
+		inRange = _mm256_and_ps(inRange, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, one, _CMP_LE_OQ)));
+		int mask = _mm256_movemask_ps(inRange) & ((1 << std::min<size_t>(8, span.count - k)) - 1);
+		for (int lane = 0; lane < 8; ++lane) {
+			if (mask & (1 << lane)) {
+				return (int32_t)index[lane];
+			}
+		}
+	}
+	return -1;
+}
+#endif
+
+int32_t SweepWalls(const WallCache& cache, WallSpan span, float x, float y, float dx, float dy, float limit, float& t) {
+	switch (GetKernelPath()) {
+#if defined(WALL_CACHE_X86)
+		case KERNEL_AVX2:
+			return sweepWallsAvx2(cache, span, x, y, dx, dy, limit, t);
+		case KERNEL_SSE:
+			return sweepWallsSse(cache, span, x, y, dx, dy, limit, t);
+#endif
+		default:
+			return sweepWallsScalar(cache, span, x, y, dx, dy, limit, t);
+	}
+}
+
+int32_t FindNearWall(const WallCache& cache, WallSpan span, float px, float py, float threshold) {
+	switch (GetKernelPath()) {
+#if defined(WALL_CACHE_X86)
+		case KERNEL_AVX2:
+			return findNearWallAvx2(cache, span, px, py, threshold);
+		case KERNEL_SSE:
+			return findNearWallSse(cache, span, px, py, threshold);
+#endif
+		default:
+			return findNearWallScalar(cache, span, px, py, threshold);
+	}
+}
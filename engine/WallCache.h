@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ParticleStore.h"
+
+class Wall;
+
+// Walls are stored in blocks of this many, the widest narrowphase.
+const size_t WALL_CACHE_LANES = 8;
+
+// The walls one query tests: `count` ascending indices, or the first `count`
+// walls of the cache when `indices` is null.
+struct WallSpan {
+	const uint32_t* indices;
+	size_t count;
+};
+
+// What the narrowphase needs of each wall, computed once when the wall is
+// added instead of per particle, and stored as separate arrays so one
+// particle is tested against 8 walls per AVX2 instruction (4 with SSE).
+// Entries line up with Simulation::walls, and the arrays are padded to a
+// whole block so a block load never runs past the end.
+class WallCache {
+public:
+	void Add(const Wall& wall);
+	void Clear();
+	size_t Size() const { return count; }
+
+	// Start point and the vector from start to end.
+	AlignedArray<float> startX, startY, edgeX, edgeY;
+	// Unit normal, to the left of the edge, and 1 / |edge|^2; all 0 for a
+	// zero-length wall.
+	AlignedArray<float> normalX, normalY, inverseLengthSquared;
+	// Mirror across the wall's line: (vx, vy) -> (xx * vx + xy * vy, xy * vx - xx * vy).
+	AlignedArray<float> reflectXX, reflectXY;
+
+private:
+	size_t count = 0;
+};
+
+// Swept test of the move (x, y) -> (x + dx, y + dy) against every wall in
+// `span`, with the same arithmetic and rules as SweepWall. Returns the index
+// of the wall hit earliest, if it is hit before `limit` (a fraction of the
+// move), and sets t; the lower index wins a tie. -1 when no wall qualifies.
+int32_t SweepWalls(const WallCache& cache, WallSpan span, float x, float y, float dx, float dy, float limit, float& t);
+
+// The threshold test of Particle::UpdatePosition: the first wall in `span`
+// whose line passes within `threshold` of (px, py) at a point on the
+// segment, or -1.
+int32_t FindNearWall(const WallCache& cache, WallSpan span, float px, float py, float threshold);
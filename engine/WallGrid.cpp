@@ -0,0 +1,109 @@
+#include "WallGrid.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cmath>
+
+static float segmentPointDistance(const Wall& wall, float px, float py) {
+	float dx = wall.endX - wall.startX;
+	float dy = wall.endY - wall.startY;
+	float lengthSquared = dx * dx + dy * dy;
+	float t = lengthSquared > 0 ? ((px - wall.startX) * dx + (py - wall.startY) * dy) / lengthSquared : 0.0f;
+	t = std::min(std::max(t, 0.0f), 1.0f);
+
+	float cx = wall.startX + t * dx - px;
+	float cy = wall.startY + t * dy - py;
+	return sqrt(cx * cx + cy * cy);
+}
+
+WallGrid::WallGrid(float width, float height, float cellSize, float margin)
+	: cellSize(cellSize), margin(margin) {
+	columns = std::max(1, (int)ceil(width / cellSize));
+	rows = std::max(1, (int)ceil(height / cellSize));
+	cells.resize((size_t)columns * rows);
+}
+
+int WallGrid::CellX(float x) const {
+	int cx = (int)floor(x / cellSize);
+	return std::min(std::max(cx, 0), columns - 1);
+}
+
+int WallGrid::CellY(float y) const {
+	int cy = (int)floor(y / cellSize);
+	return std::min(std::max(cy, 0), rows - 1);
+}
+
+void WallGrid::Clear() {
+	for (auto& cell : cells) {
+		cell.clear();
+	}
+	wallCount = 0;
+}
+
+void WallGrid::Insert(const Wall& wall, uint32_t wallIndex) {
+	int minX = CellX(std::min(wall.startX, wall.endX) - margin);
+	int maxX = CellX(std::max(wall.startX, wall.endX) + margin);
+	int minY = CellY(std::min(wall.startY, wall.endY) - margin);
+	int maxY = CellY(std::max(wall.startY, wall.endY) + margin);
+
+	// A cell is kept when the wall comes within margin of any point in it;
+	// the half diagonal makes the centre test conservative.
+	float reach = margin + cellSize * 0.70710678f;
+
+	for (int cy = minY; cy <= maxY; ++cy) {
+		for (int cx = minX; cx <= maxX; ++cx) {
+			float centerX = (cx + 0.5f) * cellSize;
+			float centerY = (cy + 0.5f) * cellSize;
+			if (segmentPointDistance(wall, centerX, centerY) <= reach) {
+				cells[(size_t)cy * columns + cx].push_back(wallIndex);
+			}
+		}
+	}
+	++wallCount;
+}
+
+void WallGrid::AppendCell(int cx, int cy, std::vector<uint32_t>& out) const {
+	const std::vector<uint32_t>& cell = cells[(size_t)cy * columns + cx];
+	out.insert(out.end(), cell.begin(), cell.end());
+}
+
+void WallGrid::Query(float x0, float y0, float x1, float y1, std::vector<uint32_t>& out) const {
+	out.clear();
+	if (wallCount == 0) {
+		return;
+	}
+
+	int cx = CellX(x0);
+	int cy = CellY(y0);
+	int endX = CellX(x1);
+	int endY = CellY(y1);
+	AppendCell(cx, cy, out);
+
+	if (cx != endX || cy != endY) {
+		// Grid traversal along the step (Amanatides & Woo).
+		float dx = x1 - x0;
+		float dy = y1 - y0;
+		int stepX = dx > 0 ? 1 : -1;
+		int stepY = dy > 0 ? 1 : -1;
+		float tDeltaX = dx != 0 ? cellSize / fabs(dx) : INFINITY;
+		float tDeltaY = dy != 0 ? cellSize / fabs(dy) : INFINITY;
+		float tMaxX = dx != 0 ? ((cx + (stepX > 0 ? 1 : 0)) * cellSize - x0) / dx : INFINITY;
+		float tMaxY = dy != 0 ? ((cy + (stepY > 0 ? 1 : 0)) * cellSize - y0) / dy : INFINITY;
+
+		for (int guard = columns + rows; guard > 0 && (cx != endX || cy != endY); --guard) {
+			if (tMaxX < tMaxY) {
+				cx = std::min(std::max(cx + stepX, 0), columns - 1);
+				tMaxX += tDeltaX;
+			} else {
+				cy = std::min(std::max(cy + stepY, 0), rows - 1);
+				tMaxY += tDeltaY;
+			}
+			AppendCell(cx, cy, out);
+		}
+	}
+
+	if (out.size() > 1) {
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+}
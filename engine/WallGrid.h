@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Wall;
+
+// Uniform grid over the wall segments. A wall is registered in every cell it
+// passes within `margin` of, so a query only has to look at the cells a
+// particle's step runs through instead of at every wall in the scene.
+class WallGrid {
+public:
+	WallGrid(float width, float height, float cellSize, float margin);
+
+	void Clear();
+	void Insert(const Wall& wall, uint32_t wallIndex);
+
+	// Replaces `out` with the indices of walls registered in the cells crossed
+	// by (x0, y0)-(x1, y1), sorted ascending and without duplicates.
+	void Query(float x0, float y0, float x1, float y1, std::vector<uint32_t>& out) const;
+
+	bool Empty() const { return wallCount == 0; }
+	float GetCellSize() const { return cellSize; }
+
+private:
+	int CellX(float x) const;
+	int CellY(float y) const;
+	void AppendCell(int cx, int cy, std::vector<uint32_t>& out) const;
+
+	float cellSize;
+	float margin;
+	int columns, rows;
+	size_t wallCount = 0;
+	std::vector<std::vector<uint32_t>> cells;
+};
@@ -0,0 +1,246 @@
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Spins before a waiting thread starts yielding its time slice.
+const int SPIN_ITERATIONS = 4000;
+
+static uint64_t nowNanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void pinCurrentThread(size_t cpu) {
+	unsigned int cpuCount = std::thread::hardware_concurrency();
+	if (cpuCount == 0) {
+		return;
+	}
+	cpu %= cpuCount;
+
+#if defined(_WIN32)
+	if (cpu < sizeof(DWORD_PTR) * 8) {
+		SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+	}
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+WorkerPool::WorkerPool(size_t numThreads, const std::string& name, int firstCore)
+	: name(name), firstCore(firstCore) {
+	Resize(numThreads);
+}
+
+WorkerPool::~WorkerPool() {
+	StopThreads();
+}
+
+void WorkerPool::Resize(size_t requestedThreads) {
+	if (requestedThreads == 0) {
+		requestedThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	if (slots && requestedThreads == numThreads) {
+		return;
+	}
+
+	StopThreads();
+	numThreads = requestedThreads;
+	slots.reset(new WorkerSlot[numThreads]);
+	ResetStats();
+	StartThreads();
+}
+
+void WorkerPool::StartThreads() {
+	stopping = false;
+	for (size_t i = 1; i < numThreads; ++i) {
+		threads.emplace_back(&WorkerPool::WorkerLoop, this, i, generation);
+	}
+}
+
+void WorkerPool::StopThreads() {
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		stopping = true;
+		++generation;
+	}
+	wakeCondition.notify_all();
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+}
+
+void WorkerPool::WorkerLoop(size_t workerIndex, uint64_t seenGeneration) {
+	if (firstCore != UNPINNED) {
+		pinCurrentThread((size_t)firstCore + workerIndex);
+	}
+	SetProfileThreadName(name + " " + std::to_string(workerIndex));
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wakeCondition.wait(lock, [&] { return generation != seenGeneration; });
+			seenGeneration = generation;
+			if (stopping) {
+				return;
+			}
+		}
+
+		RunJob(workerIndex);
+		workersFinished.fetch_add(1, std::memory_order_release);
+	}
+}
+
+void WorkerPool::RunTicks(int ticks, size_t count, size_t chunkSize, const RangeFunction& body,
+	const TickFunction& tickDone) {
+	if (ticks <= 0) {
+		return;
+	}
+
+	uint64_t start = nowNanoseconds();
+
+	jobTicks = ticks;
+	jobCount = count;
+	jobChunkSize = std::max<size_t>(1, chunkSize);
+	jobChunks = (uint32_t)((count + jobChunkSize - 1) / jobChunkSize);
+	jobBody = &body;
+	jobTickDone = tickDone ? &tickDone : nullptr;
+	barrierArrived.store(0, std::memory_order_relaxed);
+	workersFinished.store(0, std::memory_order_relaxed);
+	DealChunks();
+
+	if (numThreads > 1) {
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			++generation;
+		}
+		wakeCondition.notify_all();
+	}
+
+	RunJob(0);
+
+	// The job description must outlive every worker's last read of it.
+	int spins = 0;
+	while (workersFinished.load(std::memory_order_acquire) != numThreads - 1) {
+		if (++spins > SPIN_ITERATIONS) {
+			std::this_thread::yield();
+		}
+	}
+
+	jobBody = nullptr;
+	jobTickDone = nullptr;
+	wallNanoseconds.fetch_add(nowNanoseconds() - start, std::memory_order_relaxed);
+}
+
+void WorkerPool::RunJob(size_t workerIndex) {
+	WorkerSlot& slot = slots[workerIndex];
+
+	for (int tick = 0; tick < jobTicks; ++tick) {
+		uint32_t chunk;
+		while (NextChunk(workerIndex, chunk)) {
+			size_t begin = (size_t)chunk * jobChunkSize;
+			size_t end = std::min(begin + jobChunkSize, jobCount);
+
+			uint64_t start = nowNanoseconds();
+			(*jobBody)(begin, end, workerIndex);
+			slot.busyNanoseconds.fetch_add(nowNanoseconds() - start, std::memory_order_relaxed);
+		}
+
+		ArriveAndWait(tick);
+	}
+}
+
+void WorkerPool::DealChunks() {
+	for (size_t i = 0; i < numThreads; ++i) {
+		uint64_t first = (uint64_t)jobChunks * i / numThreads;
+		uint64_t last = (uint64_t)jobChunks * (i + 1) / numThreads;
+		slots[i].range.store((first << 32) | last, std::memory_order_relaxed);
+	}
+}
+
+bool WorkerPool::NextChunk(size_t workerIndex, uint32_t& chunk) {
+	// Own range is consumed from the front...
+	std::atomic<uint64_t>& own = slots[workerIndex].range;
+	uint64_t range = own.load(std::memory_order_acquire);
+	while ((range >> 32) < (range & 0xffffffffu)) {
+		uint64_t first = range >> 32;
+		if (own.compare_exchange_weak(range, ((first + 1) << 32) | (range & 0xffffffffu), std::memory_order_acq_rel)) {
+			chunk = (uint32_t)first;
+			return true;
+		}
+	}
+
+	// ...and other ranges are stolen from the back.
+	for (size_t k = 1; k < numThreads; ++k) {
+		std::atomic<uint64_t>& victim = slots[(workerIndex + k) % numThreads].range;
+		range = victim.load(std::memory_order_acquire);
+		while ((range >> 32) < (range & 0xffffffffu)) {
+			uint64_t last = range & 0xffffffffu;
+			if (victim.compare_exchange_weak(range, (range & 0xffffffff00000000ull) | (last - 1), std::memory_order_acq_rel)) {
+				chunk = (uint32_t)(last - 1);
+				stolenChunks.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void WorkerPool::ArriveAndWait(int tick) {
+	uint64_t phase = barrierPhase.load(std::memory_order_acquire);
+
+	if (barrierArrived.fetch_add(1, std::memory_order_acq_rel) + 1 == numThreads) {
+		if (jobTickDone) {
+			(*jobTickDone)(tick);
+		}
+		if (tick + 1 < jobTicks) {
+			DealChunks();
+		}
+		barrierArrived.store(0, std::memory_order_relaxed);
+		barrierPhase.fetch_add(1, std::memory_order_release);
+		return;
+	}
+
+	int spins = 0;
+	while (barrierPhase.load(std::memory_order_acquire) == phase) {
+		if (++spins > SPIN_ITERATIONS) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+double WorkerPool::GetBusyRatio() const {
+	uint64_t wall = wallNanoseconds.load(std::memory_order_relaxed);
+	if (wall == 0) {
+		return 0.0;
+	}
+
+	uint64_t busy = 0;
+	for (size_t i = 0; i < numThreads; ++i) {
+		busy += slots[i].busyNanoseconds.load(std::memory_order_relaxed);
+	}
+	return std::min(1.0, (double)busy / ((double)wall * numThreads));
+}
+
+void WorkerPool::ResetStats() {
+	for (size_t i = 0; i < numThreads; ++i) {
+		slots[i].busyNanoseconds.store(0, std::memory_order_relaxed);
+	}
+	stolenChunks.store(0, std::memory_order_relaxed);
+	wallNanoseconds.store(0, std::memory_order_relaxed);
+}
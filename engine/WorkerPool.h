@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Pass as firstCore to leave a pool's threads to the OS scheduler.
+const int UNPINNED = -1;
+
+// Long-lived pool of worker threads. The calling thread takes part as
+// worker 0, so a pool of N threads owns N - 1 std::threads.
+//
+// RunTicks hands the whole "step N ticks" job to the workers at once. Each
+// tick the index range is cut into chunks that are dealt out evenly; a worker
+// that runs out of its own chunks steals from the back of another worker's
+// range. Workers meet at a barrier between ticks, where the last one to arrive
+// runs the optional tickDone callback before the next tick starts.
+class WorkerPool {
+public:
+	// body(begin, end, workerIndex) processes indices [begin, end).
+	typedef std::function<void(size_t, size_t, size_t)> RangeFunction;
+	typedef std::function<void(int)> TickFunction;
+
+	// Worker threads are named "<name> <index>" in profiles. With firstCore
+	// >= 0, worker i is pinned to core (firstCore + i) modulo the core count;
+	// only the one pool doing the heavy lifting should pin, or several pools
+	// stack on the same cores.
+	explicit WorkerPool(size_t numThreads = 0, const std::string& name = "worker", int firstCore = UNPINNED);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// 0 selects std::thread::hardware_concurrency().
+	void Resize(size_t numThreads);
+	size_t GetThreadCount() const { return numThreads; }
+
+	void RunTicks(int ticks, size_t count, size_t chunkSize, const RangeFunction& body,
+		const TickFunction& tickDone = TickFunction());
+
+	void ParallelFor(size_t count, size_t chunkSize, const RangeFunction& body) {
+		RunTicks(1, count, chunkSize, body);
+	}
+
+	// Fraction of worker time spent inside body() since the last ResetStats().
+	double GetBusyRatio() const;
+	uint64_t GetStolenChunks() const { return stolenChunks.load(std::memory_order_relaxed); }
+	void ResetStats();
+
+private:
+	struct alignas(64) WorkerSlot {
+		// Remaining chunk range packed as (first << 32) | last.
+		std::atomic<uint64_t> range{ 0 };
+		std::atomic<uint64_t> busyNanoseconds{ 0 };
+	};
+
+	void StartThreads();
+	void StopThreads();
+	void WorkerLoop(size_t workerIndex, uint64_t seenGeneration);
+	void RunJob(size_t workerIndex);
+	void DealChunks();
+	bool NextChunk(size_t workerIndex, uint32_t& chunk);
+	void ArriveAndWait(int tick);
+
+	size_t numThreads = 1;
+	std::string name;
+	int firstCore = UNPINNED;
+	std::vector<std::thread> threads;
+	std::unique_ptr<WorkerSlot[]> slots;
+
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	uint64_t generation = 0;
+	bool stopping = false;
+
+	// Current job, valid while a RunTicks call is in flight.
+	int jobTicks = 0;
+	size_t jobCount = 0;
+	size_t jobChunkSize = 1;
+	uint32_t jobChunks = 0;
+	const RangeFunction* jobBody = nullptr;
+	const TickFunction* jobTickDone = nullptr;
+
+	std::atomic<size_t> barrierArrived{ 0 };
+	std::atomic<uint64_t> barrierPhase{ 0 };
+	std::atomic<size_t> workersFinished{ 0 };
+
+	std::atomic<uint64_t> stolenChunks{ 0 };
+	std::atomic<uint64_t> wallNanoseconds{ 0 };
+};